@@ -34,6 +34,13 @@
 */
 
 #include <stdio.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h> /* for _get_osfhandle() */
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #include "glk.h"
 #include "garglk.h"
 #include "gi_blorb.h"
@@ -41,6 +48,51 @@
 static strid_t blorbfile = NULL;
 static giblorb_map_t *blorbmap = NULL;
 
+/* the whole blorb file mapped read-only, so resources can be handed out
+   in place instead of being read into the heap each time */
+static unsigned char *blorbdata = NULL;
+static long blorblen = 0;
+
+static void giblorb_map_file(FILE *fl)
+{
+#ifdef _WIN32
+    HANDLE fh, mh;
+    LARGE_INTEGER size;
+    void *view;
+
+    fh = (HANDLE) _get_osfhandle(fileno(fl));
+    if (fh == INVALID_HANDLE_VALUE || !GetFileSizeEx(fh, &size)
+            || !size.QuadPart || size.HighPart)
+        return;
+
+    mh = CreateFileMapping(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mh)
+        return;
+
+    /* the view keeps the mapping alive after the handle is closed */
+    view = MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mh);
+    if (!view)
+        return;
+
+    blorbdata = view;
+    blorblen = size.LowPart;
+#else
+    struct stat st;
+    void *view;
+
+    if (fstat(fileno(fl), &st) || st.st_size <= 0)
+        return;
+
+    view = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fileno(fl), 0);
+    if (view == MAP_FAILED)
+        return;
+
+    blorbdata = view;
+    blorblen = st.st_size;
+#endif
+}
+
 giblorb_err_t giblorb_set_resource_map(strid_t file)
 {
     giblorb_err_t err;
@@ -60,6 +112,9 @@ giblorb_err_t giblorb_set_resource_map(strid_t file)
 
     blorbfile = file;
 
+    giblorb_map_file(file->file);
+    gli_picture_scan();
+
     return giblorb_err_None;
 }
 
@@ -98,3 +153,35 @@ void giblorb_get_resource(glui32 usage, glui32 resnum,
     if (type)
         *type = blorbres.chunktype;
 }
+
+/* Returns a view of the resource inside the mapped blorb file, or FALSE
+   when the file could not be mapped and the caller should read it from
+   giblorb_get_resource() instead. The data is never freed. */
+int giblorb_get_resource_data(glui32 usage, glui32 resnum,
+    unsigned char **data, long *len, glui32 *type)
+{
+    giblorb_err_t err;
+    giblorb_result_t blorbres;
+
+    *data = NULL;
+
+    if (!blorbmap || !blorbdata)
+        return FALSE;
+
+    err = giblorb_load_resource(blorbmap, giblorb_method_FilePos,
+            &blorbres, usage, resnum);
+    if (err)
+        return FALSE;
+
+    if (blorbres.data.startpos > blorblen
+            || blorbres.length > blorblen - blorbres.data.startpos)
+        return FALSE;
+
+    *data = blorbdata + blorbres.data.startpos;
+    if (len)
+        *len = blorbres.length;
+    if (type)
+        *type = blorbres.chunktype;
+
+    return TRUE;
+}
@@ -79,7 +79,9 @@ stream_t *gli_new_stream(glui32 type, int readable, int writable, glui32 rock, i
   str->win = NULL;
   str->lastop = 0;
   str->file = NULL;
+  str->filebuf = NULL;
   str->textfile = FALSE;
+  str->unflushed = 0;
 
   str->prev = NULL;
   str->next = gli_streamlist;
@@ -163,6 +165,7 @@ static stream_t *gli_stream_open_file(frefid_t fref, glui32 fmode,
   char msg[256];
   stream_t *str;
   FILE *fl;
+  char *filebuf;
 
   if (!fref)
   {
@@ -222,6 +225,15 @@ static stream_t *gli_stream_open_file(frefid_t fref, glui32 fmode,
     return 0;
   }
 
+  /* give stdio a buffer big enough for everything we hold back */
+  filebuf = NULL;
+  if (fmode != filemode_Read && gli_conf_flushsize > 0)
+  {
+    filebuf = malloc(gli_conf_flushsize * 1024);
+    if (filebuf)
+      setvbuf(fl, filebuf, _IOFBF, gli_conf_flushsize * 1024);
+  }
+
   if (fmode == filemode_WriteAppend)
     fseek(fl, 0, 2); /* ...to the end. */
 
@@ -234,10 +246,12 @@ static stream_t *gli_stream_open_file(frefid_t fref, glui32 fmode,
   {
     gli_strict_warning("stream_open_file: unable to create stream.");
     fclose(fl);
+    free(filebuf);
     return 0;
   }
 
   str->file = fl;
+  str->filebuf = filebuf;
   str->lastop = 0;
   str->textfile = fref->textmode;
 
@@ -398,6 +412,59 @@ void glk_stream_close(stream_t *str, stream_result_t *result)
   gli_stream_close(str);
 }
 
+/* File output is left in the stdio buffer rather than flushed per
+   character. It goes out when the stream is closed, seeked or read,
+   when the game waits in glk_select, or once flushsize kilobytes or
+   flushtime seconds have piled up. */
+
+int gli_streams_dirty = 0;
+
+static void gli_stream_flush(stream_t *str)
+{
+  if (!str->unflushed)
+    return;
+  fflush(str->file);
+  str->unflushed = 0;
+  gli_streams_dirty--;
+}
+
+static void gli_stream_wrote(stream_t *str, glui32 len)
+{
+  if (!str->unflushed)
+  {
+    str->dirtytime = time(NULL);
+    gli_streams_dirty++;
+  }
+  str->unflushed += len;
+  if (str->unflushed >= (glui32)gli_conf_flushsize * 1024)
+    gli_stream_flush(str);
+}
+
+void gli_streams_flush(int expired)
+{
+  stream_t *str;
+  time_t now = 0;
+
+  if (!gli_streams_dirty)
+    return;
+
+  if (expired)
+  {
+    if (!gli_conf_flushtime)
+      return;
+    now = time(NULL);
+  }
+
+  for (str = gli_streamlist; str; str = str->next)
+  {
+    if (str->type != strtype_File || !str->unflushed)
+      continue;
+    if (expired && now - str->dirtytime < gli_conf_flushtime)
+      continue;
+    gli_stream_flush(str);
+  }
+}
+
 void gli_stream_close(stream_t *str)
 {
   window_t *win;
@@ -427,8 +494,11 @@ void gli_stream_close(stream_t *str)
           }
           break;
       case strtype_File:
+          gli_stream_flush(str);
           fclose(str->file);
+          free(str->filebuf);
           str->file = NULL;
+          str->filebuf = NULL;
           str->lastop = 0;
           break;
   }
@@ -498,6 +568,7 @@ void glk_stream_set_position(stream_t *str, glsi32 pos, glui32 seekmode)
           break;
       case strtype_File:
           /* Either reading or writing is legal after an fseek. */
+          gli_stream_flush(str);
           str->lastop = 0;
           if (str->unicode)
               pos *= 4;
@@ -563,7 +634,9 @@ static void gli_stream_ensure_op(stream_t *str, glui32 op)
      only come up for ReadWrite or WriteAppend files. */
   if (str->lastop != 0 && str->lastop != op)
   {
-    long pos = ftell(str->file);
+    long pos;
+    gli_stream_flush(str);
+    pos = ftell(str->file);
     fseek(str->file, pos, SEEK_SET);
   }
   str->lastop = op;
@@ -630,7 +703,7 @@ static void gli_put_char(stream_t *str, unsigned char ch)
               putc(0, str->file);
               putc(ch, str->file);
           }
-          fflush(str->file);
+          gli_stream_wrote(str, str->unicode ? 4 : 1);
           break;
   }
 }
@@ -698,7 +771,7 @@ static void gli_put_char_uni(stream_t *str, glui32 ch)
               putc(((ch >>  8) & 0xFF), str->file);
               putc( (ch        & 0xFF), str->file);
           }
-          fflush(str->file);
+          gli_stream_wrote(str, str->unicode ? 4 : 1);
           break;
   }
 }
@@ -806,7 +879,7 @@ static void gli_put_buffer(stream_t *str, char *buf, glui32 len)
                     putc( (ch        & 0xFF), str->file);
                 }
             }
-            fflush(str->file);
+            gli_stream_wrote(str, str->unicode ? len * 4 : len);
             break;
     }
 }
@@ -921,7 +994,7 @@ static void gli_put_buffer_uni(stream_t *str, glui32 *buf, glui32 len)
                     putc( (ch        & 0xFF), str->file);
                 }
             }
-            fflush(str->file);
+            gli_stream_wrote(str, str->unicode ? len * 4 : len);
             break;
     }
 }
@@ -137,6 +137,17 @@ int gli_caret_shape = 2;
 int gli_link_style = 1;
 
 int gli_conf_lcd = 1;
+int gli_conf_glyphcache = 8192; /* kilobytes per font */
+int gli_conf_lazyglyphs = 1;
+int gli_conf_glyphwarmup = 1;
+int gli_conf_scrollback = 0; /* kilobytes per window, 0 for no limit */
+int gli_conf_flushsize = 64; /* kilobytes buffered per file stream */
+int gli_conf_flushtime = 2; /* seconds, 0 to wait for glk_select */
+int gli_conf_piccache = 65536; /* kilobytes of decoded pictures, 0 for no limit */
+int gli_conf_picthreads = 2;
+int gli_conf_picprefetch = 32768; /* kilobytes decoded ahead of use, 0 for no limit */
+int gli_conf_scalethreads = 4;
+int gli_conf_soundcache = 16384; /* kilobytes of decoded sounds, 0 for no limit */
 
 int gli_wmarginx = 15;
 int gli_wmarginy = 15;
@@ -400,6 +411,29 @@ static void readoneconfig(char *fname, char *argv0, char *gamefile)
         if (!strcmp(cmd, "lcd"))
             gli_conf_lcd = atoi(arg);
 
+        if (!strcmp(cmd, "glyphcache"))
+            gli_conf_glyphcache = atoi(arg);
+        if (!strcmp(cmd, "lazyglyphs"))
+            gli_conf_lazyglyphs = atoi(arg);
+        if (!strcmp(cmd, "glyphwarmup"))
+            gli_conf_glyphwarmup = atoi(arg);
+        if (!strcmp(cmd, "scrollback"))
+            gli_conf_scrollback = atoi(arg);
+        if (!strcmp(cmd, "flushsize"))
+            gli_conf_flushsize = atoi(arg);
+        if (!strcmp(cmd, "flushtime"))
+            gli_conf_flushtime = atoi(arg);
+        if (!strcmp(cmd, "piccache"))
+            gli_conf_piccache = atoi(arg);
+        if (!strcmp(cmd, "picthreads"))
+            gli_conf_picthreads = atoi(arg);
+        if (!strcmp(cmd, "picprefetch"))
+            gli_conf_picprefetch = atoi(arg);
+        if (!strcmp(cmd, "scalethreads"))
+            gli_conf_scalethreads = atoi(arg);
+        if (!strcmp(cmd, "soundcache"))
+            gli_conf_soundcache = atoi(arg);
+
         if (!strcmp(cmd, "caretshape"))
             gli_caret_shape = atoi(arg);
 
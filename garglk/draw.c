@@ -24,6 +24,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <math.h>
 #include "glk.h"
 #include "garglk.h"
@@ -35,7 +36,7 @@ void gli_get_builtin_font(int idx, unsigned char **ptr, unsigned int *len);
 #include FT_OUTLINE_H
 
 #include <math.h> /* for pow() */
-#include "uthash.h" /* for kerning cache */
+#include "uthash.h" /* for glyph index */
 
 #define mul255(a,b) (((a) * ((b) + 1)) >> 8)
 #define grayscale(r,g,b) ((30 * (r) + 59 * (g) + 11 * (b)) / 100)
@@ -47,7 +48,11 @@ void gli_get_builtin_font(int idx, unsigned char **ptr, unsigned int *len);
 typedef struct font_s font_t;
 typedef struct bitmap_s bitmap_t;
 typedef struct fentry_s fentry_t;
+typedef struct fblock_s fblock_t;
+typedef struct atlas_s atlas_t;
+typedef struct aslot_s aslot_t;
 typedef struct kcache_s kcache_t;
+typedef struct run_s run_t;
 
 struct bitmap_s
 {
@@ -55,32 +60,115 @@ struct bitmap_s
     unsigned char *data;
 };
 
+/*
+ * One entry per code point. The rendered subpixel variants live in the
+ * font's atlas; off[] is their offset in the slab and the loaded mask
+ * says which of them are currently resident.
+ */
 struct fentry_s
 {
     glui32 cid;
+    glui32 gid;
     int adv;
+    unsigned char loaded;
     bitmap_t glyph[GLI_SUBPIX];
+    size_t off[GLI_SUBPIX];
+    unsigned long stamp[GLI_SUBPIX];
+    UT_hash_handle hh;
+};
+
+#define FBLOCKSIZE 256
+
+struct fblock_s
+{
+    fentry_t entries[FBLOCKSIZE];
+    int used;
+    fblock_t *next;
+};
+
+/*
+ * The atlas is a single slab used as a ring: bitmaps are appended at
+ * head and the oldest ones are evicted from tail when space runs out.
+ * Every bitmap is preceded by an aslot_t naming its owner, so eviction
+ * only has to walk the headers. A bitmap that is used after it has
+ * drifted into the older half of the ring is copied back to head, which
+ * makes the ring behave like an LRU cache.
+ */
+struct aslot_s
+{
+    fentry_t *owner;
+    int sub;
+    size_t size;
+};
+
+struct atlas_s
+{
+    unsigned char *slab;
+    size_t size, budget;
+    size_t head, tail, limit;
+    int wrapped;
+    unsigned long clock;
 };
 
+/*
+ * Kerning is cached without touching the allocator on lookup: Latin-1
+ * pairs index a dense table, everything else goes to an open addressing
+ * table that only allocates when it has to grow.
+ */
+
+#define KERNUNKNOWN (-32768)
+#define KERNEMPTY 0xFFFFFFFF
+
 struct kcache_s
 {
-    glui32 pair[2];
+    glui32 c0, c1;
     int value;
-    UT_hash_handle hh;
+};
+
+/*
+ * A shaped run is a string of text in one font after ligature
+ * substitution, with glyph entries and kerning resolved. Measuring and
+ * drawing the same run share it through a small direct mapped cache,
+ * so a line that is measured and then drawn, or redrawn in a later
+ * frame, is only shaped once.
+ */
+
+#define RUNCACHE 1024
+
+struct run_s
+{
+    int font;
+    int len;
+    glui32 hash;
+    glui32 *text;
+    int count;
+    fentry_t **glyphs;
+    int *kern;
+    unsigned char *space;
+    int width;
+    int spaceadv;
+    int nspaces;
+    int alloced;
 };
 
 struct font_s
 {
     FT_Face face;
-    bitmap_t lowglyphs[256][GLI_SUBPIX];
-    int lowadvs[256];
-    unsigned char lowloaded[256/8];
+    char *name;
+    unsigned char *mem;
+    unsigned int memlen;
+    float size, aspect;
+    fentry_t *lowentries[256];
     fentry_t *highentries;
-    int num_highentries, alloced_highentries;
+    fblock_t *blocks;
+    atlas_t atlas;
     int make_bold;
     int make_oblique;
+    int dolig;
     int kerned;
+    short *kernlow;
     kcache_t *kerncache;
+    int kernsize, kerncount;
 };
 
 /*
@@ -110,6 +198,26 @@ static const int gli_bpp = 3;
 static FT_Library ftlib;
 static FT_Matrix ftmat;
 
+static garglk_glyphstats_t glyphstats;
+
+static run_t *runcache[RUNCACHE];
+
+/*
+ * Warm-up: with lazy glyphs, a background thread pre-renders printable
+ * ASCII for every font using its own FreeType instance. The main thread
+ * copies the results into the atlases once the thread is done.
+ */
+
+#define WARMFIRST 32
+#define WARMLAST 126
+#define WARMCOUNT (WARMLAST - WARMFIRST + 1)
+
+static bitmap_t warmglyphs[8][WARMCOUNT][GLI_SUBPIX];
+static unsigned char warmloaded[8][WARMCOUNT];
+static gli_thread_t *warmthread = NULL;
+static gli_mutex_t *warmlock = NULL;
+static int warmdone = FALSE;
+
 /*
  * Font loading
  */
@@ -167,117 +275,352 @@ static void gammacopy_lcd(unsigned char *dst, unsigned char *src, int w, int h,
     }
 }
 
-static int findhighglyph(glui32 cid, fentry_t *entries, int length)
+/*
+ * Glyph atlas
+ */
+
+#define ASLOTALIGN (sizeof(void*))
+#define aslotsize(n) ((sizeof(aslot_t) + (n) + ASLOTALIGN - 1) & ~(ASLOTALIGN - 1))
+
+static unsigned char *atlas_scratch = NULL;
+static size_t atlas_scratch_size = 0;
+
+static void atlas_evict(atlas_t *a)
 {
-    int start = 0, end = length, mid = 0;
-    while (start < end)
+    aslot_t *slot = (aslot_t*)(a->slab + a->tail);
+
+    if (slot->owner)
     {
-        mid = (start + end) / 2;
-        if (entries[mid].cid == cid)
-            return mid;
-        else if (entries[mid].cid < cid)
-            start = mid + 1;
-        else
-            end = mid;
+        slot->owner->loaded &= ~(1 << slot->sub);
+        glyphstats.evictions++;
+        glyphstats.bytes -= slot->size;
+    }
+
+    a->tail += slot->size;
+    if (a->wrapped && a->tail == a->limit)
+    {
+        a->wrapped = FALSE;
+        a->tail = 0;
+    }
+}
+
+/* reserve room for n bytes of bitmap data and return its slab offset */
+static size_t atlas_alloc(atlas_t *a, fentry_t *owner, int sub, size_t n)
+{
+    size_t need = aslotsize(n);
+    aslot_t *slot;
+
+    /* never let a single glyph take more than a quarter of the slab */
+    if (need * 4 > a->budget)
+        a->budget = need * 4;
+
+    while (1)
+    {
+        if (!a->wrapped)
+        {
+            if (a->tail == a->head)
+                a->tail = a->head = 0;
+
+            if (a->size - a->head >= need)
+                break;
+
+            if (a->size < a->budget)
+            {
+                size_t newsize = a->size ? a->size * 2 : 65536;
+                unsigned char *newslab;
+                while (newsize < a->head + need)
+                    newsize *= 2;
+                if (newsize > a->budget)
+                    newsize = a->budget;
+                if (newsize >= a->head + need)
+                {
+                    newslab = realloc(a->slab, newsize);
+                    if (!newslab)
+                        winabort("glyph atlas: out of memory");
+                    glyphstats.capacity += newsize - a->size;
+                    a->slab = newslab;
+                    a->size = newsize;
+                    continue;
+                }
+            }
+
+            a->limit = a->head;
+            a->head = 0;
+            a->wrapped = TRUE;
+        }
+
+        if (a->tail - a->head >= need)
+            break;
+
+        atlas_evict(a);
     }
-    return ~mid;
+
+    slot = (aslot_t*)(a->slab + a->head);
+    slot->owner = owner;
+    slot->sub = sub;
+    slot->size = need;
+
+    a->head += need;
+    a->clock += need;
+    glyphstats.bytes += need;
+
+    return a->head - need + sizeof(aslot_t);
 }
 
-static void loadglyph(font_t *f, glui32 cid)
+/* rasterize one subpixel variant into face->glyph */
+static int rasterglyph(font_t *f, FT_Face face, glui32 gid, int x)
 {
     FT_Vector v;
     int err;
-    glui32 gid;
-    int x;
-    bitmap_t glyphs[GLI_SUBPIX];
-    int adv;
 
-    gid = FT_Get_Char_Index(f->face, cid);
-    if (gid == 0)
-        gid = FT_Get_Char_Index(f->face, '?');
+    v.x = (x * 64) / GLI_SUBPIX;
+    v.y = 0;
+
+    FT_Set_Transform(face, 0, &v);
+
+    err = FT_Load_Glyph(face, gid,
+            FT_LOAD_NO_BITMAP | FT_LOAD_NO_HINTING);
+    if (err)
+        return err;
+
+    if (f->make_bold)
+        FT_Outline_Embolden(&face->glyph->outline, FT_MulFix(face->units_per_EM, face->size->metrics.y_scale) / 24);
+
+    if (f->make_oblique)
+        FT_Outline_Transform(&face->glyph->outline, &ftmat);
+
+    if (gli_conf_lcd)
+        err = FT_Render_Glyph(face->glyph, FT_RENDER_MODE_LCD);
+    else
+        err = FT_Render_Glyph(face->glyph, FT_RENDER_MODE_LIGHT);
+
+    return err;
+}
+
+/* copy a gamma corrected rendering out of face->glyph */
+static void copyglyph(unsigned char *dst, FT_Face face, int w, int h, int pitch)
+{
+    if (gli_conf_lcd)
+        gammacopy_lcd(dst, face->glyph->bitmap.buffer, w, h, pitch);
+    else
+        gammacopy(dst, face->glyph->bitmap.buffer, pitch * h);
+}
+
+/* place a subpixel variant in the atlas and return its data pointer */
+static unsigned char *storeglyph(font_t *f, fentry_t *e, int x, bitmap_t *src)
+{
+    bitmap_t *glyph = &e->glyph[x];
+
+    glyph->lsb = src->lsb;
+    glyph->top = src->top;
+    glyph->w = src->w;
+    glyph->h = src->h;
+    glyph->pitch = src->pitch;
+
+    e->off[x] = atlas_alloc(&f->atlas, e, x, glyph->pitch * glyph->h);
+    e->stamp[x] = f->atlas.clock;
+    e->loaded |= (1 << x);
+
+    glyph->data = f->atlas.slab + e->off[x];
+    return glyph->data;
+}
+
+static void renderglyph(font_t *f, fentry_t *e, int x)
+{
+    FT_GlyphSlot slot = f->face->glyph;
+    bitmap_t glyph;
+
+    if (rasterglyph(f, f->face, e->gid, x))
+        winabort("FT_Render_Glyph");
+
+    e->adv = (slot->advance.x * GLI_SUBPIX + 32) / 64;
+
+    glyph.lsb = slot->bitmap_left;
+    glyph.top = slot->bitmap_top;
+    glyph.w = slot->bitmap.width;
+    glyph.h = slot->bitmap.rows;
+    glyph.pitch = slot->bitmap.pitch;
+
+    copyglyph(storeglyph(f, e, x, &glyph), f->face,
+            glyph.w, glyph.h, glyph.pitch);
+}
+
+static fentry_t *loadglyph(font_t *f, glui32 cid)
+{
+    fentry_t *e;
+    int x;
 
-    for (x = 0; x < GLI_SUBPIX; x++)
+    if (!f->blocks || f->blocks->used == FBLOCKSIZE)
     {
-        v.x = (x * 64) / GLI_SUBPIX;
-        v.y = 0;
+        fblock_t *b = malloc(sizeof(fblock_t));
+        if (!b)
+            winabort("loadglyph: out of memory");
+        b->used = 0;
+        b->next = f->blocks;
+        f->blocks = b;
+    }
 
-        FT_Set_Transform(f->face, 0, &v);
+    e = &f->blocks->entries[f->blocks->used++];
+    memset(e, 0, sizeof(fentry_t));
+    e->cid = cid;
 
-        err = FT_Load_Glyph(f->face, gid,
-                FT_LOAD_NO_BITMAP | FT_LOAD_NO_HINTING);
-        if (err)
+    e->gid = FT_Get_Char_Index(f->face, cid);
+    if (e->gid == 0)
+        e->gid = FT_Get_Char_Index(f->face, '?');
+
+    if (gli_conf_lazyglyphs)
+    {
+        /* only the advance is needed until the glyph is drawn */
+        FT_Set_Transform(f->face, 0, 0);
+        if (FT_Load_Glyph(f->face, e->gid, FT_LOAD_NO_BITMAP | FT_LOAD_NO_HINTING))
             winabort("FT_Load_Glyph");
+        e->adv = (f->face->glyph->advance.x * GLI_SUBPIX + 32) / 64;
+    }
+    else
+    {
+        for (x = 0; x < GLI_SUBPIX; x++)
+            renderglyph(f, e, x);
+    }
 
-        if (f->make_bold)
-            FT_Outline_Embolden(&f->face->glyph->outline, FT_MulFix(f->face->units_per_EM, f->face->size->metrics.y_scale) / 24);
+    if (cid < 256)
+        f->lowentries[cid] = e;
+    else
+        HASH_ADD_INT(f->highentries, cid, e);
 
-        if (f->make_oblique)
-            FT_Outline_Transform(&f->face->glyph->outline, &ftmat);
+    return e;
+}
 
-        if (gli_conf_lcd)
-            err = FT_Render_Glyph(f->face->glyph, FT_RENDER_MODE_LCD);
-        else
-            err = FT_Render_Glyph(f->face->glyph, FT_RENDER_MODE_LIGHT);
-        if (err)
-            winabort("FT_Render_Glyph");
-
-        adv = (f->face->glyph->advance.x * GLI_SUBPIX + 32) / 64;
-
-        glyphs[x].lsb = f->face->glyph->bitmap_left;
-        glyphs[x].top = f->face->glyph->bitmap_top;
-        glyphs[x].w = f->face->glyph->bitmap.width;
-        glyphs[x].h = f->face->glyph->bitmap.rows;
-        glyphs[x].pitch = f->face->glyph->bitmap.pitch;
-        glyphs[x].data =
-            malloc(glyphs[x].pitch * glyphs[x].h);
-                if (gli_conf_lcd)
-                    gammacopy_lcd(glyphs[x].data,
-                            f->face->glyph->bitmap.buffer,
-                            glyphs[x].w, glyphs[x].h, glyphs[x].pitch);
-                else
-                    gammacopy(glyphs[x].data,
-                            f->face->glyph->bitmap.buffer,
-                            glyphs[x].pitch * glyphs[x].h);
-    }
+static fentry_t *getglyph(font_t *f, glui32 cid)
+{
+    fentry_t *e;
 
     if (cid < 256)
     {
-        f->lowloaded[cid/8] |= (1 << (cid%8));
-        f->lowadvs[cid] = adv;
-        memcpy(f->lowglyphs[cid], glyphs, sizeof glyphs);
+        e = f->lowentries[cid];
     }
     else
     {
-        int idx = findhighglyph(cid, f->highentries, f->num_highentries);
-        if (idx < 0)
+        HASH_FIND_INT(f->highentries, &cid, e);
+    }
+
+    if (!e)
+        e = loadglyph(f, cid);
+
+    return e;
+}
+
+static void warmup(void *arg)
+{
+    FT_Library lib;
+    FT_Face face;
+    font_t *f;
+    glui32 gid;
+    int i, c, x;
+
+    if (FT_Init_FreeType(&lib))
+        goto done;
+
+    for (i = 0; i < 8; i++)
+    {
+        f = &gfont_table[i];
+
+        if (f->mem)
+        {
+            if (FT_New_Memory_Face(lib, f->mem, f->memlen, 0, &face))
+                continue;
+        }
+        else
+        {
+            if (FT_New_Face(lib, f->name, 0, &face))
+                continue;
+        }
+
+        if (FT_Set_Char_Size(face, f->size * f->aspect * 64, f->size * 64, 72, 72) ||
+                FT_Select_Charmap(face, ft_encoding_unicode))
+        {
+            FT_Done_Face(face);
+            continue;
+        }
+
+        for (c = 0; c < WARMCOUNT; c++)
         {
-            idx = ~idx;
+            gid = FT_Get_Char_Index(face, WARMFIRST + c);
+            if (gid == 0)
+                gid = FT_Get_Char_Index(face, '?');
 
-            /* make room if needed */
-            if (f->alloced_highentries == f->num_highentries)
+            for (x = 0; x < GLI_SUBPIX; x++)
             {
-                fentry_t *newentries;
-                int newsize = f->alloced_highentries * 2;
-                if (!newsize)
-                    newsize = 2;
-                newentries = malloc(newsize * sizeof(fentry_t));
-                if (!newentries)
-                    return;
-                if (f->highentries)
-                {
-                    memcpy(newentries, f->highentries, f->num_highentries * sizeof(fentry_t));
-                    free(f->highentries);
-                }
-                f->highentries = newentries;
-                f->alloced_highentries = newsize;
+                FT_GlyphSlot slot = face->glyph;
+                bitmap_t *glyph = &warmglyphs[i][c][x];
+
+                if (rasterglyph(f, face, gid, x))
+                    continue;
+
+                glyph->lsb = slot->bitmap_left;
+                glyph->top = slot->bitmap_top;
+                glyph->w = slot->bitmap.width;
+                glyph->h = slot->bitmap.rows;
+                glyph->pitch = slot->bitmap.pitch;
+                glyph->data = malloc(glyph->pitch * glyph->h + 1);
+                if (!glyph->data)
+                    continue;
+
+                copyglyph(glyph->data, face, glyph->w, glyph->h, glyph->pitch);
+                warmloaded[i][c] |= (1 << x);
             }
+        }
+
+        FT_Done_Face(face);
+    }
+
+    FT_Done_FreeType(lib);
 
-            /* insert new glyph */
-            memmove(&f->highentries[idx+1], &f->highentries[idx], (f->num_highentries - idx) * sizeof(fentry_t));
-            f->highentries[idx].cid = cid;
-            f->highentries[idx].adv = adv;
-            memcpy(f->highentries[idx].glyph, glyphs, sizeof glyphs);
-            f->num_highentries++;
+done:
+    gli_mutex_lock(warmlock);
+    warmdone = TRUE;
+    gli_mutex_unlock(warmlock);
+}
+
+/* adopt the warm-up renderings once the thread has finished */
+static void warmup_merge(void)
+{
+    fentry_t *e;
+    bitmap_t *glyph;
+    int done;
+    int i, c, x;
+
+    gli_mutex_lock(warmlock);
+    done = warmdone;
+    gli_mutex_unlock(warmlock);
+
+    if (!done)
+        return;
+
+    gli_thread_join(warmthread);
+    warmthread = NULL;
+    gli_mutex_destroy(warmlock);
+    warmlock = NULL;
+
+    for (i = 0; i < 8; i++)
+    {
+        for (c = 0; c < WARMCOUNT; c++)
+        {
+            if (!warmloaded[i][c])
+                continue;
+
+            e = getglyph(&gfont_table[i], WARMFIRST + c);
+
+            for (x = 0; x < GLI_SUBPIX; x++)
+            {
+                glyph = &warmglyphs[i][c][x];
+                if (!(warmloaded[i][c] & (1 << x)))
+                    continue;
+                if (!(e->loaded & (1 << x)))
+                    memcpy(storeglyph(&gfont_table[i], e, x, glyph),
+                            glyph->data, glyph->pitch * glyph->h);
+                free(glyph->data);
+                glyph->data = NULL;
+            }
         }
     }
 }
@@ -311,6 +654,8 @@ static void loadfont(font_t *f, char *name, float size, float aspect, int style)
         {
             gli_get_builtin_font(i, &mem, &len);
             err = FT_New_Memory_Face(ftlib, mem, len, 0, &f->face);
+            f->mem = mem;
+            f->memlen = len;
             if (err)
                 winabort("FT_New_Face: %s: 0x%x", name, err);
             break;
@@ -337,6 +682,10 @@ static void loadfont(font_t *f, char *name, float size, float aspect, int style)
         }
     }
 
+    f->name = name;
+    f->size = size;
+    f->aspect = aspect;
+
     err = FT_Set_Char_Size(f->face, size * aspect * 64, size * 64, 72, 72);
     if (err)
         winabort("FT_Set_Char_Size: %s", name);
@@ -345,12 +694,32 @@ static void loadfont(font_t *f, char *name, float size, float aspect, int style)
     if (err)
         winabort("FT_Select_CharMap: %s", name);
 
-    memset(f->lowloaded, 0, sizeof f->lowloaded);
-    f->alloced_highentries = 0;
-    f->num_highentries = 0;
+    memset(f->lowentries, 0, sizeof f->lowentries);
     f->highentries = NULL;
+    f->blocks = NULL;
+    memset(&f->atlas, 0, sizeof f->atlas);
+    f->atlas.budget = gli_conf_glyphcache * 1024;
+    f->dolig = !FT_IS_FIXED_WIDTH(f->face);
+    if (FT_Get_Char_Index(f->face, UNI_LIG_FI) == 0)
+        f->dolig = FALSE;
+    if (FT_Get_Char_Index(f->face, UNI_LIG_FL) == 0)
+        f->dolig = FALSE;
+
     f->kerned = FT_HAS_KERNING(f->face);
+    f->kernlow = NULL;
     f->kerncache = NULL;
+    f->kernsize = 0;
+    f->kerncount = 0;
+
+    if (f->kerned)
+    {
+        f->kernlow = malloc(256 * 256 * sizeof(short));
+        if (!f->kernlow)
+            winabort("loadfont: out of memory");
+        for (i = 0; i < 256 * 256; i++)
+            f->kernlow[i] = KERNUNKNOWN;
+        glyphstats.kernallocs++;
+    }
 
     switch (style)
     {
@@ -416,8 +785,20 @@ void gli_initialize_fonts(void)
 
     loadglyph(&gfont_table[0], '0');
 
+    if (gli_conf_lazyglyphs && gli_conf_glyphwarmup)
+    {
+        warmlock = gli_mutex_create();
+        if (warmlock)
+            warmthread = gli_thread_create(warmup, NULL);
+        if (!warmthread && warmlock)
+        {
+            gli_mutex_destroy(warmlock);
+            warmlock = NULL;
+        }
+    }
+
     gli_cellh = gli_leading;
-    gli_cellw = (gfont_table[0].lowadvs['0'] + GLI_SUBPIX - 1) / GLI_SUBPIX;
+    gli_cellw = (gfont_table[0].lowentries['0']->adv + GLI_SUBPIX - 1) / GLI_SUBPIX;
 }
 
 /*
@@ -451,105 +832,426 @@ void gli_draw_pixel(int x, int y, unsigned char alpha, unsigned char *rgb)
 #endif
 }
 
-void gli_draw_pixel_lcd(int x, int y, unsigned char *alpha, unsigned char *rgb)
-{
-    unsigned char *p = gli_image_rgb + y * gli_image_s + x * gli_bpp;
-    unsigned char invalf[3];
-        invalf[0] = 255 - alpha[0];
-        invalf[1] = 255 - alpha[1];
-        invalf[2] = 255 - alpha[2];
-    if (x < 0 || x >= gli_image_w)
-        return;
-    if (y < 0 || y >= gli_image_h)
-        return;
-#ifdef WIN32
-    p[0] = rgb[2] + mul255((short)p[0] - rgb[2], invalf[2]);
-    p[1] = rgb[1] + mul255((short)p[1] - rgb[1], invalf[1]);
-    p[2] = rgb[0] + mul255((short)p[2] - rgb[0], invalf[0]);
-#elif defined __APPLE__ || defined __EFL_4BPP__
-    p[0] = rgb[2] + mul255((short)p[0] - rgb[2], invalf[2]);
-    p[1] = rgb[1] + mul255((short)p[1] - rgb[1], invalf[1]);
-    p[2] = rgb[0] + mul255((short)p[2] - rgb[0], invalf[0]);
-    p[3] = 0xFF;
-#elif defined __EFL_1BPP__
-    int gray = grayscale( rgb[0], rgb[1], rgb[2] );
-    int invalfgray = grayscale( invalf[0], invalf[1], invalf[2] );
-    p[0] = gray + mul255((short)p[0] - gray, invalfgray);
-#else
-    p[0] = rgb[0] + mul255((short)p[0] - rgb[0], invalf[0]);
-    p[1] = rgb[1] + mul255((short)p[1] - rgb[1], invalf[1]);
-    p[2] = rgb[2] + mul255((short)p[2] - rgb[2], invalf[2]);
+
+/*
+ * Coverage blending
+ *
+ * Glyphs and pictures are composited a row at a time. Each row is clipped
+ * against the framebuffer once, expanded into a source colour span and an
+ * alpha span laid out exactly like the framebuffer bytes, and then blended
+ * by blend_span(). The kernel works on bytes, so the same code handles the
+ * 3, 4 and 1 bpp layouts. Pictures are premultiplied by alpha and go
+ * through blend_span_premul() instead; their opaque runs are copied.
+ */
+
+#if defined WIN32 || defined __APPLE__ || defined __EFL_4BPP__
+#define BLEND_BGR
 #endif
-}
 
+#if defined __AVX2__
+#include <immintrin.h>
+#elif defined __SSE2__
+#include <emmintrin.h>
+#endif
 
-static inline void draw_bitmap(bitmap_t *b, int x, int y, unsigned char *rgb)
+static unsigned char *blend_src = NULL;
+static unsigned char *blend_alpha = NULL;
+static int blend_alloced = 0;
+
+/* horizontal limits on top of the framebuffer, narrowed for grid runs */
+static int blend_clipx0 = 0;
+static int blend_clipx1 = INT_MAX;
+
+static int blend_reserve(int n)
+{
+    if (n > blend_alloced)
+    {
+        unsigned char *src = realloc(blend_src, n);
+        unsigned char *alpha;
+        if (!src)
+            return FALSE;
+        blend_src = src;
+        alpha = realloc(blend_alpha, n);
+        if (!alpha)
+            return FALSE;
+        blend_alpha = alpha;
+        blend_alloced = n;
+    }
+    return TRUE;
+}
+
+/*
+ * dst = (dst * (256 - w) + src * w) >> 8, with w = a + (a >> 7) so that
+ * full coverage yields the exact source colour and zero leaves dst alone.
+ */
+static void blend_span(unsigned char *dp, const unsigned char *sp, const unsigned char *ap, int n)
 {
-    int i, k, c;
-    for (k = 0; k < b->h; k++)
+    int i = 0;
+
+#if defined __AVX2__
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i full = _mm256_set1_epi16(256);
+        for (; i + 32 <= n; i += 32)
+        {
+            __m256i d = _mm256_loadu_si256((const __m256i *)(dp + i));
+            __m256i s = _mm256_loadu_si256((const __m256i *)(sp + i));
+            __m256i a = _mm256_loadu_si256((const __m256i *)(ap + i));
+            __m256i dl = _mm256_unpacklo_epi8(d, zero);
+            __m256i dh = _mm256_unpackhi_epi8(d, zero);
+            __m256i sl = _mm256_unpacklo_epi8(s, zero);
+            __m256i sh = _mm256_unpackhi_epi8(s, zero);
+            __m256i al = _mm256_unpacklo_epi8(a, zero);
+            __m256i ah = _mm256_unpackhi_epi8(a, zero);
+            al = _mm256_add_epi16(al, _mm256_srli_epi16(al, 7));
+            ah = _mm256_add_epi16(ah, _mm256_srli_epi16(ah, 7));
+            dl = _mm256_add_epi16(_mm256_mullo_epi16(dl, _mm256_sub_epi16(full, al)),
+                    _mm256_mullo_epi16(sl, al));
+            dh = _mm256_add_epi16(_mm256_mullo_epi16(dh, _mm256_sub_epi16(full, ah)),
+                    _mm256_mullo_epi16(sh, ah));
+            d = _mm256_packus_epi16(_mm256_srli_epi16(dl, 8), _mm256_srli_epi16(dh, 8));
+            _mm256_storeu_si256((__m256i *)(dp + i), d);
+        }
+    }
+#endif
+
+#if defined __SSE2__
     {
-        for (i = 0; i < b->w; i ++)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i full = _mm_set1_epi16(256);
+        for (; i + 16 <= n; i += 16)
         {
-            c = b->data[k * b->pitch + i];
-            gli_draw_pixel(x + b->lsb + i, y - b->top + k, c, rgb);
+            __m128i d = _mm_loadu_si128((const __m128i *)(dp + i));
+            __m128i s = _mm_loadu_si128((const __m128i *)(sp + i));
+            __m128i a = _mm_loadu_si128((const __m128i *)(ap + i));
+            __m128i dl = _mm_unpacklo_epi8(d, zero);
+            __m128i dh = _mm_unpackhi_epi8(d, zero);
+            __m128i sl = _mm_unpacklo_epi8(s, zero);
+            __m128i sh = _mm_unpackhi_epi8(s, zero);
+            __m128i al = _mm_unpacklo_epi8(a, zero);
+            __m128i ah = _mm_unpackhi_epi8(a, zero);
+            al = _mm_add_epi16(al, _mm_srli_epi16(al, 7));
+            ah = _mm_add_epi16(ah, _mm_srli_epi16(ah, 7));
+            dl = _mm_add_epi16(_mm_mullo_epi16(dl, _mm_sub_epi16(full, al)),
+                    _mm_mullo_epi16(sl, al));
+            dh = _mm_add_epi16(_mm_mullo_epi16(dh, _mm_sub_epi16(full, ah)),
+                    _mm_mullo_epi16(sh, ah));
+            d = _mm_packus_epi16(_mm_srli_epi16(dl, 8), _mm_srli_epi16(dh, 8));
+            _mm_storeu_si128((__m128i *)(dp + i), d);
         }
     }
+#endif
+
+    for (; i < n; i++)
+    {
+        int w = ap[i] + (ap[i] >> 7);
+        dp[i] = (dp[i] * (256 - w) + sp[i] * w) >> 8;
+    }
 }
 
-static inline void draw_bitmap_lcd(bitmap_t *b, int x, int y, unsigned char *rgb)
+/* dst = src + ((dst * (256 - w)) >> 8), for source colours premultiplied by alpha */
+static void blend_span_premul(unsigned char *dp, const unsigned char *sp, const unsigned char *ap, int n)
 {
-    int i, j, k;
-    for (k = 0; k < b->h; k++)
+    int i = 0;
+
+#if defined __AVX2__
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i full = _mm256_set1_epi16(256);
+        for (; i + 32 <= n; i += 32)
+        {
+            __m256i d = _mm256_loadu_si256((const __m256i *)(dp + i));
+            __m256i s = _mm256_loadu_si256((const __m256i *)(sp + i));
+            __m256i a = _mm256_loadu_si256((const __m256i *)(ap + i));
+            __m256i dl = _mm256_unpacklo_epi8(d, zero);
+            __m256i dh = _mm256_unpackhi_epi8(d, zero);
+            __m256i al = _mm256_unpacklo_epi8(a, zero);
+            __m256i ah = _mm256_unpackhi_epi8(a, zero);
+            al = _mm256_sub_epi16(full, _mm256_add_epi16(al, _mm256_srli_epi16(al, 7)));
+            ah = _mm256_sub_epi16(full, _mm256_add_epi16(ah, _mm256_srli_epi16(ah, 7)));
+            dl = _mm256_srli_epi16(_mm256_mullo_epi16(dl, al), 8);
+            dh = _mm256_srli_epi16(_mm256_mullo_epi16(dh, ah), 8);
+            d = _mm256_adds_epu8(_mm256_packus_epi16(dl, dh), s);
+            _mm256_storeu_si256((__m256i *)(dp + i), d);
+        }
+    }
+#endif
+
+#if defined __SSE2__
     {
-        for (i = 0, j = 0; i < b->w; i += 3, j ++)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i full = _mm_set1_epi16(256);
+        for (; i + 16 <= n; i += 16)
         {
-            gli_draw_pixel_lcd(x + b->lsb + j, y - b->top + k, b->data + k * b->pitch + i, rgb);
+            __m128i d = _mm_loadu_si128((const __m128i *)(dp + i));
+            __m128i s = _mm_loadu_si128((const __m128i *)(sp + i));
+            __m128i a = _mm_loadu_si128((const __m128i *)(ap + i));
+            __m128i dl = _mm_unpacklo_epi8(d, zero);
+            __m128i dh = _mm_unpackhi_epi8(d, zero);
+            __m128i al = _mm_unpacklo_epi8(a, zero);
+            __m128i ah = _mm_unpackhi_epi8(a, zero);
+            al = _mm_sub_epi16(full, _mm_add_epi16(al, _mm_srli_epi16(al, 7)));
+            ah = _mm_sub_epi16(full, _mm_add_epi16(ah, _mm_srli_epi16(ah, 7)));
+            dl = _mm_srli_epi16(_mm_mullo_epi16(dl, al), 8);
+            dh = _mm_srli_epi16(_mm_mullo_epi16(dh, ah), 8);
+            d = _mm_adds_epu8(_mm_packus_epi16(dl, dh), s);
+            _mm_storeu_si128((__m128i *)(dp + i), d);
         }
     }
+#endif
+
+    for (; i < n; i++)
+    {
+        int w = ap[i] + (ap[i] >> 7);
+        int v = sp[i] + ((dp[i] * (256 - w)) >> 8);
+        dp[i] = v > 255 ? 255 : v;
+    }
 }
 
-void gli_draw_clear(unsigned char *rgb)
+/* fill n pixels of the source span with a solid colour */
+static void blend_fill_color(unsigned char *sp, unsigned char *rgb, int n)
 {
-    unsigned char *p;
-    int x, y;
-    
 #ifdef __EFL_1BPP__
-    int gray = grayscale( rgb[0], rgb[1], rgb[2] );
-#endif
-    for (y = 0; y < gli_image_h; y++)
+    memset(sp, grayscale(rgb[0], rgb[1], rgb[2]), n);
+#else
+    int x;
+    for (x = 0; x < n; x++)
     {
-        p = gli_image_rgb + y * gli_image_s;
-        for (x = 0; x < gli_image_w; x++)
-        {
-#ifdef WIN32
-            *p++ = rgb[2];
-            *p++ = rgb[1];
-            *p++ = rgb[0];
-#elif defined __APPLE__ || defined __EFL_4BPP__
-            *p++ = rgb[2];
-            *p++ = rgb[1];
-            *p++ = rgb[0];
-            *p++ = 0xFF;
-#elif defined __EFL_1BPP__
-            *p++ = gray;
+#ifdef BLEND_BGR
+        sp[0] = rgb[2];
+        sp[1] = rgb[1];
+        sp[2] = rgb[0];
 #else
-            *p++ = rgb[0];
-            *p++ = rgb[1];
-            *p++ = rgb[2];
+        sp[0] = rgb[0];
+        sp[1] = rgb[1];
+        sp[2] = rgb[2];
 #endif
-        }
+        if (gli_bpp == 4)
+            sp[3] = 0xFF;
+        sp += gli_bpp;
     }
+#endif
 }
 
-void gli_draw_rect(int x0, int y0, int w, int h, unsigned char *rgb)
+/* expand one row of grayscale coverage into the alpha span */
+static void blend_fill_alpha(unsigned char *ap, const unsigned char *cov, int n)
 {
-    unsigned char *p0;
-    int x1 = x0 + w;
-    int y1 = y0 + h;
-    int x, y;
-
-    if (x0 < 0) x0 = 0;
-    if (y0 < 0) y0 = 0;
+#ifdef __EFL_1BPP__
+    memcpy(ap, cov, n);
+#else
+    int x;
+    for (x = 0; x < n; x++)
+    {
+        ap[0] = ap[1] = ap[2] = cov[x];
+        if (gli_bpp == 4)
+            ap[3] = 0xFF;
+        ap += gli_bpp;
+    }
+#endif
+}
+
+/* expand one row of LCD (RGB triplet) coverage into the alpha span */
+static void blend_fill_alpha_lcd(unsigned char *ap, const unsigned char *cov, int n)
+{
+    int x;
+    for (x = 0; x < n; x++)
+    {
+#ifdef __EFL_1BPP__
+        ap[0] = 255 - grayscale(255 - cov[0], 255 - cov[1], 255 - cov[2]);
+#else
+#ifdef BLEND_BGR
+        ap[0] = cov[2];
+        ap[1] = cov[1];
+        ap[2] = cov[0];
+#else
+        ap[0] = cov[0];
+        ap[1] = cov[1];
+        ap[2] = cov[2];
+#endif
+        if (gli_bpp == 4)
+            ap[3] = 0xFF;
+#endif
+        ap += gli_bpp;
+        cov += 3;
+    }
+}
+
+/* expand one row of RGBA picture data into the source and alpha spans */
+static void blend_fill_rgba(unsigned char *sp, unsigned char *ap, const unsigned char *rgba, int n)
+{
+    int x;
+    for (x = 0; x < n; x++)
+    {
+#ifdef __EFL_1BPP__
+        sp[0] = grayscale(rgba[0], rgba[1], rgba[2]);
+        ap[0] = rgba[3];
+#else
+#ifdef BLEND_BGR
+        sp[0] = rgba[2];
+        sp[1] = rgba[1];
+        sp[2] = rgba[0];
+#else
+        sp[0] = rgba[0];
+        sp[1] = rgba[1];
+        sp[2] = rgba[2];
+#endif
+        ap[0] = ap[1] = ap[2] = rgba[3];
+        if (gli_bpp == 4)
+        {
+            sp[3] = 0xFF;
+            ap[3] = 0xFF;
+        }
+#endif
+        sp += gli_bpp;
+        ap += gli_bpp;
+        rgba += 4;
+    }
+}
+
+/* copy opaque RGBA picture data straight into the framebuffer */
+static void blend_copy_rgba(unsigned char *dp, const unsigned char *rgba, int n)
+{
+    int x;
+    for (x = 0; x < n; x++)
+    {
+#ifdef __EFL_1BPP__
+        dp[0] = grayscale(rgba[0], rgba[1], rgba[2]);
+#else
+#ifdef BLEND_BGR
+        dp[0] = rgba[2];
+        dp[1] = rgba[1];
+        dp[2] = rgba[0];
+#else
+        dp[0] = rgba[0];
+        dp[1] = rgba[1];
+        dp[2] = rgba[2];
+#endif
+        if (gli_bpp == 4)
+            dp[3] = 0xFF;
+#endif
+        dp += gli_bpp;
+        rgba += 4;
+    }
+}
+
+/*
+ * Clip a w x h block placed at (x, y) against the framebuffer.
+ * Returns FALSE if nothing is visible; otherwise the visible block
+ * is [*sx0, *sx0 + *cw) x [*sy0, *sy0 + *ch) in source coordinates.
+ */
+static int blend_clip(int x, int y, int w, int h, int *sx0, int *sy0, int *cw, int *ch)
+{
+    int x0 = 0, y0 = 0, x1 = w, y1 = h;
+    int lo = blend_clipx0 > 0 ? blend_clipx0 : 0;
+    int hi = blend_clipx1 < gli_image_w ? blend_clipx1 : gli_image_w;
+
+    if (x < lo) x0 = lo - x;
+    if (y < 0) y0 = -y;
+    if (x + x1 > hi) x1 = hi - x;
+    if (y + y1 > gli_image_h) y1 = gli_image_h - y;
+
+    if (x0 >= x1 || y0 >= y1)
+        return FALSE;
+
+    *sx0 = x0;
+    *sy0 = y0;
+    *cw = x1 - x0;
+    *ch = y1 - y0;
+    return TRUE;
+}
+
+static inline void draw_bitmap(bitmap_t *b, int x, int y, unsigned char *rgb)
+{
+    unsigned char *dp;
+    int sx0, sy0, cw, ch, k;
+
+    x += b->lsb;
+    y -= b->top;
+
+    if (!blend_clip(x, y, b->w, b->h, &sx0, &sy0, &cw, &ch))
+        return;
+    if (!blend_reserve(cw * gli_bpp))
+        return;
+
+    if (rgb)
+        blend_fill_color(blend_src, rgb, cw);
+
+    dp = gli_image_rgb + (y + sy0) * gli_image_s + (x + sx0) * gli_bpp;
+    for (k = sy0; k < sy0 + ch; k++)
+    {
+        blend_fill_alpha(blend_alpha, b->data + k * b->pitch + sx0, cw);
+        blend_span(dp, blend_src, blend_alpha, cw * gli_bpp);
+        dp += gli_image_s;
+    }
+}
+
+static inline void draw_bitmap_lcd(bitmap_t *b, int x, int y, unsigned char *rgb)
+{
+    unsigned char *dp;
+    int sx0, sy0, cw, ch, k;
+
+    x += b->lsb;
+    y -= b->top;
+
+    if (!blend_clip(x, y, b->w / 3, b->h, &sx0, &sy0, &cw, &ch))
+        return;
+    if (!blend_reserve(cw * gli_bpp))
+        return;
+
+    if (rgb)
+        blend_fill_color(blend_src, rgb, cw);
+
+    dp = gli_image_rgb + (y + sy0) * gli_image_s + (x + sx0) * gli_bpp;
+    for (k = sy0; k < sy0 + ch; k++)
+    {
+        blend_fill_alpha_lcd(blend_alpha, b->data + k * b->pitch + sx0 * 3, cw);
+        blend_span(dp, blend_src, blend_alpha, cw * gli_bpp);
+        dp += gli_image_s;
+    }
+}
+
+void gli_draw_clear(unsigned char *rgb)
+{
+    unsigned char *p;
+    int x, y;
+    
+#ifdef __EFL_1BPP__
+    int gray = grayscale( rgb[0], rgb[1], rgb[2] );
+#endif
+    for (y = 0; y < gli_image_h; y++)
+    {
+        p = gli_image_rgb + y * gli_image_s;
+        for (x = 0; x < gli_image_w; x++)
+        {
+#ifdef WIN32
+            *p++ = rgb[2];
+            *p++ = rgb[1];
+            *p++ = rgb[0];
+#elif defined __APPLE__ || defined __EFL_4BPP__
+            *p++ = rgb[2];
+            *p++ = rgb[1];
+            *p++ = rgb[0];
+            *p++ = 0xFF;
+#elif defined __EFL_1BPP__
+            *p++ = gray;
+#else
+            *p++ = rgb[0];
+            *p++ = rgb[1];
+            *p++ = rgb[2];
+#endif
+        }
+    }
+}
+
+void gli_draw_rect(int x0, int y0, int w, int h, unsigned char *rgb)
+{
+    unsigned char *p0;
+    int x1 = x0 + w;
+    int y1 = y0 + h;
+    int x, y;
+
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
     if (x1 < 0) x1 = 0;
     if (y1 < 0) y1 = 0;
 
@@ -589,85 +1291,360 @@ void gli_draw_rect(int x0, int y0, int w, int h, unsigned char *rgb)
     }
 }
 
-static int charkern(font_t *f, int c0, int c1)
-{
-    FT_Vector v;
-    int err;
-    int g0, g1;
+#define kernhash(c0, c1) ((c0) * 31 + (c1) * 0x9E3779B1)
 
-    if (!f->kerned)
-        return 0;
+static void kerngrow(font_t *f)
+{
+    kcache_t *old = f->kerncache;
+    int oldsize = f->kernsize;
+    int i, k;
 
-    kcache_t *item = malloc(sizeof(kcache_t));
-    memset(item, 0, sizeof(kcache_t));
-    item->pair[0] = c0;
-    item->pair[1] = c1;
+    f->kernsize = oldsize ? oldsize * 2 : 1024;
+    f->kerncache = malloc(f->kernsize * sizeof(kcache_t));
+    if (!f->kerncache)
+        winabort("charkern: out of memory");
+    glyphstats.kernallocs++;
 
-    kcache_t *match = NULL;
-    HASH_FIND(hh, f->kerncache, item->pair, 2 * sizeof(glui32), match);
+    for (i = 0; i < f->kernsize; i++)
+        f->kerncache[i].c0 = KERNEMPTY;
 
-    if (match)
+    for (i = 0; i < oldsize; i++)
     {
-        free(item);
-        return match->value;
+        if (old[i].c0 == KERNEMPTY)
+            continue;
+        k = kernhash(old[i].c0, old[i].c1) & (f->kernsize - 1);
+        while (f->kerncache[k].c0 != KERNEMPTY)
+            k = (k + 1) & (f->kernsize - 1);
+        f->kerncache[k] = old[i];
     }
 
+    free(old);
+}
+
+static int kernlookup(font_t *f, int c0, int c1)
+{
+    FT_Vector v;
+    int err;
+    int g0, g1;
+
     g0 = FT_Get_Char_Index(f->face, touni(c0));
     g1 = FT_Get_Char_Index(f->face, touni(c1));
 
-    if (g0 == 0 || g1 == 0) {
-        free(item);
+    if (g0 == 0 || g1 == 0)
         return 0;
-    }
 
     err = FT_Get_Kerning(f->face, g0, g1, FT_KERNING_UNFITTED, &v);
     if (err)
         winabort("FT_Get_Kerning");
 
-    item->value = (v.x * GLI_SUBPIX) / 64.0;
-    HASH_ADD_KEYPTR(hh, f->kerncache, item->pair, 2 * sizeof(glui32), item);
+    return (v.x * GLI_SUBPIX) / 64.0;
+}
+
+static int charkern(font_t *f, int c0, int c1)
+{
+    kcache_t *item;
+    int k;
+
+    if (!f->kerned)
+        return 0;
+
+    glyphstats.kernlookups++;
+    glyphstats.kernframe++;
+
+    if ((glui32)c0 < 256 && (glui32)c1 < 256)
+    {
+        short *value = &f->kernlow[c0 * 256 + c1];
+        if (*value == KERNUNKNOWN)
+            *value = kernlookup(f, c0, c1);
+        return *value;
+    }
+
+    if (f->kerncount * 2 >= f->kernsize)
+        kerngrow(f);
+
+    k = kernhash((glui32)c0, (glui32)c1) & (f->kernsize - 1);
+    while (1)
+    {
+        item = &f->kerncache[k];
+        if (item->c0 == KERNEMPTY)
+            break;
+        if (item->c0 == c0 && item->c1 == c1)
+            return item->value;
+        k = (k + 1) & (f->kernsize - 1);
+    }
+
+    item->c0 = c0;
+    item->c1 = c1;
+    item->value = kernlookup(f, c0, c1);
+    f->kerncount++;
 
     return item->value;
 }
 
-static void getglyph(font_t *f, glui32 cid, int *adv, bitmap_t **glyphs)
+static bitmap_t *getbitmap(font_t *f, fentry_t *e, int x)
 {
-    if (cid < 256)
+    atlas_t *a = &f->atlas;
+    bitmap_t *glyph = &e->glyph[x];
+
+    if (!(e->loaded & (1 << x)) && warmthread)
+        warmup_merge();
+
+    if (!(e->loaded & (1 << x)))
     {
-        if ((f->lowloaded[cid/8] & (1 << (cid%8))) == 0)
-            loadglyph(f, cid);
-        *adv = f->lowadvs[cid];
-        *glyphs = f->lowglyphs[cid];
+        glyphstats.misses++;
+        renderglyph(f, e, x);
+        return glyph;
     }
-    else
+
+    glyphstats.hits++;
+
+    /* move bitmaps that are still in use away from the tail */
+    if (a->clock - e->stamp[x] > a->size / 2)
+    {
+        size_t n = glyph->pitch * glyph->h;
+        aslot_t *slot = (aslot_t*)(a->slab + e->off[x] - sizeof(aslot_t));
+
+        if (n > atlas_scratch_size)
+        {
+            unsigned char *scratch = realloc(atlas_scratch, n);
+            if (!scratch)
+                winabort("glyph atlas: out of memory");
+            atlas_scratch = scratch;
+            atlas_scratch_size = n;
+        }
+
+        /* blank glyphs such as the space still move, but have no data */
+        if (n)
+            memcpy(atlas_scratch, a->slab + e->off[x], n);
+        slot->owner = NULL;
+        glyphstats.bytes -= slot->size;
+
+        e->off[x] = atlas_alloc(a, e, x, n);
+        e->stamp[x] = a->clock;
+        if (n)
+            memcpy(a->slab + e->off[x], atlas_scratch, n);
+    }
+
+    glyph->data = a->slab + e->off[x];
+    return glyph;
+}
+
+void gli_draw_begin_frame(void)
+{
+    glyphstats.kernframe = 0;
+}
+
+void garglk_glyph_cache_stats(garglk_glyphstats_t *stats)
+{
+    if (stats)
+        *stats = glyphstats;
+}
+
+/*
+ * Damage tracking. Window redraws report the parts of the framebuffer
+ * they changed, either directly or by diffing a snapshot taken before
+ * drawing. Rectangles are merged as they arrive and handed to winrepaint
+ * once per frame.
+ */
+
+#define DAMAGEMAX 16
+
+static rect_t damage[DAMAGEMAX];
+static int ndamage = 0;
+static garglk_framestats_t framestats;
+
+static unsigned char *snapbuf = NULL;
+static int snapsize = 0;
+static rect_t snapbox;
+
+static int rectarea(rect_t *r)
+{
+    return (r->x1 - r->x0) * (r->y1 - r->y0);
+}
+
+static rect_t rectunion(rect_t *a, rect_t *b)
+{
+    rect_t u;
+    u.x0 = a->x0 < b->x0 ? a->x0 : b->x0;
+    u.y0 = a->y0 < b->y0 ? a->y0 : b->y0;
+    u.x1 = a->x1 > b->x1 ? a->x1 : b->x1;
+    u.y1 = a->y1 > b->y1 ? a->y1 : b->y1;
+    return u;
+}
+
+void gli_damage_rect(int x0, int y0, int x1, int y1)
+{
+    rect_t r, u;
+    int i, best, cost, bestcost;
+
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > gli_image_w) x1 = gli_image_w;
+    if (y1 > gli_image_h) y1 = gli_image_h;
+    if (x0 >= x1 || y0 >= y1)
+        return;
+
+    r.x0 = x0; r.y0 = y0;
+    r.x1 = x1; r.y1 = y1;
+
+    /* absorb every rectangle the union covers without wasting pixels */
+    i = 0;
+    while (i < ndamage)
+    {
+        u = rectunion(&damage[i], &r);
+        if (rectarea(&u) <= rectarea(&damage[i]) + rectarea(&r))
+        {
+            r = u;
+            damage[i] = damage[--ndamage];
+            i = 0;
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    /* out of slots: merge with whichever grows the least */
+    if (ndamage == DAMAGEMAX)
+    {
+        best = 0;
+        bestcost = -1;
+        for (i = 0; i < ndamage; i++)
+        {
+            u = rectunion(&damage[i], &r);
+            cost = rectarea(&u) - rectarea(&damage[i]) - rectarea(&r);
+            if (bestcost < 0 || cost < bestcost)
+            {
+                best = i;
+                bestcost = cost;
+            }
+        }
+        r = rectunion(&damage[best], &r);
+        damage[best] = damage[--ndamage];
+    }
+
+    damage[ndamage++] = r;
+}
+
+/* remember what is under a rectangle before redrawing it */
+void gli_damage_begin(int x0, int y0, int x1, int y1)
+{
+    int y, n;
+
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > gli_image_w) x1 = gli_image_w;
+    if (y1 > gli_image_h) y1 = gli_image_h;
+
+    snapbox.x0 = x0; snapbox.y0 = y0;
+    snapbox.x1 = x1; snapbox.y1 = y1;
+
+    /* a forced redraw damages everything anyway */
+    if (x0 >= x1 || y0 >= y1 || gli_force_redraw)
+    {
+        snapbox.x1 = snapbox.x0;
+        return;
+    }
+
+    n = (x1 - x0) * gli_bpp * (y1 - y0);
+    if (n > snapsize)
     {
-        int idx = findhighglyph(cid, f->highentries, f->num_highentries);
-        if (idx < 0)
+        unsigned char *buf = realloc(snapbuf, n);
+        if (!buf)
         {
-            loadglyph(f, cid);
-            idx = ~idx;
+            /* can't diff, so assume it all changed */
+            gli_damage_rect(x0, y0, x1, y1);
+            snapbox.x1 = snapbox.x0;
+            return;
         }
-        *adv = f->highentries[idx].adv;
-        *glyphs = f->highentries[idx].glyph;
+        snapbuf = buf;
+        snapsize = n;
+    }
+
+    n = (x1 - x0) * gli_bpp;
+    for (y = y0; y < y1; y++)
+        memcpy(snapbuf + (y - y0) * n, gli_image_rgb + y * gli_image_s + x0 * gli_bpp, n);
+}
+
+/* report the part of the snapshot that drawing has changed */
+void gli_damage_end(void)
+{
+    int n = (snapbox.x1 - snapbox.x0) * gli_bpp;
+    int bx0 = snapbox.x1, bx1 = snapbox.x0;
+    int by0 = -1, by1 = -1;
+    unsigned char *sp, *dp;
+    int a, b, y;
+
+    if (n <= 0)
+        return;
+
+    for (y = snapbox.y0; y < snapbox.y1; y++)
+    {
+        sp = snapbuf + (y - snapbox.y0) * n;
+        dp = gli_image_rgb + y * gli_image_s + snapbox.x0 * gli_bpp;
+        if (!memcmp(sp, dp, n))
+            continue;
+
+        for (a = 0; sp[a] == dp[a]; a++)
+            ;
+        for (b = n - 1; sp[b] == dp[b]; b--)
+            ;
+
+        if (snapbox.x0 + a / gli_bpp < bx0)
+            bx0 = snapbox.x0 + a / gli_bpp;
+        if (snapbox.x0 + b / gli_bpp + 1 > bx1)
+            bx1 = snapbox.x0 + b / gli_bpp + 1;
+        if (by0 < 0)
+            by0 = y;
+        by1 = y + 1;
+    }
+
+    if (by0 >= 0)
+        gli_damage_rect(bx0, by0, bx1, by1);
+
+    snapbox.x1 = snapbox.x0;
+}
+
+/* hand the merged damage of this frame to the toolkit */
+void gli_damage_flush(void)
+{
+    int i;
+
+    if (!ndamage)
+        return;
+
+    framestats.frames++;
+    framestats.regions = ndamage;
+    framestats.pixels = 0;
+
+    for (i = 0; i < ndamage; i++)
+    {
+        framestats.pixels += rectarea(&damage[i]);
+        winrepaint(damage[i].x0, damage[i].y0, damage[i].x1, damage[i].y1);
     }
+
+    framestats.totalregions += framestats.regions;
+    framestats.totalpixels += framestats.pixels;
+
+    ndamage = 0;
+}
+
+void garglk_frame_stats(garglk_framestats_t *stats)
+{
+    if (stats)
+        *stats = framestats;
 }
 
 int gli_string_width(int fidx, unsigned char *s, int n, int spw)
 {
     font_t *f = &gfont_table[fidx];
-    int dolig = ! FT_IS_FIXED_WIDTH(f->face);
+    int dolig = f->dolig;
     int prev = -1;
     int w = 0;
 
-    if ( FT_Get_Char_Index(f->face, UNI_LIG_FI) == 0 )
-        dolig = 0;
-    if ( FT_Get_Char_Index(f->face, UNI_LIG_FL) == 0 )
-        dolig = 0;
-
     while (n--)
     {
-        bitmap_t *glyphs;
-        int adv;
+        fentry_t *e;
         int c = touni(*s++);
 
         if (dolig && n && c == 'f' && *s == 'i')
@@ -683,7 +1660,7 @@ int gli_string_width(int fidx, unsigned char *s, int n, int spw)
           n--;
         }
 
-        getglyph(f, c, &adv, &glyphs);
+        e = getglyph(f, c);
 
         if (prev != -1)
             w += charkern(f, prev, c);
@@ -691,7 +1668,7 @@ int gli_string_width(int fidx, unsigned char *s, int n, int spw)
         if (spw >= 0 && c == ' ')
             w += spw;
         else
-            w += adv;
+            w += e->adv;
 
         prev = c;
     }
@@ -703,20 +1680,14 @@ int gli_draw_string(int x, int y, int fidx, unsigned char *rgb,
         unsigned char *s, int n, int spw)
 {
     font_t *f = &gfont_table[fidx];
-    int dolig = ! FT_IS_FIXED_WIDTH(f->face);
+    int dolig = f->dolig;
     int prev = -1;
     glui32 c;
     int px, sx;
 
-    if ( FT_Get_Char_Index(f->face, UNI_LIG_FI) == 0 )
-        dolig = 0;
-    if ( FT_Get_Char_Index(f->face, UNI_LIG_FL) == 0 )
-        dolig = 0;
-
     while (n--)
     {
-        bitmap_t *glyphs;
-        int adv;
+        fentry_t *e;
 
         c = touni(*s++);
 
@@ -733,7 +1704,7 @@ int gli_draw_string(int x, int y, int fidx, unsigned char *rgb,
           n--;
         }
 
-        getglyph(f, c, &adv, &glyphs);
+        e = getglyph(f, c);
 
         if (prev != -1)
             x += charkern(f, prev, c);
@@ -741,15 +1712,15 @@ int gli_draw_string(int x, int y, int fidx, unsigned char *rgb,
         px = x / GLI_SUBPIX;
         sx = x % GLI_SUBPIX;
 
-                if (gli_conf_lcd)
-                    draw_bitmap_lcd(&glyphs[sx], px, y, rgb);
-                else
-                    draw_bitmap(&glyphs[sx], px, y, rgb);
+        if (gli_conf_lcd)
+            draw_bitmap_lcd(getbitmap(f, e, sx), px, y, rgb);
+        else
+            draw_bitmap(getbitmap(f, e, sx), px, y, rgb);
 
         if (spw >= 0 && c == ' ')
             x += spw;
         else
-            x += adv;
+            x += e->adv;
 
         prev = c;
     }
@@ -757,109 +1728,198 @@ int gli_draw_string(int x, int y, int fidx, unsigned char *rgb,
     return x;
 }
 
-int gli_draw_string_uni(int x, int y, int fidx, unsigned char *rgb,
-        glui32 *s, int n, int spw)
+static glui32 runhash(int fidx, glui32 *s, int n)
+{
+    glui32 h = 2166136261u ^ fidx;
+    while (n--)
+        h = (h ^ *s++) * 16777619u;
+    return h;
+}
+
+static run_t *shaperun(int fidx, glui32 *s, int n)
 {
     font_t *f = &gfont_table[fidx];
-    int dolig = ! FT_IS_FIXED_WIDTH(f->face);
+    glui32 hash = runhash(fidx, s, n);
+    run_t **slot = &runcache[hash & (RUNCACHE - 1)];
+    run_t *run = *slot;
     int prev = -1;
     glui32 c;
-    int px, sx;
+    int i;
+
+    if (run && run->hash == hash && run->font == fidx && run->len == n
+            && !memcmp(run->text, s, n * sizeof(glui32)))
+    {
+        glyphstats.runhits++;
+        return run;
+    }
 
-    if ( FT_Get_Char_Index(f->face, UNI_LIG_FI) == 0 )
-        dolig = 0;
-    if ( FT_Get_Char_Index(f->face, UNI_LIG_FL) == 0 )
-        dolig = 0;
+    glyphstats.runmisses++;
+
+    if (!run)
+    {
+        run = malloc(sizeof(run_t));
+        if (!run)
+            winabort("shaperun: out of memory");
+        memset(run, 0, sizeof(run_t));
+        *slot = run;
+    }
+
+    if (n > run->alloced)
+    {
+        int size = n > 64 ? n : 64;
+        free(run->text);
+        free(run->glyphs);
+        free(run->kern);
+        free(run->space);
+        run->text = malloc(size * sizeof(glui32));
+        run->glyphs = malloc(size * sizeof(fentry_t*));
+        run->kern = malloc(size * sizeof(int));
+        run->space = malloc(size);
+        if (!run->text || !run->glyphs || !run->kern || !run->space)
+            winabort("shaperun: out of memory");
+        run->alloced = size;
+    }
+
+    run->font = fidx;
+    run->len = n;
+    run->hash = hash;
+    memcpy(run->text, s, n * sizeof(glui32));
+
+    run->count = 0;
+    run->width = 0;
+    run->spaceadv = 0;
+    run->nspaces = 0;
 
     while (n--)
     {
-        bitmap_t *glyphs;
-        int adv;
+        fentry_t *e;
 
         c = *s++;
 
-        if (dolig && n && c == 'f' && *s == 'i')
+        if (f->dolig && n && c == 'f' && *s == 'i')
         {
           c = UNI_LIG_FI;
           s++;
           n--;
         }
-        if (dolig && n && c == 'f' && *s == 'l')
+        if (f->dolig && n && c == 'f' && *s == 'l')
         {
           c = UNI_LIG_FL;
           s++;
           n--;
         }
 
-        getglyph(f, c, &adv, &glyphs);
+        e = getglyph(f, c);
 
-        if (prev != -1)
-            x += charkern(f, prev, c);
+        i = run->count++;
+        run->glyphs[i] = e;
+        run->kern[i] = prev != -1 ? charkern(f, prev, c) : 0;
+        run->space[i] = (c == ' ');
+
+        run->width += run->kern[i] + e->adv;
+        if (c == ' ')
+        {
+            run->spaceadv += e->adv;
+            run->nspaces++;
+        }
+
+        prev = c;
+    }
+
+    return run;
+}
+
+int gli_draw_string_uni(int x, int y, int fidx, unsigned char *rgb,
+        glui32 *s, int n, int spw)
+{
+    font_t *f = &gfont_table[fidx];
+    run_t *run;
+    int px, sx;
+    int i;
+
+    if (n <= 0)
+        return x;
+
+    run = shaperun(fidx, s, n);
+
+    for (i = 0; i < run->count; i++)
+    {
+        fentry_t *e = run->glyphs[i];
+
+        x += run->kern[i];
 
         px = x / GLI_SUBPIX;
         sx = x % GLI_SUBPIX;
 
-                if (gli_conf_lcd)
-                    draw_bitmap_lcd(&glyphs[sx], px, y, rgb);
-                else
-                    draw_bitmap(&glyphs[sx], px, y, rgb);
+        if (gli_conf_lcd)
+            draw_bitmap_lcd(getbitmap(f, e, sx), px, y, rgb);
+        else
+            draw_bitmap(getbitmap(f, e, sx), px, y, rgb);
 
-        if (spw >= 0 && c == ' ')
+        if (spw >= 0 && run->space[i])
             x += spw;
         else
-            x += adv;
-
-        prev = c;
+            x += e->adv;
     }
 
     return x;
 }
 
-int gli_string_width_uni(int fidx, glui32 *s, int n, int spw)
+/*
+ * Text grids put one glyph in each cell, with no ligatures or kerning,
+ * so a run of cells in one style skips shaping: glyphs come straight
+ * from the font's entry table at a fixed advance, and the colour span
+ * is filled once for the whole run. Coordinates are in pixels, and
+ * nothing is drawn outside [x0, x1).
+ */
+void gli_draw_grid_uni(int x, int y, int fidx, unsigned char *rgb,
+        glui32 *s, int n, int cellw, int x0, int x1)
 {
     font_t *f = &gfont_table[fidx];
-    int dolig = ! FT_IS_FIXED_WIDTH(f->face);
-    int prev = -1;
-    int w = 0;
+    bitmap_t *b;
+    int filled = 0;
+    int k, w;
 
-    if ( FT_Get_Char_Index(f->face, UNI_LIG_FI) == 0 )
-        dolig = 0;
-    if ( FT_Get_Char_Index(f->face, UNI_LIG_FL) == 0 )
-        dolig = 0;
+    blend_clipx0 = x0;
+    blend_clipx1 = x1;
 
-    while (n--)
+    for (k = 0; k < n; k++, x += cellw)
     {
-        bitmap_t *glyphs;
-        int adv;
-        int c = *s++;
+        b = getbitmap(f, getglyph(f, s[k]), 0);
+        if (!b->w || !b->h)
+            continue;
 
-        if (dolig && n && c == 'f' && *s == 'i')
+        w = gli_conf_lcd ? b->w / 3 : b->w;
+        if (w > filled)
         {
-          c = UNI_LIG_FI;
-          s++;
-          n--;
-        }
-        if (dolig && n && c == 'f' && *s == 'l')
-        {
-          c = UNI_LIG_FL;
-          s++;
-          n--;
+            if (!blend_reserve(w * gli_bpp))
+                break;
+            blend_fill_color(blend_src, rgb, w);
+            filled = w;
         }
 
-        getglyph(f, c, &adv, &glyphs);
+        if (gli_conf_lcd)
+            draw_bitmap_lcd(b, x, y, NULL);
+        else
+            draw_bitmap(b, x, y, NULL);
+    }
 
-        if (prev != -1)
-            w += charkern(f, prev, c);
+    blend_clipx0 = 0;
+    blend_clipx1 = INT_MAX;
+}
 
-        if (spw >= 0 && c == ' ')
-            w += spw;
-        else
-            w += adv;
+int gli_string_width_uni(int fidx, glui32 *s, int n, int spw)
+{
+    run_t *run;
 
-        prev = c;
-    }
+    if (n <= 0)
+        return 0;
 
-    return w;
+    run = shaperun(fidx, s, n);
+
+    if (spw >= 0)
+        return run->width - run->spaceadv + run->nspaces * spw;
+    return run->width;
 }
 
 void gli_draw_caret(int x, int y)
@@ -890,7 +1950,7 @@ void gli_draw_picture(picture_t *src, int x0, int y0, int dx0, int dy0, int dx1,
 {
     unsigned char *sp, *dp;
     int x1, y1, sx0, sy0, sx1, sy1;
-    int x, y, w, h;
+    int y, w, h;
 
     sx0 = 0;
     sy0 = 0;
@@ -929,35 +1989,42 @@ void gli_draw_picture(picture_t *src, int x0, int y0, int dx0, int dy0, int dx1,
     w = sx1 - sx0;
     h = sy1 - sy0;
 
+    if (!blend_reserve(w * gli_bpp))
+        return;
+
+    if (!src->spanrow)
+    {
+        for (y = 0; y < h; y++)
+        {
+            blend_fill_rgba(blend_src, blend_alpha, sp, w);
+            blend_span_premul(dp, blend_src, blend_alpha, w * gli_bpp);
+            sp += src->w * 4;
+            dp += gli_image_s;
+        }
+        return;
+    }
+
+    /* copy opaque spans, blend the rest and skip what is clear */
     for (y = 0; y < h; y++)
     {
-        for (x = 0; x < w; x++)
+        picspan_t *span = src->spans + src->spanrow[sy0 + y];
+        picspan_t *end = src->spans + src->spanrow[sy0 + y + 1];
+
+        for (; span < end; span++)
         {
-            unsigned char sa = sp[x*4+3];
-            unsigned char na = 255 - sa;
-            unsigned char sr = mul255(sp[x*4+0], sa);
-            unsigned char sg = mul255(sp[x*4+1], sa);
-            unsigned char sb = mul255(sp[x*4+2], sa);
-#ifdef __EFL_1BPP__
-            unsigned char sgray = grayscale(sr, sg, sb);
-#endif
-#ifdef WIN32
-            dp[x*3+0] = sb + mul255(dp[x*3+0], na);
-            dp[x*3+1] = sg + mul255(dp[x*3+1], na);
-            dp[x*3+2] = sr + mul255(dp[x*3+2], na);
-#elif defined __APPLE__ || defined __EFL_4BPP__
-            dp[x*4+0] = sb + mul255(dp[x*4+0], na);
-            dp[x*4+1] = sg + mul255(dp[x*4+1], na);
-            dp[x*4+2] = sr + mul255(dp[x*4+2], na);
-            dp[x*4+3] = 0xFF;
-#elif defined __EFL_1BPP__
-            dp[x] = sgray + mul255(dp[x], na);
-#else
-            dp[x*3+0] = sr + mul255(dp[x*3+0], na);
-            dp[x*3+1] = sg + mul255(dp[x*3+1], na);
-            dp[x*3+2] = sb + mul255(dp[x*3+2], na);
-#endif
+            int a = span->x0 > sx0 ? span->x0 : sx0;
+            int b = span->x1 < sx1 ? span->x1 : sx1;
+            if (a >= b)
+                continue;
+            if (span->opaque)
+                blend_copy_rgba(dp + (a - sx0) * gli_bpp, sp + (a - sx0) * 4, b - a);
+            else
+            {
+                blend_fill_rgba(blend_src, blend_alpha, sp + (a - sx0) * 4, b - a);
+                blend_span_premul(dp + (a - sx0) * gli_bpp, blend_src, blend_alpha, (b - a) * gli_bpp);
+            }
         }
+
         sp += src->w * 4;
         dp += gli_image_s;
     }
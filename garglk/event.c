@@ -92,6 +92,10 @@ void gli_dispatch_event(event_t *event, int polled)
 {
     event_t *dispatch;
 
+    /* the toolkit is about to wait, so show what has changed */
+    if (gli_redraw_pending || gli_force_redraw)
+        gli_windows_redraw();
+
     if (!polled)
     {
         dispatch = gli_retrieve_event(gli_events_logged);
@@ -147,6 +151,7 @@ void glk_select(event_t *event)
         gli_input_guess_focus();
         gli_first_event = TRUE;
     }
+    gli_streams_flush(FALSE);
     gli_select(event, 0);
 }
 
@@ -157,12 +162,15 @@ void glk_select_poll(event_t *event)
         gli_input_guess_focus();
         gli_first_event = TRUE;
     }
+    gli_streams_flush(FALSE);
     gli_select(event, 1);
 }
 
 void glk_tick()
 {
-    /* Do nothing. */
+    /* push out file output that has waited too long */
+    if (gli_streams_dirty)
+        gli_streams_flush(TRUE);
 }
 
 /* Handle a keystroke. */
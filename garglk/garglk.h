@@ -28,6 +28,7 @@
  * http://www.eblong.com/zarf/glk/index.html
  */
 
+#include <time.h>
 #include "gi_dispa.h"
 
 /* First, we define our own TRUE and FALSE and NULL, because ANSI
@@ -99,6 +100,7 @@ extern window_t *gli_focuswin;
 extern event_t *gli_curevent;
 
 extern int gli_force_redraw;
+extern int gli_redraw_pending;
 extern int gli_more_focus;
 extern int gli_cellw;
 extern int gli_cellh;
@@ -126,9 +128,11 @@ extern int gli_cellh;
 
 typedef struct rect_s rect_t;
 typedef struct picture_s picture_t;
-typedef struct piclist_s piclist_t;
+typedef struct picspan_s picspan_t;
 typedef struct style_s style_t;
 typedef struct mask_s mask_t;
+typedef struct maskspan_s maskspan_t;
+typedef struct maskrow_s maskrow_t;
 
 struct rect_s
 {
@@ -136,6 +140,16 @@ struct rect_s
     int x1, y1;
 };
 
+/* a run of pixels in a picture row that are all opaque, or some not */
+struct picspan_s
+{
+    int x0, x1;
+    int opaque;
+};
+
+/* rgba is premultiplied by alpha. The spans of row y are
+ * spans[spanrow[y]] up to spans[spanrow[y + 1]]; fully transparent
+ * runs have none, and spanrow is NULL if the table could not be built. */
 struct picture_s
 {
     int refcount;
@@ -143,13 +157,8 @@ struct picture_s
     unsigned char *rgba;
     unsigned long id;
     int scaled;
-};
-
-struct piclist_s
-{
-    picture_t *picture;
-    picture_t *scaled;
-    struct piclist_s *next;
+    picspan_t *spans;
+    int *spanrow;
 };
 
 struct style_s
@@ -160,11 +169,27 @@ struct style_s
     int reverse;
 };
 
+/* a run of pixels [x0, x1) on one row that belongs to a hyperlink */
+struct maskspan_s
+{
+    int x0, x1;
+    glui32 link;
+};
+
+/* sorted, non-overlapping link spans for one pixel row */
+struct maskrow_s
+{
+    int count;
+    int size;
+    maskspan_t *spans;
+};
+
 struct mask_s
 {
     int hor;
     int ver;
-    glui32 **links;
+    int nrows;
+    maskrow_t *rows;
     rect_t select;
 };
 
@@ -219,6 +244,17 @@ extern int gli_tmarginx;
 extern int gli_tmarginy;
 
 extern int gli_conf_lcd;
+extern int gli_conf_glyphcache;
+extern int gli_conf_lazyglyphs;
+extern int gli_conf_glyphwarmup;
+extern int gli_conf_scrollback;
+extern int gli_conf_flushsize;
+extern int gli_conf_flushtime;
+extern int gli_conf_piccache;
+extern int gli_conf_picthreads;
+extern int gli_conf_picprefetch;
+extern int gli_conf_scalethreads;
+extern int gli_conf_soundcache;
 
 extern int gli_conf_graphics;
 extern int gli_conf_sound;
@@ -335,6 +371,9 @@ struct glk_stream_struct
     FILE *file;
     glui32 lastop; /* 0, filemode_Write, or filemode_Read */
     int textfile;
+    char *filebuf; /* stdio buffer, flushsize kilobytes */
+    glui32 unflushed; /* bytes written since the last fflush */
+    time_t dirtytime; /* when those bytes started to accumulate */
 
     /* for strtype_Memory */
     void *buf;		/* unsigned char* for latin1, glui32* for unicode */
@@ -433,12 +472,16 @@ struct window_pair_s
     glui32 wborder;  /* winMethod_Border, NoBorder */
 };
 
-/* One line of the grid window. */
+/* One line of the grid window, and what is on screen for it. */
 typedef struct tgline_s
 {
     int dirty;
-    glui32 chars[256];
-    attr_t attrs[256];
+    int dirtyx0, dirtyx1; /* cells changed since the last redraw */
+    int drawn; /* shownchars and shownattrs match the screen */
+    glui32 *chars;
+    attr_t *attrs;
+    glui32 *shownchars;
+    attr_t *shownattrs;
 } tgline_t;
 
 struct window_textgrid_s
@@ -446,7 +489,8 @@ struct window_textgrid_s
     window_t *owner;
 
     int width, height;
-    tgline_t lines[256];
+    int cols, rows; /* allocated, at least width by height */
+    tgline_t *lines;
 
     int curx, cury; /* the window cursor position */
 
@@ -463,14 +507,40 @@ struct window_textgrid_s
     style_t styles[style_NUMSTYLES];
 };
 
+/* scrollback text is packed into blocks taken from a shared pool */
+#define TBCHUNKSIZE 32768
+
+typedef struct tbchunk_s tbchunk_t;
+typedef struct tbspan_s tbspan_t;
+
+struct tbchunk_s
+{
+    tbchunk_t *next;
+    int used;			/* bytes handed out */
+    int live;			/* lines still stored here */
+    unsigned char data[TBCHUNKSIZE];
+};
+
+/* a run of characters sharing the same attributes */
+struct tbspan_s
+{
+    attr_t attr;
+    int len;
+};
+
 typedef struct tbline_s
 {
     int len, newline, dirty, repaint;
     picture_t *lpic, *rpic;
     glui32 lhyper, rhyper;
     int lm, rm;
-    glui32 chars[TBLINELEN];
-    attr_t attrs[TBLINELEN];
+
+    /* packed text, unused for line 0 which lives in chars/attrs */
+    tbchunk_t *chunk;
+    tbspan_t *spans;
+    void *text;			/* glui32* if wide, else unsigned char* */
+    short nspans;
+    short wide;
 } tbline_t;
 
 struct window_textbuffer_s
@@ -483,10 +553,17 @@ struct window_textbuffer_s
 
     tbline_t *lines;
     int scrollback;
+    int linehead;		/* index in lines of line 0 */
+    int reflowed;		/* lines below this are wrapped to width */
+    int pictall;		/* height of the tallest picture in the history */
 
     int numchars;		/* number of chars in last line: lines[0] */
-    glui32 *chars;		/* alias to lines[0].chars */
-    attr_t *attrs;		/* alias to lines[0].attrs */
+    glui32 *chars;		/* text of lines[0], TBLINELEN long */
+    attr_t *attrs;		/* attributes of lines[0] */
+
+    /* packed scrollback, oldest block first */
+    tbchunk_t *chunkhead, *chunktail;
+    int nchunks;
 
     /* adjust margins temporarily for images */
     int ladjw;
@@ -554,7 +631,7 @@ struct glk_schannel_struct
     int volume;
     glui32 loop;
     int notify;
-    int buffered;
+    void *stream; /* sndsdl.c decode thread and PCM ring */
 
     gidispatch_rock_t disprock;
     channel_t *chain_next, *chain_prev;
@@ -652,12 +729,19 @@ extern void gli_stream_fill_result(stream_t *str,
     stream_result_t *result);
 extern void gli_stream_echo_line(stream_t *str, char *buf, glui32 len);
 extern void gli_stream_echo_line_uni(stream_t *str, glui32 *buf, glui32 len);
+extern void gli_streams_flush(int expired);
+extern int gli_streams_dirty;
 
 extern fileref_t *gli_new_fileref(char *filename, glui32 usage,
     glui32 rock);
 extern void gli_delete_fileref(fileref_t *fref);
 
 void gli_initialize_fonts(void);
+void gli_draw_begin_frame(void);
+void gli_damage_rect(int x0, int y0, int x1, int y1);
+void gli_damage_begin(int x0, int y0, int x1, int y1);
+void gli_damage_end(void);
+void gli_damage_flush(void);
 void gli_draw_pixel(int x, int y, unsigned char alpha, unsigned char *rgb);
 void gli_draw_clear(unsigned char *rgb);
 void gli_draw_rect(int x, int y, int w, int h, unsigned char *rgb);
@@ -665,9 +749,25 @@ int gli_draw_string(int x, int y, int f, unsigned char *rgb, unsigned char *text
 int gli_string_width(int f, unsigned char *text, int len, int spw);
 int gli_draw_string_uni(int x, int y, int f, unsigned char *rgb, glui32 *text, int len, int spacewidth);
 int gli_string_width_uni(int f, glui32 *text, int len, int spw);
+void gli_draw_grid_uni(int x, int y, int f, unsigned char *rgb, glui32 *text, int len, int cellw, int x0, int x1);
 void gli_draw_caret(int x, int y);
 void gli_draw_picture(picture_t *pic, int x, int y, int x0, int y0, int x1, int y1);
 
+typedef struct gli_thread_s gli_thread_t;
+typedef struct gli_mutex_s gli_mutex_t;
+typedef struct gli_sem_s gli_sem_t;
+
+gli_thread_t *gli_thread_create(void (*func)(void *), void *arg);
+void gli_thread_join(gli_thread_t *thread);
+gli_mutex_t *gli_mutex_create(void);
+void gli_mutex_destroy(gli_mutex_t *mutex);
+void gli_mutex_lock(gli_mutex_t *mutex);
+void gli_mutex_unlock(gli_mutex_t *mutex);
+gli_sem_t *gli_sem_create(void);
+void gli_sem_destroy(gli_sem_t *sem);
+void gli_sem_post(gli_sem_t *sem);
+void gli_sem_wait(gli_sem_t *sem);
+
 void gli_startup(int argc, char *argv[]);
 void gli_read_config(int argc, char **argv);
 
@@ -695,13 +795,19 @@ void fontunload(void);
 
 int giblorb_is_resource_map();
 void giblorb_get_resource(glui32 usage, glui32 resnum, FILE **file, long *pos, long *len, glui32 *type);
+int giblorb_get_resource_data(glui32 usage, glui32 resnum, unsigned char **data, long *len, glui32 *type);
 
 picture_t *gli_picture_load(unsigned long id);
+int gli_picture_get_info(unsigned long id, int *w, int *h);
+void gli_picture_scan(void);
 void gli_picture_store(picture_t *pic);
-picture_t *gli_picture_retrieve(unsigned long id, int scaled);
+void gli_picture_spans(picture_t *pic);
+picture_t *gli_picture_retrieve(unsigned long id, int w, int h);
 picture_t *gli_picture_scale(picture_t *src, int destwidth, int destheight);
 void gli_piclist_increment(void);
 void gli_piclist_decrement(void);
+void gli_picture_increment(picture_t *pic);
+void gli_picture_decrement(picture_t *pic);
 
 window_graphics_t *win_graphics_create(window_t *win);
 void win_graphics_destroy(window_graphics_t *cutwin);
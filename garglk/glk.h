@@ -478,6 +478,67 @@ extern void garglk_set_zcolors_stream(strid_t str, glui32 fg, glui32 bg);
 extern void garglk_set_reversevideo(glui32 reverse);
 extern void garglk_set_reversevideo_stream(strid_t str, glui32 reverse);
 
+/* garglk_glyph_cache_stats - reports the state of the glyph atlases,
+ * kerning caches and shaped-run cache, summed over all fonts. kernframe
+ * counts the kerning lookups made since the last window redraw began;
+ * kernallocs counts every allocation the kerning caches have made, so it
+ * stays constant during steady-state text output. Meant for debugging
+ * and tuning. */
+typedef struct garglk_glyphstats_struct {
+    glui32 hits;
+    glui32 misses;
+    glui32 evictions;
+    glui32 bytes;
+    glui32 capacity;
+    glui32 kernlookups;
+    glui32 kernframe;
+    glui32 kernallocs;
+    glui32 runhits;
+    glui32 runmisses;
+} garglk_glyphstats_t;
+
+extern void garglk_glyph_cache_stats(garglk_glyphstats_t *stats);
+
+/* garglk_frame_stats - reports what was handed to the toolkit for display.
+ * regions and pixels describe the last frame that changed anything, after
+ * merging; the totals add up every frame since startup. Meant for
+ * debugging and tuning. */
+typedef struct garglk_framestats_struct {
+    glui32 frames;
+    glui32 regions;
+    glui32 pixels;
+    glui32 totalregions;
+    glui32 totalpixels;
+} garglk_framestats_t;
+
+extern void garglk_frame_stats(garglk_framestats_t *stats);
+
+/* garglk_picture_cache_stats - reports on the decoded picture cache.
+ * Lookups count originals and scaled variants alike; evictions count
+ * pictures dropped to stay within the piccache budget. decodems is the
+ * time spent decoding on any thread; stallms is how long drawing was
+ * held up, decoding itself or waiting on a busy worker. Meant for
+ * debugging and tuning. */
+typedef struct garglk_picstats_struct {
+    glui32 hits;
+    glui32 misses;
+    glui32 evictions;
+    glui32 pictures;
+    glui32 bytes;
+    glui32 capacity;
+    glui32 decodes;
+    glui32 prefetched;
+    glui32 stalls;
+    glui32 decodems;
+    glui32 stallms;
+} garglk_picstats_t;
+
+extern void garglk_picture_cache_stats(garglk_picstats_t *stats);
+
+/* garglk_image_prefetch - hints that an image will be drawn soon, so it
+ * can be decoded in the background beforehand. */
+extern void garglk_image_prefetch(glui32 image);
+
 /* non standard keycodes */
 #define keycode_Erase               (0xffffef7f)
 #define keycode_MouseWheelUp        (0xffffeffe)
@@ -0,0 +1,363 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright (C) 2010 by Ben Cressey.                                         *
+ *                                                                            *
+ * This file is part of Gargoyle.                                             *
+ *                                                                            *
+ * Gargoyle is free software; you can redistribute it and/or modify           *
+ * it under the terms of the GNU General Public License as published by       *
+ * the Free Software Foundation; either version 2 of the License, or          *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * Gargoyle is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with Gargoyle; if not, write to the Free Software                    *
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA *
+ *                                                                            *
+ *****************************************************************************/
+
+/*
+ * Micro-benchmarks for the library. This is an ordinary Glk program:
+ *
+ *   glkbench [name ...]
+ *
+ * runs the named benchmarks, or all of them, and reports the results in
+ * its window and on standard output.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "glk.h"
+#include "glkstart.h"
+#include "garglk.h"
+
+glkunix_argumentlist_t glkunix_arguments[] =
+{
+    { "", glkunix_arg_ValueFollows, "benchmarks to run (default all)" },
+    { NULL, glkunix_arg_End, NULL }
+};
+
+static winid_t mainwin = NULL;
+
+static int benchargc = 0;
+static char **benchargv = NULL;
+
+static double now(void)
+{
+    glktimeval_t t;
+    glk_current_time(&t);
+    return (double)t.high_sec * 4294967296.0 + t.low_sec + t.microsec / 1e6;
+}
+
+static void report(char *fmt, ...)
+{
+    char buf[256];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsprintf(buf, fmt, ap);
+    va_end(ap);
+
+    printf("%s\n", buf);
+    fflush(stdout);
+
+    if (mainwin)
+    {
+        glk_put_string_stream(glk_window_get_stream(mainwin), buf);
+        glk_put_char_stream(glk_window_get_stream(mainwin), '\n');
+    }
+}
+
+/*
+ * Glyph blending: fill the framebuffer with text in the regular, bold,
+ * italic and fixed faces, a screenful at a time.
+ */
+
+static void bench_glyphs(void)
+{
+    static const char sample[] =
+        "The quick brown fox jumps over the lazy dog; "
+        "PACK MY BOX WITH FIVE DOZEN LIQUOR JUGS! 0123456789 ";
+    static const int faces[] = { PROPR, PROPB, PROPI, MONOR };
+    glui32 text[sizeof sample];
+    int len = sizeof sample - 1;
+    long glyphs = 0;
+    int frames = 1000;
+    double t0, t1;
+    int i, x, y, n;
+
+    if (!gli_image_rgb || gli_image_w <= 0 || gli_image_h <= gli_leading)
+    {
+        report("glyphs: no framebuffer");
+        return;
+    }
+
+    for (i = 0; i < len; i++)
+        text[i] = (unsigned char)sample[i];
+
+    t0 = now();
+    for (n = 0; n < frames; n++)
+    {
+        gli_draw_begin_frame();
+        gli_draw_clear(gli_window_color);
+        i = n;
+        for (y = 0; y + gli_leading <= gli_image_h; y += gli_leading)
+        {
+            x = 0;
+            while (x < gli_image_w * GLI_SUBPIX)
+            {
+                x = gli_draw_string_uni(x, y + gli_baseline,
+                        faces[i++ % 4], gli_more_color, text, len, -1);
+                glyphs += len;
+            }
+        }
+    }
+    t1 = now();
+
+    gli_force_redraw = 1;
+
+    report("glyphs: %ld in %.3fs, %.0f glyphs/sec",
+            glyphs, t1 - t0, glyphs / (t1 - t0));
+}
+
+/*
+ * Text buffer output: print a long transcript into the main window,
+ * redrawing it every hundred lines as a game would after each turn. This
+ * runs once with the configured scrollback, where nothing falls off the
+ * end by default, and once with a 256 KB limit, where most of it does.
+ */
+
+static double printlines(int lines)
+{
+    char buf[100];
+    double t0, t1;
+    int i;
+
+    glk_window_clear(mainwin);
+
+    t0 = now();
+    for (i = 0; i < lines; i++)
+    {
+        sprintf(buf, "%d. You are standing in an open field west of a white house.\n", i);
+        glk_put_string(buf);
+        if (i % 100 == 99)
+            gli_windows_redraw();
+    }
+    gli_windows_redraw();
+    t1 = now();
+
+    return t1 - t0;
+}
+
+/* time a full redraw of the main window */
+static double redrawtime(void)
+{
+    int frames = 100;
+    double t0, t1;
+    int i;
+
+    t0 = now();
+    for (i = 0; i < frames; i++)
+    {
+        gli_force_redraw = 1;
+        gli_windows_redraw();
+    }
+    t1 = now();
+
+    return (t1 - t0) / frames;
+}
+
+static void bench_lines(void)
+{
+    int lines = 100000;
+    int scrollback = gli_conf_scrollback;
+    double t, r;
+
+    t = printlines(lines);
+    r = redrawtime();
+    glk_window_clear(mainwin);
+    report("lines: %d in %.3fs, %.0f lines/sec, then %.2fms per redraw",
+            lines, t, lines / t, r * 1000);
+
+    gli_conf_scrollback = 256;
+    t = printlines(lines);
+    r = redrawtime();
+    glk_window_clear(mainwin);
+    gli_conf_scrollback = scrollback;
+    report("lines: %d in %.3fs, %.0f lines/sec, then %.2fms per redraw, with 256 KB of scrollback",
+            lines, t, lines / t, r * 1000);
+}
+
+/*
+ * Text buffer resizing: fill the history with paragraphs of different
+ * lengths, then make the window narrower and wider again, timing how
+ * long it takes to re-wrap the text each time.
+ */
+
+static void bench_rearrange(void)
+{
+    static const char sentence[] = " The quick brown fox jumps over the lazy dog.";
+    char buf[400];
+    rect_t box, small;
+    int lines = 10000;
+    int resizes = 20;
+    int kept;
+    double t0, t1, total, worst;
+    int i, k;
+
+    glk_window_clear(mainwin);
+
+    for (i = 0; i < lines; i++)
+    {
+        sprintf(buf, "%d.", i);
+        for (k = 0; k < i % 7; k++)
+            strcat(buf, sentence);
+        strcat(buf, "\n");
+        glk_put_string(buf);
+    }
+
+    box = mainwin->bbox;
+    small = box;
+    small.x1 = box.x0 + (box.x1 - box.x0) * 2 / 3;
+
+    total = 0;
+    worst = 0;
+    for (i = 0; i < resizes; i++)
+    {
+        t0 = now();
+        win_textbuffer_rearrange(mainwin, i % 2 ? &box : &small);
+        t1 = now();
+        total += t1 - t0;
+        if (t1 - t0 > worst)
+            worst = t1 - t0;
+    }
+
+    win_textbuffer_rearrange(mainwin, &box);
+    kept = ((window_textbuffer_t *)mainwin->data)->scrollmax;
+    glk_window_clear(mainwin);
+
+    report("rearrange: %d lines, %.2fms per resize, %.2fms at most, %d lines kept",
+            lines, total * 1000 / resizes, worst * 1000, kept);
+}
+
+/* the write system calls made so far, where the system tells us */
+static long writecalls(void)
+{
+    char buf[128];
+    long n = -1;
+    FILE *fp;
+
+    fp = fopen("/proc/self/io", "r");
+    if (!fp)
+        return -1;
+    while (fgets(buf, sizeof buf, fp))
+        if (!strncmp(buf, "syscw:", 6))
+            n = atol(buf + 6);
+    fclose(fp);
+
+    return n;
+}
+
+/*
+ * File streams: write a 10 MB transcript one character at a time.
+ */
+
+static void bench_stream(void)
+{
+    static const char text[] = "abcdefghijklmnopqrstuvwxyz\n";
+    long size = 10 * 1024 * 1024;
+    long calls;
+    double t0, t1;
+    frefid_t fref;
+    strid_t str;
+    long i;
+
+    fref = glk_fileref_create_temp(fileusage_Transcript | fileusage_TextMode, 0);
+    if (!fref)
+    {
+        report("stream: no temporary file");
+        return;
+    }
+
+    str = glk_stream_open_file(fref, filemode_Write, 0);
+    if (!str)
+    {
+        glk_fileref_destroy(fref);
+        report("stream: no temporary file");
+        return;
+    }
+
+    calls = writecalls();
+    t0 = now();
+    for (i = 0; i < size; i++)
+        glk_put_char_stream(str, text[i % (sizeof text - 1)]);
+    glk_stream_close(str, NULL);
+    t1 = now();
+    if (calls >= 0)
+        calls = writecalls() - calls;
+
+    glk_fileref_delete_file(fref);
+    glk_fileref_destroy(fref);
+
+    if (calls >= 0)
+        report("stream: %ld bytes in %.3fs, %.0f bytes/sec, %ld writes",
+                size, t1 - t0, size / (t1 - t0), calls);
+    else
+        report("stream: %ld bytes in %.3fs, %.0f bytes/sec",
+                size, t1 - t0, size / (t1 - t0));
+}
+
+static struct
+{
+    char *name;
+    void (*func)(void);
+} benches[] =
+{
+    { "glyphs", bench_glyphs },
+    { "lines", bench_lines },
+    { "rearrange", bench_rearrange },
+    { "stream", bench_stream },
+};
+
+#define NBENCHES (int)(sizeof benches / sizeof benches[0])
+
+int glkunix_startup_code(glkunix_startup_t *data)
+{
+    benchargc = data->argc - 1;
+    benchargv = data->argv + 1;
+    return TRUE;
+}
+
+void glk_main(void)
+{
+    event_t ev;
+    int i, k;
+
+    mainwin = glk_window_open(0, 0, 0, wintype_TextBuffer, 0);
+    if (!mainwin)
+        return;
+    glk_set_window(mainwin);
+
+    /* let the window system size the framebuffer */
+    glk_select_poll(&ev);
+
+    for (i = 0; i < NBENCHES; i++)
+    {
+        if (benchargc)
+        {
+            for (k = 0; k < benchargc; k++)
+                if (!strcmp(benchargv[k], benches[i].name))
+                    break;
+            if (k == benchargc)
+                continue;
+        }
+        benches[i].func();
+    }
+}
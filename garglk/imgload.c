@@ -23,6 +23,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #include <png.h>
@@ -31,53 +32,82 @@
 #include "glk.h"
 #include "garglk.h"
 #include "gi_blorb.h"
+#include "uthash.h"
 
 #define giblorb_ID_JPEG      (giblorb_make_id('J', 'P', 'E', 'G'))
 #define giblorb_ID_PNG       (giblorb_make_id('P', 'N', 'G', ' '))
 
-static void load_image_png(FILE *fl, picture_t *pic);
-static void load_image_jpeg(FILE *fl, picture_t *pic);
+static void load_image_png(FILE *fl, unsigned char *buf, long len, picture_t *pic);
+static void load_image_jpeg(FILE *fl, unsigned char *buf, long len, picture_t *pic);
 
-static piclist_t *picstore = NULL;	/* cache all loaded pictures */
-static int gli_piclist_refcount = 0;	/* count references to loaded pictures */
+/* jpeg_mem_src() arrived with libjpeg 8 */
+#if JPEG_LIB_VERSION >= 80 || defined(MEM_SRCDST_SUPPORTED)
+#define JPEG_MEMSRC
+#endif
 
-static void gli_picture_discard(picture_t *pic);
+/*
+ * Decoded pictures are cached by id and size, originals being stored
+ * as 0x0. The hash keeps its entries in order of use, least recent
+ * first, so eviction walks it from the front until the cache is back
+ * within its budget. Pictures still shown by a text buffer hold a
+ * reference of their own and are never evicted.
+ */
 
-piclist_t *gli_piclist_search(unsigned long id)
+typedef struct pickey_s
 {
-    piclist_t *picptr;
+    unsigned long id;
+    int w, h;
+} pickey_t;
+
+typedef struct picentry_s
+{
+    pickey_t key;
     picture_t *pic;
+    UT_hash_handle hh;
+} picentry_t;
 
-    picptr = picstore;
+static picentry_t *picstore = NULL;	/* cache all loaded pictures */
+static long picbytes = 0;
+static int gli_piclist_refcount = 0;	/* count references to loaded pictures */
+static garglk_picstats_t picstats;
+static double decodeus, stallus;
+static gli_mutex_t *joblock = NULL;	/* guards the job queue and decode stats */
 
-    while (picptr != NULL)
-    {
-        pic = picptr->picture;
+static void gli_picture_discard(picture_t *pic);
 
-        if (pic && pic->id == id)
-            return picptr;
+static void makekey(pickey_t *key, unsigned long id, int w, int h)
+{
+    /* the key is hashed as raw bytes, padding included */
+    memset(key, 0, sizeof(pickey_t));
+    key->id = id;
+    key->w = w;
+    key->h = h;
+}
 
-        picptr = picptr->next;
-    }
+static long picsize(picture_t *pic)
+{
+    long size = sizeof(picture_t) + (long)pic->w * pic->h * 4;
+    if (pic->spanrow)
+        size += sizeof(int) * (pic->h + 1) + sizeof(picspan_t) * pic->spanrow[pic->h];
+    return size;
+}
 
-    return NULL;
+static void picremove(picentry_t *e)
+{
+    HASH_DEL(picstore, e);
+    picbytes -= picsize(e->pic);
+    gli_picture_decrement(e->pic);
+    free(e);
 }
 
 void gli_piclist_clear(void)
 {
-    piclist_t *picptr, *tmpptr;
-
-    picptr = picstore;
+    picentry_t *e, *tmp;
 
-    while (picptr != NULL)
+    for (e = picstore; e; e = tmp)
     {
-        tmpptr = picptr;
-        picptr = picptr->next;
-
-        gli_picture_discard(tmpptr->picture);
-        gli_picture_discard(tmpptr->scaled);
-
-        free(tmpptr);
+        tmp = e->hh.next;
+        picremove(e);
     }
 
     picstore = NULL;
@@ -94,87 +124,682 @@ void gli_piclist_decrement(void)
         gli_piclist_clear();
 }
 
-void gli_picture_store_original(picture_t *pic)
+void gli_picture_increment(picture_t *pic)
+{
+    pic->refcount++;
+}
+
+void gli_picture_decrement(picture_t *pic)
 {
-    piclist_t *newpic = malloc(sizeof(piclist_t));
-    piclist_t *picptr;
+    if (pic->refcount > 0 && --pic->refcount == 0)
+        gli_picture_discard(pic);
+}
 
-    newpic->picture = pic;
-    newpic->scaled = NULL;
-    newpic->next = NULL;
+/* drop unused pictures, least recently used first, to fit the budget */
+static void gli_picture_evict(picentry_t *keep)
+{
+    picentry_t *e, *tmp;
+    long budget = (long)gli_conf_piccache * 1024;
+
+    if (gli_conf_piccache <= 0)
+        return;
 
-    if (!picstore)
+    for (e = picstore; e; e = tmp)
     {
-        picstore = newpic;
+        tmp = e->hh.next;
+        if (picbytes <= budget)
+            break;
+        if (e == keep || e->pic->refcount > 1)
+            continue;
+        picremove(e);
+        picstats.evictions++;
+    }
+}
+
+void gli_picture_store(picture_t *pic)
+{
+    picentry_t *e;
+    pickey_t key;
+
+    if (!pic)
+        return;
+
+    if (!pic->scaled)
+        makekey(&key, pic->id, 0, 0);
+    else
+        makekey(&key, pic->id, pic->w, pic->h);
+
+    HASH_FIND(hh, picstore, &key, sizeof(pickey_t), e);
+    if (e)
+        picremove(e);
+
+    e = malloc(sizeof(picentry_t));
+    if (!e)
         return;
+
+    e->key = key;
+    e->pic = pic;
+    HASH_ADD(hh, picstore, key, sizeof(pickey_t), e);
+    picbytes += picsize(pic);
+
+    gli_picture_evict(e);
+}
+
+/* look up a picture; a size of 0x0 asks for the original */
+picture_t *gli_picture_retrieve(unsigned long id, int w, int h)
+{
+    picentry_t *e;
+    pickey_t key;
+
+    makekey(&key, id, w, h);
+
+    HASH_FIND(hh, picstore, &key, sizeof(pickey_t), e);
+    if (!e)
+    {
+        picstats.misses++;
+        return NULL;
     }
 
-    picptr = picstore;
+    /* move it to the back, as the most recently used */
+    HASH_DEL(picstore, e);
+    HASH_ADD(hh, picstore, key, sizeof(pickey_t), e);
 
-    while (picptr->next != NULL)
-        picptr = picptr->next;
+    picstats.hits++;
+    return e->pic;
+}
 
-    picptr->next = newpic;
+void garglk_picture_cache_stats(garglk_picstats_t *stats)
+{
+    if (!stats)
+        return;
+
+    if (joblock)
+        gli_mutex_lock(joblock);
+    *stats = picstats;
+    stats->decodems = (glui32)(decodeus / 1000);
+    stats->stallms = (glui32)(stallus / 1000);
+    if (joblock)
+        gli_mutex_unlock(joblock);
+
+    stats->pictures = HASH_COUNT(picstore);
+    stats->bytes = picbytes;
+    stats->capacity = gli_conf_piccache > 0 ? (glui32)gli_conf_piccache * 1024 : 0;
 }
 
-void gli_picture_store_scaled(picture_t *pic)
+static void gli_picture_discard(picture_t *pic)
 {
-    piclist_t *picptr;
+    if (!pic)
+        return;
 
-    picptr = gli_piclist_search(pic->id);
+    if (pic->rgba)
+        free(pic->rgba);
+    if (pic->spans)
+        free(pic->spans);
+    if (pic->spanrow)
+        free(pic->spanrow);
 
-    if (!picptr)
+    free(pic);
+}
+
+/* pictures are kept with their colours premultiplied by alpha */
+static void premultiply(picture_t *pic)
+{
+    unsigned char *p = pic->rgba;
+    long i, n = (long)pic->w * pic->h;
+
+    for (i = 0; i < n; i++, p += 4)
+    {
+        if (p[3] != 0xFF)
+        {
+            p[0] = (p[0] * p[3] + 127) / 255;
+            p[1] = (p[1] * p[3] + 127) / 255;
+            p[2] = (p[2] * p[3] + 127) / 255;
+        }
+    }
+}
+
+#define MINSPAN 8	/* shorter opaque or clear runs are just blended */
+
+/*
+ * Split each row into spans that can be copied straight out, spans that
+ * must be blended, and gaps that need no drawing at all. Short runs are
+ * folded into the blended spans around them, so noisy alpha doesn't make
+ * a table larger than the picture.
+ */
+void gli_picture_spans(picture_t *pic)
+{
+    picspan_t *spans = NULL, *tmp;
+    int *spanrow;
+    int nspans = 0, size = 0;
+    int x, y, x0, kind, last;
+    unsigned char *p;
+
+    spanrow = malloc(sizeof(int) * (pic->h + 1));
+    if (!spanrow)
         return;
 
-    if (picptr->scaled)
-        gli_picture_discard(picptr->scaled);
+    for (y = 0; y < pic->h; y++)
+    {
+        spanrow[y] = nspans;
+        p = pic->rgba + (long)y * pic->w * 4;
+        last = -1;
+
+        for (x = 0; x < pic->w; x = x0)
+        {
+            /* kind is 0 for clear, 1 to blend and 2 for opaque */
+            x0 = x;
+            kind = p[x * 4 + 3] == 0xFF ? 2 : p[x * 4 + 3] ? 1 : 0;
+            while (x0 < pic->w && (p[x0 * 4 + 3] == 0xFF ? 2 : p[x0 * 4 + 3] ? 1 : 0) == kind)
+                x0++;
+
+            if (kind != 1 && x0 - x < MINSPAN && x > 0 && x0 < pic->w)
+                kind = 1;
+            if (!kind)
+                continue;
+
+            if (last == kind && spans[nspans - 1].x1 == x)
+            {
+                spans[nspans - 1].x1 = x0;
+                continue;
+            }
+
+            if (nspans == size)
+            {
+                size = size ? size * 2 : 64;
+                tmp = realloc(spans, sizeof(picspan_t) * size);
+                if (!tmp)
+                {
+                    free(spans);
+                    free(spanrow);
+                    return;
+                }
+                spans = tmp;
+            }
+
+            spans[nspans].x0 = x;
+            spans[nspans].x1 = x0;
+            spans[nspans].opaque = kind == 2;
+            nspans++;
+            last = kind;
+        }
+    }
 
-    picptr->scaled = pic;
+    spanrow[pic->h] = nspans;
+
+    pic->spans = spans;
+    pic->spanrow = spanrow;
 }
 
-void gli_picture_store(picture_t *pic)
+/* microseconds on the monotonic profiling clock */
+static double picclock(void)
+{
+    glktimeval_t t;
+    wincounter(&t);
+    return ((double)t.high_sec * 4294967296.0 + t.low_sec) * 1000000.0 + t.microsec;
+}
+
+/* decode a picture from a file or from memory; safe on any thread */
+static picture_t *decodepicture(unsigned long id, FILE *fl,
+        unsigned char *data, long len, glui32 chunktype)
 {
+    picture_t *pic;
+
+    pic = malloc(sizeof(picture_t));
     if (!pic)
-        return;
+        return NULL;
 
-    if (!pic->scaled)
-        gli_picture_store_original(pic);
+    pic->refcount = 1;
+    pic->w = 0;
+    pic->h = 0;
+    pic->rgba = NULL;
+    pic->id = id;
+    pic->scaled = FALSE;
+    pic->spans = NULL;
+    pic->spanrow = NULL;
+
+    if (chunktype == giblorb_ID_PNG)
+        load_image_png(fl, data, len, pic);
+
+    if (chunktype == giblorb_ID_JPEG)
+        load_image_jpeg(fl, data, len, pic);
+
+    if (!pic->rgba)
+    {
+        free(pic);
+        return NULL;
+    }
+
+    premultiply(pic);
+    gli_picture_spans(pic);
+
+    return pic;
+}
+
+/* larger pictures are left for the decoder to deal with when drawn */
+#define PICMAXSIZE 16384
+
+/* read the size of an image from its header without decoding it */
+static int picheader(unsigned char *buf, long len, glui32 chunktype, int *w, int *h)
+{
+    glui32 pw, ph;
+    long i;
+
+    if (chunktype == giblorb_ID_PNG)
+    {
+        if (len < 24 || png_sig_cmp(buf, 0, 8) || memcmp(buf + 12, "IHDR", 4))
+            return FALSE;
+        pw = ((glui32)buf[16] << 24) | ((glui32)buf[17] << 16) | ((glui32)buf[18] << 8) | buf[19];
+        ph = ((glui32)buf[20] << 24) | ((glui32)buf[21] << 16) | ((glui32)buf[22] << 8) | buf[23];
+        if (pw == 0 || ph == 0 || pw > PICMAXSIZE || ph > PICMAXSIZE)
+            return FALSE;
+        *w = pw;
+        *h = ph;
+        return TRUE;
+    }
+
+    if (chunktype == giblorb_ID_JPEG)
+    {
+        if (len < 4 || buf[0] != 0xFF || buf[1] != 0xD8)
+            return FALSE;
+
+        /* walk the markers up to the start of frame */
+        i = 2;
+        while (i + 4 <= len)
+        {
+            int marker, seglen;
+
+            if (buf[i] != 0xFF)
+                return FALSE;
+            marker = buf[i + 1];
+            if (marker == 0xFF)
+            {
+                i++;
+                continue;
+            }
+            if (marker == 0xD8 || marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+            {
+                i += 2;
+                continue;
+            }
+
+            seglen = (buf[i + 2] << 8) | buf[i + 3];
+            if (marker >= 0xC0 && marker <= 0xCF
+                    && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+            {
+                if (i + 9 > len)
+                    return FALSE;
+                ph = (buf[i + 5] << 8) | buf[i + 6];
+                pw = (buf[i + 7] << 8) | buf[i + 8];
+                if (pw == 0 || ph == 0 || pw > PICMAXSIZE || ph > PICMAXSIZE)
+                    return FALSE;
+                *w = pw;
+                *h = ph;
+                return TRUE;
+            }
+            if (marker == 0xD9 || marker == 0xDA)
+                return FALSE;
+            i += 2 + seglen;
+        }
+    }
+
+    return FALSE;
+}
+
+/*
+ * Pictures in a mapped blorb can be decoded ahead of use by a small
+ * pool of worker threads. Jobs are queued when a picture's size is
+ * asked for, when the game hints at it, and for every picture in the
+ * file at startup within the picprefetch budget. Workers only fill in
+ * the job; the main thread adopts the result into the cache when the
+ * picture is first drawn, and only waits if a worker is still busy
+ * with it.
+ */
+
+enum { JOB_QUEUED, JOB_BUSY, JOB_DONE };
+
+typedef struct picjob_s
+{
+    unsigned long id;
+    unsigned char *data;
+    long len;
+    glui32 type;
+    long size;			/* decoded size estimated from the header */
+    int state;
+    picture_t *pic;
+    struct picjob_s *prev, *next;	/* queue of jobs not yet started */
+    UT_hash_handle hh;
+} picjob_t;
+
+static picjob_t *picjobs = NULL;	/* all jobs not yet adopted, by id */
+static picjob_t *jobhead = NULL, *jobtail = NULL;
+static long jobbytes = 0;
+static gli_sem_t *jobwork = NULL;	/* posted once per queued job */
+static gli_sem_t *jobdone = NULL;	/* posted whenever a job finishes */
+static gli_thread_t **jobthreads = NULL;
+static int jobstop = FALSE;		/* tells the workers to exit */
+static int picworkers = -1;
+
+static void jobunlink(picjob_t *job)
+{
+    if (job->prev)
+        job->prev->next = job->next;
+    else
+        jobhead = job->next;
+    if (job->next)
+        job->next->prev = job->prev;
     else
-        gli_picture_store_scaled(pic);
+        jobtail = job->prev;
+    job->prev = job->next = NULL;
 }
 
-picture_t *gli_picture_retrieve(unsigned long id, int scaled)
+static void joblink(picjob_t *job, int urgent)
 {
-    piclist_t *picptr;
+    if (urgent)
+    {
+        job->prev = NULL;
+        job->next = jobhead;
+        if (jobhead)
+            jobhead->prev = job;
+        else
+            jobtail = job;
+        jobhead = job;
+    }
+    else
+    {
+        job->next = NULL;
+        job->prev = jobtail;
+        if (jobtail)
+            jobtail->next = job;
+        else
+            jobhead = job;
+        jobtail = job;
+    }
+}
+
+static void picworker(void *arg)
+{
+    picjob_t *job;
     picture_t *pic;
+    double start;
+
+    while (1)
+    {
+        gli_sem_wait(jobwork);
+
+        gli_mutex_lock(joblock);
+        if (jobstop)
+        {
+            gli_mutex_unlock(joblock);
+            break;
+        }
+        job = jobhead;
+        if (job)
+        {
+            jobunlink(job);
+            job->state = JOB_BUSY;
+        }
+        gli_mutex_unlock(joblock);
+
+        /* the main thread may have taken the job itself */
+        if (!job)
+            continue;
 
-    picptr = picstore;
+        start = picclock();
+        pic = decodepicture(job->id, NULL, job->data, job->len, job->type);
 
-    while (picptr != NULL)
+        gli_mutex_lock(joblock);
+        decodeus += picclock() - start;
+        picstats.decodes++;
+        if (pic)
+            picstats.prefetched++;
+        job->pic = pic;
+        job->state = JOB_DONE;
+        gli_mutex_unlock(joblock);
+
+        gli_sem_post(jobdone);
+    }
+}
+
+/* stop the workers before the blorb file goes away under them */
+static void picshutdown(void)
+{
+    int i;
+
+    gli_mutex_lock(joblock);
+    jobstop = TRUE;
+    gli_mutex_unlock(joblock);
+
+    for (i = 0; i < picworkers; i++)
+        gli_sem_post(jobwork);
+    for (i = 0; i < picworkers; i++)
+        gli_thread_join(jobthreads[i]);
+
+    picworkers = 0;
+}
+
+static int picstartup(void)
+{
+    gli_thread_t *thread;
+    int i;
+
+    if (picworkers >= 0)
+        return picworkers > 0;
+
+    picworkers = 0;
+
+    if (gli_conf_picthreads <= 0)
+        return FALSE;
+
+    joblock = gli_mutex_create();
+    jobwork = gli_sem_create();
+    jobdone = gli_sem_create();
+    jobthreads = malloc(sizeof(gli_thread_t *) * gli_conf_picthreads);
+    if (!joblock || !jobwork || !jobdone || !jobthreads)
+        return FALSE;
+
+    for (i = 0; i < gli_conf_picthreads; i++)
     {
-        if (!scaled)
-            pic = picptr->picture;
-        else
-            pic = picptr->scaled;
+        thread = gli_thread_create(picworker, NULL);
+        if (thread)
+            jobthreads[picworkers++] = thread;
+    }
 
-        if (pic && pic->id == id)
-            return pic;
+    if (picworkers > 0)
+        atexit(picshutdown);
 
-        picptr = picptr->next;
+    return picworkers > 0;
+}
+
+/* queue a picture for decoding, reporting its size if known */
+static int picqueue(unsigned long id, int urgent, int *w, int *h)
+{
+    picjob_t *job;
+    unsigned char *data;
+    long len;
+    glui32 type;
+    long size;
+
+    if (!gli_conf_graphics || !picstartup())
+        return FALSE;
+
+    if (!giblorb_get_resource_data(giblorb_ID_Pict, id, &data, &len, &type))
+        return FALSE;
+#ifndef JPEG_MEMSRC
+    if (type == giblorb_ID_JPEG)
+        return FALSE;
+#endif
+    if (!picheader(data, len, type, w, h))
+        return FALSE;
+
+    gli_mutex_lock(joblock);
+
+    HASH_FIND(hh, picjobs, &id, sizeof(unsigned long), job);
+    if (job)
+    {
+        if (urgent && job->state == JOB_QUEUED)
+        {
+            jobunlink(job);
+            joblink(job, TRUE);
+        }
+        gli_mutex_unlock(joblock);
+        return TRUE;
+    }
+
+    size = sizeof(picture_t) + (long)*w * *h * 4;
+    if (!urgent && gli_conf_picprefetch > 0
+            && jobbytes + size > (long)gli_conf_picprefetch * 1024)
+    {
+        gli_mutex_unlock(joblock);
+        return TRUE;
     }
 
-    return NULL;
+    job = calloc(1, sizeof(picjob_t));
+    if (!job)
+    {
+        gli_mutex_unlock(joblock);
+        return TRUE;
+    }
+
+    job->id = id;
+    job->data = data;
+    job->len = len;
+    job->type = type;
+    job->size = size;
+    job->state = JOB_QUEUED;
+    HASH_ADD(hh, picjobs, id, sizeof(unsigned long), job);
+    joblink(job, urgent);
+    jobbytes += size;
+
+    gli_mutex_unlock(joblock);
+
+    gli_sem_post(jobwork);
+    return TRUE;
 }
 
-static void gli_picture_discard(picture_t *pic)
+/* take over a queued or decoded picture, waiting on a busy worker */
+static picture_t *picadopt(unsigned long id)
 {
-    if (!pic)
+    picjob_t *job;
+    picture_t *pic;
+    double start;
+
+    if (picworkers <= 0)
+        return NULL;
+
+    gli_mutex_lock(joblock);
+
+    HASH_FIND(hh, picjobs, &id, sizeof(unsigned long), job);
+    if (!job)
+    {
+        gli_mutex_unlock(joblock);
+        return NULL;
+    }
+
+    if (job->state == JOB_QUEUED)
+    {
+        /* not started yet, so decode it here */
+        jobunlink(job);
+        job->state = JOB_BUSY;
+        gli_mutex_unlock(joblock);
+
+        start = picclock();
+        job->pic = decodepicture(id, NULL, job->data, job->len, job->type);
+
+        gli_mutex_lock(joblock);
+        decodeus += picclock() - start;
+        stallus += picclock() - start;
+        picstats.decodes++;
+        job->state = JOB_DONE;
+    }
+
+    if (job->state == JOB_BUSY)
+    {
+        start = picclock();
+        picstats.stalls++;
+        while (job->state != JOB_DONE)
+        {
+            gli_mutex_unlock(joblock);
+            gli_sem_wait(jobdone);
+            gli_mutex_lock(joblock);
+        }
+        stallus += picclock() - start;
+    }
+
+    pic = job->pic;
+    HASH_DEL(picjobs, job);
+    jobbytes -= job->size;
+    free(job);
+
+    gli_mutex_unlock(joblock);
+
+    return pic;
+}
+
+/* look in the cache without counting it as a use */
+static picture_t *picpeek(unsigned long id)
+{
+    picentry_t *e;
+    pickey_t key;
+
+    makekey(&key, id, 0, 0);
+    HASH_FIND(hh, picstore, &key, sizeof(pickey_t), e);
+    return e ? e->pic : NULL;
+}
+
+void garglk_image_prefetch(glui32 image)
+{
+    int w, h;
+
+    if (picpeek(image))
         return;
 
-    if (pic->rgba)
-        free(pic->rgba);
+    picqueue(image, FALSE, &w, &h);
+}
 
-    free(pic);
+/* queue every picture in the blorb file, up to the prefetch budget */
+void gli_picture_scan(void)
+{
+    giblorb_map_t *map;
+    glui32 num, min, max, id, found;
+    unsigned char *data;
+    int w, h;
+
+    map = giblorb_get_resource_map();
+    if (!map || !gli_conf_graphics || gli_conf_picthreads <= 0)
+        return;
+
+    if (giblorb_count_resources(map, giblorb_ID_Pict, &num, &min, &max))
+        return;
+
+    found = 0;
+    for (id = min; found < num; id++)
+    {
+        if (giblorb_get_resource_data(giblorb_ID_Pict, id, &data, NULL, NULL))
+        {
+            found++;
+            picqueue(id, FALSE, &w, &h);
+        }
+        if (id == max)
+            break;
+    }
+}
+
+int gli_picture_get_info(unsigned long id, int *w, int *h)
+{
+    picture_t *pic;
+
+    pic = picpeek(id);
+    if (!pic && picqueue(id, TRUE, w, h))
+        return TRUE;
+
+    if (!pic)
+        pic = gli_picture_load(id);
+    if (!pic)
+        return FALSE;
+
+    *w = pic->w;
+    *h = pic->h;
+    return TRUE;
 }
 
 picture_t *gli_picture_load(unsigned long id)
@@ -183,11 +808,21 @@ picture_t *gli_picture_load(unsigned long id)
     FILE *fl;
     int closeafter;
     glui32 chunktype;
+    unsigned char *data = NULL;
+    long datalen = 0;
+    double start;
+
+    pic = gli_picture_retrieve(id, 0, 0);
 
-    pic = gli_picture_retrieve(id, 0);
+    if (pic)
+        return pic;
 
+    pic = picadopt(id);
     if (pic)
+    {
+        gli_picture_store(pic);
         return pic;
+    }
 
     if (!giblorb_is_resource_map())
     {
@@ -229,42 +864,47 @@ picture_t *gli_picture_load(unsigned long id)
     else
     {
         long pos;
-        giblorb_get_resource(giblorb_ID_Pict, id, &fl, &pos, NULL, &chunktype);
-        if (!fl)
-            return NULL;
-        fseek(fl, pos, 0);
+
+        /* decode straight out of the mapped blorb when we can */
+        fl = NULL;
         closeafter = FALSE;
+        giblorb_get_resource_data(giblorb_ID_Pict, id, &data, &datalen, &chunktype);
+#ifndef JPEG_MEMSRC
+        if (data && chunktype == giblorb_ID_JPEG)
+            data = NULL;
+#endif
+        if (!data)
+        {
+            giblorb_get_resource(giblorb_ID_Pict, id, &fl, &pos, NULL, &chunktype);
+            if (!fl)
+                return NULL;
+            fseek(fl, pos, 0);
+        }
     }
 
-    pic = malloc(sizeof(picture_t));
-    pic->refcount = 1;
-    pic->w = 0;
-    pic->h = 0;
-    pic->rgba = NULL;
-    pic->id = id;
-    pic->scaled = FALSE;
-
-    if (chunktype == giblorb_ID_PNG)
-        load_image_png(fl, pic);
-
-    if (chunktype == giblorb_ID_JPEG)
-        load_image_jpeg(fl, pic);
+    start = picclock();
+    pic = decodepicture(id, fl, data, datalen, chunktype);
 
     if (closeafter)
         fclose(fl);
 
-    if (!pic->rgba)
-    {
-        free(pic);
+    if (joblock)
+        gli_mutex_lock(joblock);
+    picstats.decodes++;
+    decodeus += picclock() - start;
+    stallus += picclock() - start;
+    if (joblock)
+        gli_mutex_unlock(joblock);
+
+    if (!pic)
         return NULL;
-    }
 
     gli_picture_store(pic);
 
     return pic;
 }
 
-static void load_image_jpeg(FILE *fl, picture_t *pic)
+static void load_image_jpeg(FILE *fl, unsigned char *buf, long len, picture_t *pic)
 {
     struct jpeg_decompress_struct cinfo;
     struct jpeg_error_mgr jerr;
@@ -275,7 +915,12 @@ static void load_image_jpeg(FILE *fl, picture_t *pic)
 
     cinfo.err = jpeg_std_error(&jerr);
     jpeg_create_decompress(&cinfo);
-    jpeg_stdio_src(&cinfo, fl);
+#ifdef JPEG_MEMSRC
+    if (buf)
+        jpeg_mem_src(&cinfo, buf, len);
+    else
+#endif
+        jpeg_stdio_src(&cinfo, fl);
     jpeg_read_header(&cinfo, TRUE);
     jpeg_start_decompress(&cinfo);
 
@@ -310,18 +955,38 @@ static void load_image_jpeg(FILE *fl, picture_t *pic)
     free(row);
 }
 
-static void load_image_png(FILE *fl, picture_t *pic)
+/* a resource being read by libpng from memory */
+typedef struct pngsrc_s
+{
+    unsigned char *buf;
+    long len;
+    long pos;
+} pngsrc_t;
+
+static void read_png_mem(png_structp png_ptr, png_bytep data, png_size_t length)
+{
+    pngsrc_t *src = (pngsrc_t*) png_get_io_ptr(png_ptr);
+
+    if (length > (png_size_t)(src->len - src->pos))
+        png_error(png_ptr, "read past end of image");
+
+    memcpy(data, src->buf + src->pos, length);
+    src->pos += length;
+}
+
+static void load_image_png(FILE *fl, unsigned char *buf, long len, picture_t *pic)
 {
     int ix, x, y;
     int srcrowbytes;
     png_structp png_ptr = NULL;
     png_infop info_ptr = NULL;
+    pngsrc_t src;
 
-    /* These are static so that the setjmp/longjmp error-handling of
-       libpng doesn't mangle them. Horribly thread-unsafe, but we
-       hope we don't run into that. */
-    static png_bytep *rowarray;
-    static png_bytep srcdata;
+    /* These are volatile so that the setjmp/longjmp error-handling of
+       libpng doesn't mangle them; not static, as pictures may be
+       decoded on several threads at once. */
+    png_bytep * volatile rowarray;
+    png_bytep volatile srcdata;
 
     rowarray = NULL;
     srcdata = NULL;
@@ -348,7 +1013,15 @@ static void load_image_png(FILE *fl, picture_t *pic)
         return;
     }
 
-    png_init_io(png_ptr, fl);
+    if (buf)
+    {
+        src.buf = buf;
+        src.len = len;
+        src.pos = 0;
+        png_set_read_fn(png_ptr, &src, read_png_mem);
+    }
+    else
+        png_init_io(png_ptr, fl);
 
     png_read_info(png_ptr, info_ptr);
 
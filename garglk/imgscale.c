@@ -22,288 +22,488 @@
  *****************************************************************************/
 
 /*
- * Image scaling, based on pnmscale.c...
+ * Image scaling
+ *
+ * Pictures are resampled separably, first along each source row and then
+ * down the columns. They are stored premultiplied by alpha, so that
+ * transparent pixels don't bleed their colour into the edges. Shrinking
+ * an axis averages the source pixels each destination pixel covers;
+ * growing it interpolates linearly between the nearest two.
+ *
+ * Working values are the stored bytes times 255 in 16 bits, weights
+ * are 14 bit fixed point summing to 1 << 14, and the products are summed
+ * in 32 bits. The weights for each pair of sizes are kept in a small
+ * cache, since the same picture tends to be scaled to the same window
+ * size again and again. Large pictures are split into bands of rows
+ * scaled on separate threads.
  */
 
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "glk.h"
 #include "garglk.h"
+#include "uthash.h"
 
-picture_t *
-gli_picture_scale(picture_t *src, int newcols, int newrows)
+#if defined __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define WEIGHTBITS 14
+#define WEIGHTONE (1 << WEIGHTBITS)
+#define MAXTABLES 16
+#define BANDPIXELS 65536	/* smallest picture worth splitting */
+#define BANDROWS 32		/* fewest rows per band */
+
+/* the taps contributing to each destination pixel along one axis */
+typedef struct scaletab_s
 {
-    /* pnmscale.c - read a portable anymap and scale it
-     *
-     * Copyright (C) 1989, 1991 by Jef Poskanzer.
-     *
-     * Permission to use, copy, modify, and distribute this software and its
-     * documentation for any purpose and without fee is hereby granted, provided
-     * that the above copyright notice appear in all copies and that both that
-     * copyright notice and this permission notice appear in supporting
-     * documentation.  This software is provided "as is" without express or
-     * implied warranty.
-     */
-
-#define SCALE 4096
-#define HALFSCALE 2048
-#define maxval 255
+    int key[2];			/* source and destination length */
+    int taps;			/* widest filter, the stride of weights */
+    int *start;
+    int *count;
+    unsigned short *weights;
+    UT_hash_handle hh;
+} scaletab_t;
 
-    picture_t *dst;
+static scaletab_t *scaletabs = NULL;	/* in order of use, least recent first */
 
-    dst = gli_picture_retrieve(src->id, 1);
+static void freetab(scaletab_t *t)
+{
+    free(t->start);
+    free(t->count);
+    free(t->weights);
+    free(t);
+}
 
-    if (dst && dst->w == newcols && dst->h == newrows)
-        return dst;
+/* quantize one pixel's weights so that they sum to exactly WEIGHTONE */
+static void quantize(unsigned short *w, double *f, int n)
+{
+    double total = 0;
+    int sum = 0, diff, k;
 
-    unsigned char *xelrow;
-    unsigned char *tempxelrow;
-    unsigned char *newxelrow;
-    register unsigned char *xP;
-    register unsigned char *nxP;
-    register int row, col;
+    for (k = 0; k < n; k++)
+        total += f[k];
 
-    int rowsread, needtoreadrow;
+    for (k = 0; k < n; k++)
+    {
+        w[k] = (unsigned short)floor(f[k] / total * WEIGHTONE + 0.5);
+        sum += w[k];
+    }
 
-    int cols = src->w;
-    int rows = src->h;
+    diff = WEIGHTONE - sum;
+    for (k = 0; diff; k = (k + 1) % n)
+    {
+        if (diff > 0)
+        {
+            w[k]++;
+            diff--;
+        }
+        else if (w[k] > 0)
+        {
+            w[k]--;
+            diff++;
+        }
+    }
+}
 
-    float xscale, yscale;
-    long sxscale, syscale;
+static scaletab_t *maketab(int srclen, int dstlen)
+{
+    scaletab_t *t;
+    double scale = (double)srclen / dstlen;
+    double *f;
+    int i, j, n;
+
+    t = calloc(1, sizeof(scaletab_t));
+    if (!t)
+        return NULL;
+
+    t->key[0] = srclen;
+    t->key[1] = dstlen;
+    t->taps = srclen > dstlen ? (int)ceil(scale) + 1 : 2;
+    t->start = malloc(sizeof(int) * dstlen);
+    t->count = malloc(sizeof(int) * dstlen);
+    t->weights = calloc((size_t)dstlen * t->taps, sizeof(unsigned short));
+    f = malloc(sizeof(double) * t->taps);
+    if (!t->start || !t->count || !t->weights || !f)
+    {
+        free(f);
+        freetab(t);
+        return NULL;
+    }
 
-    register long fracrowtofill, fracrowleft;
-    long *rs;
-    long *gs;
-    long *bs;
-    long *as;
+    for (i = 0; i < dstlen; i++)
+    {
+        if (srclen > dstlen)
+        {
+            /* box: the share of each source pixel the span covers */
+            double lo = i * scale, hi = (i + 1) * scale;
+            int j0 = (int)floor(lo), j1 = (int)ceil(hi);
+            if (j1 > srclen)
+                j1 = srclen;
+            n = 0;
+            for (j = j0; j < j1 && n < t->taps; j++)
+            {
+                double a = lo > j ? lo : j;
+                double b = hi < j + 1 ? hi : j + 1;
+                f[n++] = b > a ? b - a : 0;
+            }
+            t->start[i] = j0;
+        }
+        else if (srclen < dstlen)
+        {
+            /* bilinear between the two nearest source pixels */
+            double c = (i + 0.5) * scale - 0.5;
+            int j0 = (int)floor(c);
+            double frac = c - j0;
+            if (j0 < 0)
+            {
+                j0 = 0;
+                frac = 0;
+            }
+            if (j0 >= srclen - 1)
+            {
+                j0 = srclen - 1;
+                frac = 0;
+            }
+            n = frac > 0 ? 2 : 1;
+            f[0] = 1 - frac;
+            f[1] = frac;
+            t->start[i] = j0;
+        }
+        else
+        {
+            n = 1;
+            f[0] = 1;
+            t->start[i] = i;
+        }
 
-    /* Allocate destination image and scratch space */
+        /* trailing taps that add nothing */
+        while (n > 1 && f[n - 1] <= 0)
+            n--;
 
-    dst = malloc(sizeof(picture_t));
-    dst->refcount = 1;
-    dst->w = newcols;
-    dst->h = newrows;
-    dst->rgba = malloc(newcols * newrows * 4);
-    dst->id = src->id;
-    dst->scaled = TRUE;
+        t->count[i] = n;
+        quantize(t->weights + (size_t)i * t->taps, f, n);
+    }
+
+    free(f);
+    return t;
+}
+
+/* fetch the filter for scaling srclen pixels to dstlen, building it if need be */
+static scaletab_t *gettab(int srclen, int dstlen)
+{
+    scaletab_t *t;
+    int key[2];
 
-    xelrow = src->rgba;
-    newxelrow = dst->rgba;
+    key[0] = srclen;
+    key[1] = dstlen;
 
-    tempxelrow = malloc(cols * 4);
-    rs = malloc((cols + 1) * sizeof(long));
-    gs = malloc((cols + 1) * sizeof(long));
-    bs = malloc((cols + 1) * sizeof(long));
-    as = malloc((cols + 1) * sizeof(long));
+    HASH_FIND(hh, scaletabs, key, sizeof(key), t);
+    if (t)
+    {
+        HASH_DEL(scaletabs, t);
+        HASH_ADD(hh, scaletabs, key, sizeof(key), t);
+        return t;
+    }
 
-    /* Compute all sizes and scales. */
+    t = maketab(srclen, dstlen);
+    if (!t)
+        return NULL;
 
-    xscale = (float) newcols / (float) cols;
-    yscale = (float) newrows / (float) rows;
-    sxscale = xscale * SCALE;
-    syscale = yscale * SCALE;
+    if (HASH_COUNT(scaletabs) >= MAXTABLES)
+    {
+        scaletab_t *old = scaletabs;
+        HASH_DEL(scaletabs, old);
+        freetab(old);
+    }
 
-    rowsread = 1;
-    fracrowleft = syscale;
-    needtoreadrow = 0;
+    HASH_ADD(hh, scaletabs, key, sizeof(key), t);
+    return t;
+}
 
-    for ( col = 0; col < cols; ++col )
-        rs[col] = gs[col] = bs[col] = as[col] = HALFSCALE;
-    fracrowtofill = SCALE;
+/* widen a row of bytes to 16 bit working values */
+static void widen(unsigned short *dp, const unsigned char *sp, int n)
+{
+    int i = 0;
 
-    for ( row = 0; row < newrows; ++row )
+#if defined __SSE2__
     {
-        /* First scale Y from xelrow into tempxelrow. */
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i m255 = _mm_set1_epi16(255);
+
+        for (; i + 16 <= n; i += 16)
         {
-            while ( fracrowleft < fracrowtofill )
-            {
-                if ( needtoreadrow )
-                    if ( rowsread < rows )
-                    {
-                        xelrow += src->w * 4;
-                        ++rowsread;
-                        /* needtoreadrow = 0; */
-                    }
-
-                for ( col = 0, xP = xelrow; col < cols; ++col, xP += 4 )
-                {
-                    rs[col] += fracrowleft * xP[0] * xP[3];
-                    gs[col] += fracrowleft * xP[1] * xP[3];
-                    bs[col] += fracrowleft * xP[2] * xP[3];
-                    as[col] += fracrowleft * xP[3];
-                }
-
-                fracrowtofill -= fracrowleft;
-                fracrowleft = syscale;
-                needtoreadrow = 1;
-            }
+            __m128i px = _mm_loadu_si128((const __m128i *)(sp + i));
+            _mm_storeu_si128((__m128i *)(dp + i),
+                    _mm_mullo_epi16(_mm_unpacklo_epi8(px, zero), m255));
+            _mm_storeu_si128((__m128i *)(dp + i + 8),
+                    _mm_mullo_epi16(_mm_unpackhi_epi8(px, zero), m255));
+        }
+    }
+#endif
 
-            /* Now fracrowleft is >= fracrowtofill, so we can produce a row. */
-            if ( needtoreadrow )
-                if ( rowsread < rows )
-                {
-                    xelrow += src->w * 4;
-                    ++rowsread;
-                    needtoreadrow = 0;
-                }
-
-            for ( col = 0, xP = xelrow, nxP = tempxelrow;
-                    col < cols; ++col, xP += 4, nxP += 4)
-            {
-                register long r, g, b, a;
-                r = rs[col] + fracrowtofill * xP[0] * xP[3];
-                g = gs[col] + fracrowtofill * xP[1] * xP[3];
-                b = bs[col] + fracrowtofill * xP[2] * xP[3];
-                a = as[col] + fracrowtofill * xP[3];
-
-                if (!a)
-                {
-                    r = g = b = a;
-                }
-                else
-                {
-                    r /= a;
-                    if ( r > maxval ) r = maxval;
-                    g /= a;
-                    if ( g > maxval ) g = maxval;
-                    b /= a;
-                    if ( b > maxval ) b = maxval;
-                    a /= SCALE;
-                    if ( a > maxval ) a = maxval;
-                }
-
-                nxP[0] = r;
-                nxP[1] = g;
-                nxP[2] = b;
-                nxP[3] = a;
-                rs[col] = gs[col] = bs[col] = as[col] = HALFSCALE;
-            }
+    for (; i < n; i++)
+        dp[i] = sp[i] * 255;
+}
 
-            fracrowleft -= fracrowtofill;
-            if ( fracrowleft == 0 )
-            {
-                fracrowleft = syscale;
-                needtoreadrow = 1;
-            }
-            fracrowtofill = SCALE;
+/* and narrow them back, rounding to the nearest */
+static void narrow(unsigned char *dp, const unsigned short *sp, int n)
+{
+    int i = 0;
+
+#if defined __SSE2__
+    {
+        /* (v + 128 + ((v + 128) >> 8)) >> 8 is v / 255 rounded */
+        const __m128i half = _mm_set1_epi16(128);
+
+        for (; i + 16 <= n; i += 16)
+        {
+            __m128i lo = _mm_add_epi16(_mm_loadu_si128((const __m128i *)(sp + i)), half);
+            __m128i hi = _mm_add_epi16(_mm_loadu_si128((const __m128i *)(sp + i + 8)), half);
+            lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+            hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+            _mm_storeu_si128((__m128i *)(dp + i), _mm_packus_epi16(lo, hi));
+        }
+    }
+#endif
+
+    for (; i < n; i++)
+        dp[i] = (sp[i] + 127) / 255;
+}
+
+/* resample one premultiplied row along x */
+static void scalerow(unsigned short *dp, const unsigned short *sp, scaletab_t *t, int n)
+{
+    int x, k;
+
+    for (x = 0; x < n; x++, dp += 4)
+    {
+        const unsigned short *w = t->weights + (size_t)x * t->taps;
+        const unsigned short *p = sp + t->start[x] * 4;
+        int count = t->count[x];
+
+#if defined __SSE2__
+        __m128i acc = _mm_set1_epi32(WEIGHTONE / 2);
+        __m128i v;
+
+        for (k = 0; k < count; k++, p += 4)
+        {
+            __m128i px = _mm_loadl_epi64((const __m128i *)p);
+            __m128i wt = _mm_set1_epi16((short)w[k]);
+            __m128i lo = _mm_mullo_epi16(px, wt);
+            __m128i hi = _mm_mulhi_epu16(px, wt);
+            acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(lo, hi));
         }
 
-        /* Now scale X from tempxelrow into newxelrow and write it out. */
+        /* 16 bit unsigned results, packed through the signed range */
+        v = _mm_sub_epi32(_mm_srli_epi32(acc, WEIGHTBITS), _mm_set1_epi32(32768));
+        v = _mm_xor_si128(_mm_packs_epi32(v, v), _mm_set1_epi16((short)0x8000));
+        _mm_storel_epi64((__m128i *)dp, v);
+#else
+        unsigned int r = WEIGHTONE / 2, g = r, b = r, a = r;
+
+        for (k = 0; k < count; k++, p += 4)
         {
-            register long r, g, b, a;
-            register long fraccoltofill, fraccolleft;
-            register int needcol;
+            r += w[k] * p[0];
+            g += w[k] * p[1];
+            b += w[k] * p[2];
+            a += w[k] * p[3];
+        }
 
-            nxP = newxelrow;
-            fraccoltofill = SCALE;
-            r = g = b = a = HALFSCALE;
-            needcol = 0;
+        dp[0] = r >> WEIGHTBITS;
+        dp[1] = g >> WEIGHTBITS;
+        dp[2] = b >> WEIGHTBITS;
+        dp[3] = a >> WEIGHTBITS;
+#endif
+    }
+}
 
-            for ( col = 0, xP = tempxelrow; col < cols; ++col, xP += 4 )
-            {
-                fraccolleft = sxscale;
-                while ( fraccolleft >= fraccoltofill )
-                {
-                    if ( needcol )
-                    {
-                        nxP += 4;
-                        r = g = b = a = HALFSCALE;
-                    }
-
-                    r += fraccoltofill * xP[0] * xP[3];
-                    g += fraccoltofill * xP[1] * xP[3];
-                    b += fraccoltofill * xP[2] * xP[3];
-                    a += fraccoltofill * xP[3];
-
-                    if (!a)
-                    {
-                        r = g = b = a;
-                    }
-                    else
-                    {
-                        r /= a;
-                        if ( r > maxval ) r = maxval;
-                        g /= a;
-                        if ( g > maxval ) g = maxval;
-                        b /= a;
-                        if ( b > maxval ) b = maxval;
-                        a /= SCALE;
-                        if ( a > maxval ) a = maxval;
-                    }
-
-                    nxP[0] = r;
-                    nxP[1] = g;
-                    nxP[2] = b;
-                    nxP[3] = a;
-
-                    fraccolleft -= fraccoltofill;
-                    fraccoltofill = SCALE;
-                    needcol = 1;
-                }
-
-                if ( fraccolleft > 0 )
-                {
-                    if ( needcol )
-                    {
-                        nxP += 4;
-                        r = g = b = a = HALFSCALE;
-                        needcol = 0;
-                    }
-
-                    r += fraccolleft * xP[0] * xP[3];
-                    g += fraccolleft * xP[1] * xP[3];
-                    b += fraccolleft * xP[2] * xP[3];
-                    a += fraccolleft * xP[3];
-
-                    fraccoltofill -= fraccolleft;
-                }
-            }
+/* blend count resampled rows into one, n values wide */
+static void scalecolumn(unsigned short *dp, unsigned short **rows,
+        const unsigned short *w, int count, int n)
+{
+    int i = 0, k;
 
-            if ( fraccoltofill > 0 )
-            {
-                xP -= 4;
-                r += fraccoltofill * xP[0] * xP[3];
-                g += fraccoltofill * xP[1] * xP[3];
-                b += fraccoltofill * xP[2] * xP[3];
-                a += fraccoltofill * xP[3];
-            }
+#if defined __SSE2__
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i lo = _mm_set1_epi32(WEIGHTONE / 2);
+        __m128i hi = lo;
+        __m128i v;
 
-            if ( ! needcol )
-            {
-                if (!a)
-                {
-                    r = g = b = a;
-                }
-                else
-                {
-                    r /= a;
-                    if ( r > maxval ) r = maxval;
-                    g /= a;
-                    if ( g > maxval ) g = maxval;
-                    b /= a;
-                    if ( b > maxval ) b = maxval;
-                    a /= SCALE;
-                    if ( a > maxval ) a = maxval;
-                }
-
-                nxP[0] = r;
-                nxP[1] = g;
-                nxP[2] = b;
-                nxP[3] = a;
-            }
+        for (k = 0; k < count; k++)
+        {
+            __m128i px = _mm_loadu_si128((const __m128i *)(rows[k] + i));
+            __m128i wt = _mm_set1_epi16((short)w[k]);
+            __m128i pl = _mm_mullo_epi16(px, wt);
+            __m128i ph = _mm_mulhi_epu16(px, wt);
+            lo = _mm_add_epi32(lo, _mm_unpacklo_epi16(pl, ph));
+            hi = _mm_add_epi32(hi, _mm_unpackhi_epi16(pl, ph));
+        }
+
+        lo = _mm_sub_epi32(_mm_srli_epi32(lo, WEIGHTBITS), _mm_set1_epi32(32768));
+        hi = _mm_sub_epi32(_mm_srli_epi32(hi, WEIGHTBITS), _mm_set1_epi32(32768));
+        v = _mm_xor_si128(_mm_packs_epi32(lo, hi), _mm_set1_epi16((short)0x8000));
+        _mm_storeu_si128((__m128i *)(dp + i), v);
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        unsigned int sum = WEIGHTONE / 2;
+        for (k = 0; k < count; k++)
+            sum += w[k] * rows[k][i];
+        dp[i] = sum >> WEIGHTBITS;
+    }
+}
+
+/* a run of destination rows, scaled on one thread */
+typedef struct scaleband_s
+{
+    picture_t *src, *dst;
+    scaletab_t *xt, *yt;
+    int y0, y1;
+    int ok;
+} scaleband_t;
 
-            newxelrow += dst->w * 4;
+static void scaleband(void *arg)
+{
+    scaleband_t *band = arg;
+    picture_t *src = band->src, *dst = band->dst;
+    scaletab_t *xt = band->xt, *yt = band->yt;
+    int taps = yt->taps;
+    unsigned short *line, *ring, *out;
+    unsigned short **rows;
+    int have = -1, y, k, r;
+
+    /* rows scaled along x are kept in a ring as deep as the y filter */
+    line = malloc(sizeof(unsigned short) * src->w * 4);
+    ring = malloc(sizeof(unsigned short) * dst->w * 4 * taps);
+    out = malloc(sizeof(unsigned short) * dst->w * 4);
+    rows = malloc(sizeof(unsigned short *) * taps);
+
+    band->ok = line && ring && out && rows;
+
+    for (y = band->y0; band->ok && y < band->y1; y++)
+    {
+        int s0 = yt->start[y];
+        int count = yt->count[y];
+
+        for (r = s0 > have + 1 ? s0 : have + 1; r < s0 + count; r++)
+        {
+            widen(line, src->rgba + (size_t)r * src->w * 4, src->w * 4);
+            scalerow(ring + (size_t)(r % taps) * dst->w * 4, line, xt, dst->w);
+            have = r;
         }
+
+        for (k = 0; k < count; k++)
+            rows[k] = ring + (size_t)((s0 + k) % taps) * dst->w * 4;
+
+        scalecolumn(out, rows, yt->weights + (size_t)y * taps, count, dst->w * 4);
+        narrow(dst->rgba + (size_t)y * dst->w * 4, out, dst->w * 4);
     }
 
-    free(as);
-    free(bs);
-    free(gs);
-    free(rs);
-    free(tempxelrow);
+    free(line);
+    free(ring);
+    free(out);
+    free(rows);
+}
+
+picture_t *
+gli_picture_scale(picture_t *src, int newcols, int newrows)
+{
+    picture_t *dst;
+    scaletab_t *xt, *yt;
+    scaleband_t *bands;
+    gli_thread_t **threads;
+    int nbands, i, ok;
+
+    dst = gli_picture_retrieve(src->id, newcols, newrows);
+
+    if (dst)
+        return dst;
+
+    if (newcols <= 0 || newrows <= 0)
+        return NULL;
+
+    xt = gettab(src->w, newcols);
+    yt = gettab(src->h, newrows);
+    if (!xt || !yt)
+        return NULL;
+
+    dst = malloc(sizeof(picture_t));
+    if (!dst)
+        return NULL;
+
+    dst->refcount = 1;
+    dst->w = newcols;
+    dst->h = newrows;
+    dst->rgba = malloc((size_t)newcols * newrows * 4);
+    dst->id = src->id;
+    dst->scaled = TRUE;
+    dst->spans = NULL;
+    dst->spanrow = NULL;
+
+    if (!dst->rgba)
+    {
+        free(dst);
+        return NULL;
+    }
+
+    nbands = 1;
+    if ((long)newcols * newrows >= BANDPIXELS && gli_conf_scalethreads > 1)
+    {
+        nbands = newrows / BANDROWS;
+        if (nbands > gli_conf_scalethreads)
+            nbands = gli_conf_scalethreads;
+        if (nbands < 1)
+            nbands = 1;
+    }
+
+    bands = malloc(sizeof(scaleband_t) * nbands);
+    threads = calloc(nbands, sizeof(gli_thread_t *));
+    if (!bands || !threads)
+        nbands = 0;
+
+    for (i = 0; i < nbands; i++)
+    {
+        bands[i].src = src;
+        bands[i].dst = dst;
+        bands[i].xt = xt;
+        bands[i].yt = yt;
+        bands[i].y0 = (int)((long)newrows * i / nbands);
+        bands[i].y1 = (int)((long)newrows * (i + 1) / nbands);
+        bands[i].ok = FALSE;
+    }
+
+    /* the first band is done here, the rest on their own threads */
+    for (i = 1; i < nbands; i++)
+        threads[i] = gli_thread_create(scaleband, &bands[i]);
+
+    ok = nbands > 0;
+    for (i = 0; i < nbands; i++)
+    {
+        if (threads[i])
+            gli_thread_join(threads[i]);
+        else
+            scaleband(&bands[i]);
+        ok = ok && bands[i].ok;
+    }
+
+    free(bands);
+    free(threads);
+
+    if (!ok)
+    {
+        free(dst->rgba);
+        free(dst);
+        return NULL;
+    }
 
+    gli_picture_spans(dst);
     gli_picture_store(dst);
 
     return dst;
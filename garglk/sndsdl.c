@@ -37,6 +37,7 @@
 #include "garglk.h"
 
 #include "gi_blorb.h"
+#include "uthash.h"
 
 #define giblorb_ID_MOD  (giblorb_make_id('M', 'O', 'D', ' '))
 #define giblorb_ID_OGG  (giblorb_make_id('O', 'G', 'G', 'V'))
@@ -57,6 +58,185 @@ static Sound_AudioInfo *output = NULL;
 static const int FREE = 1;
 static const int BUSY = 2;
 
+/*
+ * Compressed sounds are streamed. A decode thread per channel fills a
+ * small ring of PCM, and an effect on the mixer channel copies it out
+ * over a looping chunk of silence. The game thread never decodes, the
+ * audio thread only copies, and the whole sound is never held in memory
+ * at once. When the decoder is done and the ring has drained, the
+ * channel is expired, so it finishes and notifies like any other sound.
+ */
+
+#define STREAMBLOCK 16384			/* bytes of PCM per decode */
+#define STREAMRING (4 * STREAMBLOCK)	/* about 0.37s at 44.1kHz stereo */
+
+typedef struct sndstream_s
+{
+    Sound_Sample *decode;
+    gli_thread_t *thread;
+    gli_mutex_t *lock;
+    gli_sem_t *room;		/* posted as the mixer drains the ring */
+    unsigned char ring[STREAMRING];
+    int head, fill;		/* read position and bytes buffered */
+    glui32 loop;
+    int started, eof, stop, expired;
+    Mix_Chunk *silence;
+} sndstream_t;
+
+static Uint8 silence[STREAMBLOCK];
+
+/*
+ * Decoded samples are kept by resource id, so replaying an effect goes
+ * straight to the mixer. Entries in use by a channel or pinned by
+ * glk_sound_load_hint are never evicted; the rest go least recently
+ * used first once the budget is exceeded. Channels release entries from
+ * the audio thread, so the cache is only touched under SDL_LockAudio.
+ */
+
+#define SHORTSOUND 65536	/* compressed bytes decoded whole and cached */
+
+typedef struct sndentry_s
+{
+    glui32 id;
+    Mix_Chunk *chunk;
+    int users;			/* channels playing it */
+    int pinned;			/* preloaded by glk_sound_load_hint */
+    UT_hash_handle hh;
+} sndentry_t;
+
+static sndentry_t *sndstore = NULL;
+static long sndbytes = 0;
+
+static void sound_cache_evict(void)
+{
+    sndentry_t *e, *tmp;
+    long budget = (long)gli_conf_soundcache * 1024;
+
+    if (gli_conf_soundcache <= 0)
+        return;
+
+    for (e = sndstore; e; e = tmp)
+    {
+        tmp = e->hh.next;
+        if (sndbytes <= budget)
+            break;
+        if (e->users || e->pinned)
+            continue;
+        HASH_DEL(sndstore, e);
+        sndbytes -= e->chunk->alen;
+        Mix_FreeChunk(e->chunk);
+        free(e);
+    }
+}
+
+/* the cached sample for a sound, claimed for a channel */
+static Mix_Chunk *sound_cache_get(glui32 snd)
+{
+    sndentry_t *e;
+
+    SDL_LockAudio();
+    HASH_FIND(hh, sndstore, &snd, sizeof(glui32), e);
+    if (e)
+    {
+        /* move it to the back, as the most recently used */
+        HASH_DEL(sndstore, e);
+        HASH_ADD(hh, sndstore, id, sizeof(glui32), e);
+        e->users++;
+    }
+    SDL_UnlockAudio();
+
+    return e ? e->chunk : NULL;
+}
+
+static void sound_cache_add(glui32 snd, Mix_Chunk *chunk, int users, int pinned)
+{
+    sndentry_t *e;
+
+    if (!chunk)
+        return;
+
+    e = malloc(sizeof(sndentry_t));
+    if (!e)
+        return;
+
+    e->id = snd;
+    e->chunk = chunk;
+    e->users = users;
+    e->pinned = pinned;
+
+    SDL_LockAudio();
+    HASH_ADD(hh, sndstore, id, sizeof(glui32), e);
+    sndbytes += chunk->alen;
+    sound_cache_evict();
+    SDL_UnlockAudio();
+}
+
+/* hand a channel's sample back; false if the cache does not own it */
+static int sound_cache_release(glui32 snd, Mix_Chunk *chunk)
+{
+    sndentry_t *e;
+
+    HASH_FIND(hh, sndstore, &snd, sizeof(glui32), e);
+    if (!e || e->chunk != chunk)
+        return FALSE;
+
+    if (e->users > 0)
+        e->users--;
+    sound_cache_evict();
+    return TRUE;
+}
+
+/* decode a whole sample to a chunk, giving up past limit bytes */
+static Mix_Chunk *decode_whole(Sound_Sample *decode, long limit)
+{
+    Mix_Chunk *chunk;
+    Uint8 *pcm = NULL, *grown;
+    long len = 0, cap = 0;
+    Uint32 got;
+
+    while (!(decode->flags & (SOUND_SAMPLEFLAG_EOF | SOUND_SAMPLEFLAG_ERROR)))
+    {
+        got = Sound_Decode(decode);
+        if (!got)
+            break;
+        if (limit > 0 && len + got > limit)
+        {
+            SDL_free(pcm);
+            return NULL;
+        }
+        if (len + got > cap)
+        {
+            cap = (len + got) * 2;
+            grown = SDL_realloc(pcm, cap);
+            if (!grown)
+            {
+                SDL_free(pcm);
+                return NULL;
+            }
+            pcm = grown;
+        }
+        memcpy(pcm + len, decode->buffer, got);
+        len += got;
+    }
+
+    if ((decode->flags & SOUND_SAMPLEFLAG_ERROR) || !len)
+    {
+        SDL_free(pcm);
+        return NULL;
+    }
+
+    chunk = Mix_QuickLoad_RAW(pcm, len);
+    if (!chunk)
+    {
+        SDL_free(pcm);
+        return NULL;
+    }
+
+    /* let Mix_FreeChunk free the PCM along with the chunk */
+    chunk->allocated = 1;
+    return chunk;
+}
+
 void gli_initialize_sound(void)
 {
     if (gli_conf_sound == 1)
@@ -114,7 +294,7 @@ schanid_t glk_schannel_create(glui32 rock)
     chan->sdl_rwops = 0;
     chan->sample = 0;
     chan->decode = 0;
-    chan->buffered = 0;
+    chan->stream = 0;
     chan->sdl_channel = -1;
     chan->music = 0;
 
@@ -138,8 +318,18 @@ schanid_t glk_schannel_create_ext(glui32 rock, glui32 volume)
     return NULL;
 }
 
+static void stream_close(sndstream_t *st);
+
 static void cleanup_channel(schanid_t chan)
 {
+    if (chan->stream)
+    {
+        /* the decoder must be gone before its sample is freed */
+        if (chan->sdl_channel >= 0)
+            Mix_UnregisterAllEffects(chan->sdl_channel);
+        stream_close(chan->stream);
+        chan->stream = 0;
+    }
     if (chan->sdl_rwops)
     {
         if (!chan->decode)
@@ -148,7 +338,6 @@ static void cleanup_channel(schanid_t chan)
             Sound_FreeSample(chan->decode);
         chan->sdl_rwops = 0;
         chan->decode = 0;
-        chan->buffered = 0;
     }
     if (chan->sdl_memory)
     {
@@ -158,7 +347,7 @@ static void cleanup_channel(schanid_t chan)
     switch (chan->status)
     {
         case CHANNEL_SOUND:
-            if (chan->sample)
+            if (chan->sample && !sound_cache_release(chan->resid, chan->sample))
                 Mix_FreeChunk(chan->sample);
             if (chan->sdl_channel >= 0)
             {
@@ -176,6 +365,7 @@ static void cleanup_channel(schanid_t chan)
     }
     chan->status = CHANNEL_IDLE;
     chan->sdl_channel = -1;
+    chan->sample = 0;
     chan->music = 0;
 }
 
@@ -251,11 +441,6 @@ glui32 glk_schannel_play_multi(schanid_t *chanarray, glui32 chancount,
     return 0;
 }
 
-void glk_sound_load_hint(glui32 snd, glui32 flag)
-{
-    /* nop */
-}
-
 void glk_schannel_set_volume(schanid_t chan, glui32 vol)
 {
     if (!chan)
@@ -308,55 +493,141 @@ static void sound_completion_callback(int chan)
         gli_strict_warning("sound callback failed");
         return;
     }
-    if (!sound_channel->buffered || !sound_channel->decode)
+    if (sound_channel->notify)
     {
-        if (sound_channel->notify)
-        {
-            gli_event_store(evtype_SoundNotify, 0,
-                            sound_channel->resid, sound_channel->notify);
-        }
-        cleanup_channel(sound_channel);
-        sound_channels[chan] = 0;
-        return;
+        gli_event_store(evtype_SoundNotify, 0,
+                        sound_channel->resid, sound_channel->notify);
     }
-    Uint32 soundbytes = Sound_Decode(sound_channel->decode);
-    if (!soundbytes)
+    cleanup_channel(sound_channel);
+    sound_channels[chan] = 0;
+}
+
+/* Decode thread: keep the ring topped up until the sound ends or is stopped */
+static void stream_decode(void *arg)
+{
+    sndstream_t *st = arg;
+    Uint32 n, pos, part;
+    int rewound = FALSE;
+
+    while (1)
     {
-        sound_channel->loop--;
-        if (!sound_channel->loop)
+        gli_mutex_lock(st->lock);
+        while (!st->stop && STREAMRING - st->fill < STREAMBLOCK)
         {
-            if (sound_channel->notify)
-            {
-                gli_event_store(evtype_SoundNotify, 0,
-                                sound_channel->resid, sound_channel->notify);
-            }
-            cleanup_channel(sound_channel);
-            sound_channels[chan] = 0;
-            return;
+            gli_mutex_unlock(st->lock);
+            gli_sem_wait(st->room);
+            gli_mutex_lock(st->lock);
         }
-        else
+        gli_mutex_unlock(st->lock);
+
+        if (st->stop)
+            break;
+
+        n = Sound_Decode(st->decode);
+        if (!n)
         {
-            Sound_Rewind(sound_channel->decode);
-            soundbytes = Sound_Decode(sound_channel->decode);
+            /* a sound that yields nothing right after a rewind is over too */
+            if (rewound || (st->loop != 0xFFFFFFFF && --st->loop == 0))
+                break;
+            Sound_Rewind(st->decode);
+            rewound = TRUE;
+            continue;
         }
+        rewound = FALSE;
+
+        gli_mutex_lock(st->lock);
+        pos = (st->head + st->fill) % STREAMRING;
+        part = n < STREAMRING - pos ? n : STREAMRING - pos;
+        memcpy(st->ring + pos, st->decode->buffer, part);
+        memcpy(st->ring, (Uint8 *)st->decode->buffer + part, n - part);
+        st->fill += n;
+        st->started = TRUE;
+        gli_mutex_unlock(st->lock);
     }
-    Sound_Sample *sample = sound_channel->decode;
-    sound_channel->sample = Mix_QuickLoad_RAW(sample->buffer, soundbytes);
-    Mix_ChannelFinished(&sound_completion_callback);
-    if (Mix_PlayChannel(sound_channel->sdl_channel,
-                        sound_channel->sample,
-                        FALSE) >= 0)
+
+    gli_mutex_lock(st->lock);
+    st->eof = TRUE;
+    gli_mutex_unlock(st->lock);
+}
+
+/* Mixer effect, on the audio thread: replace the silence with decoded PCM */
+static void stream_effect(int channel, void *buf, int len, void *udata)
+{
+    sndstream_t *st = udata;
+    Uint8 *out = buf;
+    int n, part, drained;
+
+    gli_mutex_lock(st->lock);
+    n = len < st->fill ? len : st->fill;
+    part = n < STREAMRING - st->head ? n : STREAMRING - st->head;
+    memcpy(out, st->ring + st->head, part);
+    memcpy(out + part, st->ring, n - part);
+    st->head = (st->head + n) % STREAMRING;
+    st->fill -= n;
+    drained = st->eof && !st->fill && !st->expired;
+    if (drained)
+        st->expired = TRUE;
+    gli_mutex_unlock(st->lock);
+
+    /* an empty ring plays silence rather than stalling the mixer */
+    if (n < len)
+        memset(out + n, 0, len - n);
+
+    if (n)
+        gli_sem_post(st->room);
+
+    if (drained)
+        Mix_ExpireChannel(channel, 1);
+}
+
+static sndstream_t *stream_open(schanid_t chan)
+{
+    sndstream_t *st;
+
+    st = calloc(1, sizeof(sndstream_t));
+    if (!st)
+        return NULL;
+
+    st->decode = chan->decode;
+    st->loop = chan->loop;
+    st->lock = gli_mutex_create();
+    st->room = gli_sem_create();
+    st->silence = Mix_QuickLoad_RAW(silence, sizeof(silence));
+    if (st->lock && st->room && st->silence)
+        st->thread = gli_thread_create(stream_decode, st);
+
+    if (!st->thread)
     {
-        return;
+        stream_close(st);
+        return NULL;
     }
-    gli_strict_warning("buffer sound failed");
-    gli_strict_warning(Mix_GetError());
-    cleanup_channel(sound_channel);
-    return;
+
+    return st;
+}
+
+static void stream_close(sndstream_t *st)
+{
+    if (st->thread)
+    {
+        gli_mutex_lock(st->lock);
+        st->stop = TRUE;
+        gli_mutex_unlock(st->lock);
+        gli_sem_post(st->room);
+        gli_thread_join(st->thread);
+    }
+    if (st->silence)
+        Mix_FreeChunk(st->silence);
+    if (st->room)
+        gli_sem_destroy(st->room);
+    if (st->lock)
+        gli_mutex_destroy(st->lock);
+    free(st);
 }
 
-static glui32 load_sound_resource(glui32 snd, long *len, char **buf)
+static glui32 load_sound_resource(glui32 snd, long *len, char **buf, int *mapped)
 {
+    *mapped = FALSE;
+
     if (!giblorb_is_resource_map())
     {
         FILE *file;
@@ -431,6 +702,14 @@ static glui32 load_sound_resource(glui32 snd, long *len, char **buf)
         glui32 type;
         long pos;
 
+        /* play straight out of the mapped blorb, without a heap copy */
+        if (giblorb_get_resource_data(giblorb_ID_Snd, snd,
+                    (unsigned char **)buf, len, &type))
+        {
+            *mapped = TRUE;
+            return type;
+        }
+
         giblorb_get_resource(giblorb_ID_Snd, snd, &file, &pos, len, &type);
         if (!file)
             return 0;
@@ -450,11 +729,9 @@ static glui32 play_sound(schanid_t chan)
 {
     SDL_LockAudio();
     chan->status = CHANNEL_SOUND;
-    chan->buffered = 0;
     chan->sdl_channel = Mix_GroupAvailable(FREE);
     Mix_GroupChannel(chan->sdl_channel, BUSY);
     SDL_UnlockAudio();
-    chan->sample = Mix_LoadWAV_RW(chan->sdl_rwops, FALSE);
     if (chan->sdl_channel < 0)
     {
         gli_strict_warning("No available sound channels");
@@ -478,28 +755,44 @@ static glui32 play_sound(schanid_t chan)
 }
 
 /** Start a compressed sound channel */
-static glui32 play_compressed(schanid_t chan, char *ext)
+static glui32 play_compressed(schanid_t chan, char *ext, long len)
 {
+    chan->decode = Sound_NewSample(chan->sdl_rwops, ext, output, STREAMBLOCK);
+
+    /* short effects are decoded once and replayed from the cache */
+    if (chan->decode && len <= SHORTSOUND)
+    {
+        chan->sample = decode_whole(chan->decode, (long)gli_conf_soundcache * 1024);
+        if (chan->sample)
+        {
+            Sound_FreeSample(chan->decode);
+            chan->decode = 0;
+            chan->sdl_rwops = 0;
+            sound_cache_add(chan->resid, chan->sample, 1, FALSE);
+            return play_sound(chan);
+        }
+        Sound_Rewind(chan->decode);
+    }
+
     SDL_LockAudio();
     chan->status = CHANNEL_SOUND;
-    chan->buffered = 1;
     chan->sdl_channel = Mix_GroupAvailable(FREE);
     Mix_GroupChannel(chan->sdl_channel, BUSY);
     SDL_UnlockAudio();
-    chan->decode = Sound_NewSample(chan->sdl_rwops, ext, output, 65536);
-    Uint32 soundbytes = Sound_Decode(chan->decode);
-    Sound_Sample *sample = chan->decode;
-    chan->sample = Mix_QuickLoad_RAW(sample->buffer, soundbytes);
+    if (chan->decode)
+        chan->stream = stream_open(chan);
     if (chan->sdl_channel < 0)
         gli_strict_warning("No available sound channels");
-    if (chan->sdl_channel >= 0 && chan->sample)
+    if (chan->sdl_channel >= 0 && chan->stream)
     {
+        sndstream_t *st = chan->stream;
         SDL_LockAudio();
         sound_channels[chan->sdl_channel] = chan;
         SDL_UnlockAudio();
         Mix_Volume(chan->sdl_channel, chan->volume);
         Mix_ChannelFinished(&sound_completion_callback);
-        if (Mix_PlayChannel(chan->sdl_channel, chan->sample, 0) >= 0)
+        if (Mix_RegisterEffect(chan->sdl_channel, stream_effect, NULL, st)
+                && Mix_PlayChannel(chan->sdl_channel, st->silence, -1) >= 0)
             return 1;
     }
     gli_strict_warning("play sound failed");
@@ -511,7 +804,7 @@ static glui32 play_compressed(schanid_t chan, char *ext)
 }
 
 /** Start a mod music channel */
-static glui32 play_mod(schanid_t chan, long len)
+static glui32 play_mod(schanid_t chan, char *buf, long len)
 {
     FILE *file;
     char *tn;
@@ -524,7 +817,7 @@ static glui32 play_mod(schanid_t chan, long len)
     if (tempdir == NULL) tempdir = ".";
     tn = tempnam(tempdir, "gargtmp");
     file = fopen(tn, "wb");
-    fwrite(chan->sdl_memory, 1, len, file);
+    fwrite(buf, 1, len, file);
     fclose(file);
     chan->music = Mix_LoadMUS(tn);
     remove(tn);
@@ -555,6 +848,7 @@ glui32 glk_schannel_play_ext(schanid_t chan, glui32 snd, glui32 repeats, glui32
     long len;
     glui32 type;
     char *buf = 0;
+    int mapped;
 
     if (!chan)
     {
@@ -568,33 +862,42 @@ glui32 glk_schannel_play_ext(schanid_t chan, glui32 snd, glui32 repeats, glui32
     if (repeats == 0)
         return 1;
 
-    /* load sound resource into memory */
-    type = load_sound_resource(snd, &len, &buf);
-
-    chan->sdl_memory = (unsigned char*)buf;
-    chan->sdl_rwops = SDL_RWFromConstMem(buf, len);
     chan->notify = notify;
     chan->resid = snd;
     chan->loop = repeats;
 
+    /* a cached sample needs no loading or decoding */
+    chan->sample = sound_cache_get(snd);
+    if (chan->sample)
+        return play_sound(chan);
+
+    /* load sound resource into memory */
+    type = load_sound_resource(snd, &len, &buf, &mapped);
+
+    /* mapped blorb data belongs to the resource map, not the channel */
+    chan->sdl_memory = mapped ? NULL : (unsigned char*)buf;
+    chan->sdl_rwops = SDL_RWFromConstMem(buf, len);
+
     switch (type)
     {
         case giblorb_ID_FORM:
         case giblorb_ID_AIFF:
         case giblorb_ID_WAVE:
+            chan->sample = Mix_LoadWAV_RW(chan->sdl_rwops, FALSE);
+            sound_cache_add(snd, chan->sample, 1, FALSE);
             return play_sound(chan);
             break;
 
         case giblorb_ID_OGG:
-            return play_compressed(chan, "OGG");
+            return play_compressed(chan, "OGG", len);
             break;
 
         case giblorb_ID_MP3:
-            return play_compressed(chan, "MP3");
+            return play_compressed(chan, "MP3", len);
             break;
 
         case giblorb_ID_MOD:
-            return play_mod(chan, len);
+            return play_mod(chan, buf, len);
             break;
 
         default:
@@ -604,6 +907,78 @@ glui32 glk_schannel_play_ext(schanid_t chan, glui32 snd, glui32 repeats, glui32
     return 0;
 }
 
+/* decode a sound for the cache; mod music is not sampled */
+static Mix_Chunk *load_sample(glui32 snd)
+{
+    Mix_Chunk *chunk = NULL;
+    Sound_Sample *decode;
+    SDL_RWops *rw;
+    long len;
+    glui32 type;
+    char *buf = 0;
+    int mapped;
+
+    type = load_sound_resource(snd, &len, &buf, &mapped);
+    if (!type)
+        return NULL;
+
+    rw = SDL_RWFromConstMem(buf, len);
+    if (rw)
+    {
+        switch (type)
+        {
+            case giblorb_ID_FORM:
+            case giblorb_ID_AIFF:
+            case giblorb_ID_WAVE:
+                chunk = Mix_LoadWAV_RW(rw, TRUE);
+                rw = NULL;
+                break;
+
+            case giblorb_ID_OGG:
+            case giblorb_ID_MP3:
+                decode = Sound_NewSample(rw,
+                        type == giblorb_ID_OGG ? "OGG" : "MP3", output, STREAMBLOCK);
+                if (decode)
+                {
+                    chunk = decode_whole(decode, (long)gli_conf_soundcache * 1024);
+                    Sound_FreeSample(decode);
+                    rw = NULL;
+                }
+                break;
+        }
+        if (rw)
+            SDL_FreeRW(rw);
+    }
+
+    if (!mapped)
+        free(buf);
+    return chunk;
+}
+
+void glk_sound_load_hint(glui32 snd, glui32 flag)
+{
+    sndentry_t *e;
+    Mix_Chunk *chunk;
+
+    if (!gli_conf_sound)
+        return;
+
+    SDL_LockAudio();
+    HASH_FIND(hh, sndstore, &snd, sizeof(glui32), e);
+    if (e)
+    {
+        e->pinned = flag != 0;
+        sound_cache_evict();
+    }
+    SDL_UnlockAudio();
+
+    if (e || !flag)
+        return;
+
+    chunk = load_sample(snd);
+    sound_cache_add(snd, chunk, 0, TRUE);
+}
+
 void glk_schannel_pause(schanid_t chan)
 {
     /* not implemented */
@@ -621,9 +996,8 @@ void glk_schannel_stop(schanid_t chan)
         gli_strict_warning("schannel_stop: invalid id.");
         return;
     }
+    /* the completion callbacks change the status on the audio thread */
     SDL_LockAudio();
-    chan->buffered = 0;
-    SDL_UnlockAudio();
     switch (chan->status)
     {
         case CHANNEL_SOUND:
@@ -633,7 +1007,6 @@ void glk_schannel_stop(schanid_t chan)
             Mix_HaltMusic();
             break;
     }
-    SDL_LockAudio();
     cleanup_channel(chan);
     SDL_UnlockAudio();
 }
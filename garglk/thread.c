@@ -0,0 +1,259 @@
+/******************************************************************************
+ *                                                                            *
+ * Copyright (C) 2010 by Ben Cressey.                                         *
+ *                                                                            *
+ * This file is part of Gargoyle.                                             *
+ *                                                                            *
+ * Gargoyle is free software; you can redistribute it and/or modify           *
+ * it under the terms of the GNU General Public License as published by       *
+ * the Free Software Foundation; either version 2 of the License, or          *
+ * (at your option) any later version.                                        *
+ *                                                                            *
+ * Gargoyle is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of             *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              *
+ * GNU General Public License for more details.                               *
+ *                                                                            *
+ * You should have received a copy of the GNU General Public License          *
+ * along with Gargoyle; if not, write to the Free Software                    *
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA *
+ *                                                                            *
+ *****************************************************************************/
+
+/*
+ * Minimal threads and locks for background work inside the library.
+ * Glk calls and drawing stay on the main thread; workers only ever
+ * produce data that the main thread picks up under a mutex.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "glk.h"
+#include "garglk.h"
+
+#ifdef _WIN32
+
+#include <windows.h>
+
+struct gli_thread_s
+{
+    HANDLE handle;
+    void (*func)(void *);
+    void *arg;
+};
+
+struct gli_mutex_s
+{
+    CRITICAL_SECTION cs;
+};
+
+struct gli_sem_s
+{
+    HANDLE handle;
+};
+
+static DWORD WINAPI threadmain(LPVOID data)
+{
+    gli_thread_t *thread = data;
+    thread->func(thread->arg);
+    return 0;
+}
+
+gli_thread_t *gli_thread_create(void (*func)(void *), void *arg)
+{
+    gli_thread_t *thread = malloc(sizeof(gli_thread_t));
+    if (!thread)
+        return NULL;
+
+    thread->func = func;
+    thread->arg = arg;
+    thread->handle = CreateThread(NULL, 0, threadmain, thread, 0, NULL);
+    if (!thread->handle)
+    {
+        free(thread);
+        return NULL;
+    }
+
+    return thread;
+}
+
+void gli_thread_join(gli_thread_t *thread)
+{
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+    free(thread);
+}
+
+gli_mutex_t *gli_mutex_create(void)
+{
+    gli_mutex_t *mutex = malloc(sizeof(gli_mutex_t));
+    if (mutex)
+        InitializeCriticalSection(&mutex->cs);
+    return mutex;
+}
+
+void gli_mutex_destroy(gli_mutex_t *mutex)
+{
+    DeleteCriticalSection(&mutex->cs);
+    free(mutex);
+}
+
+void gli_mutex_lock(gli_mutex_t *mutex)
+{
+    EnterCriticalSection(&mutex->cs);
+}
+
+void gli_mutex_unlock(gli_mutex_t *mutex)
+{
+    LeaveCriticalSection(&mutex->cs);
+}
+
+gli_sem_t *gli_sem_create(void)
+{
+    gli_sem_t *sem = malloc(sizeof(gli_sem_t));
+    if (!sem)
+        return NULL;
+
+    sem->handle = CreateSemaphore(NULL, 0, 0x7fffffff, NULL);
+    if (!sem->handle)
+    {
+        free(sem);
+        return NULL;
+    }
+
+    return sem;
+}
+
+void gli_sem_destroy(gli_sem_t *sem)
+{
+    CloseHandle(sem->handle);
+    free(sem);
+}
+
+void gli_sem_post(gli_sem_t *sem)
+{
+    ReleaseSemaphore(sem->handle, 1, NULL);
+}
+
+void gli_sem_wait(gli_sem_t *sem)
+{
+    WaitForSingleObject(sem->handle, INFINITE);
+}
+
+#else
+
+#include <pthread.h>
+
+struct gli_thread_s
+{
+    pthread_t handle;
+    void (*func)(void *);
+    void *arg;
+};
+
+struct gli_mutex_s
+{
+    pthread_mutex_t mx;
+};
+
+/* unnamed POSIX semaphores are missing on Mac OS X, so build our own */
+struct gli_sem_s
+{
+    pthread_mutex_t mx;
+    pthread_cond_t cv;
+    int count;
+};
+
+static void *threadmain(void *data)
+{
+    gli_thread_t *thread = data;
+    thread->func(thread->arg);
+    return NULL;
+}
+
+gli_thread_t *gli_thread_create(void (*func)(void *), void *arg)
+{
+    gli_thread_t *thread = malloc(sizeof(gli_thread_t));
+    if (!thread)
+        return NULL;
+
+    thread->func = func;
+    thread->arg = arg;
+    if (pthread_create(&thread->handle, NULL, threadmain, thread))
+    {
+        free(thread);
+        return NULL;
+    }
+
+    return thread;
+}
+
+void gli_thread_join(gli_thread_t *thread)
+{
+    pthread_join(thread->handle, NULL);
+    free(thread);
+}
+
+gli_mutex_t *gli_mutex_create(void)
+{
+    gli_mutex_t *mutex = malloc(sizeof(gli_mutex_t));
+    if (mutex)
+        pthread_mutex_init(&mutex->mx, NULL);
+    return mutex;
+}
+
+void gli_mutex_destroy(gli_mutex_t *mutex)
+{
+    pthread_mutex_destroy(&mutex->mx);
+    free(mutex);
+}
+
+void gli_mutex_lock(gli_mutex_t *mutex)
+{
+    pthread_mutex_lock(&mutex->mx);
+}
+
+void gli_mutex_unlock(gli_mutex_t *mutex)
+{
+    pthread_mutex_unlock(&mutex->mx);
+}
+
+gli_sem_t *gli_sem_create(void)
+{
+    gli_sem_t *sem = malloc(sizeof(gli_sem_t));
+    if (!sem)
+        return NULL;
+
+    pthread_mutex_init(&sem->mx, NULL);
+    pthread_cond_init(&sem->cv, NULL);
+    sem->count = 0;
+
+    return sem;
+}
+
+void gli_sem_destroy(gli_sem_t *sem)
+{
+    pthread_cond_destroy(&sem->cv);
+    pthread_mutex_destroy(&sem->mx);
+    free(sem);
+}
+
+void gli_sem_post(gli_sem_t *sem)
+{
+    pthread_mutex_lock(&sem->mx);
+    sem->count++;
+    pthread_cond_signal(&sem->cv);
+    pthread_mutex_unlock(&sem->mx);
+}
+
+void gli_sem_wait(gli_sem_t *sem)
+{
+    pthread_mutex_lock(&sem->mx);
+    while (sem->count == 0)
+        pthread_cond_wait(&sem->cv, &sem->mx);
+    sem->count--;
+    pthread_mutex_unlock(&sem->mx);
+}
+
+#endif /* _WIN32 */
@@ -31,6 +31,7 @@
 #define COLS 70
 
 int gli_force_redraw = 1;
+int gli_redraw_pending = 0; /* something was touched since the last redraw */
 int gli_more_focus = 0;
 
 /* Linked list of all windows */
@@ -893,9 +894,11 @@ void gli_windows_redraw()
 {
     gli_claimselect = FALSE;
 
+    gli_draw_begin_frame();
+
     if (gli_force_redraw)
     {
-        winrepaint(0, 0, gli_image_w, gli_image_h);
+        gli_damage_rect(0, 0, gli_image_w, gli_image_h);
         gli_draw_clear(gli_window_color);
     }
 
@@ -906,12 +909,15 @@ void gli_windows_redraw()
         gli_window_refocus(gli_focuswin);
 
     gli_force_redraw = 0;
+    gli_redraw_pending = 0;
+
+    gli_damage_flush();
 }
 
 void gli_redraw_rect(int x0, int y0, int x1, int y1)
 {
     gli_drawselect = TRUE;
-    winrepaint(x0, y0, x1, y1);
+    gli_damage_rect(x0, y0, x1, y1);
 }
 
 /*
@@ -1394,19 +1400,18 @@ glui32 glk_image_draw_scaled(winid_t win, glui32 image,
 
 glui32 glk_image_get_info(glui32 image, glui32 *width, glui32 *height)
 {
-    picture_t *pic;
+    int w, h;
 
     if (!gli_conf_graphics)
         return FALSE;
 
-    pic = gli_picture_load(image);
-    if (!pic)
+    if (!gli_picture_get_info(image, &w, &h))
         return FALSE;
 
     if (width)
-        *width = pic->w;
+        *width = w;
     if (height)
-        *height = pic->h;
+        *height = h;
 
     return TRUE;
 }
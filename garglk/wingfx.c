@@ -36,11 +36,7 @@ drawpicture(picture_t *src, window_graphics_t *dst,
 void win_graphics_touch(window_graphics_t *dest)
 {
     dest->dirty = 1;
-    winrepaint(
-            dest->owner->bbox.x0,
-            dest->owner->bbox.y0,
-            dest->owner->bbox.x1,
-            dest->owner->bbox.y1);
+    gli_redraw_pending = TRUE;
 }
 
 window_graphics_t *win_graphics_create(window_t *win)
@@ -159,6 +155,8 @@ void win_graphics_redraw(window_t *win)
         if (!dwin->rgb)
             return;
 
+        gli_damage_rect(win->bbox.x0, win->bbox.y0, win->bbox.x1, win->bbox.y1);
+
         for (y = 0; y < dwin->h; y++)
             for (x = 0; x < dwin->w; x++)
             {
@@ -328,7 +326,7 @@ static void drawpicture(picture_t *src, window_graphics_t *dst,
 {
     unsigned char *sp, *dp;
     int dx1, dy1, x1, y1, sx0, sy0, sx1, sy1;
-    int x, y, w, h;
+    int x, y, h;
     int hx0, hx1, hy0, hy1;
 
     if (width != src->w || height != src->h)
@@ -382,22 +380,54 @@ static void drawpicture(picture_t *src, window_graphics_t *dst,
     sp = src->rgba + (sy0 * src->w + sx0) * 4;
     dp = dst->rgb + (y0 * dst->w + x0) * 3;
 
-    w = sx1 - sx0;
     h = sy1 - sy0;
 
+    /* pictures are premultiplied: copy opaque spans, blend the rest */
     for (y = 0; y < h; y++)
     {
-        for (x = 0; x < w; x++)
+        picspan_t *span = NULL, *end = NULL;
+        picspan_t whole;
+
+        if (src->spanrow)
+        {
+            span = src->spans + src->spanrow[sy0 + y];
+            end = src->spans + src->spanrow[sy0 + y + 1];
+        }
+        else
         {
-            unsigned char sa = sp[x*4+3];
-            unsigned char na = 255 - sa;
-            unsigned char sr = mul255(sp[x*4+0], sa);
-            unsigned char sg = mul255(sp[x*4+1], sa);
-            unsigned char sb = mul255(sp[x*4+2], sa);
-            dp[x*3+0] = sr + mul255(dp[x*3+0], na);
-            dp[x*3+1] = sg + mul255(dp[x*3+1], na);
-            dp[x*3+2] = sb + mul255(dp[x*3+2], na);
+            whole.x0 = sx0;
+            whole.x1 = sx1;
+            whole.opaque = FALSE;
+            span = &whole;
+            end = span + 1;
         }
+
+        for (; span < end; span++)
+        {
+            int a = span->x0 > sx0 ? span->x0 : sx0;
+            int b = span->x1 < sx1 ? span->x1 : sx1;
+
+            if (span->opaque)
+            {
+                for (x = a - sx0; x < b - sx0; x++)
+                {
+                    dp[x*3+0] = sp[x*4+0];
+                    dp[x*3+1] = sp[x*4+1];
+                    dp[x*3+2] = sp[x*4+2];
+                }
+            }
+            else
+            {
+                for (x = a - sx0; x < b - sx0; x++)
+                {
+                    unsigned char na = 255 - sp[x*4+3];
+                    dp[x*3+0] = sp[x*4+0] + mul255(dp[x*3+0], na);
+                    dp[x*3+1] = sp[x*4+1] + mul255(dp[x*3+1], na);
+                    dp[x*3+2] = sp[x*4+2] + mul255(dp[x*3+2], na);
+                }
+            }
+        }
+
         sp += src->w * 4;
         dp += dst->w * 3;
     }
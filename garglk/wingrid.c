@@ -29,15 +29,91 @@
 
 /* A grid of characters. We store the window as a list of lines.
  * Within a line, just store an array of characters and an array
- * of style bytes, the same size.
+ * of style bytes, the same size, sized to the window. Each line
+ * also keeps a copy of what was last drawn, so rewriting cells with
+ * the same text does not redraw them.
  */
 
+/* mark cells [x0, x1) of a line for redrawing */
+static void touchcells(window_textgrid_t *dwin, int line, int x0, int x1)
+{
+    tgline_t *ln;
+
+    if (line < 0 || line >= dwin->rows)
+        return;
+
+    ln = &dwin->lines[line];
+
+    if (!ln->dirty)
+    {
+        ln->dirty = 1;
+        ln->dirtyx0 = x0;
+        ln->dirtyx1 = x1;
+    }
+    else
+    {
+        if (x0 < ln->dirtyx0)
+            ln->dirtyx0 = x0;
+        if (x1 > ln->dirtyx1)
+            ln->dirtyx1 = x1;
+    }
+    gli_redraw_pending = TRUE;
+}
+
 static void touch(window_textgrid_t *dwin, int line)
 {
-    window_t *win = dwin->owner;
-    int y = win->bbox.y0 + line * gli_leading;
-    dwin->lines[line].dirty = 1;
-    winrepaint(win->bbox.x0, y, win->bbox.x1, y + gli_leading);
+    touchcells(dwin, line, 0, dwin->cols);
+}
+
+/* resize the storage, keeping the cells that still fit */
+static void gridalloc(window_textgrid_t *dwin, int cols, int rows)
+{
+    tgline_t *lines, *ln;
+    size_t size;
+    int k, i, n;
+
+    lines = malloc((rows > 0 ? rows : 1) * sizeof(tgline_t));
+    if (!lines)
+        winabort("textgrid: out of memory");
+
+    /* chars, attrs and their shown copies share one block per line */
+    size = (cols > 0 ? cols : 1) * 2 * (sizeof(glui32) + sizeof(attr_t));
+    n = cols < dwin->cols ? cols : dwin->cols;
+
+    for (k = 0; k < rows; k++)
+    {
+        ln = &lines[k];
+        ln->chars = malloc(size);
+        if (!ln->chars)
+            winabort("textgrid: out of memory");
+        ln->attrs = (attr_t*)(ln->chars + cols);
+        ln->shownchars = (glui32*)(ln->attrs + cols);
+        ln->shownattrs = (attr_t*)(ln->shownchars + cols);
+
+        i = 0;
+        if (k < dwin->rows)
+        {
+            memcpy(ln->chars, dwin->lines[k].chars, n * sizeof(glui32));
+            memcpy(ln->attrs, dwin->lines[k].attrs, n * sizeof(attr_t));
+            i = n;
+        }
+        for (; i < cols; i++)
+        {
+            ln->chars[i] = ' ';
+            attrclear(&ln->attrs[i]);
+        }
+
+        ln->dirty = 0;
+        ln->drawn = FALSE;
+    }
+
+    for (k = 0; k < dwin->rows; k++)
+        free(dwin->lines[k].chars);
+    free(dwin->lines);
+
+    dwin->lines = lines;
+    dwin->cols = cols;
+    dwin->rows = rows;
 }
 
 window_textgrid_t *win_textgrid_create(window_t *win)
@@ -47,6 +123,9 @@ window_textgrid_t *win_textgrid_create(window_t *win)
 
     dwin->width = 0;
     dwin->height = 0;
+    dwin->cols = 0;
+    dwin->rows = 0;
+    dwin->lines = NULL;
 
     dwin->curx = 0;
     dwin->cury = 0;
@@ -74,6 +153,9 @@ void win_textgrid_destroy(window_textgrid_t *dwin)
     if (dwin->line_terminators)
         free(dwin->line_terminators);
 
+    gridalloc(dwin, 0, 0);
+    free(dwin->lines);
+
     dwin->owner = NULL;
     free(dwin);
 }
@@ -81,6 +163,7 @@ void win_textgrid_destroy(window_textgrid_t *dwin)
 void win_textgrid_rearrange(window_t *win, rect_t *box)
 {
     int newwid, newhgt;
+    int cols, rows;
     int k, i;
     window_textgrid_t *dwin = win->data;
     dwin->owner->bbox = *box;
@@ -91,35 +174,58 @@ void win_textgrid_rearrange(window_t *win, rect_t *box)
     if (newwid == dwin->width && newhgt == dwin->height)
         return;
 
-    for (k = dwin->height; k < newhgt; k++)
+    /* cells outside the window are blank when it grows again */
+    for (k = 0; k < dwin->rows; k++)
     {
-        for (i = 0; i < sizeof(dwin->lines[k].chars) / sizeof(glui32); i++)
+        for (i = k < newhgt ? newwid : 0; i < dwin->cols; i++)
+        {
             dwin->lines[k].chars[i] = ' ';
-        memset(dwin->lines[k].attrs, 0, sizeof dwin->lines[k].attrs);
+            attrclear(&dwin->lines[k].attrs[i]);
+        }
+    }
+
+    /* keep a pending line input field in storage */
+    cols = newwid;
+    rows = newhgt;
+    if (dwin->inbuf && dwin->inmax > 0)
+    {
+        if (dwin->inorgx + dwin->inmax > cols)
+            cols = dwin->inorgx + dwin->inmax;
+        if (dwin->inorgy + 1 > rows)
+            rows = dwin->inorgy + 1;
     }
+    gridalloc(dwin, cols, rows);
 
     attrclear(&dwin->owner->attr);
     dwin->width = newwid;
     dwin->height = newhgt;
 
     for (k = 0; k < dwin->height; k++)
-    {
         touch(dwin, k);
-        for (i = dwin->width; i < sizeof(dwin->lines[0].chars) / sizeof(glui32); i++)
-        {
-            dwin->lines[k].chars[i] = ' ';
-            attrclear(&dwin->lines[k].attrs[i]);
-        }
-    }
 }
 
+/* does the screen already show cell x as it is? */
+static int shown(tgline_t *ln, int x)
+{
+    return ln->chars[x] == ln->shownchars[x]
+        && attrequal(&ln->attrs[x], &ln->shownattrs[x]);
+}
+
+/*
+ * Only the changed cells of a line are redrawn, plus one on either side
+ * that may hold ink from the glyphs they replace. Glyphs are clipped to
+ * those cells, so neighbours that are left alone are not blended twice,
+ * and the neighbours' own glyphs are drawn again to restore any ink
+ * they put inside, just as a full redraw of the line would leave it.
+ */
 void win_textgrid_redraw(window_t *win)
 {
     window_textgrid_t *dwin = win->data;
     tgline_t *ln;
     int x0, y0;
     int x, y, w;
-    int i, a, b, k, o;
+    int sx0, sx1;
+    int i, a, b, k, first, last;
     glui32 link;
     int font;
     unsigned char *fgcolor, *bgcolor;
@@ -130,67 +236,83 @@ void win_textgrid_redraw(window_t *win)
     for (i = 0; i < dwin->height; i++)
     {
         ln = dwin->lines + i;
-        if (ln->dirty || gli_force_redraw)
+        if (!ln->dirty && !gli_force_redraw)
+            continue;
+
+        ln->dirty = 0;
+
+        first = 0;
+        last = dwin->width;
+        if (!gli_force_redraw && ln->drawn)
         {
-            ln->dirty = 0;
+            a = ln->dirtyx0 > 0 ? ln->dirtyx0 : 0;
+            b = ln->dirtyx1 < last ? ln->dirtyx1 : last;
+            while (a < b && shown(ln, a))
+                a++;
+            while (b > a && shown(ln, b - 1))
+                b--;
+            if (a >= b)
+                continue;
+            first = a > 0 ? a - 1 : 0;
+            last = b < last ? b + 1 : last;
+        }
 
-            x = x0;
-            y = y0 + i * gli_leading;
+        x = x0 + first * gli_cellw;
+        y = y0 + i * gli_leading;
 
-            /* clear any stored hyperlink coordinates */
-            gli_put_hyperlink(0, x0, y, x0 + gli_cellw * dwin->width, y + gli_leading);
+        /* the last cell owns the slack up to the window edge */
+        sx0 = x;
+        sx1 = last == dwin->width ? win->bbox.x1 : x0 + last * gli_cellw;
+
+        gli_damage_begin(sx0, y, sx1, y + gli_leading);
+
+        /* clear any stored hyperlink coordinates */
+        gli_put_hyperlink(0, sx0, y, x0 + gli_cellw * last, y + gli_leading);
+
+        a = first;
+        for (b = first; b <= last; b++)
+        {
+            if (b < last && attrequal(&ln->attrs[a], &ln->attrs[b]))
+                continue;
 
-            a = 0;
-            for (b = 0; b < dwin->width; b++)
-            {
-                if (!attrequal(&ln->attrs[a], &ln->attrs[b]))
-                {
-                    link = ln->attrs[a].hyper;
-                    font = attrfont(dwin->styles, &ln->attrs[a]);
-                    fgcolor = link ? gli_link_color : attrfg(dwin->styles, &ln->attrs[a]);
-                    bgcolor = attrbg(dwin->styles, &ln->attrs[a]);
-                    w = (b - a) * gli_cellw;
-                    gli_draw_rect(x, y, w, gli_leading, bgcolor);
-                    o = x;
-                    for (k = a; k < b; k++)
-                    {
-                        gli_draw_string_uni(o * GLI_SUBPIX,
-                                y + gli_baseline, font, fgcolor,
-                                ln->chars + k, 1, -1);
-                        o += gli_cellw;
-                    }
-                    if (link)
-                    {
-                        gli_draw_rect(x, y + gli_baseline + 1, w,
-                                      gli_link_style, gli_link_color);
-                        gli_put_hyperlink(link, x, y, x + w, y + gli_leading);
-                    }
-                    x += w;
-                    a = b;
-                }
-            }
             link = ln->attrs[a].hyper;
             font = attrfont(dwin->styles, &ln->attrs[a]);
             fgcolor = link ? gli_link_color : attrfg(dwin->styles, &ln->attrs[a]);
             bgcolor = attrbg(dwin->styles, &ln->attrs[a]);
             w = (b - a) * gli_cellw;
-            w += win->bbox.x1 - (x + w);
+            if (b == dwin->width)
+                w += win->bbox.x1 - (x + w);
             gli_draw_rect(x, y, w, gli_leading, bgcolor);
-            o = x;
-            for (k = a; k < b; k++)
-            {
-                gli_draw_string_uni(o * GLI_SUBPIX,
-                                    y + gli_baseline, font, fgcolor,
-                                    ln->chars + k, 1, -1);
-                o += gli_cellw;
-            }
+            k = a;
+            if (a == first && a > 0 && attrequal(&ln->attrs[a - 1], &ln->attrs[a]))
+                k--;
+            gli_draw_grid_uni(x0 + k * gli_cellw, y + gli_baseline, font, fgcolor,
+                    ln->chars + k, b - k, gli_cellw, sx0, sx1);
             if (link)
             {
                 gli_draw_rect(x, y + gli_baseline + 1, w,
                               gli_link_style, gli_link_color);
                 gli_put_hyperlink(link, x, y, x + w, y + gli_leading);
             }
+            x += w;
+            a = b;
         }
+
+        if (last < dwin->width)
+        {
+            link = ln->attrs[last].hyper;
+            font = attrfont(dwin->styles, &ln->attrs[last]);
+            fgcolor = link ? gli_link_color : attrfg(dwin->styles, &ln->attrs[last]);
+            gli_draw_grid_uni(x, y + gli_baseline, font, fgcolor,
+                    ln->chars + last, 1, gli_cellw, sx0, sx1);
+        }
+
+        gli_damage_end();
+
+        memcpy(ln->shownchars + first, ln->chars + first, (last - first) * sizeof(glui32));
+        memcpy(ln->shownattrs + first, ln->attrs + first, (last - first) * sizeof(attr_t));
+        if (first == 0 && last == dwin->width)
+            ln->drawn = TRUE;
     }
 }
 
@@ -223,11 +345,13 @@ void win_textgrid_putchar_uni(window_t *win, glui32 ch)
         return;
     }
 
-    touch(dwin, dwin->cury);
-
     ln = &(dwin->lines[dwin->cury]);
-    ln->chars[dwin->curx] = ch;
-    ln->attrs[dwin->curx] = win->attr;
+    if (ln->chars[dwin->curx] != ch || !attrequal(&ln->attrs[dwin->curx], &win->attr))
+    {
+        ln->chars[dwin->curx] = ch;
+        ln->attrs[dwin->curx] = win->attr;
+        touchcells(dwin, dwin->cury, dwin->curx, dwin->curx + 1);
+    }
 
     dwin->curx++;
     /* We can leave the cursor outside the window, since it will be
@@ -255,7 +379,7 @@ int win_textgrid_unputchar_uni(window_t *win, glui32 ch)
     }
     if (dwin->cury < 0)
         dwin->cury = 0;
-    else if (dwin->cury >= dwin->height)
+    else if (dwin->cury >= dwin->height || dwin->curx < 0)
         return FALSE; /* outside the window */
 
     if (ch == '\n')
@@ -273,7 +397,7 @@ int win_textgrid_unputchar_uni(window_t *win, glui32 ch)
     {
         ln->chars[dwin->curx] = ' ';
         attrclear(&ln->attrs[dwin->curx]);
-        touch(dwin, dwin->cury);
+        touchcells(dwin, dwin->cury, dwin->curx, dwin->curx + 1);
         return TRUE; /* deleted the char */
     }
     else
@@ -295,12 +419,14 @@ void win_textgrid_clear(window_t *win)
     win->attr.bgcolor = gli_override_bg_set ? gli_override_bg_val : 0;
     win->attr.reverse = FALSE;
 
-    for (k = 0; k < dwin->height; k++)
+    for (k = 0; k < dwin->rows; k++)
     {
         touch(dwin, k);
-        for (j = 0; j < (sizeof dwin->lines[k].chars / sizeof *dwin->lines[k].chars); j++)
+        for (j = 0; j < dwin->cols; j++)
+        {
             dwin->lines[k].chars[j] = ' ';
-        memset(dwin->lines[k].attrs, 0, sizeof dwin->lines[k].attrs);
+            attrclear(&dwin->lines[k].attrs[j]);
+        }
     }
 
     dwin->curx = 0;
@@ -363,6 +489,10 @@ void win_textgrid_init_line(window_t *win, char *buf, int maxlen, int initlen)
     if (maxlen > (dwin->width - dwin->curx))
     maxlen = (dwin->width - dwin->curx);
 
+    /* no room if the cursor was left outside the window */
+    if (maxlen < 0 || dwin->cury >= dwin->height)
+        maxlen = 0;
+
     dwin->inbuf = buf;
     dwin->inmax = maxlen;
     dwin->inlen = 0;
@@ -391,7 +521,7 @@ void win_textgrid_init_line(window_t *win, char *buf, int maxlen, int initlen)
         dwin->curx = dwin->inorgx+dwin->incurs;
         dwin->cury = dwin->inorgy;
 
-        touch(dwin, dwin->inorgy);
+        touchcells(dwin, dwin->inorgy, dwin->inorgx, dwin->inorgx + initlen);
     }
 
     if (win->line_terminators && win->termct)
@@ -416,6 +546,10 @@ void win_textgrid_init_line_uni(window_t *win, glui32 *buf, int maxlen, int init
     if (maxlen > (dwin->width - dwin->curx))
         maxlen = (dwin->width - dwin->curx);
 
+    /* no room if the cursor was left outside the window */
+    if (maxlen < 0 || dwin->cury >= dwin->height)
+        maxlen = 0;
+
     dwin->inbuf = buf;
     dwin->inmax = maxlen;
     dwin->inlen = 0;
@@ -444,7 +578,7 @@ void win_textgrid_init_line_uni(window_t *win, glui32 *buf, int maxlen, int init
         dwin->curx = dwin->inorgx+dwin->incurs;
         dwin->cury = dwin->inorgy;
 
-        touch(dwin, dwin->inorgy);
+        touchcells(dwin, dwin->inorgy, dwin->inorgx, dwin->inorgx + initlen);
     }
 
     if (win->line_terminators && win->termct)
@@ -728,5 +862,5 @@ void gcmd_grid_accept_readline(window_t *win, glui32 arg)
     dwin->curx = dwin->inorgx+dwin->incurs;
     dwin->cury = dwin->inorgy;
 
-    touch(dwin, dwin->inorgy);
+    touchcells(dwin, dwin->inorgy, dwin->inorgx, dwin->inorgx + dwin->inmax);
 }
@@ -39,6 +39,7 @@ static int last_y = 0;
 
 void gli_resize_mask(unsigned int x, unsigned int y)
 {
+    maskrow_t *rows;
     int i;
 
     if (!gli_mask)
@@ -51,36 +52,36 @@ void gli_resize_mask(unsigned int x, unsigned int y)
         }
     }
 
-    /* deallocate old storage */
-    for (i = 0; i < gli_mask->hor; i++)
-    {
-        if (gli_mask->links[i])
-            free(gli_mask->links[i]);
-    }
-
-    if (gli_mask->links)
-        free(gli_mask->links);
-
     gli_mask->hor = x + 1;
     gli_mask->ver = y + 1;
 
-    /* allocate new storage */
-    gli_mask->links = (glui32**) calloc(gli_mask->hor, sizeof(glui32*));
-    if (!gli_mask->links)
+    /* the row table only ever grows; the spans are what get thrown away */
+    if (gli_mask->ver > gli_mask->nrows)
     {
-        gli_strict_warning("resize_mask: out of memory");
-        gli_mask->hor = 0;
-        gli_mask->ver = 0;
-        return;
+        rows = (maskrow_t*) realloc(gli_mask->rows,
+                gli_mask->ver * sizeof(maskrow_t));
+        if (!rows)
+        {
+            gli_strict_warning("resize_mask: out of memory");
+            gli_mask->hor = 0;
+            gli_mask->ver = 0;
+            return;
+        }
+        memset(rows + gli_mask->nrows, 0,
+                (gli_mask->ver - gli_mask->nrows) * sizeof(maskrow_t));
+        gli_mask->rows = rows;
+        gli_mask->nrows = gli_mask->ver;
     }
 
-    for (i = 0; i < gli_mask->hor; i++)
+    /* forget all links, and give back span storage for rows now off screen */
+    for (i = 0; i < gli_mask->nrows; i++)
     {
-        gli_mask->links[i] = (glui32*) calloc(gli_mask->ver, sizeof(glui32));
-        if (!gli_mask->links[i])
+        gli_mask->rows[i].count = 0;
+        if (i >= gli_mask->ver && gli_mask->rows[i].spans)
         {
-            gli_strict_warning("resize_mask: could not allocate new memory");
-            return;
+            free(gli_mask->rows[i].spans);
+            gli_mask->rows[i].spans = NULL;
+            gli_mask->rows[i].size = 0;
         }
     }
 
@@ -92,9 +93,80 @@ void gli_resize_mask(unsigned int x, unsigned int y)
     return;
 }
 
+/* index of the first span in the row that ends after x */
+static int findspan(maskrow_t *row, int x)
+{
+    int lo = 0;
+    int hi = row->count;
+    int mid;
+
+    while (lo < hi)
+    {
+        mid = (lo + hi) / 2;
+        if (row->spans[mid].x1 <= x)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/* paint [x0, x1) of a row with linkval, replacing whatever was there */
+static int putspan(maskrow_t *row, glui32 linkval, int x0, int x1)
+{
+    maskspan_t add[3];
+    maskspan_t *spans;
+    int first, last, nadd, size;
+
+    first = findspan(row, x0);
+    last = first;
+    while (last < row->count && row->spans[last].x0 < x1)
+        last++;
+
+    /* keep the uncovered ends of spans we overlap */
+    nadd = 0;
+    if (first < last && row->spans[first].x0 < x0)
+    {
+        add[nadd] = row->spans[first];
+        add[nadd++].x1 = x0;
+    }
+    if (linkval)
+    {
+        add[nadd].x0 = x0;
+        add[nadd].x1 = x1;
+        add[nadd++].link = linkval;
+    }
+    if (first < last && row->spans[last-1].x1 > x1)
+    {
+        add[nadd] = row->spans[last-1];
+        add[nadd++].x0 = x1;
+    }
+
+    if (!nadd && first == last)
+        return TRUE;
+
+    if (row->count - (last - first) + nadd > row->size)
+    {
+        size = row->size ? row->size * 2 : 8;
+        spans = (maskspan_t*) realloc(row->spans, size * sizeof(maskspan_t));
+        if (!spans)
+            return FALSE;
+        row->spans = spans;
+        row->size = size;
+    }
+
+    memmove(row->spans + first + nadd, row->spans + last,
+            (row->count - last) * sizeof(maskspan_t));
+    memcpy(row->spans + first, add, nadd * sizeof(maskspan_t));
+    row->count += nadd - (last - first);
+
+    return TRUE;
+}
+
 void gli_put_hyperlink(glui32 linkval, unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1)
 {
-    int i, k;
+    int k;
     int tx0 = x0 < x1 ? x0 : x1;
     int tx1 = x0 < x1 ? x1 : x0;
     int ty0 = y0 < y1 ? y0 : y1;
@@ -108,17 +180,22 @@ void gli_put_hyperlink(glui32 linkval, unsigned int x0, unsigned int y0, unsigne
 
     if (tx0 >= gli_mask->hor
             || tx1 >= gli_mask->hor
-            || ty0 >= gli_mask->ver  || ty1 >= gli_mask->ver
-            || !gli_mask->links[tx0] || !gli_mask->links[tx1])
+            || ty0 >= gli_mask->ver  || ty1 >= gli_mask->ver)
     {
         gli_strict_warning("set_hyperlink: invalid range given");
         return;
     }
 
-    for (i = tx0; i < tx1; i++)
+    if (tx0 == tx1)
+        return;
+
+    for (k = ty0; k < ty1; k++)
     {
-        for (k = ty0; k < ty1; k++)
-            gli_mask->links[i][k] = linkval;
+        if (!putspan(&gli_mask->rows[k], linkval, tx0, tx1))
+        {
+            gli_strict_warning("set_hyperlink: out of memory");
+            return;
+        }
     }
 
     return;
@@ -126,6 +203,9 @@ void gli_put_hyperlink(glui32 linkval, unsigned int x0, unsigned int y0, unsigne
 
 glui32 gli_get_hyperlink(unsigned int x, unsigned int y)
 {
+    maskrow_t *row;
+    int i;
+
     if (!gli_mask || !gli_mask->hor || !gli_mask->ver)
     {
         gli_strict_warning("get_hyperlink: struct not initialized");
@@ -133,14 +213,18 @@ glui32 gli_get_hyperlink(unsigned int x, unsigned int y)
     }
 
     if (x >= gli_mask->hor
-            || y >= gli_mask->ver
-            || !gli_mask->links[x])
+            || y >= gli_mask->ver)
     {
         gli_strict_warning("get_hyperlink: invalid range given");
         return 0;
     }
 
-    return gli_mask->links[x][y];
+    row = &gli_mask->rows[y];
+    i = findspan(row, x);
+    if (i < row->count && row->spans[i].x0 <= x)
+        return row->spans[i].link;
+
+    return 0;
 }
 
 void gli_start_selection(int x, int y)
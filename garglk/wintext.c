@@ -33,32 +33,359 @@
 /* how many pixels we add to left/right margins */
 #define SLOP (2 * GLI_SUBPIX)
 
+/* how many lines past the window we re-wrap when the width changes */
+#define REFLOWAHEAD 200
+
 static void
 put_text(window_textbuffer_t *dwin, char *buf, int len, int pos, int oldlen);
 static void
 put_text_uni(window_textbuffer_t *dwin, glui32 *buf, int len, int pos, int oldlen);
 static glui32
 put_picture(window_textbuffer_t *dwin, picture_t *pic, glui32 align, glui32 linkval);
+static void
+scrollresize(window_textbuffer_t *dwin);
+static void
+scrolloneline(window_textbuffer_t *dwin, int forced);
+
+/* line 0 is the newest line; lines is a ring starting at linehead */
+static tbline_t *lineat(window_textbuffer_t *dwin, int line)
+{
+    return dwin->lines + (dwin->linehead + line) % dwin->scrollback;
+}
+
+/*
+ * Scrollback storage. When a line scrolls up from line 0 its text is
+ * packed into a block as attribute runs followed by the characters, one
+ * byte each when they all fit in Latin-1. Blocks fill up in order and are
+ * emptied oldest first; empty blocks go back to a pool shared by all
+ * windows. Lines of old paragraphs that are wrapped again are moved into
+ * blocks linked in where the old ones were, to keep that order.
+ */
+
+#define TBPOOLMAX 8
+
+static tbchunk_t *tbpool = NULL;
+static int tbpoolsize = 0;
+
+/* no evicting while lines are being re-wrapped */
+static int reflowing = FALSE;
+
+/* scratch copy of the line being drawn */
+static glui32 tbchars[TBLINELEN];
+static attr_t tbattrs[TBLINELEN];
+
+static tbchunk_t *chunknew(void)
+{
+    tbchunk_t *c;
+
+    if (tbpool)
+    {
+        c = tbpool;
+        tbpool = c->next;
+        tbpoolsize--;
+    }
+    else
+    {
+        c = malloc(sizeof(tbchunk_t));
+        if (!c)
+            return NULL;
+    }
+
+    c->next = NULL;
+    c->used = 0;
+    c->live = 0;
+    return c;
+}
+
+static void chunkfree(tbchunk_t *c)
+{
+    if (tbpoolsize < TBPOOLMAX)
+    {
+        c->next = tbpool;
+        tbpool = c;
+        tbpoolsize++;
+    }
+    else
+    {
+        free(c);
+    }
+}
+
+static void lineclear(tbline_t *ln)
+{
+    ln->dirty = 0;
+    ln->repaint = 0;
+    ln->lm = 0;
+    ln->rm = 0;
+    ln->lpic = 0;
+    ln->rpic = 0;
+    ln->lhyper = 0;
+    ln->rhyper = 0;
+    ln->len = 0;
+    ln->newline = 0;
+    ln->chunk = NULL;
+    ln->spans = NULL;
+    ln->text = NULL;
+    ln->nspans = 0;
+    ln->wide = 0;
+}
+
+/* let go of the pictures a line shows */
+static void linepicsrelease(tbline_t *ln)
+{
+    if (ln->lpic)
+        gli_picture_decrement(ln->lpic);
+    if (ln->rpic)
+        gli_picture_decrement(ln->rpic);
+    ln->lpic = NULL;
+    ln->rpic = NULL;
+}
+
+/* drop the packed text and pictures of a line, and its block once that is empty */
+static void linerelease(window_textbuffer_t *dwin, tbline_t *ln)
+{
+    tbchunk_t *c = ln->chunk;
+    tbchunk_t **pp;
+
+    linepicsrelease(ln);
+
+    if (!c)
+        return;
+
+    ln->chunk = NULL;
+    ln->spans = NULL;
+    ln->text = NULL;
+    ln->nspans = 0;
+
+    if (--c->live > 0)
+        return;
+
+    if (c == dwin->chunktail)
+    {
+        c->used = 0;
+        return;
+    }
+
+    for (pp = &dwin->chunkhead; *pp != c; pp = &(*pp)->next)
+        ;
+    *pp = c->next;
+    dwin->nchunks--;
+    chunkfree(c);
+}
+
+/* forget the oldest line to stay within the scrollback limit */
+static void evictline(window_textbuffer_t *dwin)
+{
+    tbline_t *ln = lineat(dwin, dwin->scrollmax);
+
+    linerelease(dwin, ln);
+    lineclear(ln);
+
+    dwin->scrollmax--;
+    if (dwin->lastseen > dwin->scrollmax)
+        dwin->lastseen = dwin->scrollmax;
+    if (dwin->scrollpos > dwin->scrollmax - dwin->height + 1)
+        dwin->scrollpos = dwin->scrollmax - dwin->height + 1;
+    if (dwin->scrollpos < 0)
+        dwin->scrollpos = 0;
+}
+
+static int overlimit(window_textbuffer_t *dwin, int nchunks)
+{
+    return gli_conf_scrollback > 0 &&
+        (long)nchunks * TBCHUNKSIZE > (long)gli_conf_scrollback * 1024;
+}
+
+/* bytes a line takes up in a block */
+static int packedsize(int nspans, int len, int wide)
+{
+    int need = nspans * sizeof(tbspan_t) + len * (wide ? sizeof(glui32) : 1);
+    return (need + 7) & ~7;
+}
+
+/* copy the text of line 0 into the scrollback */
+static void linepack(window_textbuffer_t *dwin, tbline_t *ln)
+{
+    int len = ln->len;
+    int nspans, wide, need;
+    tbchunk_t *c;
+    tbspan_t *sp;
+    int i;
+
+    if (len == 0)
+        return;
+
+    nspans = 1;
+    wide = dwin->chars[0] > 0xff;
+    for (i = 1; i < len; i++)
+    {
+        if (!attrequal(&dwin->attrs[i-1], &dwin->attrs[i]))
+            nspans++;
+        if (dwin->chars[i] > 0xff)
+            wide = TRUE;
+    }
+
+    need = packedsize(nspans, len, wide);
+
+    c = dwin->chunktail;
+    if (!c || TBCHUNKSIZE - c->used < need)
+    {
+        while (!reflowing && overlimit(dwin, dwin->nchunks + 1)
+                && dwin->scrollmax > MAX(dwin->height, 1))
+        {
+            evictline(dwin);
+            if (c && c->used == 0)
+                break;
+        }
+
+        if (!c || TBCHUNKSIZE - c->used < need)
+        {
+            c = chunknew();
+            if (!c)
+            {
+                ln->len = 0;
+                return;
+            }
+            if (dwin->chunktail)
+                dwin->chunktail->next = c;
+            else
+                dwin->chunkhead = c;
+            dwin->chunktail = c;
+            dwin->nchunks++;
+        }
+    }
+
+    sp = (tbspan_t *)(c->data + c->used);
+    sp->attr = dwin->attrs[0];
+    sp->len = 1;
+    for (i = 1; i < len; i++)
+    {
+        if (!attrequal(&sp->attr, &dwin->attrs[i]))
+        {
+            sp++;
+            sp->attr = dwin->attrs[i];
+            sp->len = 0;
+        }
+        sp->len++;
+    }
+
+    ln->chunk = c;
+    ln->spans = (tbspan_t *)(c->data + c->used);
+    ln->nspans = nspans;
+    ln->wide = wide;
+    ln->text = ln->spans + nspans;
+
+    if (wide)
+        memcpy(ln->text, dwin->chars, len * sizeof(glui32));
+    else
+    {
+        unsigned char *tp = ln->text;
+        for (i = 0; i < len; i++)
+            tp[i] = dwin->chars[i];
+    }
+
+    c->used += need;
+    c->live++;
+}
+
+/*
+ * Move the packed text of n lines, newest first, to the block at *pp.
+ * Lines that don't fit go into new blocks linked in before it, so the
+ * blocks still hold the lines oldest first.
+ */
+static void linerepack(window_textbuffer_t *dwin, tbline_t *lines, int n, tbchunk_t **pp)
+{
+    tbchunk_t *c = *pp;
+    tbline_t *ln;
+    int need;
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        ln = lines + i;
+        if (!ln->chunk)
+            continue;
+
+        need = packedsize(ln->nspans, ln->len, ln->wide);
+
+        if (!c || TBCHUNKSIZE - c->used < need)
+        {
+            c = chunknew();
+            if (!c)
+            {
+                ln->chunk = NULL;
+                ln->spans = NULL;
+                ln->text = NULL;
+                ln->nspans = 0;
+                ln->len = 0;
+                continue;
+            }
+            c->next = *pp;
+            *pp = c;
+            if (!c->next)
+                dwin->chunktail = c;
+            dwin->nchunks++;
+        }
+
+        memcpy(c->data + c->used, ln->spans, need);
+        ln->chunk = c;
+        ln->spans = (tbspan_t *)(c->data + c->used);
+        ln->text = ln->spans + ln->nspans;
+
+        c->used += need;
+        c->live++;
+    }
+}
+
+/* expand a line into full length character and attribute arrays */
+static void lineunpack(window_textbuffer_t *dwin, int line, glui32 *chars, attr_t *attrs)
+{
+    tbline_t *ln = lineat(dwin, line);
+    int i, k, p;
+
+    if (line == 0)
+    {
+        memcpy(chars, dwin->chars, ln->len * sizeof(glui32));
+        memcpy(attrs, dwin->attrs, ln->len * sizeof(attr_t));
+    }
+    else if (ln->chunk)
+    {
+        if (ln->wide)
+            memcpy(chars, ln->text, ln->len * sizeof(glui32));
+        else
+        {
+            unsigned char *tp = ln->text;
+            for (i = 0; i < ln->len; i++)
+                chars[i] = tp[i];
+        }
+
+        for (k = 0, p = 0; k < ln->nspans; k++)
+            for (i = 0; i < ln->spans[k].len; i++)
+                attrs[p++] = ln->spans[k].attr;
+    }
+
+    if (ln->len == 0)
+        attrclear(&attrs[0]);
+}
 
 static void touch(window_textbuffer_t *dwin, int line)
 {
-    window_t *win = dwin->owner;
-    int y = win->bbox.y0 + gli_tmarginy + (dwin->height - line - 1) * gli_leading;
-//    if (dwin->scrollmax && dwin->scrollmax < dwin->height)
-//        y -= (dwin->height - dwin->scrollmax) * gli_leading;
-    dwin->lines[line].dirty = 1;
+    lineat(dwin, line)->dirty = 1;
     gli_clear_selection();
-    winrepaint(win->bbox.x0, y - 2, win->bbox.x1, y + gli_leading + 2);
+    gli_redraw_pending = TRUE;
 }
 
+/* only lines that are visible, or will be once we scroll to the bottom,
+ * need to be marked; everything else is redrawn when scrolled into view */
 static void touchscroll(window_textbuffer_t *dwin)
 {
-    window_t *win = dwin->owner;
     int i;
     gli_clear_selection();
-    winrepaint(win->bbox.x0, win->bbox.y0, win->bbox.x1, win->bbox.y1);
-    for (i = 0; i < dwin->scrollmax; i++)
-        dwin->lines[i].dirty = 1;
+    gli_redraw_pending = TRUE;
+    for (i = 0; i < dwin->height && i < dwin->scrollmax; i++)
+        lineat(dwin, i)->dirty = 1;
+    for (i = dwin->scrollpos; i < dwin->scrollpos + dwin->height && i < dwin->scrollmax; i++)
+        lineat(dwin, i)->dirty = 1;
 }
 
 window_textbuffer_t *win_textbuffer_create(window_t *win)
@@ -80,6 +407,9 @@ window_textbuffer_t *win_textbuffer_create(window_t *win)
     dwin->scrollpos = 0;
     dwin->scrollmax = 0;
     dwin->scrollback = SCROLLBACK;
+    dwin->linehead = 0;
+    dwin->reflowed = 1;
+    dwin->pictall = 0;
 
     dwin->width = -1;
     dwin->height = -1;
@@ -92,27 +422,21 @@ window_textbuffer_t *win_textbuffer_create(window_t *win)
     dwin->ladjn = dwin->radjn = 0;
 
     dwin->numchars = 0;
-    dwin->chars = dwin->lines[0].chars;
-    dwin->attrs = dwin->lines[0].attrs;
+    dwin->chars = malloc(sizeof(glui32) * TBLINELEN);
+    dwin->attrs = malloc(sizeof(attr_t) * TBLINELEN);
+
+    dwin->chunkhead = NULL;
+    dwin->chunktail = NULL;
+    dwin->nchunks = 0;
 
     dwin->spaced = 0;
     dwin->dashed = 0;
 
     for (i = 0; i < dwin->scrollback; i++)
-    {
-        dwin->lines[i].dirty = 0;
-        dwin->lines[i].repaint = 0;
-        dwin->lines[i].lm = 0;
-        dwin->lines[i].rm = 0;
-        dwin->lines[i].lpic = 0;
-        dwin->lines[i].rpic = 0;
-        dwin->lines[i].lhyper = 0;
-        dwin->lines[i].rhyper = 0;
-        dwin->lines[i].len = 0;
-        dwin->lines[i].newline = 0;
-        memset(dwin->lines[i].chars, ' ', sizeof dwin->lines[i].chars);
-        memset(dwin->lines[i].attrs,   0, sizeof dwin->lines[i].attrs);
-    }
+        lineclear(lineat(dwin, i));
+
+    memset(dwin->chars, ' ', TBLINELEN * 4);
+    memset(dwin->attrs, 0, TBLINELEN * sizeof(attr_t));
 
     memcpy(dwin->styles, gli_tstyles, sizeof gli_tstyles);
 
@@ -124,6 +448,8 @@ window_textbuffer_t *win_textbuffer_create(window_t *win)
 
 void win_textbuffer_destroy(window_textbuffer_t *dwin)
 {
+    int i;
+
     if (dwin->inbuf)
     {
         if (gli_unregister_arr)
@@ -139,31 +465,110 @@ void win_textbuffer_destroy(window_textbuffer_t *dwin)
     if (dwin->line_terminators)
         free(dwin->line_terminators);
 
+    for (i = 0; i < dwin->scrollback; i++)
+        linepicsrelease(dwin->lines + i);
+
+    while (dwin->chunkhead)
+    {
+        tbchunk_t *c = dwin->chunkhead;
+        dwin->chunkhead = c->next;
+        chunkfree(c);
+    }
+
+    free(dwin->chars);
+    free(dwin->attrs);
     free(dwin->lines);
     free(dwin);
 }
 
-static void reflow(window_t *win)
+/* the oldest line of the paragraph that line k is part of */
+static int parastart(window_textbuffer_t *dwin, int k)
+{
+    while (k < dwin->scrollmax && !lineat(dwin, k + 1)->newline)
+        k++;
+    return k;
+}
+
+/* a scratch textbuffer to wrap old paragraphs into, with blocks of its own */
+static window_textbuffer_t *scratchbuffer(window_textbuffer_t *dwin)
+{
+    window_textbuffer_t *tmp = malloc(sizeof(window_textbuffer_t));
+    int i;
+
+    if (!tmp)
+        return NULL;
+
+    *tmp = *dwin;
+
+    tmp->lines = malloc(sizeof(tbline_t) * SCROLLBACK);
+    tmp->chars = malloc(sizeof(glui32) * TBLINELEN);
+    tmp->attrs = malloc(sizeof(attr_t) * TBLINELEN);
+    if (!tmp->lines || !tmp->chars || !tmp->attrs)
+    {
+        free(tmp->lines);
+        free(tmp->chars);
+        free(tmp->attrs);
+        free(tmp);
+        return NULL;
+    }
+
+    tmp->scrollback = SCROLLBACK;
+    tmp->linehead = 0;
+    tmp->chunkhead = NULL;
+    tmp->chunktail = NULL;
+    tmp->nchunks = 0;
+    for (i = 0; i < tmp->scrollback; i++)
+        lineclear(tmp->lines + i);
+    memset(tmp->chars, ' ', TBLINELEN * 4);
+    memset(tmp->attrs, 0, TBLINELEN * sizeof(attr_t));
+
+    tmp->numchars = 0;
+    tmp->ladjw = tmp->radjw = 0;
+    tmp->ladjn = tmp->radjn = 0;
+    tmp->spaced = 0;
+    tmp->dashed = 0;
+    tmp->lastseen = 0;
+    tmp->scrollpos = 0;
+    tmp->scrollmax = 0;
+    tmp->reflowed = 1;
+
+    return tmp;
+}
+
+/*
+ * Re-wrap the whole paragraphs in lines first (oldest) down to last.
+ * When last is 0 the text is replayed into the window itself, otherwise
+ * into a scratch buffer whose lines then replace the old ones.
+ */
+static int rewrap(window_t *win, int first, int last)
 {
     window_textbuffer_t *dwin = win->data;
+    window_textbuffer_t *tmp = NULL;
+    window_textbuffer_t *out;
+    tbline_t *tail = NULL;
+    tbline_t *newlines = NULL;
+    tbchunk_t *c, **pp;
+    int ntail = 0;
+    int pictall = 0;
     int inputbyte = -1;
     attr_t curattr;
     attr_t oldattr;
-    int i, k, p, s;
+    int i, k, p, n;
     int x;
 
     if (dwin->height < 4 || dwin->width < 20)
-        return;
-
-    dwin->lines[0].len = dwin->numchars;
+        return FALSE;
 
     /* allocate temp buffers */
-    attr_t *attrbuf = malloc(sizeof(attr_t) * SCROLLBACK * TBLINELEN);
-    glui32 *charbuf = malloc(sizeof(glui32) * SCROLLBACK * TBLINELEN);
-    int *alignbuf = malloc(sizeof(int) * SCROLLBACK);
-    picture_t **pictbuf = malloc(sizeof(picture_t *) * SCROLLBACK);
-    glui32 *hyperbuf = malloc(sizeof(glui32) * SCROLLBACK);
-    int *offsetbuf = malloc(sizeof(int) * SCROLLBACK);
+    for (k = first, p = 0; k >= last; k--)
+        p += lineat(dwin, k)->len + 1;
+
+    attr_t *attrbuf = malloc(sizeof(attr_t) * p);
+    glui32 *charbuf = malloc(sizeof(glui32) * p);
+    int *alignbuf = malloc(sizeof(int) * (first - last + 1) * 2);
+    picture_t **pictbuf = malloc(sizeof(picture_t *) * (first - last + 1) * 2);
+    glui32 *hyperbuf = malloc(sizeof(glui32) * (first - last + 1) * 2);
+    int *offsetbuf = malloc(sizeof(int) * ((first - last + 1) * 2 + 1));
 
     if (!attrbuf || !charbuf || !alignbuf || !pictbuf || !hyperbuf || !offsetbuf)
     {
@@ -173,7 +578,7 @@ static void reflow(window_t *win)
         free(pictbuf);
         free(hyperbuf);
         free(offsetbuf);
-        return;
+        return FALSE;
     }
 
     /* copy text to temp buffers */
@@ -183,39 +588,40 @@ static void reflow(window_t *win)
 
     x = 0;
     p = 0;
-    s = dwin->scrollmax < SCROLLBACK ? dwin->scrollmax : SCROLLBACK - 1;
 
-    for (k = s; k >= 0; k--)
+    for (k = first; k >= last; k--)
     {
         if (k == 0 && win->line_request)
             inputbyte = p + dwin->infence;
 
-        if (dwin->lines[k].lpic)
+        if (lineat(dwin, k)->lpic)
         {
             offsetbuf[x] = p;
             alignbuf[x] = imagealign_MarginLeft;
-            pictbuf[x] = dwin->lines[k].lpic;
-            hyperbuf[x] = dwin->lines[k].lhyper;
+            pictbuf[x] = lineat(dwin, k)->lpic;
+            gli_picture_increment(pictbuf[x]);
+            hyperbuf[x] = lineat(dwin, k)->lhyper;
             x++;
         }
 
-        if (dwin->lines[k].rpic)
+        if (lineat(dwin, k)->rpic)
         {
             offsetbuf[x] = p;
             alignbuf[x] = imagealign_MarginRight;
-            pictbuf[x] = dwin->lines[k].rpic;
-            hyperbuf[x] = dwin->lines[k].rhyper;
+            pictbuf[x] = lineat(dwin, k)->rpic;
+            gli_picture_increment(pictbuf[x]);
+            hyperbuf[x] = lineat(dwin, k)->rhyper;
             x++;
         }
 
-        for (i = 0; i < dwin->lines[k].len; i++)
+        if (lineat(dwin, k)->len)
         {
-            attrbuf[p] = curattr = dwin->lines[k].attrs[i];
-            charbuf[p] = dwin->lines[k].chars[i];
-            p++;
+            lineunpack(dwin, k, charbuf + p, attrbuf + p);
+            p += lineat(dwin, k)->len;
+            curattr = attrbuf[p - 1];
         }
 
-        if (dwin->lines[k].newline)
+        if (lineat(dwin, k)->newline)
         {
             attrbuf[p] = curattr;
             charbuf[p] = '\n';
@@ -225,12 +631,47 @@ static void reflow(window_t *win)
 
     offsetbuf[x] = -1;
 
-    /* clear window */
+    if (last == 0)
+    {
+        /* set the older lines aside, they keep their wrapping for now */
+        ntail = dwin->scrollmax - first;
+        if (ntail)
+            tail = malloc(sizeof(tbline_t) * ntail);
+        if (!tail)
+            ntail = 0;
+        for (i = 0; i < ntail; i++)
+        {
+            tail[i] = *lineat(dwin, first + 1 + i);
+            lineclear(lineat(dwin, first + 1 + i));
+        }
 
-    win_textbuffer_clear(win);
+        /* clear window, but remember how tall the older pictures are */
+        pictall = dwin->pictall;
+        win_textbuffer_clear(win);
+    }
+    else
+    {
+        tmp = scratchbuffer(dwin);
+        if (!tmp)
+        {
+            for (i = 0; offsetbuf[i] != -1; i++)
+                gli_picture_decrement(pictbuf[i]);
+            free(attrbuf);
+            free(charbuf);
+            free(alignbuf);
+            free(pictbuf);
+            free(hyperbuf);
+            free(offsetbuf);
+            return FALSE;
+        }
+        win->data = tmp;
+    }
 
     /* and dump text back */
 
+    out = win->data;
+    reflowing = TRUE;
+
     x = 0;
     for (i = 0; i < p; i++)
     {
@@ -240,25 +681,111 @@ static void reflow(window_t *win)
 
         if (offsetbuf[x] == i)
         {
-            put_picture(dwin, pictbuf[x], alignbuf[x], hyperbuf[x]);
+            put_picture(out, pictbuf[x], alignbuf[x], hyperbuf[x]);
             x ++;
         }
 
         win_textbuffer_putchar_uni(win, charbuf[i]);
     }
 
-    /* terribly sorry about this... */
-    dwin->lastseen = 0;
-    dwin->scrollpos = 0;
+    if (tmp && (tmp->numchars || lineat(tmp, 0)->lpic || lineat(tmp, 0)->rpic))
+        scrolloneline(tmp, 0);
 
-    if (inputbyte != -1)
+    reflowing = FALSE;
+
+    if (last == 0)
     {
-        dwin->infence = dwin->numchars;
-        put_text_uni(dwin, charbuf + inputbyte, p - inputbyte, dwin->numchars, 0);
-        dwin->incurs = dwin->numchars;
+        /* terribly sorry about this... */
+        dwin->lastseen = 0;
+        dwin->scrollpos = 0;
+
+        if (inputbyte != -1)
+        {
+            dwin->infence = dwin->numchars;
+            put_text_uni(dwin, charbuf + inputbyte, p - inputbyte, dwin->numchars, 0);
+            dwin->incurs = dwin->numchars;
+        }
+
+        /* put the older lines back above the new ones */
+        dwin->reflowed = dwin->scrollmax + 1;
+        for (i = 0; i < ntail; i++)
+        {
+            if (dwin->scrollmax + 1 > dwin->scrollback - 1)
+                scrollresize(dwin);
+            if (dwin->scrollmax + 1 > dwin->scrollback - 1)
+                linerelease(dwin, tail + i);
+            else
+                *lineat(dwin, ++dwin->scrollmax) = tail[i];
+        }
+        free(tail);
+
+        if (pictall > dwin->pictall)
+            dwin->pictall = pictall;
+    }
+    else
+    {
+        /* splice the scratch lines in place of the old ones */
+        win->data = dwin;
+
+        n = tmp->scrollmax;
+        k = dwin->scrollmax - (first - last + 1) + n;
+        x = dwin->scrollback;
+        while (x - 1 < k || x - 1 < dwin->lastseen)
+            x *= 2;
+
+        newlines = malloc(sizeof(tbline_t) * x);
+        if (newlines)
+        {
+            for (i = last; i <= first; i++)
+                linerelease(dwin, lineat(dwin, i));
+
+            /* the new lines join the block of the next newer line, or go before it */
+            c = NULL;
+            for (i = last - 1; i > 0 && !c; i--)
+                c = lineat(dwin, i)->chunk;
+            for (pp = &dwin->chunkhead; *pp != c; pp = &(*pp)->next)
+                ;
+
+            for (i = 0; i < last; i++)
+                newlines[i] = *lineat(dwin, i);
+            for (i = 0; i < n; i++)
+                newlines[last + i] = *lineat(tmp, i + 1);
+            for (i = first + 1; i <= dwin->scrollmax; i++)
+                newlines[last + n + i - first - 1] = *lineat(dwin, i);
+            for (i = k + 1; i < x; i++)
+                lineclear(newlines + i);
+
+            linerepack(dwin, newlines + last, n, pp);
+
+            free(dwin->lines);
+            dwin->lines = newlines;
+            dwin->linehead = 0;
+            dwin->scrollback = x;
+            dwin->scrollmax = k;
+            dwin->reflowed = last + n;
+        }
+        else
+        {
+            for (i = 1; i <= n; i++)
+                linepicsrelease(lineat(tmp, i));
+        }
+
+        while (tmp->chunkhead)
+        {
+            c = tmp->chunkhead;
+            tmp->chunkhead = c->next;
+            chunkfree(c);
+        }
+
+        free(tmp->lines);
+        free(tmp->chars);
+        free(tmp->attrs);
+        free(tmp);
     }
 
     /* free temp buffers */
+    for (i = 0; offsetbuf[i] != -1; i++)
+        gli_picture_decrement(pictbuf[i]);
     free(attrbuf);
     free(charbuf);
     free(alignbuf);
@@ -269,6 +796,39 @@ static void reflow(window_t *win)
     win->attr = oldattr;
 
     touchscroll(dwin);
+
+    return newlines || last == 0;
+}
+
+/* make sure lines up to 'upto' are wrapped to the current width */
+static void reflowto(window_t *win, int upto)
+{
+    window_textbuffer_t *dwin = win->data;
+    int first;
+
+    while (dwin->reflowed <= upto && dwin->reflowed <= dwin->scrollmax)
+    {
+        first = parastart(dwin, MIN(upto + REFLOWAHEAD, dwin->scrollmax));
+        if (!rewrap(win, first, dwin->reflowed))
+            break;
+    }
+}
+
+/*
+ * Only the paragraphs that fill the window, and a margin above it, are
+ * wrapped to the new width right away; older ones follow as they are
+ * scrolled towards.
+ */
+static void reflow(window_t *win)
+{
+    window_textbuffer_t *dwin = win->data;
+    int first;
+
+    lineat(dwin, 0)->len = dwin->numchars;
+
+    first = parastart(dwin, MIN(dwin->height + REFLOWAHEAD, dwin->scrollmax));
+    if (rewrap(win, first, 0))
+        reflowto(win, dwin->height + REFLOWAHEAD);
 }
 
 void win_textbuffer_rearrange(window_t *win, rect_t *box)
@@ -307,6 +867,7 @@ void win_textbuffer_rearrange(window_t *win, rect_t *box)
             dwin->scrollpos = dwin->scrollmax - dwin->height + 1;
         if (dwin->scrollpos < 0)
             dwin->scrollpos = 0;
+        reflowto(win, dwin->scrollpos + dwin->height);
         touchscroll(dwin);
 
         /* allocate copy buffer */
@@ -350,6 +911,8 @@ void win_textbuffer_redraw(window_t *win)
 {
     window_textbuffer_t *dwin = win->data;
     tbline_t *ln;
+    glui32 *chars = tbchars;
+    attr_t *attrs = tbattrs;
     int linelen;
     int nsp, spw, pw;
     int x0, y0, x1, y1;
@@ -358,16 +921,12 @@ void win_textbuffer_redraw(window_t *win)
     glui32 link;
     int font;
     unsigned char *color;
-    int i;
+    int i, last;
     int hx0, hx1, hy0, hy1;
     int selbuf, selrow, selchar, sx0, sx1, selleft, selright;
     int tx, tsc, tsw, lsc, rsc;
 
-    dwin->lines[0].len = dwin->numchars;
-
-    ln = malloc(sizeof(tbline_t));
-    if (!ln)
-        return;
+    lineat(dwin, 0)->len = dwin->numchars;
 
     x0 = (win->bbox.x0 + gli_tmarginx) * GLI_SUBPIX;
     x1 = (win->bbox.x1 - gli_tmarginx - gli_scroll_width) * GLI_SUBPIX;
@@ -401,11 +960,11 @@ void win_textbuffer_redraw(window_t *win)
             selrow = FALSE;
         }
 
+        ln = lineat(dwin, i);
+
         /* mark selected line dirty */
         if (selrow)
-            dwin->lines[i].dirty = TRUE;
-
-        memcpy(ln, dwin->lines + i, sizeof(tbline_t));
+            ln->dirty = TRUE;
 
         /* skip if we can */
         if (!ln->dirty && !ln->repaint && !gli_force_redraw && dwin->scrollpos == 0)
@@ -418,29 +977,30 @@ void win_textbuffer_redraw(window_t *win)
         /* keep selected line dirty and flag for repaint */
         if (!selrow)
         {
-            dwin->lines[i].dirty = FALSE;
-            dwin->lines[i].repaint = FALSE;
+            ln->dirty = FALSE;
+            ln->repaint = FALSE;
         }
         else
         {
-            dwin->lines[i].repaint = TRUE;
+            ln->repaint = TRUE;
         }
 
         /* leave bottom line blank for [more] prompt */
         if (i == dwin->scrollpos && i > 0)
             continue;
 
+        lineunpack(dwin, i, chars, attrs);
         linelen = ln->len;
 
         /* kill spaces at the end unless they're a different color*/
         color = gli_override_bg_set ? gli_window_color : win->bgcolor;
-        while (i > 0 && linelen > 1 && ln->chars[linelen-1] == ' ' 
-            && dwin->styles[ln->attrs[linelen-1].style].bg == color 
-            && !dwin->styles[ln->attrs[linelen-1].style].reverse)
+        while (i > 0 && linelen > 1 && chars[linelen-1] == ' ' 
+            && dwin->styles[attrs[linelen-1].style].bg == color 
+            && !dwin->styles[attrs[linelen-1].style].reverse)
                 linelen --;
 
         /* kill characters that would overwrite the scroll bar */
-        while (linelen > 1 && calcwidth(dwin, ln->chars, ln->attrs, 0, linelen, -1) >= pw)
+        while (linelen > 1 && calcwidth(dwin, chars, attrs, 0, linelen, -1) >= pw)
             linelen --;
 
         /*
@@ -449,9 +1009,9 @@ void win_textbuffer_redraw(window_t *win)
         if (gli_conf_justify && !ln->newline && i > 0)
         {
             for (a = 0, nsp = 0; a < linelen; a++)
-                if (ln->chars[a] == ' ')
+                if (chars[a] == ' ')
                     nsp ++;
-            w = calcwidth(dwin, ln->chars, ln->attrs, 0, linelen, 0);
+            w = calcwidth(dwin, chars, attrs, 0, linelen, 0);
             if (nsp)
                 spw = (x1 - x0 - ln->lm - ln->rm - 2 * SLOP - w) / nsp;
             else
@@ -472,7 +1032,7 @@ void win_textbuffer_redraw(window_t *win)
             if (selleft && selright)
             {
                 rsc = linelen > 0 ? linelen - 1 : 0;
-                selchar = calcwidth(dwin, ln->chars, ln->attrs, lsc, rsc, spw)/GLI_SUBPIX;
+                selchar = calcwidth(dwin, chars, attrs, lsc, rsc, spw)/GLI_SUBPIX;
             }
             else
             {
@@ -480,7 +1040,7 @@ void win_textbuffer_redraw(window_t *win)
                 if (selleft)
                 {
                     tsc = linelen > 0 ? linelen - 1 : 0;
-                    selchar = calcwidth(dwin, ln->chars, ln->attrs, lsc, tsc, spw)/GLI_SUBPIX;
+                    selchar = calcwidth(dwin, chars, attrs, lsc, tsc, spw)/GLI_SUBPIX;
                 }
                 else
                 {
@@ -489,9 +1049,9 @@ void win_textbuffer_redraw(window_t *win)
                     /* measure string widths until we find left char */
                     for (tsc = 0; tsc < linelen; tsc++)
                     {
-                        tsw = calcwidth(dwin, ln->chars, ln->attrs, 0, tsc, spw)/GLI_SUBPIX;
+                        tsw = calcwidth(dwin, chars, attrs, 0, tsc, spw)/GLI_SUBPIX;
                         if (tsw + tx >= sx0 ||
-                                tsw + tx + GLI_SUBPIX >= sx0 && ln->chars[tsc] != ' ')
+                                tsw + tx + GLI_SUBPIX >= sx0 && chars[tsc] != ' ')
                         {
                             lsc = tsc;
                             selchar = TRUE;
@@ -511,7 +1071,7 @@ void win_textbuffer_redraw(window_t *win)
                     /* measure string widths until we find right char */
                         for (tsc = lsc; tsc < linelen; tsc++)
                         {
-                            tsw = calcwidth(dwin, ln->chars, ln->attrs, lsc, tsc, spw)/GLI_SUBPIX;
+                            tsw = calcwidth(dwin, chars, attrs, lsc, tsc, spw)/GLI_SUBPIX;
                             if (tsw + sx0 < sx1)
                                 rsc = tsc;
                         }
@@ -525,8 +1085,8 @@ void win_textbuffer_redraw(window_t *win)
             {
                 for (tsc = lsc; tsc <= rsc; tsc++)
                 {
-                    ln->attrs[tsc].reverse = !ln->attrs[tsc].reverse;
-                    dwin->copybuf[dwin->copypos] = ln->chars[tsc];
+                    attrs[tsc].reverse = !attrs[tsc].reverse;
+                    dwin->copybuf[dwin->copypos] = chars[tsc];
                     dwin->copypos++;
                 }
             }
@@ -535,6 +1095,8 @@ void win_textbuffer_redraw(window_t *win)
             dwin->copypos++;
         }
 
+        gli_damage_begin(win->bbox.x0, y - 2, win->bbox.x1, y + gli_leading + 2);
+
         /* clear any stored hyperlink coordinates */
         gli_put_hyperlink(0, x0/GLI_SUBPIX, y,
                 x1/GLI_SUBPIX, y + gli_leading);
@@ -551,12 +1113,12 @@ void win_textbuffer_redraw(window_t *win)
         a = 0;
         for (b = 0; b < linelen; b++)
         {
-            if (!attrequal(&ln->attrs[a], &ln->attrs[b]))
+            if (!attrequal(&attrs[a], &attrs[b]))
             {
-                link = ln->attrs[a].hyper;
-                font = attrfont(dwin->styles, &ln->attrs[a]);
-                color = attrbg(dwin->styles, &ln->attrs[a]);
-                w = gli_string_width_uni(font, ln->chars + a, b - a, spw);
+                link = attrs[a].hyper;
+                font = attrfont(dwin->styles, &attrs[a]);
+                color = attrbg(dwin->styles, &attrs[a]);
+                w = gli_string_width_uni(font, chars + a, b - a, spw);
                 gli_draw_rect(x/GLI_SUBPIX, y,
                         w/GLI_SUBPIX, gli_leading,
                         color);
@@ -573,10 +1135,10 @@ void win_textbuffer_redraw(window_t *win)
                 a = b;
             }
         }
-        link = ln->attrs[a].hyper;
-        font = attrfont(dwin->styles, &ln->attrs[a]);
-        color = attrbg(dwin->styles, &ln->attrs[a]);
-        w = gli_string_width_uni(font, ln->chars + a, b - a, spw);
+        link = attrs[a].hyper;
+        font = attrfont(dwin->styles, &attrs[a]);
+        color = attrbg(dwin->styles, &attrs[a]);
+        w = gli_string_width_uni(font, chars + a, b - a, spw);
         gli_draw_rect(x/GLI_SUBPIX, y, w/GLI_SUBPIX,
                 gli_leading, color);
         if (link)
@@ -614,21 +1176,23 @@ void win_textbuffer_redraw(window_t *win)
         a = 0;
         for (b = 0; b < linelen; b++)
         {
-            if (!attrequal(&ln->attrs[a], &ln->attrs[b]))
+            if (!attrequal(&attrs[a], &attrs[b]))
             {
-                link = ln->attrs[a].hyper;
-                font = attrfont(dwin->styles, &ln->attrs[a]);
-                color = link ? gli_link_color : attrfg(dwin->styles, &ln->attrs[a]);
+                link = attrs[a].hyper;
+                font = attrfont(dwin->styles, &attrs[a]);
+                color = link ? gli_link_color : attrfg(dwin->styles, &attrs[a]);
                 x = gli_draw_string_uni(x, y + gli_baseline,
-                        font, color, ln->chars + a, b - a, spw);
+                        font, color, chars + a, b - a, spw);
                 a = b;
             }
         }
-        link = ln->attrs[a].hyper;
-        font = attrfont(dwin->styles, &ln->attrs[a]);
-        color = link ? gli_link_color : attrfg(dwin->styles, &ln->attrs[a]);
+        link = attrs[a].hyper;
+        font = attrfont(dwin->styles, &attrs[a]);
+        color = link ? gli_link_color : attrfg(dwin->styles, &attrs[a]);
         gli_draw_string_uni(x, y + gli_baseline,
-                font, color, ln->chars + a, linelen - a, spw);
+                font, color, chars + a, linelen - a, spw);
+
+        gli_damage_end();
     }
 
     /*
@@ -639,6 +1203,8 @@ void win_textbuffer_redraw(window_t *win)
         x = x0 + SLOP;
         y = y0 + (dwin->height - 1) * gli_leading;
 
+        gli_damage_begin(x0/GLI_SUBPIX, y, x1/GLI_SUBPIX, y + gli_leading);
+
         gli_put_hyperlink(0, x0/GLI_SUBPIX, y,
                 x1/GLI_SUBPIX, y + gli_leading);
 
@@ -659,6 +1225,7 @@ void win_textbuffer_redraw(window_t *win)
         gli_draw_string(x, y + gli_baseline, 
                 gli_more_font, color,
                 gli_more_prompt, strlen(gli_more_prompt), -1);
+        gli_damage_end();
         y1 = y; /* don't want pictures overdrawing "[more]" */
 
         /* try to claim the focus */
@@ -672,46 +1239,55 @@ void win_textbuffer_redraw(window_t *win)
     }
 
     /*
-     * draw the images
+     * draw the images; they hang down from their line, so lines above
+     * the window can still show one
      */
-    for (i = 0; i < dwin->scrollback; i++)
+    last = dwin->scrollpos + dwin->height + (dwin->pictall + gli_leading - 1) / gli_leading;
+    for (i = dwin->scrollpos; i <= last && i <= dwin->scrollmax && i < dwin->scrollback; i++)
     {
-        memcpy(ln, dwin->lines + i, sizeof(tbline_t));
+        tbline_t *pln = lineat(dwin, i);
+
+        if (!pln->lpic && !pln->rpic)
+            continue;
 
         y = y0 + (dwin->height - (i - dwin->scrollpos) - 1) * gli_leading;
 
-        if (ln->lpic)
+        if (pln->lpic)
         {
-            if (y < y1 && y + ln->lpic->h > y0)
+            if (y < y1 && y + pln->lpic->h > y0)
             {
-                gli_draw_picture(ln->lpic,
-                        x0/GLI_SUBPIX, y,
-                        x0/GLI_SUBPIX, y0, x1/GLI_SUBPIX, y1);
-                link = ln->lhyper;
+                link = pln->lhyper;
                 hy0 = y > y0 ? y : y0;
-                hy1 = y + ln->lpic->h < y1 ? y + ln->lpic->h : y1;
+                hy1 = y + pln->lpic->h < y1 ? y + pln->lpic->h : y1;
                 hx0 = x0/GLI_SUBPIX;
-                hx1 = x0/GLI_SUBPIX + ln->lpic->w < x1/GLI_SUBPIX
-                            ? x0/GLI_SUBPIX + ln->lpic->w
+                hx1 = x0/GLI_SUBPIX + pln->lpic->w < x1/GLI_SUBPIX
+                            ? x0/GLI_SUBPIX + pln->lpic->w
                             : x1/GLI_SUBPIX;
+                gli_damage_begin(hx0, hy0, hx1, hy1);
+                gli_draw_picture(pln->lpic,
+                        x0/GLI_SUBPIX, y,
+                        x0/GLI_SUBPIX, y0, x1/GLI_SUBPIX, y1);
+                gli_damage_end();
                 gli_put_hyperlink(link, hx0, hy0, hx1, hy1);
             }
         }
 
-        if (ln->rpic)
+        if (pln->rpic)
         {
-            if (y < y1 && y + ln->rpic->h > y0)
+            if (y < y1 && y + pln->rpic->h > y0)
             {
-                gli_draw_picture(ln->rpic,
-                        x1/GLI_SUBPIX - ln->rpic->w, y,
-                        x0/GLI_SUBPIX, y0, x1/GLI_SUBPIX, y1);
-                link = ln->rhyper;
+                link = pln->rhyper;
                 hy0 = y > y0 ? y : y0;
-                hy1 = y + ln->rpic->h < y1 ? y + ln->rpic->h : y1;
-                hx0 = x1/GLI_SUBPIX - ln->rpic->w > x0/GLI_SUBPIX
-                            ? x1/GLI_SUBPIX - ln->rpic->w
+                hy1 = y + pln->rpic->h < y1 ? y + pln->rpic->h : y1;
+                hx0 = x1/GLI_SUBPIX - pln->rpic->w > x0/GLI_SUBPIX
+                            ? x1/GLI_SUBPIX - pln->rpic->w
                             : x0/GLI_SUBPIX;
                 hx1 = x1/GLI_SUBPIX;
+                gli_damage_begin(hx0, hy0, hx1, hy1);
+                gli_draw_picture(pln->rpic,
+                        x1/GLI_SUBPIX - pln->rpic->w, y,
+                        x0/GLI_SUBPIX, y0, x1/GLI_SUBPIX, y1);
+                gli_damage_end();
                 gli_put_hyperlink(link, hx0, hy0, hx1, hy1);
             }
         }
@@ -732,6 +1308,8 @@ void win_textbuffer_redraw(window_t *win)
         y0 = win->bbox.y0 + gli_tmarginy;
         y1 = win->bbox.y1 - gli_tmarginy;
 
+        gli_damage_begin(x0, y0, x1, y1);
+
         gli_put_hyperlink(0, x0, y0, x1, y1);
 
         y0 += gli_scroll_width / 2;
@@ -762,6 +1340,8 @@ void win_textbuffer_redraw(window_t *win)
                     y1 + gli_scroll_width/2 - i,
                     i*2, 1, gli_scroll_fg);
         }
+
+        gli_damage_end();
     }
 
     /* send selected text to clipboard */
@@ -777,40 +1357,30 @@ void win_textbuffer_redraw(window_t *win)
     /* no more prompt means all text has been seen */
     if (!dwin->owner->more_request)
         dwin->lastseen = 0;
-
-    free(ln);
 }
 
+/* grow the ring, unrolling it so that line 0 is back at the start */
 static void scrollresize(window_textbuffer_t *dwin)
 {
+    int newsize = dwin->scrollback * 2;
     int i;
 
-    tbline_t *newlines = realloc(dwin->lines, sizeof(tbline_t) * (dwin->scrollback + SCROLLBACK));
+    tbline_t *newlines = malloc(sizeof(tbline_t) * newsize);
 
     if (!newlines)
         return;
 
+    for (i = 0; i < dwin->scrollback; i++)
+        memcpy(newlines + i, lineat(dwin, i), sizeof(tbline_t));
+
+    free(dwin->lines);
     dwin->lines = newlines;
-    dwin->chars = dwin->lines[0].chars;
-    dwin->attrs = dwin->lines[0].attrs;
-
-    for (i = dwin->scrollback; i < (dwin->scrollback + SCROLLBACK); i++)
-    {
-        dwin->lines[i].dirty = 0;
-        dwin->lines[i].repaint = 0;
-        dwin->lines[i].lm = 0;
-        dwin->lines[i].rm = 0;
-        dwin->lines[i].lpic = 0;
-        dwin->lines[i].rpic = 0;
-        dwin->lines[i].lhyper = 0;
-        dwin->lines[i].rhyper = 0;
-        dwin->lines[i].len = 0;
-        dwin->lines[i].newline = 0;
-        memset(dwin->lines[i].chars, ' ', sizeof dwin->lines[i].chars);
-        memset(dwin->lines[i].attrs,   0, sizeof dwin->lines[i].attrs);
-    }
-
-    dwin->scrollback += SCROLLBACK;
+    dwin->linehead = 0;
+
+    for (i = dwin->scrollback; i < newsize; i++)
+        lineclear(dwin->lines + i);
+
+    dwin->scrollback = newsize;
 }
 
 static void scrolloneline(window_textbuffer_t *dwin, int forced)
@@ -819,6 +1389,7 @@ static void scrolloneline(window_textbuffer_t *dwin, int forced)
 
     dwin->lastseen ++;
     dwin->scrollmax ++;
+    dwin->reflowed ++;
 
     if (dwin->scrollmax > dwin->scrollback - 1
             || dwin->lastseen > dwin->scrollback - 1)
@@ -836,15 +1407,17 @@ static void scrolloneline(window_textbuffer_t *dwin, int forced)
         dwin->dashed = 0;
     dwin->spaced = 0;
 
-    dwin->lines[0].len = dwin->numchars;
-    dwin->lines[0].newline = forced;
+    lineat(dwin, 0)->len = dwin->numchars;
+    lineat(dwin, 0)->newline = forced;
 
-    for (i = dwin->scrollback - 1; i > 0; i--)
-    {
-        memcpy(dwin->lines+i, dwin->lines+i-1, sizeof(tbline_t));
-        if (i < dwin->height)
-            touch(dwin, i);
-    }
+    /* rotate the ring: the oldest slot becomes the new line 0 */
+    dwin->linehead = (dwin->linehead + dwin->scrollback - 1) % dwin->scrollback;
+    lineat(dwin, 0)->dirty = lineat(dwin, 1)->dirty;
+    lineat(dwin, 0)->repaint = lineat(dwin, 1)->repaint;
+    linepack(dwin, lineat(dwin, 1));
+
+    for (i = 1; i < dwin->height && i < dwin->scrollback; i++)
+        touch(dwin, i);
 
     if (dwin->radjn)
         dwin->radjn--;
@@ -856,14 +1429,14 @@ static void scrolloneline(window_textbuffer_t *dwin, int forced)
         dwin->ladjw = 0;
 
     touch(dwin, 0);
-    dwin->lines[0].len = 0;
-    dwin->lines[0].newline = 0;
-    dwin->lines[0].lm = dwin->ladjw;
-    dwin->lines[0].rm = dwin->radjw;
-    dwin->lines[0].lpic = NULL;
-    dwin->lines[0].rpic = NULL;
-    dwin->lines[0].lhyper = 0;
-    dwin->lines[0].rhyper = 0;
+    lineat(dwin, 0)->len = 0;
+    lineat(dwin, 0)->newline = 0;
+    lineat(dwin, 0)->lm = dwin->ladjw;
+    lineat(dwin, 0)->rm = dwin->radjw;
+    lineat(dwin, 0)->lpic = NULL;
+    lineat(dwin, 0)->rpic = NULL;
+    lineat(dwin, 0)->lhyper = 0;
+    lineat(dwin, 0)->rhyper = 0;
     memset(dwin->chars, ' ', TBLINELEN * 4);
     memset(dwin->attrs, 0, TBLINELEN * sizeof(attr_t));
 
@@ -1134,23 +1707,27 @@ void win_textbuffer_clear(window_t *win)
 
     dwin->numchars = 0;
 
-    for (i = 0; i < dwin->scrollback; i++)
+    /* oldest first, so blocks are released from the front */
+    for (i = dwin->scrollback - 1; i >= 0; i--)
     {
-        dwin->lines[i].len = 0;
-        dwin->lines[i].lpic = 0;
-        dwin->lines[i].rpic = 0;
-        dwin->lines[i].lhyper = 0;
-        dwin->lines[i].rhyper = 0;
-        dwin->lines[i].lm = 0;
-        dwin->lines[i].rm = 0;
-        dwin->lines[i].newline = 0;
-        dwin->lines[i].dirty = 1;
-        dwin->lines[i].repaint = 0;
+        linerelease(dwin, lineat(dwin, i));
+        lineat(dwin, i)->len = 0;
+        lineat(dwin, i)->lpic = 0;
+        lineat(dwin, i)->rpic = 0;
+        lineat(dwin, i)->lhyper = 0;
+        lineat(dwin, i)->rhyper = 0;
+        lineat(dwin, i)->lm = 0;
+        lineat(dwin, i)->rm = 0;
+        lineat(dwin, i)->newline = 0;
+        lineat(dwin, i)->dirty = 1;
+        lineat(dwin, i)->repaint = 0;
     }
 
     dwin->lastseen = 0;
     dwin->scrollpos = 0;
     dwin->scrollmax = 0;
+    dwin->reflowed = 1;
+    dwin->pictall = 0;
 
     for (i = 0; i < dwin->height; i++)
         touch(dwin, i);
@@ -1355,6 +1932,9 @@ int gcmd_accept_scroll(window_t *win, glui32 arg)
     int pageht = dwin->height - 2;        /* 1 for prompt, 1 for overlap */
     int startpos = dwin->scrollpos;
 
+    /* lines we may scroll to have to be wrapped to the current width */
+    reflowto(win, dwin->scrollpos + dwin->height + MAX(pageht, 3));
+
     switch (arg)
     {
         case keycode_PageUp:
@@ -1707,16 +2287,20 @@ void gcmd_buffer_accept_readline(window_t *win, glui32 arg)
 static glui32
 put_picture(window_textbuffer_t *dwin, picture_t *pic, glui32 align, glui32 linkval)
 {
+    if (pic->h > dwin->pictall)
+        dwin->pictall = pic->h;
+
     if (align == imagealign_MarginRight)
     {
-        if (dwin->lines[0].rpic || dwin->numchars)
+        if (lineat(dwin, 0)->rpic || dwin->numchars)
             return FALSE;
 
         dwin->radjw = (pic->w + gli_tmarginx) * GLI_SUBPIX;
         dwin->radjn = (pic->h + gli_cellh - 1) / gli_cellh;
-        dwin->lines[0].rpic = pic;
-        dwin->lines[0].rm = dwin->radjw;
-        dwin->lines[0].rhyper = linkval;
+        lineat(dwin, 0)->rpic = pic;
+        gli_picture_increment(pic);
+        lineat(dwin, 0)->rm = dwin->radjw;
+        lineat(dwin, 0)->rhyper = linkval;
     }
 
     else
@@ -1724,14 +2308,15 @@ put_picture(window_textbuffer_t *dwin, picture_t *pic, glui32 align, glui32 link
         if (align != imagealign_MarginLeft && dwin->numchars)
             win_textbuffer_putchar_uni(dwin->owner, '\n');
 
-        if (dwin->lines[0].lpic || dwin->numchars)
+        if (lineat(dwin, 0)->lpic || dwin->numchars)
             return FALSE;
 
         dwin->ladjw = (pic->w + gli_tmarginx) * GLI_SUBPIX;
         dwin->ladjn = (pic->h + gli_cellh - 1) / gli_cellh;
-        dwin->lines[0].lpic = pic;
-        dwin->lines[0].lm = dwin->ladjw;
-        dwin->lines[0].lhyper = linkval;
+        lineat(dwin, 0)->lpic = pic;
+        gli_picture_increment(pic);
+        lineat(dwin, 0)->lm = dwin->ladjw;
+        lineat(dwin, 0)->lhyper = linkval;
 
         if (align != imagealign_MarginLeft)
             win_textbuffer_flow_break(dwin);
@@ -1762,6 +2347,8 @@ glui32 win_textbuffer_draw_picture(window_textbuffer_t *dwin,
     {
         picture_t *tmp;
         tmp = gli_picture_scale(pic, width, height);
+        if (!tmp)
+            return FALSE;
         pic = tmp;
     }
 
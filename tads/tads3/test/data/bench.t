@@ -0,0 +1,125 @@
+/*
+ *   Interpreter benchmark - a compute-bound program for test_bench.  This
+ *   exercises the common instruction mix: local variable arithmetic and
+ *   branches, function calls and returns, property evaluation and method
+ *   calls (including properties inherited through a class hierarchy, with
+ *   several classes seen at the same call site), and list indexing.
+ */
+
+#include "tads.h"
+
+class Counter: object
+    count = 0
+    bump(n)
+    {
+        count += n;
+        return count;
+    }
+;
+
+counter: Counter
+;
+
+class Shape: object
+    sides = 0
+    scale = 1
+    area(n) { return sides * scale * n; }
+;
+
+class Polygon: Shape;
+class ConvexPolygon: Polygon;
+class RegularPolygon: ConvexPolygon;
+
+class Triangle: RegularPolygon
+    sides = 3
+;
+
+class Square: RegularPolygon
+    sides = 4
+;
+
+class Pentagon: RegularPolygon
+    sides = 5
+;
+
+triangle: Triangle;
+square: Square;
+pentagon: Pentagon;
+
+function _main(args)
+{
+    tadsSay('fib(20) = ' + fib(20) + '\n');
+    tadsSay('primes below 5000 = ' + countPrimes(5000) + '\n');
+    tadsSay('property calls = ' + propLoop(50000) + '\n');
+    tadsSay('inherited calls = ' + inheritLoop(30000) + '\n');
+    tadsSay('list sum = ' + listLoop(200) + '\n');
+}
+
+function fib(n)
+{
+    if (n < 2)
+        return n;
+    return fib(n - 1) + fib(n - 2);
+}
+
+function countPrimes(n)
+{
+    local cnt = 0;
+
+    for (local i = 2 ; i < n ; ++i)
+    {
+        local prime = true;
+
+        for (local j = 2 ; j * j <= i ; ++j)
+        {
+            if (i % j == 0)
+            {
+                prime = nil;
+                break;
+            }
+        }
+
+        if (prime)
+            ++cnt;
+    }
+
+    return cnt;
+}
+
+function propLoop(n)
+{
+    counter.count = 0;
+    for (local i = 0 ; i < n ; ++i)
+        counter.bump(i & 7);
+    return counter.count;
+}
+
+function inheritLoop(n)
+{
+    local shapes = [triangle, square, pentagon];
+    local sum = 0;
+
+    for (local i = 0 ; i < n ; ++i)
+    {
+        local s = shapes[i % 3 + 1];
+        sum += s.area(i & 3) + s.scale;
+    }
+    return sum;
+}
+
+function listLoop(n)
+{
+    local lst = [];
+    local sum = 0;
+
+    for (local i = 1 ; i <= n ; ++i)
+        lst += i;
+
+    for (local rep = 0 ; rep < 50 ; ++rep)
+    {
+        for (local i = 1 ; i <= n ; ++i)
+            sum += lst[i];
+    }
+
+    return sum;
+}
@@ -0,0 +1,151 @@
+/*
+ *   gengc.t - test of the generational garbage collector.  The objects
+ *   created at the start are promoted to the old generation by a full
+ *   collection; the main loop then stores young objects into them while
+ *   creating enough garbage to trigger many minor collections.  A missed
+ *   write barrier would show up as a deleted object in the checks at the
+ *   end.
+ */
+
+#include "tads.h"
+#include "t3.h"
+#include "vector.h"
+#include "lookup.h"
+
+
+_say_embed(str) { tadsSay(str); }
+
+_main(args)
+{
+    t3SetSay(_say_embed);
+    main();
+}
+
+class Node: object
+    construct(v) { val = v; }
+    val = 0
+    next = nil
+;
+
+class Counted: object
+    finalize() { ++counter.finalized; }
+;
+
+counter: object
+    finalized = 0
+;
+
+holder: object
+    obj = nil
+    lst = nil
+    tmp = nil
+;
+
+/* 
+ *   add a node to the head of a list; the new node is referenced only from
+ *   the list once we return 
+ */
+addNode(obj, val)
+{
+    local n = new Node(val);
+    n.next = obj.next;
+    obj.next = n;
+}
+
+/* create enough garbage to trigger a few collections */
+churn(cnt)
+{
+    for (local i = 1 ; i <= cnt ; ++i)
+    {
+        local l = [new Node(i), 'more garbage ' + i];
+        l = l + i;
+    }
+}
+
+main()
+{
+    local oldObj, oldVec, oldTab, weak;
+    local sum, cnt, n;
+
+    /* create some dynamic objects, and promote them with a full pass */
+    oldObj = new Node(0);
+    oldVec = new Vector(10);
+    for (local i = 1 ; i <= 10 ; ++i)
+        oldVec += nil;
+    oldTab = new LookupTable();
+    weak = new WeakRefLookupTable();
+    t3RunGC();
+
+    /* a young object that's only weakly referenced */
+    weak[1] = new Node(5);
+
+    /* store young objects in the old ones while churning out garbage */
+    for (local i = 1 ; i <= 3000 ; ++i)
+    {
+        /* keep every tenth node on a list hanging off the old object */
+        if (i % 10 == 0)
+            addNode(oldObj, i);
+
+        /* replace vector, lookup table, and root object contents */
+        oldVec[i % 10 + 1] = new Node(i);
+        oldTab[i % 50] = new Node(i);
+        holder.obj = new Node(i);
+        holder.lst = [i, new Node(i)];
+
+        /* create some garbage */
+        for (local j = 0 ; j < 5 ; ++j)
+        {
+            local s = 'garbage ' + i + '/' + j;
+            local l = [s, new Node(j), j];
+            l = l + s.length();
+        }
+
+        /* create some garbage that needs finalization */
+        if (i % 30 == 0)
+            new Counted();
+    }
+
+    /* make sure the last stores have been through a collection */
+    churn(3000);
+
+    /* check the list */
+    for (sum = 0, cnt = 0, n = oldObj.next ; n != nil ; n = n.next)
+        sum += n.val, ++cnt;
+    "list: <<cnt>> nodes, sum <<sum>>\n";
+
+    /* check the vector */
+    sum = 0;
+    for (local i = 1 ; i <= 10 ; ++i)
+        sum += oldVec[i].val;
+    "vector: sum <<sum>>\n";
+
+    /* check the lookup table */
+    sum = 0;
+    oldTab.forEach({x: sum += x.val});
+    "lookup table: <<oldTab.getEntryCount()>> entries, sum <<sum>>\n";
+
+    /* check the root object */
+    "holder: obj <<holder.obj.val>>, lst <<holder.lst[1]>>/<<
+        holder.lst[2].val>>\n";
+
+    /* the weakly referenced object should have been collected */
+    "weak value: <<weak[1] == nil ? 'collected' : 'still present'>>\n";
+
+    /*
+     *   an object that's only referenced from undo must survive, and must
+     *   be restored into the old object intact
+     */
+    holder.tmp = new Node(77);
+    savepoint();
+    holder.tmp = nil;
+    oldObj.next = new Node(-1);
+    churn(3000);
+    undo();
+    churn(3000);
+    "after undo: tmp <<holder.tmp.val>>, list head <<oldObj.next.val>>\n";
+
+    /* run the finalizers for everything that's left */
+    t3RunGC();
+    t3RunGC();
+    "finalized: <<counter.finalized>>\n";
+}
@@ -0,0 +1,97 @@
+/*
+ *   pcache.t - test of the property lookup cache.  All of the property
+ *   evaluations go through the same few call sites in show(), so a stale
+ *   cache entry would show up as an out-of-date value after one of the
+ *   changes below.  
+ */
+
+#include "tads.h"
+#include "t3.h"
+
+
+_say_embed(str) { tadsSay(str); }
+
+_main(args)
+{
+    t3SetSay(_say_embed);
+    main();
+}
+
+class Base: object
+    name = 'Base'
+    desc = 'base desc'
+;
+
+class Mid: Base
+;
+
+class Leaf: Mid
+    name = 'Leaf'
+;
+
+class Other: object
+    name = 'Other'
+    desc = 'other desc'
+;
+
+leaf1: Leaf;
+leaf2: Leaf;
+other1: Other;
+multi: Other, Leaf;
+
+show(id, obj)
+{
+    "<<id>>: name = <<obj.name>>, desc = <<obj.desc>>\n";
+}
+
+showAll(title)
+{
+    "<<title>>\n";
+    show('leaf1', leaf1);
+    show('leaf2', leaf2);
+    show('other1', other1);
+    show('multi', multi);
+    "\b";
+}
+
+main()
+{
+    local x;
+
+    showAll('Initial');
+
+    Mid.desc = 'mid desc';
+    showAll('Added Mid.desc');
+
+    savepoint();
+    Leaf.desc = 'leaf desc';
+    showAll('Added Leaf.desc');
+
+    undo();
+    showAll('Undid Leaf.desc');
+
+    Base.desc = 'new base desc';
+    Mid.desc = 'new mid desc';
+    showAll('Changed Base.desc and Mid.desc');
+
+    leaf1.desc = 'leaf1 desc';
+    showAll('Added leaf1.desc');
+
+    Leaf.setSuperclassList([Other]);
+    showAll('Changed Leaf to [Other]');
+
+    multi.setSuperclassList([Base]);
+    showAll('Changed multi to [Base]');
+
+    "Dynamic instances\n";
+    for (local i = 0 ; i < 4 ; ++i)
+    {
+        if (i % 2 == 0)
+            x = TadsObject.createInstanceOf(Other, Mid);
+        else
+            x = TadsObject.createInstanceOf(Mid, Other);
+        show('instance ' + i, x);
+        x = nil;
+        t3RunGC();
+    }
+}
@@ -0,0 +1,273 @@
+/*
+ *   rexbench.t - regular expression test and benchmark.  Runs a set of
+ *   patterns taken from the adv3 library (the command tokenizer rules, the
+ *   English name and verb patterns, and the sentence-ending patterns)
+ *   through rexMatch, rexSearch, rexGroup, and rexReplace many times, with
+ *   the patterns given both as RexPattern objects and as strings.
+ *
+ *   Most of these patterns can be matched without backtracking; a few use
+ *   back-references or assertions, which can't, so this also checks that
+ *   the two kinds of pattern give the answers we expect.
+ */
+
+#include "tads.h"
+#include "t3.h"
+#include "vector.h"
+
+
+_say_embed(str) { tadsSay(str); }
+
+_main(args)
+{
+    t3SetSay(_say_embed);
+    pats.init();
+    main();
+}
+
+/*
+ *   The patterns.  The library creates these with static initializers, but
+ *   we don't have a preinit pass here, so we create them at startup.
+ */
+pats: object
+    init()
+    {
+        /* the command tokenizer rules */
+        tokRules = [
+            ['whitespace', new RexPattern('<Space>+')],
+            ['punctuation', new RexPattern('[.,;:?!]')],
+            ['spelled number',
+             new RexPattern('<NoCase>(twenty|thirty|forty|fifty|sixty|'
+                            + 'seventy|eighty|ninety)-'
+                            + '(one|two|three|four|five|six|seven|eight|nine)'
+                            + '(?!<AlphaNum>)')],
+            ['initials',
+             new RexPattern('<alpha><period><alpha><period>'
+                            + '<alpha><period>')],
+            ['initials', new RexPattern('<alpha><period><alpha><period>')],
+            ['abbreviation',
+             new RexPattern('<Alpha|-><AlphaNum|-|squote>*<period>')],
+            ['apostrophe-s',
+             new RexPattern('<Alpha|-|&><AlphaNum|-|&|squote>*<squote>[sS]')],
+            ['word', new RexPattern('<Alpha|-|&><AlphaNum|-|&|squote>*')],
+            ['string', new RexPattern('"(.*)"')],
+            ['integer', new RexPattern('[0-9]+')]
+        ];
+
+        /* verb endings */
+        iesEndingPat = new RexPattern('.*[^aeiou]y$');
+        esEndingPat = new RexPattern('.*(o|ch|sh)$');
+
+        /* object names */
+        patLeadingTagOrQuote = new RexPattern(
+            '(<langle><^rangle>+<rangle>|"|\')+');
+        patOneLetterWord = new RexPattern('<alpha>(<^alpha>|$)');
+        patOfPhrase = new RexPattern('<nocase>(.+?)(<space>+of<space>+.+)');
+        aOrTPat = new RexPattern(
+            '<nocase><space>*[at]<space>+(<^space>.*)$');
+        patIdObjApostS = new RexPattern(
+            '(?!<^space>+\'s<space>)(<^space>+)(<space>+<^space>+)\'s$');
+        patParamWithExclam = new RexPattern('.*(!)(?:<space>.*|/.*|$)');
+
+        /* sentences */
+        patEndOfSentence = new RexPattern('[.;:!?]<^alphanum>');
+        eosPattern = new RexPattern(
+            '<case>([.!?](<rparen|rsquare|dquote|squote>'
+            + '|<langle><^rangle>*<rangle>)*) +(?![-a-z])');
+        punctPat = new RexPattern('[.?!,;:]');
+
+        /* a back-reference, which needs the backtracking matcher */
+        repeatPat = new RexPattern('<nocase>%<(<alpha>+)<space>+%1%>');
+    }
+
+    tokRules = nil
+    iesEndingPat = nil
+    esEndingPat = nil
+    patLeadingTagOrQuote = nil
+    patOneLetterWord = nil
+    patOfPhrase = nil
+    aOrTPat = nil
+    patIdObjApostS = nil
+    patParamWithExclam = nil
+    patEndOfSentence = nil
+    eosPattern = nil
+    punctPat = nil
+    repeatPat = nil
+;
+
+/* tokenize a string, returning a vector of [rule name, text] pairs */
+tokenize(str)
+{
+    local toks = new Vector(20);
+
+    while (str != '')
+    {
+        local len = nil;
+
+        /* find the first rule that matches */
+        foreach (local rule in pats.tokRules)
+        {
+            if ((len = rexMatch(rule[2], str)) != nil && len > 0)
+            {
+                if (rule[1] != 'whitespace')
+                    toks.append([rule[1], str.substr(1, len)]);
+                break;
+            }
+        }
+
+        /* skip a character we can't match */
+        if (len == nil || len == 0)
+            len = 1;
+
+        /* move on */
+        str = str.substr(len + 1);
+    }
+
+    return toks;
+}
+
+/* get the third-person form of a verb */
+conjugate(verb)
+{
+    if (rexMatch(pats.iesEndingPat, verb))
+        return verb.substr(1, verb.length() - 1) + 'ies';
+    else if (rexMatch(pats.esEndingPat, verb))
+        return verb + 'es';
+    else
+        return verb + 's';
+}
+
+main()
+{
+    local names = [
+        'the small brass key', 'a rusty iron key', 'Bob\'s lantern',
+        'pile of old newspapers', '<b>bold</b> text', '"quoted" thing',
+        'X', 'an apple', 't bone of the day', 'house of the rising sun',
+        'red ball', 'ticket to ride!', 'the the thing'
+    ];
+    local commands = [
+        'take the brass key, then go north.',
+        'put twenty-one coins in Bob\'s box; look at J.R.R. Tolkien.',
+        'say "hello there" to Mr. Smith!  ask him about the 1234 widgets',
+        'x me. i. n. s. e. w. l. get all but the lamp, u.  d',
+        'drop thirty-seven marbles and forty-two pebbles?  wait 12 turns'
+    ];
+    local verbs = ['carry', 'go', 'watch', 'push', 'take', 'say', 'echo'];
+    local sum = 0, cnt = 0, toks, s, m, r1, r2;
+
+    /* tokenize the commands repeatedly */
+    for (local i = 0 ; i < 300 ; ++i)
+    {
+        foreach (local c in commands)
+        {
+            toks = tokenize(c);
+            cnt += toks.length();
+            foreach (local t in toks)
+                sum += t[2].length();
+        }
+    }
+    "tokens: <<cnt>>, total length <<sum>>\n";
+
+    /* show a couple of the tokenized commands */
+    for (local i = 2 ; i <= 3 ; ++i)
+    {
+        foreach (local t in tokenize(commands[i]))
+            "[<<t[1]>>: <<t[2]>>] ";
+        "\n";
+    }
+
+    /* conjugate some verbs */
+    for (local i = 0 ; i < 3000 ; ++i)
+    {
+        foreach (local v in verbs)
+            s = conjugate(v);
+    }
+    foreach (local v in verbs)
+        "<<conjugate(v)>> ";
+    "\n";
+
+    /* run the name patterns */
+    for (local i = 0 ; i < 500 ; ++i)
+    {
+        foreach (local n in names)
+        {
+            rexMatch(pats.patLeadingTagOrQuote, n);
+            rexMatch(pats.patOneLetterWord, n);
+            rexMatch(pats.patOfPhrase, n);
+            rexMatch(pats.aOrTPat, n);
+            rexMatch(pats.patIdObjApostS, n);
+            rexMatch(pats.patParamWithExclam, n);
+            rexSearch(pats.repeatPat, n);
+        }
+    }
+
+    /* report the match lengths and groups */
+    foreach (local n in names)
+    {
+        "<<n>>:";
+        if ((m = rexMatch(pats.patLeadingTagOrQuote, n)) != nil)
+            " tag/quote <<m>>";
+        if (rexMatch(pats.patOneLetterWord, n) != nil)
+            " one-letter";
+        if (rexMatch(pats.patOfPhrase, n) != nil)
+            " of-phrase '<<rexGroup(1)[3]>>' '<<rexGroup(2)[3]>>'";
+        if (rexMatch(pats.aOrTPat, n) != nil)
+            " a/t '<<rexGroup(1)[3]>>'";
+        if (rexMatch(pats.patIdObjApostS, n) != nil)
+            " apostrophe-s '<<rexGroup(1)[3]>>' '<<rexGroup(2)[3]>>'";
+        if (rexMatch(pats.patParamWithExclam, n) != nil)
+            " exclamation at <<rexGroup(1)[1]>>";
+        if ((m = rexSearch(pats.repeatPat, n)) != nil)
+            " repeat '<<m[3]>>' at <<m[1]>>";
+        "\n";
+    }
+
+    /* search and replace in a paragraph */
+    s = 'It was a dark and stormy night.  The rain fell in torrents - '
+        + 'except at occasional intervals, when it was checked by a '
+        + 'violent gust of wind!  "Who goes there?"  No answer (as usual.)  '
+        + 'Dr. Who had gone to St. Ives, etc.  The end.';
+    for (local i = 0 ; i < 500 ; ++i)
+    {
+        r1 = rexReplace(pats.eosPattern, s, '%1|', ReplaceAll);
+        r2 = rexReplace(pats.punctPat, s, '', ReplaceAll);
+        m = rexSearch(pats.patEndOfSentence, s);
+    }
+    "sentences: <<r1>>\n";
+    "no punctuation: <<r2>>\n";
+    "end of sentence: <<m[1]>> '<<m[3]>>'\n";
+
+    /* patterns given as strings, as the library does in many places */
+    cnt = 0;
+    for (local i = 0 ; i < 2000 ; ++i)
+    {
+        foreach (local n in names)
+        {
+            if (rexMatch('<space>*[yY]', n) != nil)
+                ++cnt;
+            if (rexMatch('<^space|star|/>*', n) > 3)
+                ++cnt;
+            if (rexSearch('%<(a|an|the)%>', n) != nil)
+                ++cnt;
+        }
+    }
+    "string patterns: <<cnt>>\n";
+    m = rexSearch('%<(a|an|the)%>', 'eat the apple');
+    "group: <<rexGroup(1)[3]>> at <<rexGroup(1)[1]>>\n";
+    "trim: [<<rexReplace('^<space>+|<space>+$', '   some text   ', '',
+                         ReplaceAll)>>]\n";
+    "swap: <<rexReplace('(<alpha>+) (<alpha>+)', 'hello world again',
+                        '%2 %1', ReplaceAll)>>\n";
+    "nocase: <<rexReplace('<nocase>the', 'The cat and THE hat', 'a',
+                          ReplaceAll)>>\n";
+    "shortest: <<rexSearch('<min>a.*b', 'xxaxbxb')[3]>> <<
+        rexSearch('a.*?b', 'xxaxbxb')[3]>> <<rexSearch('a.*b', 'xxaxbxb')[3]>>\n";
+
+    /*
+     *   A pattern with a lot of ambiguity.  A backtracking matcher takes
+     *   time exponential in the length of the string to find out that this
+     *   doesn't match.
+     */
+    s = 'aaaaaaaaaaaaaaaaaaaaaaaaaaaa';
+    "ambiguous: <<rexMatch('(a|aa)*b', s) == nil ? 'no match' : 'match'>>, <<
+        rexMatch('(a|aa)*', s)>>\n";
+}
@@ -0,0 +1,99 @@
+/*
+ *   strcat.t - string concatenation test and benchmark.  Builds 1 MB of
+ *   text through 100,000 appends of ten bytes each, then checks that the
+ *   result reads back correctly.  Strings are limited to 64K bytes, so the
+ *   text is built as twenty 50,000-byte strings of 5,000 appends each.
+ *
+ *   Long concatenation results are built as ropes, so this also checks
+ *   that ropes behave exactly like ordinary strings in every way we can
+ *   get at them.
+ */
+
+#include "tads.h"
+#include "t3.h"
+#include "lookup.h"
+
+
+_say_embed(str) { tadsSay(str); }
+
+_main(args)
+{
+    t3SetSay(_say_embed);
+    main();
+}
+
+export RuntimeError;
+export exceptionMessage;
+
+class RuntimeError: object
+    construct(errno, ...) { errno_ = errno; }
+    errno_ = 0
+    exceptionMessage = nil
+;
+
+main()
+{
+    local total = 0, sum = 0, s, t, u, tab;
+
+    /* build 1 MB of text, in twenty strings of 50,000 bytes */
+    for (local i = 1 ; i <= 20 ; ++i)
+    {
+        s = '';
+        for (local j = 0 ; j < 5000 ; ++j)
+            s += 'abcdefghi' + (j % 10);
+
+        /* read back a few characters from different parts of the string */
+        total += s.length();
+        sum += s.find('i7') + s.substr(49991, 10).length()
+            + (s.substr(25001, 10) == 'abcdefghi0' ? 1 : 0);
+    }
+    "built <<total>> bytes, check <<sum>>\n";
+
+    /* a rope that's prepended to rather than appended to */
+    s = '';
+    for (local i = 0 ; i < 1000 ; ++i)
+        s = ('' + (i % 10)) + s;
+    "prepended: <<s.length()>> <<s.substr(1, 12)>> <<s.substr(989)>>\n";
+
+    /* mix in conversions from other types */
+    s = '';
+    for (local i = 0 ; i < 200 ; ++i)
+        s = s + i + nil + true + ',';
+    "mixed: <<s.length()>> <<s.substr(1, 24)>> <<s.substr(s.length() - 15)>>\n";
+
+    /* a rope that shares its parts */
+    t = s + s;
+    u = s + s;
+    "shared: <<t.length()>> <<t == u ? 'equal' : 'different'>> <<
+        t.find('199true,') == s.length() - 7 ? 'ok' : 'bad'>>\n";
+
+    /* ropes as lookup table keys, compared against flat strings */
+    tab = new LookupTable();
+    tab[t] = 'found';
+    "lookup: <<tab[u]>> <<tab[t.substr(1)]>>\n";
+
+    /* comparisons and conversions */
+    "compare: <<t > s ? 'greater' : 'not greater'>>, <<
+        toInteger('12' + s.substr(1, 0)) + 1>>\n";
+    "upper: <<s.toUpper().substr(1, 20)>>\n";
+
+    /* displaying a rope */
+    s = 'This line is long enough to be built as a rope, since it '
+        + 'goes on for quite a while; to make sure, we add the same '
+        + 'text several times. ';
+    s = s + s + s + s + s;
+    "<<s.length()>>: <<s.substr(1, 60)>>\n";
+
+    /* going past the length limit should still be an error */
+    try
+    {
+        s = 'x';
+        for (local i = 0 ; i < 20 ; ++i)
+            s += s;
+        "no error!\n";
+    }
+    catch (RuntimeError exc)
+    {
+        "length limit: <<s.length()>>, error <<exc.errno_>>\n";
+    }
+}
@@ -0,0 +1,270 @@
+/*
+ *   T3 Interpreter Benchmark - load and execute an image file, and report
+ *   the number of byte-code instructions executed per second.
+ *   
+ *   This must be compiled with VMRUN_COUNT_OPS defined.  Build it once with
+ *   VMRUN_THREADED_DISPATCH=0 and once with VMRUN_THREADED_DISPATCH=1 to
+ *   compare the switch and threaded interpreter loops; unix/test/run_bench
+ *   runs a set of the test programs through both builds.
+ *   
+ *   usage: test_bench [-r repeat_count] <test_exec options> image.t3
+ *   
+ *   The program's own output goes to stdout as usual; the timing results,
+ *   along with the property lookup cache statistics for each property
+ *   evaluation opcode, are written to stderr, so that they can be captured
+ *   separately.  
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "os.h"
+#include "t3std.h"
+#include "vmmain.h"
+#include "vmconsol.h"
+#include "vmrun.h"
+#include "vmop.h"
+#include "vmtobj.h"
+#include "t3test.h"
+#include "vmhostsi.h"
+
+#ifndef VMRUN_COUNT_OPS
+#error test_bench must be compiled with VMRUN_COUNT_OPS defined
+#endif
+
+
+/*
+ *   The property evaluation opcodes that go through the property lookup
+ *   cache, for the statistics report 
+ */
+static const struct
+{
+    uchar opc;
+    const char *name;
+}
+pcache_ops[] =
+{
+    { OPC_GETPROP, "GETPROP" },
+    { OPC_GETPROPSELF, "GETPROPSELF" },
+    { OPC_GETPROPLCL1, "GETPROPLCL1" },
+    { OPC_GETPROPR0, "GETPROPR0" },
+    { OPC_GETPROPDATA, "GETPROPDATA" },
+    { OPC_OBJGETPROP, "OBJGETPROP" },
+    { OPC_CALLPROP, "CALLPROP" },
+    { OPC_CALLPROPSELF, "CALLPROPSELF" },
+    { OPC_CALLPROPLCL1, "CALLPROPLCL1" },
+    { OPC_CALLPROPR0, "CALLPROPR0" },
+    { OPC_OBJCALLPROP, "OBJCALLPROP" }
+};
+
+/*
+ *   Client services interface 
+ */
+class MyClientIfc: public CVmMainClientIfc
+{
+public:
+    MyClientIfc()
+    {
+        /* no instructions executed or time spent yet */
+        op_cnt_ = 0;
+        elapsed_ = 0;
+
+        /* no property lookups yet */
+        memset(own_, 0, sizeof(own_));
+        memset(hit_, 0, sizeof(hit_));
+        memset(miss_, 0, sizeof(miss_));
+    }
+
+    /* set plain ASCII mode */
+    void set_plain_mode() { os_plain(); }
+
+    /* create the main console */
+    CVmConsoleMain *create_console(struct vm_globals *vmg)
+    {
+        VMGLOB_PTR(vmg);
+        return new CVmConsoleMain(vmg0_);
+    }
+
+    /* delete the console */
+    void delete_console(struct vm_globals *vmg, CVmConsoleMain *con)
+    {
+        VMGLOB_PTR(vmg);
+
+        /* flush any pending buffered output */
+        con->flush(vmg_ VM_NL_NONE);
+
+        /* delete the output formatter */
+        con->delete_obj(vmg0_);
+    }
+
+    /* initialize */
+    void client_init(struct vm_globals *vmg,
+                     const char *script_file, int script_quiet,
+                     const char *,
+                     const char *,
+                     const char *)
+    {
+        /* set up for global access */
+        VMGLOB_PTR(vmg);
+
+        /* if we have a script file, set up script input on the console */
+        if (script_file != 0)
+        {
+            G_console->open_script_file(
+                vmg_ script_file, script_quiet, FALSE);
+        }
+    }
+
+    /* terminate */
+    void client_terminate(struct vm_globals *vmg)
+    {
+        VMGLOB_PTR(vmg);
+        G_console->close_script_file(vmg0_);
+    }
+
+    /* pre-execution initialization */
+    void pre_exec(struct vm_globals *globals)
+    {
+        VMGLOB_PTR(globals);
+        
+        /* turn off MORE mode, since we're not interactive */
+        G_console->set_more_state(FALSE);
+
+        /* 
+         *   start counting and timing here, so that we measure only the
+         *   byte-code execution and not the image loading 
+         */
+        G_interpreter->reset_op_count();
+        start_time_ = clock();
+    }
+
+    /* post-execution termination/error termination */
+    void post_exec(struct vm_globals *globals) { add_run(globals); }
+    void post_exec_err(struct vm_globals *globals) { add_run(globals); }
+
+    /* display an error */
+    void display_error(struct vm_globals *, const struct CVmException *,
+                       const char *msg, int add_blank_line)
+    {
+        /* display the error on the stdio console */
+        printf("%s\n", msg);
+
+        /* add a blank line if desired */
+        if (add_blank_line)
+            printf("\n");
+    }
+
+    /* total instructions executed and CPU seconds spent over all runs */
+    double op_cnt_;
+    double elapsed_;
+
+    /* 
+     *   property lookups by opcode over all runs: found in the object
+     *   itself, found in the cache, and not cached 
+     */
+    double own_[256];
+    double hit_[256];
+    double miss_[256];
+
+protected:
+    /* add the statistics for the run that just finished to the totals */
+    void add_run(struct vm_globals *globals)
+    {
+        VMGLOB_PTR(globals);
+        elapsed_ += (double)(clock() - start_time_) / CLOCKS_PER_SEC;
+        op_cnt_ += G_interpreter->get_op_count();
+
+        /* add the property cache statistics */
+        for (size_t i = 0 ; i < countof(pcache_ops) ; ++i)
+        {
+            uchar opc = pcache_ops[i].opc;
+            own_[opc] += G_tadsobj_cache->get_own_count(opc);
+            hit_[opc] += G_tadsobj_cache->get_hit_count(opc);
+            miss_[opc] += G_tadsobj_cache->get_miss_count(opc);
+        }
+    }
+
+    /* 
+     *   starting time of the current run - we use the CPU clock rather than
+     *   the OS layer's timer, since the latter may only have one-second
+     *   resolution 
+     */
+    clock_t start_time_;
+};
+
+/*
+ *   Main program entrypoint 
+ */
+int main(int argc, char **argv)
+{
+    int stat = 0;
+    int reps = 1;
+    int i;
+    char **run_argv;
+    MyClientIfc clientifc;
+    CVmHostIfc *hostifc = new CVmHostIfcStdio(argv[0]);
+
+    /* initialize for testing */
+    test_init();
+
+    /* check for a repeat count, and remove it from the VM arguments */
+    if (argc >= 3 && strcmp(argv[1], "-r") == 0)
+    {
+        reps = atoi(argv[2]);
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+
+    /* initialize the OS layer */
+    os_init(&argc, argv, 0, 0, 0);
+
+    /* 
+     *   Run the image the requested number of times.  The VM rewrites the
+     *   image name in its argument vector in test mode, so give each run a
+     *   fresh copy.  
+     */
+    run_argv = new char *[argc + 1];
+    for (i = 0 ; i < reps ; ++i)
+    {
+        memcpy(run_argv, argv, (argc + 1) * sizeof(argv[0]));
+        stat = vm_run_image_main(&clientifc, "test_bench", argc, run_argv,
+                                 TRUE, TRUE, hostifc);
+    }
+    delete [] run_argv;
+
+    /* report the results */
+    fprintf(stderr, "%s dispatch: %.0f instructions in %.3f sec",
+            VMRUN_THREADED_DISPATCH ? "threaded" : "switch",
+            clientifc.op_cnt_, clientifc.elapsed_);
+    if (clientifc.elapsed_ != 0)
+        fprintf(stderr, " (%.0f instructions/sec)",
+                clientifc.op_cnt_ / clientifc.elapsed_);
+    fprintf(stderr, "\n");
+
+    /* report the property cache statistics for the opcodes we saw */
+    for (i = 0 ; i < (int)countof(pcache_ops) ; ++i)
+    {
+        uchar opc = pcache_ops[i].opc;
+        double tot = clientifc.own_[opc] + clientifc.hit_[opc]
+                     + clientifc.miss_[opc];
+
+        if (tot != 0)
+            fprintf(stderr, "  %-12s %10.0f lookups: %5.1f%% own, "
+                    "%5.1f%% cache hit, %5.1f%% miss\n",
+                    pcache_ops[i].name, tot,
+                    100.0 * clientifc.own_[opc] / tot,
+                    100.0 * clientifc.hit_[opc] / tot,
+                    100.0 * clientifc.miss_[opc] / tot);
+    }
+
+    /* uninitialize the OS layer */
+    os_uninit();
+
+    /* done with the host interface */
+    delete hostifc;
+
+    /* done */
+    return stat;
+}
@@ -2356,6 +2356,7 @@ struct re_replace_arg
         s = 0;
         pat = 0;
         our_pat = FALSE;
+        parser = 0;
         rpl_func.set_nil();
         rpl_argc = 0;
         rpl_str = 0;
@@ -2364,9 +2365,9 @@ struct re_replace_arg
 
     ~re_replace_arg()
     {
-        /* if we created the pattern object, delete it */
+        /* if we got the pattern from the parser's cache, release it */
         if (pat != 0 && our_pat)
-            CRegexParser::free_pattern(pat);
+            parser->release_cached_pattern(pat);
         if (s != 0)
             delete s;
     }
@@ -2389,16 +2390,14 @@ struct re_replace_arg
         }
         else if ((str = patv->get_as_string(vmg0_)) != 0)
         {
-            /* compile the string */
-            re_status_t stat;
-            stat = G_bif_tads_globals->rex_parser->compile_pattern(
-                str + VMB_LEN, vmb_get_len(str), &pat);
-
-            /* if that failed, we don't have a pattern */
-            if (stat != RE_STATUS_SUCCESS)
-                pat = 0;
+            /* 
+             *   get the compiled pattern from the parser's cache, compiling
+             *   it if necessary (this yields null if the pattern has errors) 
+             */
+            parser = G_bif_tads_globals->rex_parser;
+            pat = parser->get_cached_pattern(str + VMB_LEN, vmb_get_len(str));
 
-            /* note that we allocated the pattern, so we have to delete it */
+            /* note that we have to release the pattern when we're done */
             our_pat = TRUE;
         }
         else
@@ -2464,8 +2463,12 @@ struct re_replace_arg
     /* our search pattern */
     re_compiled_pattern *pat;
 
-    /* Did we create the pattern?  If so, delete it on destruction. */
+    /* 
+     *   Did we get the pattern from the parser's cache?  If so, release it
+     *   on destruction.  
+     */
     int our_pat;
+    CRegexParser *parser;
 
     /* our replacement string, or null if it's a callback function */
     const char *rpl_str;
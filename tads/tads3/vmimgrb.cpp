@@ -768,16 +768,17 @@ void CVmObjList::convert_to_const_data(VMG_ CVmConstMapper *mapper,
 ulong CVmObjString::rebuild_image(VMG_ char *buf, ulong buflen)
 {
     size_t copy_size;
+    const char *str = get_as_string(vmg0_);
 
     /* calculate how much space we need to store the data */
-    copy_size = vmb_get_len(ext_) + VMB_LEN;
+    copy_size = vmb_get_len(str) + VMB_LEN;
 
     /* make sure we have room for our data */
     if (copy_size > buflen)
         return copy_size;
 
     /* copy the data */
-    memcpy(buf, ext_, copy_size);
+    memcpy(buf, str, copy_size);
 
     /* return the size */
     return copy_size;
@@ -791,7 +792,8 @@ void CVmObjString::reserve_const_data(VMG_ CVmConstMapper *mapper,
                                       vm_obj_id_t self)
 {
     /* reserve the space for our string data */
-    mapper->alloc_pool_space(self, vmb_get_len(ext_) + VMB_LEN);
+    mapper->alloc_pool_space(
+        self, vmb_get_len(get_as_string(vmg0_)) + VMB_LEN);
 }
 
 
@@ -808,7 +810,10 @@ void CVmObjString::convert_to_const_data(VMG_ CVmConstMapper *mapper,
      *   value 
      */
     if (mapper->get_pool_addr(self))
-        mapper->store_data(self, ext_, vmb_get_len(ext_) + VMB_LEN);
+    {
+        const char *str = get_as_string(vmg0_);
+        mapper->store_data(self, str, vmb_get_len(str) + VMB_LEN);
+    }
 }
 
 
@@ -310,9 +310,6 @@ void vm_terminate(vm_globals *vmg__, CVmMainClientIfc *clientifc)
     VM_IFELSE_ALLOC_PRE_GLOBAL(delete G_interpreter,
                                G_interpreter->terminate());
 
-    /* terminate the TadsObject class */
-    CVmObjTads::class_term(vmg0_);
-
     /* delete the source file table */
     delete G_srcf_table;
 
@@ -336,6 +333,13 @@ void vm_terminate(vm_globals *vmg__, CVmMainClientIfc *clientifc)
     G_obj_table->delete_obj_table(vmg0_);
     VM_IF_ALLOC_PRE_GLOBAL(delete G_obj_table);
 
+    /* 
+     *   terminate the TadsObject class - we have to wait until the objects
+     *   are gone, since deleting a TadsObject can invalidate its class's
+     *   property lookup cache 
+     */
+    CVmObjTads::class_term(vmg0_);
+
     /* delete the dependency tables */
     G_bif_table->clear(vmg0_);
     delete G_meta_table;
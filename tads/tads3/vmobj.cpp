@@ -52,6 +52,18 @@ Modified
 #ifdef VMOBJ_GC_STATS
 # define IF_GC_STATS(x) x
 
+/* kinds of collection passes */
+#define VMOBJ_GC_FULL   0
+#define VMOBJ_GC_MINOR  1
+
+/* 
+ *   upper limits (in milliseconds) of the pause-time histogram buckets;
+ *   the last bucket counts everything at or above the last limit 
+ */
+static const long gc_pause_limits[] = { 1, 2, 5, 10, 20, 50, 100, 200, 500 };
+const int GC_PAUSE_BUCKETS =
+    sizeof(gc_pause_limits)/sizeof(gc_pause_limits[0]) + 1;
+
 struct
 {
     void gc_stats()
@@ -61,19 +73,37 @@ struct
         cur_freed = 0;
         max_freed = 0;
         t = 0;
+        memset(kind_runs, 0, sizeof(kind_runs));
+        memset(kind_t, 0, sizeof(kind_t));
+        memset(max_pause, 0, sizeof(max_pause));
+        memset(pauses, 0, sizeof(pauses));
     }
 
-    void begin_pass()
+    void begin_pass(int kind)
     {
         t0 = os_get_sys_clock_ms();
         runs++;
+        cur_kind = kind;
+        kind_runs[kind]++;
         pass_start_bytes = cur_bytes;
         cur_freed = 0;
     }
 
     void end_pass()
     {
-        t += os_get_sys_clock_ms() - t0;
+        long pause = os_get_sys_clock_ms() - t0;
+        int i;
+
+        t += pause;
+        kind_t[cur_kind] += pause;
+        if (pause > max_pause[cur_kind])
+            max_pause[cur_kind] = pause;
+
+        /* count the pause in its histogram bucket */
+        for (i = 0 ; i < GC_PAUSE_BUCKETS - 1 && pause >= gc_pause_limits[i] ;
+             ++i) ;
+        pauses[cur_kind][i]++;
+
         if (cur_freed > max_freed)
             max_freed = cur_freed;
         long garbage_bytes = pass_start_bytes - cur_bytes;
@@ -124,6 +154,32 @@ struct
                max_garbage_bytes,
                t,
                runs != 0 ? t/runs : 0);
+
+        /* show the pause times for each kind of pass */
+        display_pauses(VMOBJ_GC_MINOR, "minor");
+        display_pauses(VMOBJ_GC_FULL, "full");
+    }
+
+    void display_pauses(int kind, const char *name)
+    {
+        int i;
+        char label[40];
+
+        sprintf(label, "%s collections:", name);
+        printf("  %-23s%ld (%ld ms, max pause %ld ms)\n",
+               label, kind_runs[kind], kind_t[kind], max_pause[kind]);
+        if (kind_runs[kind] == 0)
+            return;
+
+        printf("  %s pause histogram:\n", name);
+        for (i = 0 ; i < GC_PAUSE_BUCKETS ; ++i)
+        {
+            if (i < GC_PAUSE_BUCKETS - 1)
+                printf("    < %3ld ms: ", gc_pause_limits[i]);
+            else
+                printf("    >=%3ld ms: ", gc_pause_limits[i-1]);
+            printf("%8ld\n", pauses[kind][i]);
+        }
     }
 
     /* number of times the gc has run */
@@ -156,6 +212,17 @@ struct
     /* starting time in ticks of current run */
     long t0;
 
+    /* kind of the current run (VMOBJ_GC_FULL, VMOBJ_GC_MINOR) */
+    int cur_kind;
+
+    /* number of runs, elapsed time and longest pause for each kind */
+    long kind_runs[2];
+    long kind_t[2];
+    long max_pause[2];
+
+    /* pause-time histogram for each kind */
+    long pauses[2][GC_PAUSE_BUCKETS];
+
 } gc_stats;
 
 #else /* VMOBJ_GC_STATS */
@@ -1404,6 +1471,10 @@ void CVmObjTable::init(VMG0_)
     allocs_since_gc_ = 0;
     bytes_since_gc_ = 0;
 
+    /* we haven't run any minor collections yet */
+    minor_since_full_ = 0;
+    gc_full_needed_ = FALSE;
+
     /* 
      *   Set the upper limit for new objects and allocated bytes between
      *   garbage collection passes.
@@ -1637,8 +1708,29 @@ vm_obj_id_t CVmObjTable::alloc_obj(VMG_ int in_root_set,
  */
 void CVmObjTable::gc_before_alloc(VMG0_)
 {
+#if VMOBJ_GC_GENERATIONAL
+    /* 
+     *   collect only the young generation, unless it's time for a full
+     *   pass to clean up the old generation 
+     */
+    if (!gc_full_needed_ && minor_since_full_ < (uint)VM_GC_MINOR_PER_FULL)
+    {
+        /* count it if in statistics mode */
+        IF_GC_STATS(gc_stats.begin_pass(VMOBJ_GC_MINOR));
+
+        /* run a minor pass */
+        gc_minor_init(vmg0_);
+        gc_pass_finish(vmg0_);
+        ++minor_since_full_;
+
+        /* count it if in statistics mode */
+        IF_GC_STATS(gc_stats.end_pass());
+        return;
+    }
+#endif
+
     /* count it if in statistics mode */
-    IF_GC_STATS(gc_stats.begin_pass());
+    IF_GC_STATS(gc_stats.begin_pass(VMOBJ_GC_FULL));
 
     /* run a full garbage collection pass */
     gc_pass_init(vmg0_);
@@ -1727,6 +1819,13 @@ void CVmObjTable::init_entry_for_alloc(vm_obj_id_t id,
     entry->reachable_ = VMOBJ_UNREACHABLE;
     entry->finalize_state_ = VMOBJ_UNFINALIZABLE;
 
+    /* 
+     *   a new object starts out in the young generation, except that root
+     *   set objects are never collected, so they're old from the start 
+     */
+    entry->young_ = !in_root_set;
+    entry->remembered_ = FALSE;
+
     /* add it to the GC work queue for the next GC pass */
     if (in_root_set)
         add_to_gc_queue(id, entry, VMOBJ_REACHABLE);
@@ -1927,7 +2026,7 @@ void CVmObjTable::add_to_globals(vm_obj_id_t obj)
 void CVmObjTable::gc_full(VMG0_)
 {
     /* count it if in statistics mode */
-    IF_GC_STATS(gc_stats.begin_pass());
+    IF_GC_STATS(gc_stats.begin_pass(VMOBJ_GC_FULL));
 
     /* 
      *   run the initial pass to mark globally-reachable objects, then run
@@ -1960,6 +2059,10 @@ void CVmObjTable::gc_pass_init(VMG0_)
     allocs_since_gc_ = 0;
     bytes_since_gc_ = 0;
 
+    /* this is a full pass, so start a new cycle of minor passes */
+    minor_since_full_ = 0;
+    gc_full_needed_ = FALSE;
+
     /* trace objects reachable from the stack */
     gc_trace_stack(vmg0_);
 
@@ -1976,6 +2079,74 @@ void CVmObjTable::gc_pass_init(VMG0_)
     G_undo->gc_mark_refs(vmg0_);
 }
 
+/*
+ *   Garbage collector - initialize a young-generation pass.  The caller
+ *   finishes the pass with gc_pass_finish(), as with a full pass.
+ *   
+ *   Every old object (one that has survived a previous pass) is presumed
+ *   reachable, so the only objects this pass can collect are the young
+ *   ones.  To find the young objects that are reachable, we trace from the
+ *   usual roots, plus the old objects that might refer to young objects:
+ *   those whose metaclass doesn't maintain the write barrier, and those
+ *   that have stored an object reference since the last pass.  Every
+ *   object that survives a pass is promoted to the old generation, so an
+ *   old object can only refer to a young object by way of a store made
+ *   after the last pass.  
+ */
+void CVmObjTable::gc_minor_init(VMG0_)
+{
+    CVmObjPageEntry **pg;
+    CVmObjPageEntry *entry;
+    size_t i;
+    size_t j;
+    vm_obj_id_t id;
+
+    /* reset the allocation counters, as in a full pass */
+    allocs_since_gc_ = 0;
+    bytes_since_gc_ = 0;
+
+    /* 
+     *   The work queue contains the root set, which is entirely old.  We'll
+     *   rebuild the queue below with only the old objects we need to trace,
+     *   so simply drop the existing queue.  
+     */
+    gc_queue_head_ = VM_INVALID_OBJ;
+
+    /* mark the old generation as reachable */
+    for (id = 0, i = pages_used_, pg = pages_ ; i > 0 ; ++pg, --i)
+    {
+        /* go through each entry on this page */
+        for (j = VM_OBJ_PAGE_CNT, entry = *pg ; j > 0 ; --j, ++entry, ++id)
+        {
+            /* skip free entries and young objects */
+            if (entry->free_ || entry->young_)
+                continue;
+
+            /* presume the object is reachable */
+            entry->reachable_ = VMOBJ_REACHABLE;
+
+            /* 
+             *   if it might refer to a young object, trace it - we can't
+             *   use add_to_gc_queue() for this, since that only queues
+             *   objects that haven't been reached yet 
+             */
+            if (entry->can_have_refs_
+                && (entry->remembered_
+                    || !entry->get_vm_obj()->has_gc_write_barrier()))
+            {
+                entry->next_obj_ = gc_queue_head_;
+                gc_queue_head_ = id;
+            }
+        }
+    }
+
+    /* trace the roots, exactly as in a full pass */
+    gc_trace_stack(vmg0_);
+    gc_trace_imports(vmg0_);
+    gc_trace_globals(vmg0_);
+    G_undo->gc_mark_refs(vmg0_);
+}
+
 /*
  *   Garbage collection - continue processing the work queue.  This
  *   processes a set of entries from the work queue.  This routine can be
@@ -2199,6 +2370,15 @@ void CVmObjTable::gc_pass_finish(VMG0_)
                     if (entry->finalize_state_ == VMOBJ_FINALIZABLE)
                         add_to_finalize_queue(id, entry);
 
+                    /*
+                     *   The object has survived a pass, so it's now part of
+                     *   the old generation.  Everything it refers to has
+                     *   survived as well, so it can't refer to a young
+                     *   object until it stores a new reference.  
+                     */
+                    entry->young_ = FALSE;
+                    entry->remembered_ = FALSE;
+
                     /* 
                      *   restore initial conditions for this object, so that
                      *   we're properly set up for the next GC pass 
@@ -3085,6 +3265,12 @@ void CVmObjTable::reset_to_image(VMG0_)
      */
     G_undo->drop_undo(vmg0_);
 
+    /* 
+     *   resetting and restoring objects bypasses the write barriers, so the
+     *   next collection has to be a full one 
+     */
+    gc_full_needed_ = TRUE;
+
     /* delete all of the globals */
     if (globals_ != 0)
     {
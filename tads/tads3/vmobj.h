@@ -106,6 +106,27 @@ Modified
  */
 const int VM_GC_WORK_INCREMENT = 500;
 
+/*
+ *   Generational collection.  When this is enabled, the automatic
+ *   collections triggered by allocation normally trace only the "young"
+ *   generation - the objects created since the last collection.  Every
+ *   object that survives a collection is promoted to the "old" generation,
+ *   and old objects are presumed reachable during a young-generation
+ *   ("minor") collection.  An old object that can refer to other objects
+ *   is traced during a minor collection only if its metaclass doesn't
+ *   provide a write barrier (see CVmObject::gc_write_barrier()), or if it
+ *   does and it has stored an object reference since the last collection.
+ *   
+ *   Since old garbage accumulates between full collections, we run a full
+ *   collection after every VM_GC_MINOR_PER_FULL minor collections, and
+ *   explicit collections (gc_full()) are always full.  
+ */
+#ifndef VMOBJ_GC_GENERATIONAL
+#define VMOBJ_GC_GENERATIONAL  1
+#endif
+
+const int VM_GC_MINOR_PER_FULL = 8;
+
 
 
 /* ------------------------------------------------------------------------ */
@@ -422,6 +443,31 @@ public:
      */
     virtual void mark_refs(VMG_ uint state) = 0;
 
+    /*
+     *   Does this metaclass maintain the generational garbage collector's
+     *   write barrier?  A metaclass that returns true here must call
+     *   gc_write_barrier() each time it stores a value in an existing
+     *   object, so that an old object that acquires a reference to a young
+     *   object is traced on the next minor collection.  Old objects of
+     *   other metaclasses are traced on every minor collection, which is
+     *   always correct but costs more.  
+     */
+    virtual int has_gc_write_barrier() const { return FALSE; }
+
+    /*
+     *   Write barrier.  A metaclass that maintains the write barrier calls
+     *   this when it stores a value in one of its objects.  Only object
+     *   references matter to the collector, so other values are ignored.  
+     */
+    void gc_write_barrier(const vm_val_t *val)
+    {
+        if (val->typ == VM_OBJ || val->typ == VM_OBJX)
+            gc_write_barrier();
+    }
+
+    /* note that this object might refer to a young object */
+    inline void gc_write_barrier();
+
     /* 
      *   Remove stale weak references.  For each weakly-referenced object,
      *   check to see if the object is marked as reachable; if not, it's
@@ -1630,6 +1676,16 @@ struct CVmObjPageEntry
     uint can_have_refs_ : 1;
     uint can_have_weak_refs_ : 1;
 
+    /*
+     *   Generational GC state.  'young_' is set for an object that hasn't
+     *   yet survived a garbage collection pass.  'remembered_' is set by
+     *   the write barrier when an object reference is stored in the object,
+     *   and tells the next minor collection to trace the object even though
+     *   it's old.  Both are cleared when the object survives a pass.  
+     */
+    uint young_ : 1;
+    uint remembered_ : 1;
+
     /* 
      *   An entry is deletable if it's unreachable and has been finalized.
      *   If the entry is marked as free, it's already been deleted, hence
@@ -1693,6 +1749,17 @@ struct CVmObjPageEntry
     }
 };
 
+/*
+ *   Write barrier for the generational garbage collector.  An object is
+ *   always constructed at the start of its object table entry (see
+ *   CVmObject::operator new()), so the object pointer is also the entry
+ *   pointer.  
+ */
+inline void CVmObject::gc_write_barrier()
+{
+    ((CVmObjPageEntry *)this)->remembered_ = TRUE;
+}
+
 /* ------------------------------------------------------------------------ */
 /*
  *   Object table.
@@ -2299,6 +2366,12 @@ private:
     /* garbage collection: trace objects reachable from machine globals */
     void gc_trace_globals(VMG0_);
 
+    /* 
+     *   initialize a young-generation pass; this takes the place of
+     *   gc_pass_init() for a minor collection 
+     */
+    void gc_minor_init(VMG0_);
+
     /* garbage collection: trace all objects reachable from the work queue */
     void gc_trace_work_queue(VMG_ int trace_transient);
 
@@ -2399,6 +2472,16 @@ private:
     uint max_allocs_between_gc_;
     ulong max_bytes_between_gc_;
 
+    /* number of minor collections since the last full collection */
+    uint minor_since_full_;
+
+    /* 
+     *   Flag: the next collection must be a full one.  We set this after
+     *   operations that bypass the write barriers, such as restoring a
+     *   saved state.  
+     */
+    uint gc_full_needed_ : 1;
+
     /* garbage collection enabled */
     uint gc_enabled_ : 1;
 };
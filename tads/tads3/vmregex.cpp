@@ -178,6 +178,10 @@ CRegexParser::CRegexParser()
     range_buf_ = 0;
     range_buf_cnt_ = 0;
     range_buf_max_ = 0;
+
+    /* nothing in the pattern cache yet */
+    memset(cache_, 0, sizeof(cache_));
+    cache_clock_ = 0;
 }
 
 /* ------------------------------------------------------------------------ */
@@ -230,6 +234,16 @@ CRegexParser::~CRegexParser()
         t3free(range_buf_);
         range_buf_ = 0;
     }
+
+    /* delete the cached patterns */
+    for (int i = 0 ; i < RE_CACHE_SIZE ; ++i)
+    {
+        if (cache_[i].pat != 0)
+        {
+            free_pattern(cache_[i].pat);
+            t3free(cache_[i].expr);
+        }
+    }
 }
 
 /* ------------------------------------------------------------------------ */
@@ -2437,6 +2451,10 @@ re_status_t CRegexParser::compile_pattern(const char *expr_str,
     /* copy the base pattern to the result */
     memcpy(pat, &base_pat, sizeof(base_pat));
 
+    /* we don't have any DFAs for the pattern yet */
+    pat->dfa[0] = pat->dfa[1] = 0;
+    pat->no_dfa = FALSE;
+
     /* copy the tuple array */
     memcpy(pat->tuples, tuple_arr_, pat->tuple_cnt * sizeof(pat->tuples[0]));
 
@@ -2491,10 +2509,107 @@ re_status_t CRegexParser::compile_pattern(const char *expr_str,
  */
 void CRegexParser::free_pattern(re_compiled_pattern *pattern)
 {
+    /* delete the pattern's DFAs, if we've built any */
+    delete pattern->dfa[0];
+    delete pattern->dfa[1];
+
     /* we allocate each pattern as a single unit, so it's easy to free */
     t3free(pattern);
 }
 
+/* ------------------------------------------------------------------------ */
+/*
+ *   Get a compiled pattern from the pattern cache, compiling it and adding
+ *   it to the cache if necessary.  
+ */
+re_compiled_pattern *CRegexParser::get_cached_pattern(const char *expr_str,
+                                                      size_t exprlen)
+{
+    unsigned int hash;
+    size_t i;
+    re_cache_entry *e, *victim;
+    re_compiled_pattern *pat;
+
+    /* figure the hash value of the expression */
+    for (hash = 0, i = 0 ; i < exprlen ; ++i)
+        hash = hash*31 + (unsigned char)expr_str[i];
+
+    /* look for the expression in the cache */
+    for (i = 0, e = cache_, victim = 0 ; i < RE_CACHE_SIZE ; ++i, ++e)
+    {
+        /* if this is the one, add a reference and return it */
+        if (e->pat != 0 && e->hash == hash && e->exprlen == exprlen
+            && memcmp(e->expr, expr_str, exprlen) == 0)
+        {
+            ++e->refs;
+            e->last_use = ++cache_clock_;
+            return e->pat;
+        }
+
+        /* 
+         *   if it's not in use, it's a candidate for replacement; prefer an
+         *   empty entry, otherwise the least recently used one 
+         */
+        if (e->refs == 0
+            && (victim == 0
+                || (victim->pat != 0
+                    && (e->pat == 0 || e->last_use < victim->last_use))))
+            victim = e;
+    }
+
+    /* it's not in the cache, so compile it */
+    if (compile_pattern(expr_str, exprlen, &pat) != RE_STATUS_SUCCESS)
+        return 0;
+
+    /* 
+     *   if every entry is in use, we can't cache it; the caller will free it
+     *   when it releases it, since we won't find it in the cache 
+     */
+    if (victim == 0)
+        return pat;
+
+    /* evict the old entry */
+    if (victim->pat != 0)
+    {
+        free_pattern(victim->pat);
+        t3free(victim->expr);
+    }
+
+    /* set up the new entry */
+    victim->expr = (char *)t3malloc(exprlen + 1);
+    memcpy(victim->expr, expr_str, exprlen);
+    victim->exprlen = exprlen;
+    victim->hash = hash;
+    victim->pat = pat;
+    victim->refs = 1;
+    victim->last_use = ++cache_clock_;
+
+    /* return the pattern */
+    return pat;
+}
+
+/*
+ *   Release a pattern obtained from get_cached_pattern() 
+ */
+void CRegexParser::release_cached_pattern(re_compiled_pattern *pattern)
+{
+    int i;
+    re_cache_entry *e;
+
+    /* find the pattern in the cache, and drop our reference */
+    for (i = 0, e = cache_ ; i < RE_CACHE_SIZE ; ++i, ++e)
+    {
+        if (e->pat == pattern)
+        {
+            --e->refs;
+            return;
+        }
+    }
+
+    /* it's not in the cache, so it belongs to the caller - free it */
+    free_pattern(pattern);
+}
+
 /* ------------------------------------------------------------------------ */
 /*
  *   Register delta list.
@@ -2564,6 +2679,190 @@ CRegexSearcher::~CRegexSearcher()
 {
 }
 
+/*
+ *   Determine if a character matches a literal character recognizer.  If
+ *   we're not in case-sensitive mode, and both characters are alphabetic,
+ *   we perform a case-insensitive comparison; otherwise we perform an
+ *   exact comparison.  
+ */
+static int match_literal(wchar_t pat_ch, wchar_t ch, int case_sensitive)
+{
+    /* 
+     *   if we have an exact match, there's no need to check for any case
+     *   conversions 
+     */
+    if (pat_ch == ch)
+        return TRUE;
+
+    /* 
+     *   If we're performing a case-insensitive search, and both characters
+     *   are alphabetic, convert the string character to the same case as
+     *   the pattern character, then compare them.  Note that we always use
+     *   the case of the pattern character, because this gives the pattern
+     *   control over the handling for languages where conversions are
+     *   ambiguous.  
+     */
+    if (!case_sensitive && t3_is_alpha(pat_ch) && t3_is_alpha(ch))
+    {
+        /* 
+         *   if the pattern character is upper-case, convert the string
+         *   character to upper-case and compare; likewise for lower-case 
+         */
+        if (t3_is_upper(pat_ch))
+            return (pat_ch == t3_to_upper(ch));
+        else if (t3_is_lower(pat_ch))
+            return (pat_ch == t3_to_lower(ch));
+    }
+
+    /* 
+     *   the search is case-sensitive, or the pattern character is
+     *   non-alphabetic or has no case; since we didn't find an exact match,
+     *   the character doesn't match 
+     */
+    return FALSE;
+}
+
+/*
+ *   Determine if a character matches a character range recognizer.  This
+ *   tells us if the character is in the range list; the caller is
+ *   responsible for inverting the result for an exclusion range.  
+ */
+static int match_range(const re_tuple *tuple, wchar_t ch, int case_sensitive)
+{
+    const wchar_t *rp;
+    size_t i;
+
+    /* search for the character in the range */
+    for (i = tuple->info.range.char_range_cnt,
+         rp = tuple->info.range.char_range ;
+         i != 0 ; i -= 2, rp += 2)
+    {
+        /* 
+         *   check for a class specifier; if it's not a class
+         *   specifier, treat it as a literal range, and check
+         *   case sensitivity 
+         */
+        if (rp[0] == '\0')
+        {
+            int match;
+
+            /*
+             *   The first character of the range pair is null,
+             *   which means that this isn't a literal range but
+             *   rather a class.  Check for a match to the
+             *   class.  
+             */
+            switch(rp[1])
+            {
+            case RE_ALPHA:
+                match = t3_is_alpha(ch);
+                break;
+
+            case RE_DIGIT:
+                match = t3_is_digit(ch);
+                break;
+
+            case RE_UPPER:
+                match = t3_is_upper(ch);
+                break;
+
+            case RE_LOWER:
+                match = t3_is_lower(ch);
+                break;
+
+            case RE_ALPHANUM:
+                match = t3_is_alpha(ch) || t3_is_digit(ch);
+                break;
+
+            case RE_SPACE:
+                match = t3_is_space(ch);
+                break;
+
+            case RE_VSPACE:
+                match = t3_is_vspace(ch);
+                break;
+
+            case RE_PUNCT:
+                match = t3_is_punct(ch);
+                break;
+
+            case RE_NEWLINE:
+                match = (ch == 0x000A
+                         || ch == 0x000D
+                         || ch == 0x000B
+                         || ch == 0x2028
+                         || ch == 0x2029);
+                break;
+                
+            case RE_NULLCHAR:
+                match = (ch == 0);
+                break;
+                
+            default:
+                /* this shouldn't happen */
+                match = FALSE;
+                break;
+            }
+            
+            /* 
+             *   if we matched, we can stop looking; otherwise,
+             *   simply keep going, since there might be another
+             *   entry that does match 
+             */
+            if (match)
+                break;
+        }
+        else if (case_sensitive)
+        {
+            /* 
+             *   the search is case-sensitive - compare the
+             *   character to the range without case conversion 
+             */
+            if (ch >= rp[0] && ch <= rp[1])
+                break;
+        }
+        else if (t3_is_upper(rp[0]) && t3_is_upper(rp[1]))
+        {
+            wchar_t uch;
+            
+            /* 
+             *   the range is all upper-case letters - convert
+             *   the source character to upper-case for the
+             *   comparison 
+             */
+            uch = t3_to_upper(ch);
+            if (uch >= rp[0] && uch <= rp[1])
+                break;
+        }
+        else if (t3_is_lower(rp[0]) && t3_is_lower(rp[1]))
+        {
+            wchar_t lch;
+
+            /* 
+             *   the range is all lower-case letters - convert
+             *   the source character to upper-case for the
+             *   comparison 
+             */
+            lch = t3_to_lower(ch);
+            if (lch >= rp[0] && lch <= rp[1])
+                break;
+        }
+        else
+        {
+            /* 
+             *   The cases of the two ends of the range don't
+             *   agree, so there's nothing we can do for case
+             *   conversions.  Simply compare the range exactly.  
+             */
+            if (ch >= rp[0] && ch <= rp[1])
+                break;
+        }
+    }
+
+    /* we matched if we stopped before exhausting the list */
+    return (i != 0);
+}
+
 /*
  *   Match a string to a compiled expression.  Returns the length of the
  *   match if successful, or -1 if no match was found.  
@@ -2574,7 +2873,7 @@ int CRegexSearcher::match(const char *entire_str,
                           const re_tuple *tuple_arr,
                           const re_machine *machine,
                           re_group_register *regs,
-                          short *loop_vars)
+                          short *loop_vars, CRegexDFA *dfa)
 {
     size_t entire_str_len;
     re_state_id cur_state, final_state;
@@ -2592,6 +2891,35 @@ int CRegexSearcher::match(const char *entire_str,
                       ? pattern->case_sensitive
                       : default_case_sensitive_);
 
+    /* 
+     *   If we have a DFA for the pattern, use it to find the match, or at
+     *   least to rule out a non-match without any backtracking.  
+     */
+    if (dfa != 0)
+    {
+        int len;
+
+        /* if the DFA doesn't find a match, there's no match */
+        if ((len = dfa->match(entire_str, str, origlen)) < 0)
+            return -1;
+
+        /* if the DFA's answer is exact, it's our match */
+        if (dfa->is_exact())
+        {
+            /* figure the group registers for the match, if we have any */
+            if (dfa->has_groups())
+                dfa->get_groups(entire_str, str, origlen, len, regs);
+
+            /* return the match length */
+            return len;
+        }
+
+        /* 
+         *   there's a match, but we need the backtracking matcher to tell
+         *   us exactly what it is 
+         */
+    }
+
     /* macro to perform a "local return" */
 #define local_return(retval) \
     _retval_ = (retval); \
@@ -2937,8 +3265,6 @@ int CRegexSearcher::match(const char *entire_str,
             {
                 int match;
                 wchar_t ch;
-                wchar_t *rp;
-                size_t i;
 
                 /* make sure we have a character to match */
                 if (curlen == 0)
@@ -2950,134 +3276,7 @@ int CRegexSearcher::match(const char *entire_str,
                 ch = p.getch();
 
                 /* search for the character in the range */
-                for (i = tuple->info.range.char_range_cnt,
-                     rp = tuple->info.range.char_range ;
-                     i != 0 ; i -= 2, rp += 2)
-                {
-                    /* 
-                     *   check for a class specifier; if it's not a class
-                     *   specifier, treat it as a literal range, and check
-                     *   case sensitivity 
-                     */
-                    if (rp[0] == '\0')
-                    {
-                        int match;
-
-                        /*
-                         *   The first character of the range pair is null,
-                         *   which means that this isn't a literal range but
-                         *   rather a class.  Check for a match to the
-                         *   class.  
-                         */
-                        switch(rp[1])
-                        {
-                        case RE_ALPHA:
-                            match = t3_is_alpha(ch);
-                            break;
-
-                        case RE_DIGIT:
-                            match = t3_is_digit(ch);
-                            break;
-
-                        case RE_UPPER:
-                            match = t3_is_upper(ch);
-                            break;
-
-                        case RE_LOWER:
-                            match = t3_is_lower(ch);
-                            break;
-
-                        case RE_ALPHANUM:
-                            match = t3_is_alpha(ch) || t3_is_digit(ch);
-                            break;
-
-                        case RE_SPACE:
-                            match = t3_is_space(ch);
-                            break;
-
-                        case RE_VSPACE:
-                            match = t3_is_vspace(ch);
-                            break;
-
-                        case RE_PUNCT:
-                            match = t3_is_punct(ch);
-                            break;
-
-                        case RE_NEWLINE:
-                            match = (ch == 0x000A
-                                     || ch == 0x000D
-                                     || ch == 0x000B
-                                     || ch == 0x2028
-                                     || ch == 0x2029);
-                            break;
-                            
-                        case RE_NULLCHAR:
-                            match = (ch == 0);
-                            break;
-                            
-                        default:
-                            /* this shouldn't happen */
-                            match = FALSE;
-                            break;
-                        }
-                        
-                        /* 
-                         *   if we matched, we can stop looking; otherwise,
-                         *   simply keep going, since there might be another
-                         *   entry that does match 
-                         */
-                        if (match)
-                            break;
-                    }
-                    else if (case_sensitive)
-                    {
-                        /* 
-                         *   the search is case-sensitive - compare the
-                         *   character to the range without case conversion 
-                         */
-                        if (ch >= rp[0] && ch <= rp[1])
-                            break;
-                    }
-                    else if (t3_is_upper(rp[0]) && t3_is_upper(rp[1]))
-                    {
-                        wchar_t uch;
-                        
-                        /* 
-                         *   the range is all upper-case letters - convert
-                         *   the source character to upper-case for the
-                         *   comparison 
-                         */
-                        uch = t3_to_upper(ch);
-                        if (uch >= rp[0] && uch <= rp[1])
-                            break;
-                    }
-                    else if (t3_is_lower(rp[0]) && t3_is_lower(rp[1]))
-                    {
-                        wchar_t lch;
-
-                        /* 
-                         *   the range is all lower-case letters - convert
-                         *   the source character to upper-case for the
-                         *   comparison 
-                         */
-                        lch = t3_to_lower(ch);
-                        if (lch >= rp[0] && lch <= rp[1])
-                            break;
-                    }
-                    else
-                    {
-                        /* 
-                         *   The cases of the two ends of the range don't
-                         *   agree, so there's nothing we can do for case
-                         *   conversions.  Simply compare the range exactly.
-                         */
-                        if (ch >= rp[0] && ch <= rp[1])
-                            break;
-                    }
-                }
-                
-                /* we matched if we stopped before exhausting the list */
-                match = (i != 0);
+                match = match_range(tuple, ch, case_sensitive);
                 
                 /* make sure we got what we wanted */
                 if ((tuple->typ == RE_RANGE && !match)
@@ -3280,71 +3479,9 @@ int CRegexSearcher::match(const char *entire_str,
                 local_return(-1);
             }
 
-            /* 
-             *   check case sensitivity - if we're not in case-sensitive
-             *   mode, and both characters are alphabetic, perform a
-             *   case-insensitive comparison; otherwise, perform an exact
-             *   comparison 
-             */
-            if (tuple->info.ch == p.getch())
-            {
-                /* 
-                 *   we have an exact match; there's no need to check for
-                 *   any case conversions 
-                 */
-            }
-            else if (!case_sensitive
-                     && t3_is_alpha(tuple->info.ch) && t3_is_alpha(p.getch()))
-            {
-                /* 
-                 *   We're performing a case-insensitive search, and both
-                 *   characters are alphabetic.  Convert the string
-                 *   character to the same case as the pattern character,
-                 *   then compare them.  Note that we always use the case of
-                 *   the pattern character, because this gives the pattern
-                 *   control over the handling for languages where
-                 *   conversions are ambiguous.  
-                 */
-                if (t3_is_upper(tuple->info.ch))
-                {
-                    /* 
-                     *   the pattern character is upper-case - convert the
-                     *   string character to upper-case and compare 
-                     */
-                    if (tuple->info.ch != t3_to_upper(p.getch()))
-                    {
-                        local_return(-1);
-                    }
-                }
-                else if (t3_is_lower(tuple->info.ch))
-                {
-                    /* 
-                     *   the pattern character is lower-case - compare to
-                     *   the lower-case string character 
-                     */
-                    if (tuple->info.ch != t3_to_lower(p.getch()))
-                    {
-                        local_return(-1);
-                    }
-                }
-                else
-                {
-                    /* 
-                     *   the pattern character is neither upper nor lower
-                     *   case, so we cannot perform a case conversion; we
-                     *   know the match isn't exact, so we don't have a
-                     *   match at all 
-                     */
-                    local_return(-1);
-                }
-            }
-            else
+            /* if the character doesn't match, this path fails */
+            if (!match_literal(tuple->info.ch, p.getch(), case_sensitive))
             {
-                /* 
-                 *   the search is case-sensitive, or this pattern character
-                 *   is non-alphabetic; since we didn't find an exact match,
-                 *   the string does not match the pattern 
-                 */
                 local_return(-1);
             }
             
@@ -3751,7 +3888,7 @@ int CRegexSearcher::search(const char *entirestr, const char *str, size_t len,
                            const re_compiled_pattern_base *pattern,
                            const re_tuple *tuple_arr,
                            const re_machine *machine, re_group_register *regs,
-                           int *result_len)
+                           int *result_len, CRegexDFA *dfa)
 {
     utf8_ptr p;
     re_group_register best_match_regs[RE_GROUP_REG_CNT];
@@ -3766,6 +3903,13 @@ int CRegexSearcher::search(const char *entirestr, const char *str, size_t len,
 
     /* search the entire string */
     max_start_pos = str + len;
+
+    /* 
+     *   if we have a DFA, use it to check for a match anywhere in the string
+     *   before we go to the trouble of trying each starting position 
+     */
+    if (dfa != 0 && !dfa->search(entirestr, str, len))
+        return -1;
     
     /*
      *   Starting at the first character in the string, search for the
@@ -3778,7 +3922,7 @@ int CRegexSearcher::search(const char *entirestr, const char *str, size_t len,
         
         /* check for a match */
         matchlen = match(entirestr, p.getptr(), len,
-                         pattern, tuple_arr, machine, regs, loop_vars);
+                         pattern, tuple_arr, machine, regs, loop_vars, dfa);
         if (matchlen >= 0)
         {
             /* check our first-begin/first-end mode */
@@ -3926,7 +4070,7 @@ int CRegexSearcher::search_for_pattern(
      *   the original string after we return 
      */
     return search(entirestr, searchstr, searchlen, pattern, pattern->tuples,
-                  &pattern->machine, regs, result_len);
+                  &pattern->machine, regs, result_len, get_dfa(pattern));
 }
 
 /* ------------------------------------------------------------------------ */
@@ -3946,7 +4090,19 @@ int CRegexSearcher::match_pattern(
     /* match the string */
     return match(entirestr, searchstr, searchlen,
                  pattern, pattern->tuples, &pattern->machine,
-                 regs, loop_vars);
+                 regs, loop_vars, get_dfa(pattern));
+}
+
+/* ------------------------------------------------------------------------ */
+/*
+ *   Get the DFA for a compiled pattern, using the case sensitivity that
+ *   applies to the pattern in this searcher.  
+ */
+CRegexDFA *CRegexSearcher::get_dfa(const re_compiled_pattern *pattern) const
+{
+    return CRegexDFA::get(pattern, pattern->case_sensitivity_specified
+                                   ? pattern->case_sensitive
+                                   : default_case_sensitive_);
 }
 
 /* ------------------------------------------------------------------------ */
@@ -3956,17 +4112,15 @@ int CRegexSearcher::match_pattern(
  *   search function; we merely match the leading substring of the given
  *   string to the given pattern.  
  *   
- *   If a pattern pattern will be used repeatedly in multiple searches or
- *   matches, it is more efficient to compile the pattern once and then
- *   re-use the compiled pattern for each search or match, since compiling a
- *   pattern takes time.  
+ *   The compiled pattern goes in the parser's pattern cache, so if we see
+ *   the same expression again, we won't have to compile it again.  
  */
 int CRegexSearcherSimple::compile_and_match(
     const char *patstr, size_t patlen,
     const char *entirestr, const char *searchstr, size_t searchlen)
 {
-    re_compiled_pattern_base pat;
-    short loop_vars[RE_LOOP_VARS_MAX];
+    re_compiled_pattern *pat;
+    int ret;
 
     /* no groups yet */
     group_cnt_ = 0;
@@ -3975,15 +4129,17 @@ int CRegexSearcherSimple::compile_and_match(
     clear_group_regs();
 
     /* compile the expression - return failure if we get an error */
-    if (parser_->compile(patstr, patlen, &pat) != RE_STATUS_SUCCESS)
+    if ((pat = parser_->get_cached_pattern(patstr, patlen)) == 0)
         return FALSE;
 
-    /* remember the group count from the compiled pattern */
-    group_cnt_ = pat.group_cnt;
-
     /* match the string */
-    return match(entirestr, searchstr, searchlen,
-                 &pat, parser_->tuple_arr_, &pat.machine, regs_, loop_vars);
+    ret = match_pattern(pat, entirestr, searchstr, searchlen);
+
+    /* we're done with the pattern */
+    parser_->release_cached_pattern(pat);
+
+    /* return the result */
+    return ret;
 }
 
 /* ------------------------------------------------------------------------ */
@@ -3991,17 +4147,16 @@ int CRegexSearcherSimple::compile_and_match(
  *   Compile an expression and search for a match within the given string.
  *   Returns the offset of the match, or -1 if no match was found.
  *   
- *   If a pattern will be used repeatedly in multiple searches or matches, it
- *   is more efficient to compile the pattern once, using compile_pattern(),
- *   and then re-use the compiled pattern for each search, since compiling a
- *   pattern takes time.  
+ *   The compiled pattern goes in the parser's pattern cache, so if we see
+ *   the same expression again, we won't have to compile it again.  
  */
 int CRegexSearcherSimple::compile_and_search(
     const char *patstr, size_t patlen,
     const char *entirestr, const char *searchstr, size_t searchlen,
     int *result_len)
 {
-    re_compiled_pattern_base pat;
+    re_compiled_pattern *pat;
+    int ret;
 
     /* no groups yet */
     group_cnt_ = 0;
@@ -4010,18 +4165,877 @@ int CRegexSearcherSimple::compile_and_search(
     clear_group_regs();
 
     /* compile the expression - return failure if we get an error */
-    if (parser_->compile(patstr, patlen, &pat) != RE_STATUS_SUCCESS)
+    if ((pat = parser_->get_cached_pattern(patstr, patlen)) == 0)
         return -1;
 
-    /* remember the group count from the compiled pattern */
-    group_cnt_ = pat.group_cnt;
+    /* search for the pattern */
+    ret = search_for_pattern(pat, entirestr, searchstr, searchlen,
+                             result_len);
 
-    /* 
-     *   search for the pattern in our copy of the string - use the copy so
-     *   that the group registers stay valid even if the caller deallocates
-     *   the original string after we return 
+    /* we're done with the pattern */
+    parser_->release_cached_pattern(pat);
+
+    /* return the result */
+    return ret;
+}
+
+/* ------------------------------------------------------------------------ */
+/*
+ *   DFA matcher 
+ */
+
+/*
+ *   Get the DFA for a pattern in the given case sensitivity mode, creating
+ *   it if necessary.  
+ */
+CRegexDFA *CRegexDFA::get(const re_compiled_pattern *pat, int case_sensitive)
+{
+    /* 
+     *   The DFAs are a cache attached to the pattern, so we treat them as
+     *   mutable even when the pattern is const.  
+     */
+    re_compiled_pattern *mpat = (re_compiled_pattern *)pat;
+    int idx = (case_sensitive ? 1 : 0);
+
+    /* if we already know we can't use a DFA, say so */
+    if (pat->no_dfa)
+        return 0;
+
+    /* if we haven't built the DFA for this mode yet, do so now */
+    if (pat->dfa[idx] == 0)
+    {
+        /* if the pattern needs backtracking, note it and give up */
+        if (!can_use_dfa(pat))
+        {
+            mpat->no_dfa = TRUE;
+            return 0;
+        }
+
+        /* create the DFA */
+        mpat->dfa[idx] = new CRegexDFA(pat, case_sensitive);
+    }
+
+    /* return the DFA */
+    return pat->dfa[idx];
+}
+
+/*
+ *   Determine if a pattern can run as a DFA 
+ */
+int CRegexDFA::can_use_dfa(const re_compiled_pattern *pat)
+{
+    re_state_id i;
+    const re_tuple *t;
+
+    /* 
+     *   a null or zero-length machine matches immediately, so there's no
+     *   point in building a DFA for it 
+     */
+    if (pat->machine.init == RE_STATE_INVALID
+        || pat->machine.init == pat->machine.final)
+        return FALSE;
+
+    /* check for recognizers that need backtracking */
+    for (i = 0, t = pat->tuples ; i < pat->tuple_cnt ; ++i, ++t)
+    {
+        switch (t->typ)
+        {
+        case RE_GROUP_MATCH:
+        case RE_ASSERT_POS:
+        case RE_ASSERT_NEG:
+        case RE_ASSERT_BACKPOS:
+        case RE_ASSERT_BACKNEG:
+        case RE_LOOKBACK_POS:
+        case RE_ZERO_VAR:
+        case RE_LOOP_BRANCH:
+            /* 
+             *   back-references, assertions, and counted loops all depend on
+             *   the path we took to get here, so they need backtracking 
+             */
+            return FALSE;
+
+        default:
+            break;
+        }
+    }
+
+    /* we can use a DFA */
+    return TRUE;
+}
+
+/*
+ *   construction 
+ */
+CRegexDFA::CRegexDFA(const re_compiled_pattern *pat, int case_sensitive)
+{
+    re_state_id i;
+    const re_tuple *t;
+
+    /* remember the pattern and mode */
+    pat_ = pat;
+    case_sensitive_ = case_sensitive;
+
+    /* 
+     *   Scan the pattern to see which context flags matter, whether there
+     *   are any group registers to track, and whether there are any
+     *   shortest-match branches.  
+     */
+    ctx_mask_ = RE_DFA_UNANCHORED;
+    has_groups_ = FALSE;
+    exact_ = TRUE;
+    for (i = 0, t = pat->tuples ; i < pat->tuple_cnt ; ++i, ++t)
+    {
+        switch (t->typ)
+        {
+        case RE_TEXT_BEGIN:
+            ctx_mask_ |= RE_DFA_AT_BEGIN;
+            break;
+
+        case RE_TEXT_END:
+            ctx_mask_ |= RE_DFA_AT_END;
+            break;
+
+        case RE_WORD_BEGIN:
+        case RE_WORD_END:
+        case RE_WORD_BOUNDARY:
+        case RE_NON_WORD_BOUNDARY:
+            ctx_mask_ |= RE_DFA_PREV_WORD | RE_DFA_NEXT_WORD;
+            break;
+
+        case RE_GROUP_ENTER:
+        case RE_GROUP_EXIT:
+            if (t->info.ch < RE_GROUP_REG_CNT)
+                has_groups_ = TRUE;
+            break;
+
+        default:
+            break;
+        }
+
+        /* 
+         *   in longest-match mode, a shortest-match branch makes the match
+         *   length depend on the branch order, which the DFA doesn't track 
+         */
+        if (pat->longest_match && (t->flags & RE_STATE_SHORTEST) != 0)
+            exact_ = FALSE;
+    }
+
+    /* allocate the state list, and clear the hash table */
+    states_ = (re_dfa_state **)t3malloc(
+        RE_DFA_MAX_STATES * sizeof(states_[0]));
+    state_cnt_ = 0;
+    flush_cnt_ = 0;
+    for (int j = 0 ; j < RE_DFA_HASH_SIZE ; ++j)
+        buckets_[j] = RE_DFA_UNKNOWN;
+    for (int j = 0 ; j < (int)countof(start_) ; ++j)
+        start_[j] = RE_DFA_UNKNOWN;
+
+    /* 
+     *   Allocate the closure scratch space.  A closure contains each NFA
+     *   state at most once; the stack can hold each state's two successors
+     *   plus the starting states.  
      */
-    return search(entirestr, searchstr, searchlen,
-                  &pat, parser_->tuple_arr_, &pat.machine,
-                  regs_, result_len);
+    closure_ = (re_state_id *)t3malloc(
+        (pat->tuple_cnt + 1) * sizeof(closure_[0]));
+    stack_ = (re_state_id *)t3malloc(
+        (3*pat->tuple_cnt + 2) * sizeof(stack_[0]));
+    marks_ = (unsigned long *)t3malloc(
+        pat->tuple_cnt * sizeof(marks_[0]));
+    memset(marks_, 0, pat->tuple_cnt * sizeof(marks_[0]));
+    mark_gen_ = 0;
+    closure_cnt_ = 0;
+
+    /* we'll allocate the register-tracking threads if we need them */
+    threads_ = 0;
+}
+
+/*
+ *   deletion 
+ */
+CRegexDFA::~CRegexDFA()
+{
+    /* delete our states */
+    flush();
+
+    /* delete our scratch space */
+    t3free(states_);
+    t3free(closure_);
+    t3free(stack_);
+    t3free(marks_);
+    if (threads_ != 0)
+        t3free(threads_);
+}
+
+/*
+ *   Discard all of our states.  We do this when we reach our limit on the
+ *   number of cached states, so that patterns that generate huge numbers
+ *   of states can't use unbounded memory; we simply start over and build
+ *   the states we need from here on.  
+ */
+void CRegexDFA::flush()
+{
+    int i;
+
+    /* delete the states */
+    for (i = 0 ; i < state_cnt_ ; ++i)
+        t3free(states_[i]);
+    state_cnt_ = 0;
+
+    /* clear the hash table and the start states */
+    for (i = 0 ; i < RE_DFA_HASH_SIZE ; ++i)
+        buckets_[i] = RE_DFA_UNKNOWN;
+    for (i = 0 ; i < (int)countof(start_) ; ++i)
+        start_[i] = RE_DFA_UNKNOWN;
+
+    /* count the flush, so that callers can tell their states are gone */
+    ++flush_cnt_;
+}
+
+/*
+ *   Find or create the state for a set of NFA states 
+ */
+int CRegexDFA::intern(const re_state_id *nfa, int nfa_cnt, unsigned int flags)
+{
+    unsigned int hash;
+    int i, idx;
+    re_dfa_state *s;
+
+    /* figure the hash value */
+    for (hash = flags, i = 0 ; i < nfa_cnt ; ++i)
+        hash = hash*31 + (unsigned int)nfa[i];
+
+    /* look for an existing state */
+    for (idx = buckets_[hash % RE_DFA_HASH_SIZE] ; idx >= 0 ; idx = s->nxt)
+    {
+        s = states_[idx];
+        if (s->hash == hash && s->flags == flags && s->nfa_cnt == nfa_cnt
+            && (nfa_cnt == 0
+                || memcmp(s->nfa, nfa, nfa_cnt * sizeof(nfa[0])) == 0))
+            return idx;
+    }
+
+    /* if we're out of room, start over */
+    if (state_cnt_ == RE_DFA_MAX_STATES)
+        flush();
+
+    /* create the new state */
+    s = (re_dfa_state *)t3malloc(
+        sizeof(re_dfa_state)
+        + (nfa_cnt > 1 ? nfa_cnt - 1 : 0)*sizeof(s->nfa[0]));
+    s->flags = flags;
+    s->hash = hash;
+    s->accept[0] = s->accept[1] = s->accept[2] = -1;
+    for (i = 0 ; i < (int)countof(s->next) ; ++i)
+        s->next[i] = RE_DFA_UNKNOWN;
+    s->nfa_cnt = nfa_cnt;
+    if (nfa_cnt != 0)
+        memcpy(s->nfa, nfa, nfa_cnt * sizeof(nfa[0]));
+
+    /* add it to the state list and the hash table */
+    idx = state_cnt_++;
+    states_[idx] = s;
+    s->nxt = buckets_[hash % RE_DFA_HASH_SIZE];
+    buckets_[hash % RE_DFA_HASH_SIZE] = idx;
+
+    /* return the new state */
+    return idx;
+}
+
+/*
+ *   Compute the closure of a set of NFA states - the set of states we can
+ *   reach from the given states without consuming any input, given the
+ *   context at the current position.  
+ */
+int CRegexDFA::compute_closure(const re_state_id *nfa, int nfa_cnt,
+                               unsigned int ctx)
+{
+    int sp, i;
+    int found_final = FALSE;
+    re_state_id final_state = pat_->machine.final;
+
+    /* start a new visit generation */
+    ++mark_gen_;
+    closure_cnt_ = 0;
+
+    /* start with the given states, plus the initial state if unanchored */
+    for (sp = 0, i = 0 ; i < nfa_cnt ; ++i)
+        stack_[sp++] = nfa[i];
+    if ((ctx & RE_DFA_UNANCHORED) != 0)
+        stack_[sp++] = pat_->machine.init;
+
+    /* visit states until we run out */
+    while (sp != 0)
+    {
+        re_state_id cur = stack_[--sp];
+        const re_tuple *t;
+        int pass;
+
+        /* skip invalid states and states we've already visited */
+        if (cur == RE_STATE_INVALID || marks_[cur] == mark_gen_)
+            continue;
+        marks_[cur] = mark_gen_;
+
+        /* if it's the final state, we have a match */
+        if (cur == final_state)
+        {
+            found_final = TRUE;
+            continue;
+        }
+
+        /* check the type */
+        t = &pat_->tuples[cur];
+        switch (t->typ)
+        {
+        case RE_EPSILON:
+            /* visit both branches */
+            stack_[sp++] = t->next_state_2;
+            stack_[sp++] = t->next_state_1;
+            continue;
+
+        case RE_GROUP_ENTER:
+        case RE_GROUP_EXIT:
+            /* group markers don't affect whether we match */
+            pass = TRUE;
+            break;
+
+        case RE_TEXT_BEGIN:
+            pass = ((ctx & RE_DFA_AT_BEGIN) != 0);
+            break;
+
+        case RE_TEXT_END:
+            pass = ((ctx & RE_DFA_AT_END) != 0);
+            break;
+
+        case RE_WORD_BEGIN:
+            pass = ((ctx & (RE_DFA_PREV_WORD | RE_DFA_NEXT_WORD))
+                    == RE_DFA_NEXT_WORD);
+            break;
+
+        case RE_WORD_END:
+            pass = ((ctx & (RE_DFA_PREV_WORD | RE_DFA_NEXT_WORD))
+                    == RE_DFA_PREV_WORD);
+            break;
+
+        case RE_WORD_BOUNDARY:
+        case RE_NON_WORD_BOUNDARY:
+            pass = (((ctx & RE_DFA_PREV_WORD) != 0)
+                    != ((ctx & RE_DFA_NEXT_WORD) != 0));
+            if (t->typ == RE_NON_WORD_BOUNDARY)
+                pass = !pass;
+            break;
+
+        default:
+            /* it's a character recognizer - add it to the closure */
+            closure_[closure_cnt_++] = cur;
+            continue;
+        }
+
+        /* if the zero-width test passed, proceed to the next state */
+        if (pass)
+            stack_[sp++] = t->next_state_1;
+    }
+
+    /* tell the caller whether we reached the final state */
+    return found_final;
+}
+
+/*
+ *   Determine if a character-matching state matches a character 
+ */
+int CRegexDFA::char_matches(const re_tuple *t, wchar_t ch) const
+{
+    switch (t->typ)
+    {
+    case RE_LITERAL:
+        return match_literal(t->info.ch, ch, case_sensitive_);
+
+    case RE_WILDCARD:
+        return TRUE;
+
+    case RE_RANGE:
+        return match_range(t, ch, case_sensitive_);
+
+    case RE_RANGE_EXCL:
+        return !match_range(t, ch, case_sensitive_);
+
+    case RE_ALPHA:
+        return t3_is_alpha(ch);
+
+    case RE_DIGIT:
+        return t3_is_digit(ch);
+
+    case RE_UPPER:
+        return t3_is_upper(ch);
+
+    case RE_LOWER:
+        return t3_is_lower(ch);
+
+    case RE_ALPHANUM:
+        return t3_is_alpha(ch) || t3_is_digit(ch);
+
+    case RE_SPACE:
+        return t3_is_space(ch);
+
+    case RE_VSPACE:
+        return t3_is_vspace(ch);
+
+    case RE_PUNCT:
+        return t3_is_punct(ch);
+
+    case RE_NEWLINE:
+        return (ch == 0x000A || ch == 0x000D || ch == 0x000B
+                || ch == 0x2028 || ch == 0x2029);
+
+    case RE_WORD_CHAR:
+        return CRegexSearcher::is_word_char(ch);
+
+    case RE_NON_WORD_CHAR:
+        return !CRegexSearcher::is_word_char(ch);
+
+    default:
+        /* anything else can't match a character */
+        return FALSE;
+    }
+}
+
+/*
+ *   Get the context flags for a position in a string 
+ */
+unsigned int CRegexDFA::get_ctx(const char *entire_str, const char *p,
+                                size_t rem) const
+{
+    unsigned int ctx = 0;
+    utf8_ptr up((char *)p);
+
+    /* note the start of the string, or the type of the previous character */
+    if (p == entire_str)
+        ctx |= RE_DFA_AT_BEGIN;
+    else if (CRegexSearcher::is_word_char(up.getch_before(1)))
+        ctx |= RE_DFA_PREV_WORD;
+
+    /* note the end of the string, or the type of the next character */
+    if (rem == 0)
+        ctx |= RE_DFA_AT_END;
+    else if (CRegexSearcher::is_word_char(up.getch()))
+        ctx |= RE_DFA_NEXT_WORD;
+
+    /* keep only the flags that matter to this pattern */
+    return ctx & ctx_mask_;
+}
+
+/*
+ *   Get the initial state for a match starting at the given point 
+ */
+int CRegexDFA::get_start_state(const char *entire_str, const char *str,
+                               unsigned int flags)
+{
+    re_state_id init = pat_->machine.init;
+
+    /* 
+     *   Figure the context flags.  We only want the flags that carry over
+     *   from the previous character, since the next character is part of
+     *   the transition.  
+     */
+    flags |= get_ctx(entire_str, str, 0)
+             & (RE_DFA_AT_BEGIN | RE_DFA_PREV_WORD);
+
+    /* 
+     *   if we haven't created this start state yet, do so now; an anchored
+     *   match starts with the initial state, and an unanchored search adds
+     *   the initial state at every position anyway, so it starts empty 
+     */
+    if (start_[flags] == RE_DFA_UNKNOWN)
+    {
+        int idx = ((flags & RE_DFA_UNANCHORED) != 0
+                   ? intern(0, 0, flags) : intern(&init, 1, flags));
+        start_[flags] = idx;
+    }
+
+    /* return the state */
+    return start_[flags];
+}
+
+/*
+ *   Determine if a state accepts (that is, if the pattern matches at the
+ *   current position), given the next character.  'rem' is the number of
+ *   bytes remaining in the string; if it's zero, we're at the end of the
+ *   string and 'ch' is ignored.  
+ */
+int CRegexDFA::accepts(int cur, size_t rem, wchar_t ch)
+{
+    re_dfa_state *s = states_[cur];
+    int idx;
+    unsigned int ctx;
+
+    /* figure out which context case we're in */
+    if (rem == 0)
+    {
+        idx = 2;
+        ctx = RE_DFA_AT_END;
+    }
+    else if (CRegexSearcher::is_word_char(ch))
+    {
+        idx = 1;
+        ctx = RE_DFA_NEXT_WORD;
+    }
+    else
+    {
+        idx = 0;
+        ctx = 0;
+    }
+
+    /* if we haven't worked out this case for this state yet, do so now */
+    if (s->accept[idx] < 0)
+        s->accept[idx] = (signed char)compute_closure(
+            s->nfa, s->nfa_cnt, s->flags | (ctx & ctx_mask_));
+
+    /* return the result */
+    return s->accept[idx];
+}
+
+/* 
+ *   comparison callback for sorting NFA state lists 
+ */
+static int re_state_cmp(const void *a, const void *b)
+{
+    re_state_id ia = *(const re_state_id *)a, ib = *(const re_state_id *)b;
+    return (ia < ib ? -1 : ia > ib ? 1 : 0);
+}
+
+/*
+ *   Get the state we reach from a state on a given character 
+ */
+int CRegexDFA::get_transition(int cur, wchar_t ch)
+{
+    re_dfa_state *s = states_[cur];
+    int nxt, i, cnt;
+    unsigned int flags;
+    unsigned long flush_cnt;
+    int is_word = CRegexSearcher::is_word_char(ch);
+
+    /* if we've already worked out this transition, use the cached value */
+    if (ch < 128 && s->next[ch] != RE_DFA_UNKNOWN)
+        return s->next[ch];
+
+    /* get the closure of the current state, given the next character */
+    compute_closure(s->nfa, s->nfa_cnt,
+                    s->flags | (is_word ? RE_DFA_NEXT_WORD & ctx_mask_ : 0));
+
+    /* 
+     *   Collect the targets of the closure states that match the character.
+     *   We're done with the closure stack, so we can use it to build the
+     *   list.  
+     */
+    for (i = 0, cnt = 0 ; i < closure_cnt_ ; ++i)
+    {
+        const re_tuple *t = &pat_->tuples[closure_[i]];
+        if (t->next_state_1 != RE_STATE_INVALID && char_matches(t, ch))
+            stack_[cnt++] = t->next_state_1;
+    }
+
+    /* put the list in canonical order, and remove duplicates */
+    qsort(stack_, cnt, sizeof(stack_[0]), re_state_cmp);
+    for (i = 1, nxt = (cnt != 0 ? 1 : 0) ; i < cnt ; ++i)
+    {
+        if (stack_[i] != stack_[nxt - 1])
+            stack_[nxt++] = stack_[i];
+    }
+    cnt = nxt;
+
+    /* the new state keeps the anchoring mode, and notes this character */
+    flags = (s->flags & RE_DFA_UNANCHORED)
+            | (is_word ? RE_DFA_PREV_WORD & ctx_mask_ : 0);
+
+    /* 
+     *   if there's nothing left in an anchored match, we're at a dead end;
+     *   otherwise find or create the new state 
+     */
+    flush_cnt = flush_cnt_;
+    if (cnt == 0 && (flags & RE_DFA_UNANCHORED) == 0)
+        nxt = RE_DFA_DEAD;
+    else
+        nxt = intern(stack_, cnt, flags);
+
+    /* 
+     *   cache the transition for an ASCII character, as long as we didn't
+     *   have to flush the cache (which would have deleted the old state) 
+     */
+    if (ch < 128 && flush_cnt == flush_cnt_)
+        s->next[ch] = nxt;
+
+    /* return the new state */
+    return nxt;
+}
+
+/*
+ *   Run the DFA.  Returns the length of the longest match (or the shortest,
+ *   if 'stop_at_first' is set), or -1 if there's no match.  
+ */
+int CRegexDFA::run(int cur, const char *entire_str, const char *str,
+                   size_t len, int stop_at_first)
+{
+    utf8_ptr p((char *)str);
+    size_t rem = len;
+    int last = -1;
+
+    for (;;)
+    {
+        wchar_t ch = (rem != 0 ? p.getch() : 0);
+
+        /* if the pattern matches here, note the match length */
+        if (accepts(cur, rem, ch))
+        {
+            last = p.getptr() - str;
+            if (stop_at_first)
+                break;
+        }
+
+        /* stop at the end of the string */
+        if (rem == 0)
+            break;
+
+        /* make the transition, and stop if there's nowhere left to go */
+        if ((cur = get_transition(cur, ch)) == RE_DFA_DEAD)
+            break;
+
+        /* move on to the next character */
+        p.inc(&rem);
+    }
+
+    /* return the match length */
+    return last;
+}
+
+/*
+ *   Match the leading substring of a string 
+ */
+int CRegexDFA::match(const char *entire_str, const char *str, size_t len)
+{
+    /* 
+     *   We need the longest match in longest-match mode, and the shortest
+     *   otherwise.  If we're not exact, any match will do.  
+     */
+    return run(get_start_state(entire_str, str, 0), entire_str, str, len,
+               !exact_ || !pat_->longest_match);
+}
+
+/*
+ *   Determine if there's a match anywhere in the string 
+ */
+int CRegexDFA::search(const char *entire_str, const char *str, size_t len)
+{
+    return run(get_start_state(entire_str, str, RE_DFA_UNANCHORED),
+               entire_str, str, len, TRUE) >= 0;
+}
+
+/*
+ *   Advance a list of threads over the zero-width transitions at the current
+ *   position, for the register-tracking pass.  We visit the states in
+ *   priority order: the source threads in order, and the first branch of
+ *   each epsilon before the second.  The first thread to reach a state
+ *   wins, since it's on the preferred path.
+ *   
+ *   We add each thread that reaches a character-matching state to 'dst'.
+ *   If 'regs' is non-null, and a thread reaches the final state, we copy
+ *   the first such thread's registers to 'regs' and return true.  
+ */
+int CRegexDFA::advance_threads(re_dfa_thread *src, int src_cnt,
+                               re_dfa_thread *dst, int *dst_cnt,
+                               unsigned int ctx, int ofs,
+                               re_group_register *regs)
+{
+    /* the work stack follows the two thread lists in our thread space */
+    re_dfa_thread *stk = threads_ + 2*(pat_->tuple_cnt + 1);
+    re_state_id final_state = pat_->machine.final;
+    int found_final = FALSE;
+    int i, sp;
+
+    /* start a new visit generation */
+    ++mark_gen_;
+    *dst_cnt = 0;
+
+    /* run each thread in order */
+    for (i = 0 ; i < src_cnt ; ++i)
+    {
+        /* start with this thread */
+        stk[0] = src[i];
+        sp = 1;
+
+        /* follow its zero-width transitions */
+        while (sp != 0)
+        {
+            re_dfa_thread *th = &stk[--sp];
+            re_state_id cur = th->state;
+            const re_tuple *t;
+            int pass;
+
+            /* skip invalid states and states we've already visited */
+            if (cur == RE_STATE_INVALID || marks_[cur] == mark_gen_)
+                continue;
+            marks_[cur] = mark_gen_;
+
+            /* if it's the final state, note the first thread to reach it */
+            if (cur == final_state)
+            {
+                if (regs != 0 && !found_final)
+                {
+                    memcpy(regs, th->regs, sizeof(th->regs));
+                    found_final = TRUE;
+                }
+                continue;
+            }
+
+            /* check the type */
+            t = &pat_->tuples[cur];
+            switch (t->typ)
+            {
+            case RE_EPSILON:
+                /* 
+                 *   Visit both branches, the first one first.  Note that
+                 *   the second branch's entry goes in the slot that 'th'
+                 *   occupies, so copy the registers before overwriting it.  
+                 */
+                if (t->next_state_2 != RE_STATE_INVALID)
+                {
+                    stk[sp].state = t->next_state_2;
+                    ++sp;
+                    stk[sp] = stk[sp - 1];
+                }
+                else
+                    stk[sp] = *th;
+                stk[sp++].state = t->next_state_1;
+                continue;
+
+            case RE_GROUP_ENTER:
+                /* note the group's start position */
+                if (t->info.ch < RE_GROUP_REG_CNT)
+                    th->regs[t->info.ch].start_ofs = ofs;
+                pass = TRUE;
+                break;
+
+            case RE_GROUP_EXIT:
+                /* note the group's end position */
+                if (t->info.ch < RE_GROUP_REG_CNT)
+                    th->regs[t->info.ch].end_ofs = ofs;
+                pass = TRUE;
+                break;
+
+            case RE_TEXT_BEGIN:
+                pass = ((ctx & RE_DFA_AT_BEGIN) != 0);
+                break;
+
+            case RE_TEXT_END:
+                pass = ((ctx & RE_DFA_AT_END) != 0);
+                break;
+
+            case RE_WORD_BEGIN:
+                pass = ((ctx & (RE_DFA_PREV_WORD | RE_DFA_NEXT_WORD))
+                        == RE_DFA_NEXT_WORD);
+                break;
+
+            case RE_WORD_END:
+                pass = ((ctx & (RE_DFA_PREV_WORD | RE_DFA_NEXT_WORD))
+                        == RE_DFA_PREV_WORD);
+                break;
+
+            case RE_WORD_BOUNDARY:
+            case RE_NON_WORD_BOUNDARY:
+                pass = (((ctx & RE_DFA_PREV_WORD) != 0)
+                        != ((ctx & RE_DFA_NEXT_WORD) != 0));
+                if (t->typ == RE_NON_WORD_BOUNDARY)
+                    pass = !pass;
+                break;
+
+            default:
+                /* it's a character recognizer - add the thread to 'dst' */
+                dst[(*dst_cnt)++] = *th;
+                continue;
+            }
+
+            /* 
+             *   if the zero-width test passed, proceed to the next state;
+             *   'th' is the top slot, so we can simply reuse it 
+             */
+            if (pass)
+            {
+                th->state = t->next_state_1;
+                ++sp;
+            }
+        }
+    }
+
+    /* tell the caller whether we found the final state */
+    return found_final;
+}
+
+/*
+ *   Find the group registers for a match.  We already know the length of
+ *   the match from running the DFA, so we just need to find the path that
+ *   the backtracking matcher would choose among the paths of that length.
+ *   The backtracker prefers the first branch of each two-way epsilon when
+ *   the branches give equal match lengths, so its choice is the first path
+ *   of the right length in branch order.  We find it by running all of the
+ *   paths in parallel, in priority order, keeping only the first thread
+ *   that reaches each state at each position; this takes time linear in
+ *   the length of the match.  
+ */
+void CRegexDFA::get_groups(const char *entire_str, const char *str,
+                           size_t len, int match_len, re_group_register *regs)
+{
+    int n = pat_->tuple_cnt + 1;
+    re_dfa_thread *cur, *nxt;
+    int cur_cnt, nxt_cnt;
+    utf8_ptr p((char *)str);
+    size_t rem = len;
+
+    /* 
+     *   Allocate our thread space if we haven't already: we need two thread
+     *   lists, plus the work stack for advance_threads().  Each list has at
+     *   most one thread per state (plus one for the initial thread); the
+     *   stack has room for each state's two successors, plus the thread
+     *   we're starting from.  
+     */
+    if (threads_ == 0)
+        threads_ = (re_dfa_thread *)t3malloc(
+            (2*n + 2*pat_->tuple_cnt + 1) * sizeof(threads_[0]));
+
+    /* start with a single thread at the initial state */
+    cur = threads_;
+    nxt = threads_ + n;
+    cur[0].state = pat_->machine.init;
+    memcpy(cur[0].regs, regs, sizeof(cur[0].regs));
+    cur_cnt = 1;
+
+    for (;;)
+    {
+        int ofs = p.getptr() - str;
+        unsigned int ctx = get_ctx(entire_str, p.getptr(), rem);
+        wchar_t ch;
+        int i;
+
+        /* 
+         *   advance the threads to the character-matching states; if we've
+         *   reached the end of the match, this fills in the registers from
+         *   the winning thread, and we're done 
+         */
+        if (advance_threads(cur, cur_cnt, nxt, &nxt_cnt,
+                            ctx, p.getptr() - entire_str,
+                            ofs == match_len ? regs : 0)
+            || ofs >= match_len || rem == 0)
+            break;
+
+        /* advance the threads that match the next character */
+        for (ch = p.getch(), i = 0, cur_cnt = 0 ; i < nxt_cnt ; ++i)
+        {
+            const re_tuple *t = &pat_->tuples[nxt[i].state];
+            if (t->next_state_1 != RE_STATE_INVALID && char_matches(t, ch))
+            {
+                cur[cur_cnt] = nxt[i];
+                cur[cur_cnt++].state = t->next_state_1;
+            }
+        }
+
+        /* on to the next character */
+        p.inc(&rem);
+    }
 }
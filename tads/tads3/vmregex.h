@@ -355,6 +355,20 @@ struct re_compiled_pattern_base
  */
 struct re_compiled_pattern: re_compiled_pattern_base
 {
+    /* 
+     *   The DFA matchers for the pattern, one for case-insensitive matching
+     *   (element 0) and one for case-sensitive matching (element 1).  We
+     *   build these on demand the first time the pattern is used in each
+     *   mode (see CRegexDFA).  
+     */
+    class CRegexDFA *dfa[2];
+
+    /* 
+     *   set when we find that the pattern can't be run as a DFA, so that we
+     *   don't keep trying to build one 
+     */
+    unsigned int no_dfa : 1;
+
     /* 
      *   the tuple array (the structure is overallocated to make room for
      *   tuple_cnt entries in this array) 
@@ -377,6 +391,37 @@ typedef enum
 } re_status_t;
 
 
+/* ------------------------------------------------------------------------ */
+/*
+ *   Compiled pattern cache entry.  The parser keeps a cache of recently
+ *   compiled expressions, so that callers that pass the same expression
+ *   string over and over (rexMatch and friends are usually called with
+ *   literal pattern strings) only pay for the compilation once.  
+ */
+struct re_cache_entry
+{
+    /* the expression text (a private copy) and its hash value */
+    char *expr;
+    size_t exprlen;
+    unsigned int hash;
+
+    /* the compiled pattern */
+    re_compiled_pattern *pat;
+
+    /* 
+     *   number of callers currently using the pattern - we can't evict an
+     *   entry while it's in use 
+     */
+    int refs;
+
+    /* last use time, for choosing an entry to evict */
+    unsigned long last_use;
+};
+
+/* number of entries in the pattern cache */
+#define RE_CACHE_SIZE  64
+
+
 /* ------------------------------------------------------------------------ */
 /*
  *   Regular expression compilation context structure.  This tracks the
@@ -407,6 +452,19 @@ public:
     /* free a pattern previously created with compile_pattern() */
     static void free_pattern(re_compiled_pattern *pattern);
 
+    /* 
+     *   Get the compiled pattern for an expression from the pattern cache,
+     *   compiling the expression and adding it to the cache if it's not
+     *   already there.  Returns null if the expression doesn't compile.
+     *   The pattern stays valid until the caller releases it with
+     *   release_cached_pattern().  
+     */
+    re_compiled_pattern *get_cached_pattern(const char *expr_str,
+                                            size_t exprlen);
+
+    /* release a pattern obtained from get_cached_pattern() */
+    void release_cached_pattern(re_compiled_pattern *pattern);
+
 protected:
     /* reset the parser */
     void reset();
@@ -530,6 +588,12 @@ protected:
 
     /* maximum number of entries in range buffer */
     size_t range_buf_max_;
+
+    /* the compiled pattern cache */
+    re_cache_entry cache_[RE_CACHE_SIZE];
+
+    /* use counter, for the cache entries' last-use times */
+    unsigned long cache_clock_;
 };
 
 /* ------------------------------------------------------------------------ */
@@ -1017,6 +1081,230 @@ protected:
     size_t used_;
 };
 
+/* ------------------------------------------------------------------------ */
+/*
+ *   DFA matcher.  The basic matcher (CRegexSearcher::match) is a
+ *   backtracking matcher that tries every branch of every alternation and
+ *   closure to find the best match, which can take time exponential in the
+ *   length of the string for patterns with a lot of ambiguity.  Most
+ *   patterns don't use any of the features that actually require
+ *   backtracking (back-references, look-ahead and look-back assertions, and
+ *   counted intervals), though, and those patterns can run as a
+ *   deterministic automaton instead.  Each DFA state is the set of NFA
+ *   states that are active at a given point in the string; we build the
+ *   DFA lazily, one transition at a time, as we encounter each new
+ *   combination of state and input character, and remember the transitions
+ *   for ASCII characters so that we only have to work them out once.
+ *   
+ *   The DFA tells us whether the pattern matches and how long the match is.
+ *   If the pattern has capturing groups, we fill in the group registers
+ *   with a second pass over the matched text that carries a register set
+ *   with each NFA state, keeping only the first-priority path into each
+ *   state at each character position.  This picks the same path that the
+ *   backtracking matcher would, since the backtracker favors the first
+ *   branch of each alternation among matches of equal length.
+ *   
+ *   A pattern that mixes shortest-match closures ("*?") into longest-match
+ *   mode chooses its match length branch by branch, which a DFA can't
+ *   represent.  For those, we only use the DFA to reject non-matches
+ *   quickly, and run the backtracking matcher when the DFA finds a match.
+ *   
+ *   A DFA is specific to a compiled pattern and a case sensitivity mode,
+ *   and is stored in the compiled pattern structure.  
+ */
+
+/* DFA state context flags */
+#define RE_DFA_AT_BEGIN    0x01         /* at the start of the entire string */
+#define RE_DFA_PREV_WORD   0x02      /* the preceding character is a word char */
+#define RE_DFA_UNANCHORED  0x04   /* a match can start at any position (search) */
+#define RE_DFA_NEXT_WORD   0x08     /* the next character is a word character */
+#define RE_DFA_AT_END      0x10            /* at the end of the string */
+
+/* maximum number of DFA states we'll cache for one pattern */
+#define RE_DFA_MAX_STATES  256
+
+/* number of hash buckets for looking up DFA states */
+#define RE_DFA_HASH_SIZE   128
+
+/* special DFA state indices */
+#define RE_DFA_UNKNOWN     (-1)                  /* transition not yet known */
+#define RE_DFA_DEAD        (-2)      /* no NFA states remain - match failed */
+
+/* DFA state */
+struct re_dfa_state
+{
+    /* context flags (RE_DFA_xxx) */
+    unsigned int flags;
+
+    /* hash value, and the next state in the same hash bucket */
+    unsigned int hash;
+    int nxt;
+
+    /*
+     *   Does the pattern match at this state?  This depends on what comes
+     *   next, so we keep one answer for a word character, one for a non-word
+     *   character, and one for the end of the string: 1 for yes, 0 for no,
+     *   -1 if we haven't figured it out yet.  
+     */
+    signed char accept[3];
+
+    /* transitions on ASCII characters (state indices or RE_DFA_xxx) */
+    int next[128];
+
+    /*
+     *   the NFA states in the set, in ascending order (the structure is
+     *   overallocated to make room for nfa_cnt entries) 
+     */
+    int nfa_cnt;
+    re_state_id nfa[1];
+};
+
+/* a thread in a register-tracking pass over a match */
+struct re_dfa_thread
+{
+    /* the NFA state */
+    re_state_id state;
+
+    /* the group registers along this thread's path */
+    re_group_register regs[RE_GROUP_REG_CNT];
+};
+
+class CRegexDFA
+{
+public:
+    /*
+     *   Get the DFA for a compiled pattern in the given case sensitivity
+     *   mode, creating it if we haven't already.  Returns null if the
+     *   pattern uses features that need the backtracking matcher.  
+     */
+    static CRegexDFA *get(const re_compiled_pattern *pat, int case_sensitive);
+
+    /* delete */
+    ~CRegexDFA();
+
+    /*
+     *   Does the DFA determine the match exactly?  If not, we can only use
+     *   it to rule out non-matches; when it finds a match, the caller must
+     *   run the backtracking matcher to get the actual match.  
+     */
+    int is_exact() const { return exact_; }
+
+    /* does the pattern set any group registers? */
+    int has_groups() const { return has_groups_; }
+
+    /*
+     *   Match the pattern to the leading substring of 'str'.  Returns the
+     *   byte length of the match, or -1 if there's no match.  If the DFA
+     *   isn't exact, a non-negative return only tells us that there's a
+     *   match of some kind.  
+     */
+    int match(const char *entire_str, const char *str, size_t len);
+
+    /* determine if the pattern matches anywhere in 'str' */
+    int search(const char *entire_str, const char *str, size_t len);
+
+    /*
+     *   Fill in the group registers for a match of the given length starting
+     *   at 'str'.  'regs' has the initial register values on entry.  
+     */
+    void get_groups(const char *entire_str, const char *str, size_t len,
+                    int match_len, re_group_register *regs);
+
+protected:
+    CRegexDFA(const re_compiled_pattern *pat, int case_sensitive);
+
+    /* determine if the pattern can run as a DFA */
+    static int can_use_dfa(const re_compiled_pattern *pat);
+
+    /* run the DFA from the given state */
+    int run(int cur, const char *entire_str, const char *str, size_t len,
+            int stop_at_first);
+
+    /* get the initial state for a match starting at 'str' */
+    int get_start_state(const char *entire_str, const char *str,
+                        unsigned int flags);
+
+    /* get the state we reach from state 'cur' on character 'ch' */
+    int get_transition(int cur, wchar_t ch);
+
+    /* determine if state 'cur' accepts with the given next character */
+    int accepts(int cur, size_t rem, wchar_t ch);
+
+    /*
+     *   compute the epsilon closure of a set of NFA states in the given
+     *   context, filling in closure_ with the character-matching states;
+     *   returns true if the final state is in the closure 
+     */
+    int compute_closure(const re_state_id *nfa, int nfa_cnt,
+                        unsigned int ctx);
+
+    /*
+     *   advance a list of threads over the zero-width transitions at a
+     *   position, for the register-tracking pass 
+     */
+    int advance_threads(re_dfa_thread *src, int src_cnt,
+                        re_dfa_thread *dst, int *dst_cnt,
+                        unsigned int ctx, int ofs, re_group_register *regs);
+
+    /* does a character-matching state match the given character? */
+    int char_matches(const re_tuple *t, wchar_t ch) const;
+
+    /* get the context flags for a position in a string */
+    unsigned int get_ctx(const char *entire_str, const char *p,
+                         size_t rem) const;
+
+    /* find or add the state for a set of NFA states */
+    int intern(const re_state_id *nfa, int nfa_cnt, unsigned int flags);
+
+    /* discard all of our states */
+    void flush();
+
+    /* the pattern */
+    const re_compiled_pattern *pat_;
+
+    /* case sensitivity */
+    int case_sensitive_;
+
+    /* are our results exact?  do we have any group registers? */
+    int exact_;
+    int has_groups_;
+
+    /*
+     *   the context flags that affect the pattern (for patterns that don't
+     *   test word boundaries, for example, we can ignore the word flags,
+     *   which lets us share states that differ only in those flags) 
+     */
+    unsigned int ctx_mask_;
+
+    /* our states, and the number of states in use */
+    re_dfa_state **states_;
+    int state_cnt_;
+
+    /* hash buckets for looking up states (state indices) */
+    int buckets_[RE_DFA_HASH_SIZE];
+
+    /* start states for the various context flag combinations */
+    int start_[RE_DFA_UNANCHORED << 1];
+
+    /* number of times we've flushed the state cache */
+    unsigned long flush_cnt_;
+
+    /*
+     *   Scratch space for computing closures: the character-matching states
+     *   in the closure, the stack of states to visit, and a visit marker for
+     *   each NFA state.  
+     */
+    re_state_id *closure_;
+    int closure_cnt_;
+    re_state_id *stack_;
+    unsigned long *marks_;
+    unsigned long mark_gen_;
+
+    /* scratch space for the register-tracking pass, allocated on demand */
+    re_dfa_thread *threads_;
+};
+
+
 /* ------------------------------------------------------------------------ */
 /*
  *   Regular Expression Searcher/Matcher.  This object encapsulates the
@@ -1024,6 +1312,8 @@ protected:
  */
 class CRegexSearcher
 {
+    friend class CRegexDFA;
+
 public:
     CRegexSearcher();
     ~CRegexSearcher();
@@ -1078,7 +1368,8 @@ protected:
               const re_compiled_pattern_base *pattern,
               const re_tuple *tuple_arr,
               const struct re_machine *machine,
-              re_group_register *regs, short *loop_vars);
+              re_group_register *regs, short *loop_vars,
+              class CRegexDFA *dfa);
 
     /* search for a regular expression within a string */
     int search(const char *entire_str,
@@ -1086,7 +1377,11 @@ protected:
                const re_compiled_pattern_base *pattern,
                const re_tuple *tuple_arr,
                const struct re_machine *machine,
-               re_group_register *regs, int *result_len);
+               re_group_register *regs, int *result_len,
+               class CRegexDFA *dfa);
+
+    /* get the DFA to use for a pattern, if it can use one */
+    class CRegexDFA *get_dfa(const re_compiled_pattern *pattern) const;
 
     /* clear a set of group registers */
     void clear_group_regs(re_group_register *regs)
@@ -85,6 +85,9 @@ void CVmRun::init()
     /* we have no program counter yet */
     pc_ptr_ = 0;
 
+    /* no instructions executed yet */
+    VMRUN_IF_COUNT_OPS(op_count_ = 0);
+
     /*
      *   If we're including the profiler in the build, allocate and
      *   initialize its memory structures. 
@@ -484,12 +487,37 @@ public:
     /* defining object */
     vm_obj_id_t defining_obj;
 
+    /* 
+     *   call site for the property lookup cache, and the opcode there; the
+     *   site is null if the caller doesn't use the cache 
+     */
+    const uchar *site;
+    uchar site_op;
+
     const uchar *get_prop(VMG_ uint caller_ofs,
                           vm_prop_id_t target_prop, uint argc)
     {
         this->caller_ofs = caller_ofs;
         this->argc = argc;
         this->target_prop = target_prop;
+        this->site = 0;
+        return get_prop(vmg0_);
+    }
+
+    /*
+     *   Evaluate a property using the property lookup cache.  'site' is the
+     *   code pointer that identifies the call site, and 'site_op' is the
+     *   opcode of the instruction there.  
+     */
+    const uchar *get_prop(VMG_ uint caller_ofs,
+                          vm_prop_id_t target_prop, uint argc,
+                          const uchar *site, uchar site_op)
+    {
+        this->caller_ofs = caller_ofs;
+        this->argc = argc;
+        this->target_prop = target_prop;
+        this->site = site;
+        this->site_op = site_op;
         return get_prop(vmg0_);
     }
 
@@ -551,6 +579,7 @@ public:
     {
         int found;
         const char *target_ptr;
+        CVmObject *objp;
         
         /* 
          *   we can evaluate properties of regular objects, as well as string
@@ -559,10 +588,20 @@ public:
         switch(self.typ)
         {
         case VM_OBJ:
+            /* 
+             *   if it's a plain TadsObject and the caller has a call site
+             *   for us, go through the property lookup cache 
+             */
+            objp = vm_objp(vmg_ self.val.obj);
+            if (site != 0
+                && objp->get_metaclass_reg() == CVmObjTads::metaclass_reg_)
+                return ((CVmObjTads *)objp)->get_prop_cached(
+                    vmg_ target_prop, &val, self.val.obj,
+                    &defining_obj, &argc, site, site_op);
+
             /* get the property value from the target object */
-            found = vm_objp(vmg_ self.val.obj)
-                    ->get_prop(vmg_ target_prop, &val, self.val.obj,
-                               &defining_obj, &argc);
+            found = objp->get_prop(vmg_ target_prop, &val, self.val.obj,
+                                   &defining_obj, &argc);
 
             /* go evaluate the result */
             return found;
@@ -747,6 +786,36 @@ public:
 };
 
 /* ------------------------------------------------------------------------ */
+/*
+ *   Case labels for the main interpreter switch.  For threaded dispatch,
+ *   each opcode case also gets an ordinary label, so that run() can build a
+ *   table of handler addresses indexed by opcode.  
+ */
+#if VMRUN_THREADED_DISPATCH
+#define VMRUN_CASE(op)      case op: op_##op
+#define VMRUN_DISPATCH(op)  dispatch[op] = &&op_##op
+#else
+#define VMRUN_CASE(op)      case op
+#endif
+
+/*
+ *   Finish the current instruction and go on to the next one.  With
+ *   threaded dispatch, each handler jumps straight to the next handler, so
+ *   that every handler ends in its own indirect jump.  The debugger version
+ *   has to go back to the top of the loop instead, to check for breakpoints
+ *   and single-stepping between instructions.  
+ */
+#if VMRUN_THREADED_DISPATCH && !defined(VM_DEBUGGER)
+#define VMRUN_NEXT \
+    do { \
+        last_pc = p; \
+        VMRUN_IF_COUNT_OPS(++op_count_); \
+        goto *dispatch[*p++]; \
+    } while (0)
+#else
+#define VMRUN_NEXT  continue
+#endif
+
 /*
  *   Execute byte code 
  */
@@ -782,6 +851,191 @@ void CVmRun::run(VMG_ const uchar *start_pc)
     const uchar *last_pc = start_pc;
     const uchar **old_pc_ptr;
 
+#if VMRUN_THREADED_DISPATCH
+    /* 
+     *   Opcode dispatch table.  Label addresses are only available inside
+     *   this function, so we fill in the table on the first call; every
+     *   opcode without a handler goes to the invalid-opcode handler.  
+     */
+    static void *dispatch[256];
+    static int dispatch_inited = FALSE;
+
+    if (!dispatch_inited)
+    {
+        for (idx = 0 ; idx < 256 ; ++idx)
+            dispatch[idx] = &&op_invalid;
+
+        VMRUN_DISPATCH(OPC_PUSH_0);
+        VMRUN_DISPATCH(OPC_PUSH_1);
+        VMRUN_DISPATCH(OPC_PUSHINT8);
+        VMRUN_DISPATCH(OPC_PUSHINT);
+        VMRUN_DISPATCH(OPC_PUSHSTR);
+        VMRUN_DISPATCH(OPC_PUSHLST);
+        VMRUN_DISPATCH(OPC_PUSHOBJ);
+        VMRUN_DISPATCH(OPC_PUSHNIL);
+        VMRUN_DISPATCH(OPC_PUSHTRUE);
+        VMRUN_DISPATCH(OPC_PUSHPROPID);
+        VMRUN_DISPATCH(OPC_PUSHFNPTR);
+        VMRUN_DISPATCH(OPC_PUSHSTRI);
+        VMRUN_DISPATCH(OPC_PUSHPARLST);
+        VMRUN_DISPATCH(OPC_MAKELSTPAR);
+        VMRUN_DISPATCH(OPC_PUSHENUM);
+        VMRUN_DISPATCH(OPC_PUSHBIFPTR);
+        VMRUN_DISPATCH(OPC_NEG);
+        VMRUN_DISPATCH(OPC_BNOT);
+        VMRUN_DISPATCH(OPC_ADD);
+        VMRUN_DISPATCH(OPC_SUB);
+        VMRUN_DISPATCH(OPC_MUL);
+        VMRUN_DISPATCH(OPC_BAND);
+        VMRUN_DISPATCH(OPC_BOR);
+        VMRUN_DISPATCH(OPC_SHL);
+        VMRUN_DISPATCH(OPC_ASHR);
+        VMRUN_DISPATCH(OPC_XOR);
+        VMRUN_DISPATCH(OPC_DIV);
+        VMRUN_DISPATCH(OPC_MOD);
+        VMRUN_DISPATCH(OPC_NOT);
+        VMRUN_DISPATCH(OPC_BOOLIZE);
+        VMRUN_DISPATCH(OPC_INC);
+        VMRUN_DISPATCH(OPC_DEC);
+        VMRUN_DISPATCH(OPC_LSHR);
+        VMRUN_DISPATCH(OPC_EQ);
+        VMRUN_DISPATCH(OPC_NE);
+        VMRUN_DISPATCH(OPC_LT);
+        VMRUN_DISPATCH(OPC_LE);
+        VMRUN_DISPATCH(OPC_GT);
+        VMRUN_DISPATCH(OPC_GE);
+        VMRUN_DISPATCH(OPC_RETVAL);
+        VMRUN_DISPATCH(OPC_RETNIL);
+        VMRUN_DISPATCH(OPC_RETTRUE);
+        VMRUN_DISPATCH(OPC_RET);
+        VMRUN_DISPATCH(OPC_NAMEDARGPTR);
+        VMRUN_DISPATCH(OPC_NAMEDARGTAB);
+        VMRUN_DISPATCH(OPC_CALL);
+        VMRUN_DISPATCH(OPC_PTRCALL);
+        VMRUN_DISPATCH(OPC_GETPROP);
+        VMRUN_DISPATCH(OPC_CALLPROP);
+        VMRUN_DISPATCH(OPC_PTRCALLPROP);
+        VMRUN_DISPATCH(OPC_GETPROPSELF);
+        VMRUN_DISPATCH(OPC_CALLPROPSELF);
+        VMRUN_DISPATCH(OPC_PTRCALLPROPSELF);
+        VMRUN_DISPATCH(OPC_OBJGETPROP);
+        VMRUN_DISPATCH(OPC_OBJCALLPROP);
+        VMRUN_DISPATCH(OPC_GETPROPDATA);
+        VMRUN_DISPATCH(OPC_PTRGETPROPDATA);
+        VMRUN_DISPATCH(OPC_GETPROPLCL1);
+        VMRUN_DISPATCH(OPC_CALLPROPLCL1);
+        VMRUN_DISPATCH(OPC_GETPROPR0);
+        VMRUN_DISPATCH(OPC_CALLPROPR0);
+        VMRUN_DISPATCH(OPC_INHERIT);
+        VMRUN_DISPATCH(OPC_PTRINHERIT);
+        VMRUN_DISPATCH(OPC_EXPINHERIT);
+        VMRUN_DISPATCH(OPC_PTREXPINHERIT);
+        VMRUN_DISPATCH(OPC_VARARGC);
+        VMRUN_DISPATCH(OPC_DELEGATE);
+        VMRUN_DISPATCH(OPC_PTRDELEGATE);
+        VMRUN_DISPATCH(OPC_SWAP2);
+        VMRUN_DISPATCH(OPC_SWAPN);
+        VMRUN_DISPATCH(OPC_GETARGN0);
+        VMRUN_DISPATCH(OPC_GETARGN1);
+        VMRUN_DISPATCH(OPC_GETARGN2);
+        VMRUN_DISPATCH(OPC_GETARGN3);
+        VMRUN_DISPATCH(OPC_GETLCL1);
+        VMRUN_DISPATCH(OPC_GETLCL2);
+        VMRUN_DISPATCH(OPC_GETARG1);
+        VMRUN_DISPATCH(OPC_GETARG2);
+        VMRUN_DISPATCH(OPC_PUSHSELF);
+        VMRUN_DISPATCH(OPC_GETDBLCL);
+        VMRUN_DISPATCH(OPC_GETDBARG);
+        VMRUN_DISPATCH(OPC_GETARGC);
+        VMRUN_DISPATCH(OPC_DUP);
+        VMRUN_DISPATCH(OPC_DISC);
+        VMRUN_DISPATCH(OPC_DISC1);
+        VMRUN_DISPATCH(OPC_GETR0);
+        VMRUN_DISPATCH(OPC_GETDBARGC);
+        VMRUN_DISPATCH(OPC_SWAP);
+        VMRUN_DISPATCH(OPC_PUSHCTXELE);
+        VMRUN_DISPATCH(OPC_DUP2);
+        VMRUN_DISPATCH(OPC_SWITCH);
+        VMRUN_DISPATCH(OPC_JMP);
+        VMRUN_DISPATCH(OPC_JT);
+        VMRUN_DISPATCH(OPC_JF);
+        VMRUN_DISPATCH(OPC_JE);
+        VMRUN_DISPATCH(OPC_JNE);
+        VMRUN_DISPATCH(OPC_JGT);
+        VMRUN_DISPATCH(OPC_JGE);
+        VMRUN_DISPATCH(OPC_JLT);
+        VMRUN_DISPATCH(OPC_JLE);
+        VMRUN_DISPATCH(OPC_JST);
+        VMRUN_DISPATCH(OPC_JSF);
+        VMRUN_DISPATCH(OPC_LJSR);
+        VMRUN_DISPATCH(OPC_LRET);
+        VMRUN_DISPATCH(OPC_JNIL);
+        VMRUN_DISPATCH(OPC_JNOTNIL);
+        VMRUN_DISPATCH(OPC_JR0T);
+        VMRUN_DISPATCH(OPC_JR0F);
+        VMRUN_DISPATCH(OPC_ITERNEXT);
+        VMRUN_DISPATCH(OPC_GETSETLCL1R0);
+        VMRUN_DISPATCH(OPC_GETSETLCL1);
+        VMRUN_DISPATCH(OPC_DUPR0);
+        VMRUN_DISPATCH(OPC_GETSPN);
+        VMRUN_DISPATCH(OPC_GETLCLN0);
+        VMRUN_DISPATCH(OPC_GETLCLN1);
+        VMRUN_DISPATCH(OPC_GETLCLN2);
+        VMRUN_DISPATCH(OPC_GETLCLN3);
+        VMRUN_DISPATCH(OPC_GETLCLN4);
+        VMRUN_DISPATCH(OPC_GETLCLN5);
+        VMRUN_DISPATCH(OPC_SAY);
+        VMRUN_DISPATCH(OPC_BUILTIN_A);
+        VMRUN_DISPATCH(OPC_BUILTIN_B);
+        VMRUN_DISPATCH(OPC_BUILTIN_C);
+        VMRUN_DISPATCH(OPC_BUILTIN_D);
+        VMRUN_DISPATCH(OPC_BUILTIN1);
+        VMRUN_DISPATCH(OPC_BUILTIN2);
+        VMRUN_DISPATCH(OPC_CALLEXT);
+        VMRUN_DISPATCH(OPC_THROW);
+        VMRUN_DISPATCH(OPC_SAYVAL);
+        VMRUN_DISPATCH(OPC_INDEX);
+        VMRUN_DISPATCH(OPC_IDXLCL1INT8);
+        VMRUN_DISPATCH(OPC_IDXINT8);
+        VMRUN_DISPATCH(OPC_NEW1);
+        VMRUN_DISPATCH(OPC_NEW2);
+        VMRUN_DISPATCH(OPC_TRNEW1);
+        VMRUN_DISPATCH(OPC_TRNEW2);
+        VMRUN_DISPATCH(OPC_INCLCL);
+        VMRUN_DISPATCH(OPC_DECLCL);
+        VMRUN_DISPATCH(OPC_ADDILCL1);
+        VMRUN_DISPATCH(OPC_ADDILCL4);
+        VMRUN_DISPATCH(OPC_ADDTOLCL);
+        VMRUN_DISPATCH(OPC_SUBFROMLCL);
+        VMRUN_DISPATCH(OPC_ZEROLCL1);
+        VMRUN_DISPATCH(OPC_ZEROLCL2);
+        VMRUN_DISPATCH(OPC_NILLCL1);
+        VMRUN_DISPATCH(OPC_NILLCL2);
+        VMRUN_DISPATCH(OPC_ONELCL1);
+        VMRUN_DISPATCH(OPC_ONELCL2);
+        VMRUN_DISPATCH(OPC_SETLCL1);
+        VMRUN_DISPATCH(OPC_SETLCL2);
+        VMRUN_DISPATCH(OPC_SETARG1);
+        VMRUN_DISPATCH(OPC_SETARG2);
+        VMRUN_DISPATCH(OPC_SETIND);
+        VMRUN_DISPATCH(OPC_SETPROP);
+        VMRUN_DISPATCH(OPC_PTRSETPROP);
+        VMRUN_DISPATCH(OPC_SETPROPSELF);
+        VMRUN_DISPATCH(OPC_OBJSETPROP);
+        VMRUN_DISPATCH(OPC_SETDBLCL);
+        VMRUN_DISPATCH(OPC_SETDBARG);
+        VMRUN_DISPATCH(OPC_SETSELF);
+        VMRUN_DISPATCH(OPC_LOADCTX);
+        VMRUN_DISPATCH(OPC_STORECTX);
+        VMRUN_DISPATCH(OPC_SETLCL1R0);
+        VMRUN_DISPATCH(OPC_SETINDLCL1I8);
+        VMRUN_DISPATCH(OPC_BP);
+        VMRUN_DISPATCH(OPC_NOP);
+
+        dispatch_inited = TRUE;
+    }
+#endif
+
     /* save the enclosing program counter pointer, and remember the new one */
     old_pc_ptr = pc_ptr_;
     pc_ptr_ = &last_pc;
@@ -866,6 +1120,18 @@ resume_execution:
              */
             last_pc = p;
 
+            /* count the instruction, if we're collecting statistics */
+            VMRUN_IF_COUNT_OPS(++op_count_);
+
+#if VMRUN_THREADED_DISPATCH
+            /*
+             *   Jump straight to the handler for the current instruction.
+             *   The handlers are the cases of the switch below, so the
+             *   switch itself is never entered in this configuration.  
+             */
+            goto *dispatch[*p++];
+#endif
+
             /* 
              *   Execute the current instruction.
              *   
@@ -882,133 +1148,135 @@ resume_execution:
              */
             switch(*p++)
             {
-            case OPC_GETARGN0:
+            VMRUN_CASE(OPC_GETARGN0):
                 pushval(vmg_ get_param(vmg_ 0));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_GETPROPSELF:
+            VMRUN_CASE(OPC_GETPROPSELF):
                 /* evaluate the property of 'self' */
                 propev.self.set_obj(get_self(vmg0_));
                 prop = get_op_uint16(&p);
                 last_pc = p;
-                p = propev.get_prop(vmg_ p - entry_ptr_native_, prop, 0);
-                continue;
+                p = propev.get_prop(vmg_ p - entry_ptr_native_, prop, 0,
+                                    p, OPC_GETPROPSELF);
+                VMRUN_NEXT;
 
-            case OPC_GETR0:
+            VMRUN_CASE(OPC_GETR0):
                 /* push the contents of R0 */
                 pushval(vmg_ &r0_);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_DUPR0:
+            VMRUN_CASE(OPC_DUPR0):
                 /* push the contents of R0 twice */
                 pushval(vmg_ &r0_);
                 pushval(vmg_ &r0_);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_GETSETLCL1R0:
+            VMRUN_CASE(OPC_GETSETLCL1R0):
                 /* set local from R0 and leave value on stack */
                 pushval(vmg_ &r0_);
                 *get_local(vmg_ get_op_uint8(&p)) = r0_;
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_GETSETLCL1:
+            VMRUN_CASE(OPC_GETSETLCL1):
                 /* set local and leave value on stack */
                 *get_local(vmg_ get_op_uint8(&p)) = *get(0);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_SETPROPSELF:
+            VMRUN_CASE(OPC_SETPROPSELF):
                 /* get the value to set */
                 popval(vmg_ &val);
 
                 /* set it */
                 set_prop(vmg_ get_self(vmg0_), get_op_uint16(&p), &val);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_SETLCL1R0:
+            VMRUN_CASE(OPC_SETLCL1R0):
                 /* store R0 in the specific local */
                 *get_local(vmg_ get_op_uint8(&p)) = r0_;
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_GETARGN1:
+            VMRUN_CASE(OPC_GETARGN1):
                 pushval(vmg_ get_param(vmg_ 1));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_GETLCLN0:
+            VMRUN_CASE(OPC_GETLCLN0):
                 pushval(vmg_ get_local(vmg_ 0));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_SETLCL1:
+            VMRUN_CASE(OPC_SETLCL1):
                 /* get a pointer to the local */
                 valp = get_local(vmg_ get_op_uint8(&p));
 
                 /* pop the value into the local */
                 popval(vmg_ valp);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_PUSHSELF:
+            VMRUN_CASE(OPC_PUSHSELF):
                 /* push 'self' */
                 pushval(vmg_ get_self_val(vmg0_));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_RETNIL:
+            VMRUN_CASE(OPC_RETNIL):
                 /* store nil in R0 */
                 r0_.set_nil();
 
                 /* return */
                 if ((p = do_return(vmg0_)) == 0)
                     goto exit_loop;
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_RETVAL:
+            VMRUN_CASE(OPC_RETVAL):
                 /* pop the return value into R0 */
                 popval(vmg_ &r0_);
 
                 /* return */
                 if ((p = do_return(vmg0_)) == 0)
                     goto exit_loop;
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_GETPROPLCL1:
+            VMRUN_CASE(OPC_GETPROPLCL1):
                 /* get the local whose property we're evaluating */
                 propev.self = *get_local(vmg_ get_op_uint8(&p));
 
                 /* evaluate the property of the local variable */
                 prop = get_op_uint16(&p);
                 last_pc = p;
-                p = propev.get_prop(vmg_ p - entry_ptr_native_, prop, 0);
-                continue;
+                p = propev.get_prop(vmg_ p - entry_ptr_native_, prop, 0,
+                                    p, OPC_GETPROPLCL1);
+                VMRUN_NEXT;
 
-            case OPC_JNIL:
+            VMRUN_CASE(OPC_JNIL):
                 /* jump if top of stack is nil */
                 valp = get(0);
                 p += (valp->typ == VM_NIL ? osrp2s(p) : 2);
 
                 /* discard the top value, regardless of what happened */
                 discard();
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_RET:
+            VMRUN_CASE(OPC_RET):
                 /* return, leaving R0 unchanged */
                 if ((p = do_return(vmg0_)) == 0)
                     goto exit_loop;
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_PUSHENUM:
+            VMRUN_CASE(OPC_PUSHENUM):
                 /* push a UINT4 operand value */
                 push_enum(vmg_ get_op_uint32(&p));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_JMP:
+            VMRUN_CASE(OPC_JMP):
                 /* unconditionally jump to the given offset */
                 p += osrp2s(p);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_JNE:
+            VMRUN_CASE(OPC_JNE):
                 /* jump if the two values at top of stack are not equal */
                 p += (!pop2_equal(vmg0_) ? osrp2s(p) : 2);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_JR0F:
+            VMRUN_CASE(OPC_JR0F):
                 /* 
                  *   if R0 is true, or it's a non-zero numeric value, or any
                  *   non-numeric and non-boolean value, stay put; otherwise,
@@ -1025,18 +1293,18 @@ resume_execution:
                     /* it's non-zero and non-nil - do not jump */
                     p += 2;
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_GETARGN2:
+            VMRUN_CASE(OPC_GETARGN2):
                 pushval(vmg_ get_param(vmg_ 2));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_JGT:
+            VMRUN_CASE(OPC_JGT):
                 /* jump if greater */
                 p += (pop2_compare_gt(vmg0_) ? osrp2s(p) : 2);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_CALLPROPSELF:
+            VMRUN_CASE(OPC_CALLPROPSELF):
                 /* get the argument count */
                 argc = get_op_uint8(&p);
 
@@ -1045,10 +1313,11 @@ resume_execution:
                 propev.self.set_obj(get_self(vmg0_));
                 prop = get_op_uint16(&p);
                 last_pc = p;
-                p = propev.get_prop(vmg_ p - entry_ptr_native_, prop, argc);
-                continue;
+                p = propev.get_prop(vmg_ p - entry_ptr_native_, prop, argc,
+                                    p, OPC_CALLPROPSELF);
+                VMRUN_NEXT;
 
-            case OPC_INDEX:
+            VMRUN_CASE(OPC_INDEX):
                 /* 
                  *   make a safe copy of the object to index, as we're going
                  *   to store the result directly over that stack slot 
@@ -1070,14 +1339,14 @@ resume_execution:
                                     &val, G_predef->operator_idx, 1,
                                     VMERR_CANNOT_INDEX_TYPE);
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_DUP:
+            VMRUN_CASE(OPC_DUP):
                 /* re-push the item at top of stack */
                 pushval(vmg_ get(0));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_IDXLCL1INT8:
+            VMRUN_CASE(OPC_IDXLCL1INT8):
                 /* get the local */
                 valp = get_local(vmg_ get_op_uint8(&p));
 
@@ -1100,13 +1369,13 @@ resume_execution:
                                     valp, G_predef->operator_idx, 1,
                                     VMERR_CANNOT_INDEX_TYPE);
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_GETLCLN2:
+            VMRUN_CASE(OPC_GETLCLN2):
                 pushval(vmg_ get_local(vmg_ 2));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_CALLPROP:
+            VMRUN_CASE(OPC_CALLPROP):
                 /* get the argument count */
                 argc = get_op_uint8(&p);
 
@@ -1117,31 +1386,32 @@ resume_execution:
                 /* evaluate the property given by the immediate data */
                 prop = get_op_uint16(&p);
                 last_pc = p;
-                p = propev.get_prop(vmg_ p - entry_ptr_native_, prop, argc);
-                continue;
+                p = propev.get_prop(vmg_ p - entry_ptr_native_, prop, argc,
+                                    p, OPC_CALLPROP);
+                VMRUN_NEXT;
 
-            case OPC_GETLCLN1:
+            VMRUN_CASE(OPC_GETLCLN1):
                 pushval(vmg_ get_local(vmg_ 1));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_GETARGN3:
+            VMRUN_CASE(OPC_GETARGN3):
                 pushval(vmg_ get_param(vmg_ 3));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_GETLCLN3:
+            VMRUN_CASE(OPC_GETLCLN3):
                 pushval(vmg_ get_local(vmg_ 3));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_JNOTNIL:
+            VMRUN_CASE(OPC_JNOTNIL):
                 /* jump if top of stack is not nil */
                 valp = get(0);
                 p += (valp->typ != VM_NIL ? osrp2s(p) : 2);
 
                 /* discard the top value, regardless of what happened */
                 discard();
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_ITERNEXT:
+            VMRUN_CASE(OPC_ITERNEXT):
                 /* get the iterator object from the local */
                 valp = get_local(vmg_ get_op_uint16(&p));
 
@@ -1161,29 +1431,30 @@ resume_execution:
                 }
                 break;
 
-            case OPC_PUSH_0:
+            VMRUN_CASE(OPC_PUSH_0):
                 /* push the constant value 0 */
                 push_int(vmg_ 0);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_GETPROP:
+            VMRUN_CASE(OPC_GETPROP):
                 /* get the object whose property we're fetching */
                 pop(&propev.self);
 
                 /* evaluate the property */
                 prop = get_op_uint16(&p);
                 last_pc = p;
-                p = propev.get_prop(vmg_ p - entry_ptr_native_, prop, 0);
-                continue;
+                p = propev.get_prop(vmg_ p - entry_ptr_native_, prop, 0,
+                                    p, OPC_GETPROP);
+                VMRUN_NEXT;
 
-            case OPC_GETLCLN4:
+            VMRUN_CASE(OPC_GETLCLN4):
                 pushval(vmg_ get_local(vmg_ 4));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_JE:
+            VMRUN_CASE(OPC_JE):
                 /* jump if the two values at top of stack are equal */
                 p += (pop2_equal(vmg0_) ? osrp2s(p) : 2);
-                continue;
+                VMRUN_NEXT;
 
                 /* 
                  *   End of case table sorting by instruction execution
@@ -1193,32 +1464,32 @@ resume_execution:
                  *   only so large.  
                  */
 
-            case OPC_PUSHNIL:
+            VMRUN_CASE(OPC_PUSHNIL):
                 /* push nil */
                 push_nil(vmg0_);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_PUSHTRUE:
+            VMRUN_CASE(OPC_PUSHTRUE):
                 /* push true */
                 push()->set_true();
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_PUSH_1:
+            VMRUN_CASE(OPC_PUSH_1):
                 /* push the constant value 1 */
                 push_int(vmg_ 1);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_PUSHINT8:
+            VMRUN_CASE(OPC_PUSHINT8):
                 /* push an SBYTE operand value */
                 push_int(vmg_ get_op_int8(&p));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_PUSHINT:
+            VMRUN_CASE(OPC_PUSHINT):
                 /* push a UINT4 operand value */
                 push_int(vmg_ get_op_int32(&p));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_INC:
+            VMRUN_CASE(OPC_INC):
                 /* 
                  *   Increment the value at top of stack.  We must perform
                  *   the same type conversions as the ADD instruction does.
@@ -1246,9 +1517,9 @@ resume_execution:
                                         VMERR_BAD_TYPE_ADD);
                     }
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_ADD:
+            VMRUN_CASE(OPC_ADD):
                 /* if they're both integers, add them the quick way */
                 valp = get(0);
                 valp2 = get(1);
@@ -1274,9 +1545,9 @@ resume_execution:
                                     &val, G_predef->operator_add, 1,
                                     VMERR_BAD_TYPE_ADD);
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_DEC:
+            VMRUN_CASE(OPC_DEC):
                 /* 
                  *   Decrement the value at top of stack.  We must perform
                  *   the same type conversions as the SUB instruction does.
@@ -1304,9 +1575,9 @@ resume_execution:
                                         VMERR_BAD_TYPE_SUB);
                     }
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_SUB:
+            VMRUN_CASE(OPC_SUB):
                 /* if they're both integers, subtract them the quick way */
                 valp = get(0);
                 valp2 = get(1);
@@ -1332,14 +1603,14 @@ resume_execution:
                                     &val, G_predef->operator_sub, 1,
                                     VMERR_BAD_TYPE_SUB);
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_PUSHSTR:
+            VMRUN_CASE(OPC_PUSHSTR):
                 /* push UINT4 offset operand as a string */
                 push()->set_sstring(get_op_uint32(&p));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_PUSHSTRI:
+            VMRUN_CASE(OPC_PUSHSTRI):
                 /* inline string - get the length prefix */
                 cnt = get_op_uint16(&p);
 
@@ -1351,28 +1622,28 @@ resume_execution:
 
                 /* push the new string */
                 push_obj(vmg_ obj);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_PUSHLST:
+            VMRUN_CASE(OPC_PUSHLST):
                 /* push UINT4 offset operand as a list */
                 push()->set_list(get_op_uint32(&p));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_PUSHOBJ:
+            VMRUN_CASE(OPC_PUSHOBJ):
                 /* push UINT4 object ID operand */
                 push()->set_obj(get_op_uint32(&p));
-                continue;
-            case OPC_PUSHPROPID:
+                VMRUN_NEXT;
+            VMRUN_CASE(OPC_PUSHPROPID):
                 /* push UINT2 property ID operand */
                 push()->set_propid(get_op_uint16(&p));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_PUSHFNPTR:
+            VMRUN_CASE(OPC_PUSHFNPTR):
                 /* push a function pointer operand */
                 push()->set_fnptr(get_op_uint32(&p));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_PUSHPARLST:
+            VMRUN_CASE(OPC_PUSHPARLST):
                 /* get the number of fixed parameters */
                 cnt = *p++;
 
@@ -1382,9 +1653,9 @@ resume_execution:
 
                 /* push the new list */
                 push_obj(vmg_ obj);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_MAKELSTPAR:
+            VMRUN_CASE(OPC_MAKELSTPAR):
                 {
                     int lstcnt;
                     uint i;
@@ -1409,7 +1680,7 @@ resume_execution:
                         pushval(vmg_ &val2);
 
                         /* our work here is done */
-                        continue;
+                        VMRUN_NEXT;
                     }
 
                     /* set up a pointer to the current function header */
@@ -1441,9 +1712,9 @@ resume_execution:
                     val2.val.intval += lstcnt;
                     pushval(vmg_ &val2);
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_NEG:
+            VMRUN_CASE(OPC_NEG):
                 /* check the type */
                 if ((valp = get(0))->is_numeric())
                 {
@@ -1466,9 +1737,9 @@ resume_execution:
                                     &val, G_predef->operator_neg, 0,
                                     VMERR_BAD_TYPE_NEG);
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_BNOT:
+            VMRUN_CASE(OPC_BNOT):
                 /* check the type */
                 if ((valp = get(0))->typ == VM_INT)
                 {
@@ -1484,9 +1755,9 @@ resume_execution:
                                     &val, G_predef->operator_bit_not, 0,
                                     VMERR_BAD_TYPE_BIT_NOT);
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_MUL:
+            VMRUN_CASE(OPC_MUL):
                 /* if they're both integers, this is easy */
                 valp = get(0);
                 valp2 = get(1);
@@ -1512,9 +1783,9 @@ resume_execution:
                                     &val, G_predef->operator_mul, 1,
                                     VMERR_BAD_TYPE_MUL);
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_DIV:
+            VMRUN_CASE(OPC_DIV):
                 /* if they're both integers, divide them the quick way */
                 valp = get(0);
                 valp2 = get(1);
@@ -1545,9 +1816,9 @@ resume_execution:
                                     &val, G_predef->operator_div, 1,
                                     VMERR_BAD_TYPE_DIV);
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_MOD:
+            VMRUN_CASE(OPC_MOD):
                 /* remainder number at (TOS-1) by number at top of stack */
                 valp = get(0);
                 valp2 = get(1);
@@ -1574,9 +1845,9 @@ resume_execution:
                                     &val, G_predef->operator_mod, 1,
                                     VMERR_BAD_TYPE_MOD);
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_BAND:
+            VMRUN_CASE(OPC_BAND):
                 /* bitwise AND two integers on top of stack */
                 valp = get(0);
                 valp2 = get(1);
@@ -1599,9 +1870,9 @@ resume_execution:
                                     &val, G_predef->operator_bit_and, 1,
                                     VMERR_BAD_TYPE_BIT_AND);
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_BOR:
+            VMRUN_CASE(OPC_BOR):
                 /* bitwise OR two integers on top of stack */
                 valp = get(0);
                 valp2 = get(1);
@@ -1624,9 +1895,9 @@ resume_execution:
                                     &val, G_predef->operator_bit_or, 1,
                                     VMERR_BAD_TYPE_BIT_OR);
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_SHL:
+            VMRUN_CASE(OPC_SHL):
                 /* 
                  *   bit-shift left integer at (TOS-1) by integer at top
                  *   of stack 
@@ -1652,9 +1923,9 @@ resume_execution:
                                     &val, G_predef->operator_shl, 1,
                                     VMERR_BAD_TYPE_SHL);
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_ASHR:
+            VMRUN_CASE(OPC_ASHR):
                 /* 
                  *   arithmetic shift right integer at (TOS-1) by integer at
                  *   top of stack 
@@ -1681,9 +1952,9 @@ resume_execution:
                                     &val, G_predef->operator_ashr, 1,
                                     VMERR_BAD_TYPE_ASHR);
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_LSHR:
+            VMRUN_CASE(OPC_LSHR):
                 /* 
                  *   logical shift right integer at (TOS-1) by integer at
                  *   top of stack 
@@ -1710,9 +1981,9 @@ resume_execution:
                                     &val, G_predef->operator_lshr, 1,
                                     VMERR_BAD_TYPE_LSHR);
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_XOR:
+            VMRUN_CASE(OPC_XOR):
                 /* XOR two values at top of stack */
                 popval_2(vmg_ &val, &val2);
                 if (!xor_and_push(vmg_ &val, &val2))
@@ -1724,9 +1995,9 @@ resume_execution:
                                     &val, G_predef->operator_xor, 1,
                                     VMERR_BAD_TYPE_XOR);
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_NOT:
+            VMRUN_CASE(OPC_NOT):
                 /* 
                  *   invert the logic value; if the value is a number,
                  *   treat 0 as nil and non-zero as true 
@@ -1737,12 +2008,12 @@ resume_execution:
                 case VM_NIL:
                     /* !nil -> true */
                     valp->set_true();
-                    continue;
+                    VMRUN_NEXT;
 
                 case VM_OBJ:
                     /* !obj -> true if obj is nil, nil otherwise */
                     valp->set_logical(valp->val.obj == VM_INVALID_OBJ);
-                    continue;
+                    VMRUN_NEXT;
 
                 case VM_TRUE:
                 case VM_PROP:
@@ -1753,19 +2024,19 @@ resume_execution:
                 case VM_ENUM:
                     /* these are all considered true, so !them -> nil */
                     valp->set_nil();
-                    continue;
+                    VMRUN_NEXT;
 
                 case VM_INT:
                     /* !int -> true if int is 0, nil otherwise */
                     valp->set_logical(valp->val.intval == 0);
-                    continue;
+                    VMRUN_NEXT;
 
                 default:
                     err_throw(VMERR_NO_LOG_CONV);
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_BOOLIZE:
+            VMRUN_CASE(OPC_BOOLIZE):
                 /* set to a boolean value */
                 valp = get(0);
                 switch(valp->typ)
@@ -1773,54 +2044,54 @@ resume_execution:
                 case VM_NIL:
                 case VM_TRUE:
                     /* it's already a logical value - leave it alone */
-                    continue;
+                    VMRUN_NEXT;
 
                 case VM_INT:
                     /* integer: 0 -> nil, non-zero -> true */
                     valp->set_logical(valp->val.intval);
-                    continue;
+                    VMRUN_NEXT;
 
                 case VM_ENUM:
                     /* an enum is always non-nil */
                     valp->set_true();
-                    continue;
+                    VMRUN_NEXT;
 
                 default:
                     err_throw(VMERR_NO_LOG_CONV);
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_EQ:
+            VMRUN_CASE(OPC_EQ):
                 /* compare two values at top of stack for equality */
                 push_bool(vmg_ pop2_equal(vmg0_));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_NE:
+            VMRUN_CASE(OPC_NE):
                 /* compare two values at top of stack for inequality */
                 push_bool(vmg_ !pop2_equal(vmg0_));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_LT:
+            VMRUN_CASE(OPC_LT):
                 /* compare values at top of stack - true if (TOS-1) < TOS */
                 push_bool(vmg_ pop2_compare_lt(vmg0_));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_LE:
+            VMRUN_CASE(OPC_LE):
                 /* compare values at top of stack - true if (TOS-1) <= TOS */
                 push_bool(vmg_ pop2_compare_le(vmg0_));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_GT:
+            VMRUN_CASE(OPC_GT):
                 /* compare values at top of stack - true if (TOS-1) > TOS */
                 push_bool(vmg_ pop2_compare_gt(vmg0_));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_GE:
+            VMRUN_CASE(OPC_GE):
                 /* compare values at top of stack - true if (TOS-1) >= TOS */
                 push_bool(vmg_ pop2_compare_ge(vmg0_));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_VARARGC:
+            VMRUN_CASE(OPC_VARARGC):
                 {
                     uchar opc;
 
@@ -1921,12 +2192,12 @@ resume_execution:
 
                     default:
                         err_throw(VMERR_INVALID_OPCODE_MOD);
-                        continue;
+                        VMRUN_NEXT;
                     }
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_NAMEDARGPTR:
+            VMRUN_CASE(OPC_NAMEDARGPTR):
                 /* 
                  *   Pointer to named argument table.  Discard the named
                  *   arguments (the count is given by a one-byte operand),
@@ -1934,9 +2205,9 @@ resume_execution:
                  */
                 discard(get_op_uint8(&p));
                 p += 2;
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_NAMEDARGTAB:
+            VMRUN_CASE(OPC_NAMEDARGTAB):
                 /* 
                  *   Named argument table.  As with NAMEDARGPTR, we must
                  *   discard the named arguments.  Then we simply skip the
@@ -1945,9 +2216,9 @@ resume_execution:
                 ofs = get_op_uint16(&p);
                 discard(get_op_uint16(&p));
                 p += ofs - 2;
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_CALL:
+            VMRUN_CASE(OPC_CALL):
                 /* get the argument count */
                 argc = get_op_uint8(&p);
 
@@ -1958,9 +2229,9 @@ resume_execution:
                 /* call it */
                 last_pc = p;
                 p = do_call_func_nr(vmg_ p - entry_ptr_native_, ofs, argc);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_PTRCALL:
+            VMRUN_CASE(OPC_PTRCALL):
                 /* get the argument count */
                 argc = get_op_uint8(&p);
 
@@ -1979,26 +2250,27 @@ resume_execution:
                 /* call the function */
                 last_pc = p;
                 p = call_func_ptr(vmg_ &val, argc, 0, p - entry_ptr_native_);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_RETTRUE:
+            VMRUN_CASE(OPC_RETTRUE):
                 /* store true in R0 */
                 r0_.set_true();
 
                 /* return */
                 if ((p = do_return(vmg0_)) == 0)
                     goto exit_loop;
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_GETPROPR0:
+            VMRUN_CASE(OPC_GETPROPR0):
                 /* evaluate the property of R0 */
                 propev.self = r0_;
                 prop = get_op_uint16(&p);
                 last_pc = p;
-                p = propev.get_prop(vmg_ p - entry_ptr_native_, prop, 0);
-                continue;
+                p = propev.get_prop(vmg_ p - entry_ptr_native_, prop, 0,
+                                    p, OPC_GETPROPR0);
+                VMRUN_NEXT;
 
-            case OPC_CALLPROPLCL1:
+            VMRUN_CASE(OPC_CALLPROPLCL1):
                 /* get the argument count */
                 argc = get_op_uint8(&p);
 
@@ -2009,10 +2281,11 @@ resume_execution:
                 /* call the property of the local */
                 prop = get_op_uint16(&p);
                 last_pc = p;
-                p = propev.get_prop(vmg_ p - entry_ptr_native_, prop, argc);
-                continue;
+                p = propev.get_prop(vmg_ p - entry_ptr_native_, prop, argc,
+                                    p, OPC_CALLPROPLCL1);
+                VMRUN_NEXT;
 
-            case OPC_CALLPROPR0:
+            VMRUN_CASE(OPC_CALLPROPR0):
                 /* get the argument count */
                 argc = get_op_uint8(&p);
 
@@ -2021,10 +2294,11 @@ resume_execution:
                 propev.self = r0_;
                 prop = get_op_uint16(&p);
                 last_pc = p;
-                p = propev.get_prop(vmg_ p - entry_ptr_native_, prop, argc);
-                continue;
+                p = propev.get_prop(vmg_ p - entry_ptr_native_, prop, argc,
+                                    p, OPC_CALLPROPR0);
+                VMRUN_NEXT;
 
-            case OPC_PTRCALLPROP:
+            VMRUN_CASE(OPC_PTRCALLPROP):
                 /* get the argument count */
                 argc = get_op_uint8(&p);
 
@@ -2040,9 +2314,9 @@ resume_execution:
                 last_pc = p;
                 p = propev.get_prop(vmg_ p - entry_ptr_native_,
                                     val.val.prop, argc);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_PTRCALLPROPSELF:
+            VMRUN_CASE(OPC_PTRCALLPROPSELF):
                 /* get the argument count */
                 argc = get_op_uint8(&p);
 
@@ -2056,19 +2330,20 @@ resume_execution:
                 last_pc = p;
                 p = propev.get_prop(vmg_ p - entry_ptr_native_,
                                     val.val.prop, argc);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_OBJGETPROP:
+            VMRUN_CASE(OPC_OBJGETPROP):
                 /* get the object */
                 propev.self.set_obj((vm_obj_id_t)get_op_uint32(&p));
 
                 /* evaluate the property */
                 prop = get_op_uint16(&p);
                 last_pc = p;
-                p = propev.get_prop(vmg_ p - entry_ptr_native_, prop, 0);
-                continue;
+                p = propev.get_prop(vmg_ p - entry_ptr_native_, prop, 0,
+                                    p, OPC_OBJGETPROP);
+                VMRUN_NEXT;
 
-            case OPC_OBJCALLPROP:
+            VMRUN_CASE(OPC_OBJCALLPROP):
                 /* get the argument count */
                 argc = get_op_uint8(&p);
 
@@ -2079,10 +2354,11 @@ resume_execution:
                 /* evaluate the property */
                 prop = get_op_uint16(&p);
                 last_pc = p;
-                p = propev.get_prop(vmg_ p - entry_ptr_native_, prop, argc);
-                continue;
+                p = propev.get_prop(vmg_ p - entry_ptr_native_, prop, argc,
+                                    p, OPC_OBJCALLPROP);
+                VMRUN_NEXT;
 
-            case OPC_GETPROPDATA:
+            VMRUN_CASE(OPC_GETPROPDATA):
                 /* get the object whose property we're fetching */
                 pop(&propev.self);
 
@@ -2103,10 +2379,11 @@ resume_execution:
 
                 /* evaluate the property given by the immediate data */
                 last_pc = p;
-                p = propev.get_prop(vmg_ p - entry_ptr_native_, prop, 0);
-                continue;
+                p = propev.get_prop(vmg_ p - entry_ptr_native_, prop, 0,
+                                    p, OPC_GETPROPDATA);
+                VMRUN_NEXT;
 
-            case OPC_PTRGETPROPDATA:
+            VMRUN_CASE(OPC_PTRGETPROPDATA):
                 /* get the property and object to evaluate */
                 pop_prop(vmg_ &val);
                 pop(&propev.self);
@@ -2127,33 +2404,33 @@ resume_execution:
                 last_pc = p;
                 p = propev.get_prop(vmg_ p - entry_ptr_native_,
                                     val.val.prop, 0);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_GETLCL1:
+            VMRUN_CASE(OPC_GETLCL1):
                 /* push the local */
                 pushval(vmg_ get_local(vmg_ get_op_uint8(&p)));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_GETLCLN5:
+            VMRUN_CASE(OPC_GETLCLN5):
                 pushval(vmg_ get_local(vmg_ 5));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_GETLCL2:
+            VMRUN_CASE(OPC_GETLCL2):
                 /* push the local */
                 pushval(vmg_ get_local(vmg_ get_op_uint16(&p)));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_GETARG1:
+            VMRUN_CASE(OPC_GETARG1):
                 /* push the argument */
                 pushval(vmg_ get_param(vmg_ get_op_uint8(&p)));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_GETARG2:
+            VMRUN_CASE(OPC_GETARG2):
                 /* push the argument */
                 pushval(vmg_ get_param(vmg_ get_op_uint16(&p)));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_SETSELF:
+            VMRUN_CASE(OPC_SETSELF):
                 /* retrieve the 'self' object */
                 pop(&val);
                 
@@ -2163,18 +2440,18 @@ resume_execution:
 
                 /* set 'self' */
                 set_self(vmg_ &val);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_STORECTX:
+            VMRUN_CASE(OPC_STORECTX):
                 /* create the context object */
                 create_loadctx_obj(vmg_ push(),
                                    get_self(vmg0_),
                                    get_defining_obj(vmg0_),
                                    get_orig_target_obj(vmg0_),
                                    get_target_prop(vmg0_));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_LOADCTX:
+            VMRUN_CASE(OPC_LOADCTX):
                 {
                     const char *lstp;
 
@@ -2201,44 +2478,44 @@ resume_execution:
                     /* discard the context object at top of stack */
                     discard();
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_PUSHCTXELE:
+            VMRUN_CASE(OPC_PUSHCTXELE):
                 /* check our context element type */
                 switch(*p++)
                 {
                 case PUSHCTXELE_TARGPROP:
                     /* push the target property ID */
                     push(get_from_frame(frame_ptr_, VMRUN_FPOFS_PROP));
-                    continue;
+                    VMRUN_NEXT;
 
                 case PUSHCTXELE_TARGOBJ:
                     /* push the original target object ID */
                     push(get_from_frame(frame_ptr_, VMRUN_FPOFS_ORIGTARG));
-                    continue;
+                    VMRUN_NEXT;
 
                 case PUSHCTXELE_DEFOBJ:
                     /* push the defining object */
                     push(get_from_frame(frame_ptr_, VMRUN_FPOFS_DEFOBJ));
-                    continue;
+                    VMRUN_NEXT;
 
                 case PUSHCTXELE_INVOKEE:
                     /* push the invokee object */
                     push(get_from_frame(frame_ptr_, VMRUN_FPOFS_INVOKEE));
-                    continue;
+                    VMRUN_NEXT;
 
                 default:
                     /* the opcode is not valid in this VM version */
                     err_throw(VMERR_INVALID_OPCODE);
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_GETARGC:
+            VMRUN_CASE(OPC_GETARGC):
                 /* push the argument counter */
                 push_int(vmg_ get_cur_argc(vmg0_));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_DUP2:
+            VMRUN_CASE(OPC_DUP2):
                 /* 
                  *   duplicate the top two elements: first push the
                  *   second-from-top, then push the old top (which will now
@@ -2246,9 +2523,9 @@ resume_execution:
                  */
                 pushval(vmg_ get(1));
                 pushval(vmg_ get(1));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_SWAP:
+            VMRUN_CASE(OPC_SWAP):
                 /* swap the top two elements on the stack */
                 valp = get(0);
                 valp2 = get(1);
@@ -2261,9 +2538,9 @@ resume_execution:
 
                 /* copy the working copy of TOS over TOS-1 */
                 *valp2 = val;
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_SWAP2:
+            VMRUN_CASE(OPC_SWAP2):
                 /* swap the top two elements with the next two */
                 valp = get(0);
                 valp2 = get(1);
@@ -2279,9 +2556,9 @@ resume_execution:
                 /* copy the saved 2,3 over 0,1 */
                 *valp = val;
                 *valp2 = val2;
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_SWAPN:
+            VMRUN_CASE(OPC_SWAPN):
                 /* swap elements at two given stack indices */
                 valp = get(get_op_uint8(&p));
                 valp2 = get(get_op_uint8(&p));
@@ -2294,47 +2571,47 @@ resume_execution:
 
                 /* write the copy of val1 over val2 */
                 *valp2 = val;
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_GETSPN:
+            VMRUN_CASE(OPC_GETSPN):
                 /* push stack element at index */
                 push(get(get_op_uint8(&p)));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_DISC:
+            VMRUN_CASE(OPC_DISC):
                 /* discard the item at the top of the stack */
                 discard();
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_DISC1:
+            VMRUN_CASE(OPC_DISC1):
                 /* discard n items */
                 discard(get_op_uint8(&p));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_GETDBARGC:
+            VMRUN_CASE(OPC_GETDBARGC):
                 /* push the argument count from the selected frame */
                 push_int(vmg_ get_argc_at_level(vmg_ get_op_uint16(&p) + 1));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_GETDBLCL:
+            VMRUN_CASE(OPC_GETDBLCL):
                 /* get the local variable number and stack level */
                 idx = get_op_uint16(&p);
                 level = get_op_uint16(&p);
 
                 /* push the value */
                 pushval(vmg_ get_local_at_level(vmg_ idx, level + 1));
-                continue;
+                VMRUN_NEXT;
                 
-            case OPC_GETDBARG:
+            VMRUN_CASE(OPC_GETDBARG):
                 /* get the parameter variable number and stack level */
                 idx = get_op_uint16(&p);
                 level = get_op_uint16(&p);
 
                 /* push the value */
                 pushval(vmg_ get_param_at_level(vmg_ idx, level + 1));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_SETDBLCL:
+            VMRUN_CASE(OPC_SETDBLCL):
                 /* get the local variable number and stack level */
                 idx = get_op_uint16(&p);
                 level = get_op_uint16(&p);
@@ -2344,9 +2621,9 @@ resume_execution:
 
                 /* pop the value into the local */
                 popval(vmg_ valp);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_SETDBARG:
+            VMRUN_CASE(OPC_SETDBARG):
                 /* get the parameter variable number and stack level */
                 idx = get_op_uint16(&p);
                 level = get_op_uint16(&p);
@@ -2356,9 +2633,9 @@ resume_execution:
 
                 /* pop the value into the local */
                 popval(vmg_ valp);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_SWITCH:
+            VMRUN_CASE(OPC_SWITCH):
                 /* get the control value */
                 valp = get(0);
 
@@ -2389,9 +2666,9 @@ resume_execution:
                 /* if we didn't find it, jump to the default case */
                 if (cnt == 0)
                     p += osrp2s(p);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_JT:
+            VMRUN_CASE(OPC_JT):
                 /* get the value */
                 valp = get(0);
 
@@ -2413,9 +2690,9 @@ resume_execution:
 
                 /* discard the value */
                 discard();
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_JR0T:
+            VMRUN_CASE(OPC_JR0T):
                 /* 
                  *   if R0 is true, or it's a non-zero numeric value, or any
                  *   non-numeric and non-boolean value, jump 
@@ -2431,9 +2708,9 @@ resume_execution:
                     /* it's non-zero and non-nil - jump */
                     p += osrp2s(p);
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_JF:
+            VMRUN_CASE(OPC_JF):
                 /* get the value */
                 valp = get(0);
 
@@ -2456,24 +2733,24 @@ resume_execution:
 
                 /* discard the value */
                 discard();
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_JGE:
+            VMRUN_CASE(OPC_JGE):
                 /* jump if greater or equal */
                 p += (pop2_compare_ge(vmg0_) ? osrp2s(p) : 2);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_JLT:
+            VMRUN_CASE(OPC_JLT):
                 /* jump if less */
                 p += (pop2_compare_lt(vmg0_) ? osrp2s(p) : 2);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_JLE:
+            VMRUN_CASE(OPC_JLE):
                 /* jump if less or equal */
                 p += (pop2_compare_le(vmg0_) ? osrp2s(p) : 2);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_JST:
+            VMRUN_CASE(OPC_JST):
                 /* get (do not remove) the element at top of stack */
                 valp = get(0);
 
@@ -2502,9 +2779,9 @@ resume_execution:
                     /* skip to the next instruction */
                     p += 2;
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_JSF:
+            VMRUN_CASE(OPC_JSF):
                 /* get (do not remove) the element at top of stack */
                 valp = get(0);
 
@@ -2526,9 +2803,9 @@ resume_execution:
                     /* skip to the next instruction */
                     p += 2;
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_LJSR:
+            VMRUN_CASE(OPC_LJSR):
                 /* 
                  *   compute and push the offset of the next instruction
                  *   (at +2 because of the branch offset operand) from our
@@ -2540,9 +2817,9 @@ resume_execution:
 
                 /* jump to the target address */
                 p += osrp2s(p);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_LRET:
+            VMRUN_CASE(OPC_LRET):
                 /* get the indicated local variable */
                 valp = get_local(vmg_ get_op_uint16(&p));
                 
@@ -2556,9 +2833,9 @@ resume_execution:
                  *   current method header pointer 
                  */
                 p = entry_ptr_native_ + valp->val.intval;
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_SAY:
+            VMRUN_CASE(OPC_SAY):
                 /* get the string offset */
                 ofs = get_op_int32(&p);
 
@@ -2566,16 +2843,16 @@ resume_execution:
                 last_pc = p;
                 p = disp_dstring(vmg_ ofs, p - entry_ptr_native_,
                                  get_self_check(vmg0_));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_SAYVAL:
+            VMRUN_CASE(OPC_SAYVAL):
                 /* invoke the default string display function */
                 last_pc = p;
                 p = disp_string_val(vmg_ p - entry_ptr_native_,
                                     get_self_check(vmg0_));
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_THROW:
+            VMRUN_CASE(OPC_THROW):
                 /* pop the exception object */
                 pop_obj(vmg_ &val);
 
@@ -2593,9 +2870,9 @@ resume_execution:
                     /* terminate execution */
                     goto exit_loop;
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_INHERIT:
+            VMRUN_CASE(OPC_INHERIT):
                 /* get the argument count */
                 argc = get_op_uint8(&p);
 
@@ -2604,9 +2881,9 @@ resume_execution:
                 prop = (vm_prop_id_t)get_op_uint16(&p);
                 last_pc = p;
                 p = inh_prop(vmg_ p - entry_ptr_native_, prop, argc);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_PTRINHERIT:
+            VMRUN_CASE(OPC_PTRINHERIT):
                 /* get the argument count */
                 argc = get_op_uint8(&p);
 
@@ -2617,9 +2894,9 @@ resume_execution:
                 /* inherit it */
                 last_pc = p;
                 p = inh_prop(vmg_ p - entry_ptr_native_, val.val.prop, argc);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_EXPINHERIT:
+            VMRUN_CASE(OPC_EXPINHERIT):
                 /* get the argument count */
                 argc = get_op_uint8(&p);
 
@@ -2640,9 +2917,9 @@ resume_execution:
                 last_pc = p;
                 p = get_prop(vmg_ p - entry_ptr_native_,
                              &val, prop, &val2, argc, 0);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_PTREXPINHERIT:
+            VMRUN_CASE(OPC_PTREXPINHERIT):
                 /* get the argument count */
                 argc = get_op_uint8(&p);
 
@@ -2658,9 +2935,9 @@ resume_execution:
                 last_pc = p;
                 p = get_prop(vmg_ p - entry_ptr_native_,
                              &val3, val.val.prop, &val2, argc, 0);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_DELEGATE:
+            VMRUN_CASE(OPC_DELEGATE):
                 /* get the argument count */
                 argc = get_op_uint8(&p);
 
@@ -2676,9 +2953,9 @@ resume_execution:
                 last_pc = p;
                 p = get_prop(vmg_ p - entry_ptr_native_,
                              &val, prop, &val2, argc, 0);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_PTRDELEGATE:
+            VMRUN_CASE(OPC_PTRDELEGATE):
                 /* get the argument count */
                 argc = get_op_uint8(&p);
 
@@ -2694,9 +2971,9 @@ resume_execution:
                 last_pc = p;
                 p = get_prop(vmg_ p - entry_ptr_native_,
                              &val2, val.val.prop, &val3, argc, 0);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_BUILTIN_A:
+            VMRUN_CASE(OPC_BUILTIN_A):
                 /* get the function index and argument count */
                 argc = get_op_uint8(&p);
 
@@ -2705,9 +2982,9 @@ resume_execution:
 
                 /* call the function in set #0 */
                 call_bif(vmg_ 0, idx, argc);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_BUILTIN_B:
+            VMRUN_CASE(OPC_BUILTIN_B):
                 /* get the function index and argument count */
                 argc = get_op_uint8(&p);
 
@@ -2716,9 +2993,9 @@ resume_execution:
 
                 /* call the function in set #1 */
                 call_bif(vmg_ 1, idx, argc);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_BUILTIN_C:
+            VMRUN_CASE(OPC_BUILTIN_C):
                 /* get the function index and argument count */
                 argc = get_op_uint8(&p);
 
@@ -2727,9 +3004,9 @@ resume_execution:
 
                 /* call the function in set #2 */
                 call_bif(vmg_ 2, idx, argc);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_BUILTIN_D:
+            VMRUN_CASE(OPC_BUILTIN_D):
                 /* get the function index and argument count */
                 argc = get_op_uint8(&p);
 
@@ -2738,9 +3015,9 @@ resume_execution:
 
                 /* call the function in set #3 */
                 call_bif(vmg_ 3, idx, argc);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_BUILTIN1:
+            VMRUN_CASE(OPC_BUILTIN1):
                 /* get the function index and argument count */
                 argc = get_op_uint8(&p);
 
@@ -2752,9 +3029,9 @@ resume_execution:
 
                 /* call the function in set #0 */
                 call_bif(vmg_ set_idx, idx, argc);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_BUILTIN2:
+            VMRUN_CASE(OPC_BUILTIN2):
                 /* get the function index and argument count */
                 argc = get_op_uint8(&p);
 
@@ -2766,14 +3043,14 @@ resume_execution:
 
                 /* call the function in set #0 */
                 call_bif(vmg_ set_idx, idx, argc);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_CALLEXT:
+            VMRUN_CASE(OPC_CALLEXT):
                 //$$$
                 err_throw(VMERR_CALLEXT_NOT_IMPL);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_IDXINT8:
+            VMRUN_CASE(OPC_IDXINT8):
                 /* 
                  *   make a copy of the value to index, so we can overwrite
                  *   the stack slot with the result 
@@ -2797,9 +3074,9 @@ resume_execution:
                                     &val, G_predef->operator_idx, 1,
                                     VMERR_CANNOT_INDEX_TYPE);
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_BP:
+            VMRUN_CASE(OPC_BP):
                 /* step back to the breakpoint location itself */
                 VM_IF_DEBUGGER(--p);
 
@@ -2822,15 +3099,15 @@ resume_execution:
                  */
                 goto exec_instruction;
 
-            case OPC_NOP:
+            VMRUN_CASE(OPC_NOP):
                 /* NO OP - no effect */
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_TRNEW1:
+            VMRUN_CASE(OPC_TRNEW1):
                 trans = TRUE;
                 goto do_opc_new1;
 
-            case OPC_NEW1:
+            VMRUN_CASE(OPC_NEW1):
                 trans = FALSE;
                 /* fall through to do_opc_new1 */
 
@@ -2847,13 +3124,13 @@ resume_execution:
                 /* create the new object */
                 last_pc = p;
                 p = new_and_store_r0(vmg_ p, idx, argc, trans);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_TRNEW2:
+            VMRUN_CASE(OPC_TRNEW2):
                 trans = TRUE;
                 goto do_opc_new2;
 
-            case OPC_NEW2:
+            VMRUN_CASE(OPC_NEW2):
                 trans = FALSE;
                 /* fall through to do_opc_new2 */
 
@@ -2870,9 +3147,9 @@ resume_execution:
                 /* create the new object */
                 last_pc = p;
                 p = new_and_store_r0(vmg_ p, idx, argc, trans);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_INCLCL:
+            VMRUN_CASE(OPC_INCLCL):
                 /* get the local */
                 valp = get_local(vmg_ itmp = get_op_uint16(&p));
                 
@@ -2900,9 +3177,9 @@ resume_execution:
                                         VMERR_BAD_TYPE_ADD);
                     }
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_DECLCL:
+            VMRUN_CASE(OPC_DECLCL):
                 /* get the local */
                 valp = get_local(vmg_ itmp = get_op_uint16(&p));
 
@@ -2930,9 +3207,9 @@ resume_execution:
                                         VMERR_BAD_TYPE_SUB);
                     }
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_ADDILCL1:
+            VMRUN_CASE(OPC_ADDILCL1):
                 /* get the local */
                 valp = get_local(vmg_ itmp = get_op_uint8(&p));
 
@@ -2961,9 +3238,9 @@ resume_execution:
                                         VMERR_BAD_TYPE_ADD);
                     }
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_ADDILCL4:
+            VMRUN_CASE(OPC_ADDILCL4):
                 /* get the local */
                 valp = get_local(vmg_ itmp = get_op_uint16(&p));
 
@@ -2992,9 +3269,9 @@ resume_execution:
                                         VMERR_BAD_TYPE_ADD);
                     }
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_ADDTOLCL:
+            VMRUN_CASE(OPC_ADDTOLCL):
                 /* get the local */
                 valp = get_local(vmg_ itmp = get_op_uint16(&p));
 
@@ -3031,9 +3308,9 @@ resume_execution:
                                         VMERR_BAD_TYPE_ADD);
                     }
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_SUBFROMLCL:
+            VMRUN_CASE(OPC_SUBFROMLCL):
                 /* get the local */
                 valp = get_local(vmg_ itmp = get_op_uint16(&p));
 
@@ -3067,63 +3344,63 @@ resume_execution:
                                     valp, G_predef->operator_sub, 1,
                                     VMERR_BAD_TYPE_SUB);
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_ZEROLCL1:
+            VMRUN_CASE(OPC_ZEROLCL1):
                 /* get the local and set it to zero */
                 get_local(vmg_ get_op_uint8(&p))->set_int(0);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_ZEROLCL2:
+            VMRUN_CASE(OPC_ZEROLCL2):
                 /* get the local and set it to zero */
                 get_local(vmg_ get_op_uint16(&p))->set_int(0);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_NILLCL1:
+            VMRUN_CASE(OPC_NILLCL1):
                 /* get the local and set it to zero */
                 get_local(vmg_ get_op_uint8(&p))->set_nil();
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_NILLCL2:
+            VMRUN_CASE(OPC_NILLCL2):
                 /* get the local and set it to zero */
                 get_local(vmg_ get_op_uint16(&p))->set_nil();
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_ONELCL1:
+            VMRUN_CASE(OPC_ONELCL1):
                 /* get the local and set it to zero */
                 get_local(vmg_ get_op_uint8(&p))->set_int(1);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_ONELCL2:
+            VMRUN_CASE(OPC_ONELCL2):
                 /* get the local and set it to zero */
                 get_local(vmg_ get_op_uint16(&p))->set_int(1);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_SETLCL2:
+            VMRUN_CASE(OPC_SETLCL2):
                 /* get a pointer to the local */
                 valp = get_local(vmg_ get_op_uint16(&p));
 
                 /* pop the value into the local */
                 popval(vmg_ valp);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_SETARG1:
+            VMRUN_CASE(OPC_SETARG1):
                 /* get a pointer to the parameter */
                 valp = get_param(vmg_ get_op_uint8(&p));
 
                 /* pop the value into the parameter */
                 popval(vmg_ valp);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_SETARG2:
+            VMRUN_CASE(OPC_SETARG2):
                 /* get a pointer to the parameter */
                 valp = get_param(vmg_ get_op_uint16(&p));
 
                 /* pop the value into the parameter */
                 popval(vmg_ valp);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_SETIND:
+            VMRUN_CASE(OPC_SETIND):
                 /* pop the index */
                 popval(vmg_ &val2);
 
@@ -3149,9 +3426,9 @@ resume_execution:
                                     &val, G_predef->operator_setidx, 2,
                                     VMERR_CANNOT_INDEX_TYPE);
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_SETINDLCL1I8:
+            VMRUN_CASE(OPC_SETINDLCL1I8):
                 /* get the local */
                 valp = get_local(vmg_ itmp = get_op_uint8(&p));
 
@@ -3175,9 +3452,9 @@ resume_execution:
                                     valp, G_predef->operator_setidx, 2,
                                     VMERR_CANNOT_INDEX_TYPE);
                 }
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_SETPROP:
+            VMRUN_CASE(OPC_SETPROP):
                 /* get the object whose property we're setting */
                 pop_obj(vmg_ &val);
 
@@ -3186,9 +3463,9 @@ resume_execution:
 
                 /* set the value */
                 set_prop(vmg_ val.val.obj, get_op_uint16(&p), &val2);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_PTRSETPROP:
+            VMRUN_CASE(OPC_PTRSETPROP):
                 /* get the property and object to set */
                 pop_prop(vmg_ &val);
                 pop_obj(vmg_ &val2);
@@ -3198,9 +3475,9 @@ resume_execution:
 
                 /* set it */
                 set_prop(vmg_ val2.val.obj, val.val.prop, &val3);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_OBJSETPROP:
+            VMRUN_CASE(OPC_OBJSETPROP):
                 /* get the object */
                 obj = (vm_obj_id_t)get_op_uint32(&p);
 
@@ -3209,14 +3486,20 @@ resume_execution:
 
                 /* set the property */
                 set_prop(vmg_ obj, get_op_uint16(&p), &val);
-                continue;
+                VMRUN_NEXT;
 
-            case OPC_PUSHBIFPTR:
+            VMRUN_CASE(OPC_PUSHBIFPTR):
                 /* push pointer to built-in function */
                 idx = get_op_uint16(&p);
                 push()->set_bifptr(get_op_uint16(&p), (ushort)idx);
                 validate_bifptr(vmg0_);
-                continue;
+                VMRUN_NEXT;
+
+#if VMRUN_THREADED_DISPATCH
+            op_invalid:
+                /* the dispatch table sends all unused opcodes here */
+                err_throw(VMERR_INVALID_OPCODE);
+#endif
 
 #ifdef OS_FILL_OUT_CASE_TABLES
             /*
@@ -3364,7 +3647,7 @@ resume_execution:
             default:
                 /* unrecognized opcode */
                 err_throw(VMERR_INVALID_OPCODE);
-                continue;
+                VMRUN_NEXT;
 
 #endif /* OS_FILL_OUT_CASE_TABLES */
             }
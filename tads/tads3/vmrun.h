@@ -31,6 +31,40 @@ Modified
 #include "vmfunc.h"
 
 
+/* ------------------------------------------------------------------------ */
+/*
+ *   Instruction dispatch.  The portable interpreter loop dispatches each
+ *   instruction through a 'switch' on the opcode.  On compilers that
+ *   support taking the address of a label (gcc and clang), the loop can
+ *   instead jump directly to each opcode's handler through a table of label
+ *   addresses ("threaded" dispatch).  This avoids the switch's range check,
+ *   and gives each handler its own indirect jump, which branch predictors
+ *   handle much better than a single shared one.
+ *   
+ *   Threaded dispatch is used by default where it's available.  #define
+ *   VMRUN_THREADED_DISPATCH as 0 on the compiler command line to force the
+ *   portable switch, or as 1 to force threaded dispatch.  
+ */
+#ifndef VMRUN_THREADED_DISPATCH
+# ifdef __GNUC__
+#  define VMRUN_THREADED_DISPATCH  1
+# else
+#  define VMRUN_THREADED_DISPATCH  0
+# endif
+#endif
+
+/*
+ *   Instruction counting.  #define VMRUN_COUNT_OPS to make the interpreter
+ *   count every instruction it executes; this is meant for benchmarking
+ *   (see tads3/test/test_bench.cpp), so it's normally omitted.  
+ */
+#ifdef VMRUN_COUNT_OPS
+#define VMRUN_IF_COUNT_OPS(x)  x
+#else
+#define VMRUN_IF_COUNT_OPS(x)
+#endif
+
+
 /* ------------------------------------------------------------------------ */
 /*
  *   for debugger use - interpreter context save structure 
@@ -1095,6 +1129,12 @@ public:
     /* get the last program counter address */
     const uchar *get_last_pc() const { return pc_ptr_ != 0 ? *pc_ptr_ : 0; }
 
+#ifdef VMRUN_COUNT_OPS
+    /* get/reset the number of instructions executed */
+    unsigned long get_op_count() const { return op_count_; }
+    void reset_op_count() { op_count_ = 0; }
+#endif
+
 protected:
     /* 
      *   Execute byte code starting at a given address.  This function
@@ -1502,6 +1542,11 @@ protected:
      */
     int halt_vm_;
 
+#ifdef VMRUN_COUNT_OPS
+    /* number of instructions executed, for benchmarking */
+    unsigned long op_count_;
+#endif
+
     /* flag: profiling is active */
     int profiling_;
 
@@ -24,6 +24,7 @@ Modified
 #include <stdio.h>
 #include <string.h>
 #include <limits.h>
+#include <assert.h>
 
 #include "t3std.h"
 #include "vmmcreg.h"
@@ -445,10 +446,11 @@ void CVmObjString::save_to_file(VMG_ CVmFile *fp)
     size_t len;
     
     /* get our length */
-    len = vmb_get_len(ext_);
+    const char *str = get_as_string(vmg0_);
+    len = vmb_get_len(str);
 
     /* write the length prefix and the string */
-    fp->write_bytes(ext_, len + VMB_LEN);
+    fp->write_bytes(str, len + VMB_LEN);
 }
 
 /*
@@ -494,7 +496,8 @@ long CVmObjString::cast_to_int(VMG0_) const
      *   explicit int cast, so don't allow BigNumber promotions 
      */
     vm_val_t val;
-    parse_num_val(vmg_ &val, ext_ + VMB_LEN, vmb_get_len(ext_), 10, TRUE);
+    const char *str = get_as_string(vmg0_);
+    parse_num_val(vmg_ &val, str + VMB_LEN, vmb_get_len(str), 10, TRUE);
 
     /* return the integer value */
     return val.val.intval;
@@ -510,7 +513,8 @@ void CVmObjString::cast_to_num(VMG_ vm_val_t *val, vm_obj_id_t self) const
      *   return whatever numeric type is needed to represent the value, so
      *   allow BigNumber promotions if necessary. 
      */
-    parse_num_val(vmg_ val, ext_ + VMB_LEN, vmb_get_len(ext_), 10, FALSE);
+    const char *str = get_as_string(vmg0_);
+    parse_num_val(vmg_ val, str + VMB_LEN, vmb_get_len(str), 10, FALSE);
 }
 
 /*
@@ -684,6 +688,18 @@ int CVmObjString::add_val(VMG_ vm_val_t *result,
     return TRUE;
 }
 
+/*
+ *   Get the rope extension for a string value, if it's an unflattened
+ *   rope.  'val' must be a string value.  
+ */
+static const vm_strrope_ext *get_str_rope(VMG_ const vm_val_t *val)
+{
+    if (val->typ == VM_OBJ)
+        return ((CVmObjString *)vm_objp(vmg_ val->val.obj))->get_rope();
+    else
+        return 0;
+}
+
 /*
  *   Static string adder.  This creates a new string object that results
  *   from appending the given value to the given string constant.  This is
@@ -708,18 +724,31 @@ void CVmObjString::add_to_str(VMG_ vm_val_t *result,
     size_t len1, len2;
     CVmObjString *objptr;
     vm_val_t new_obj2;
+    const vm_strrope_ext *rope;
+    int val_is_str;
 
     /* 
-     *   Get the string buffer pointers.  The left value is already a string,
-     *   or we wouldn't be here.  The right value can be anything, though, so
-     *   we need to apply an implicit string conversion if it's another type.
+     *   Get the string buffer pointers and lengths.  The left value is
+     *   already a string, or we wouldn't be here.  The right value can be
+     *   anything, though, so we need to apply an implicit string conversion
+     *   if it's another type.  If either value is a rope, get its length
+     *   from the rope rather than flattening it - we might be able to build
+     *   the result as a rope as well.  
      */
-    strval1 = self->get_as_string(vmg0_);
-    strval2 = cvt_to_str(vmg_ &new_obj2, buf, sizeof(buf), val, 10, 0);
+    strval1 = strval2 = 0;
+    if ((rope = get_str_rope(vmg_ self)) != 0)
+        len1 = rope->len;
+    else
+        len1 = vmb_get_len(strval1 = self->get_as_string(vmg0_));
 
-    /* get the lengths of the two strings */
-    len1 = vmb_get_len(strval1);
-    len2 = vmb_get_len(strval2);
+    new_obj2.set_nil();
+    val_is_str = (val->typ == VM_SSTRING
+                  || (val->typ == VM_OBJ && is_string_obj(vmg_ val->val.obj)));
+    if (val_is_str && (rope = get_str_rope(vmg_ val)) != 0)
+        len2 = rope->len;
+    else
+        len2 = vmb_get_len(strval2 = cvt_to_str(
+            vmg_ &new_obj2, buf, sizeof(buf), val, 10, 0));
 
     /*
      *   If the right-hand value is zero length, or it's nil, simply return
@@ -733,7 +762,7 @@ void CVmObjString::add_to_str(VMG_ vm_val_t *result,
         /* we're appending nothing to the string; just return 'self' */
         *result = *self;
     }
-    else if (len1 == 0 && val->get_as_string(vmg0_) != 0)
+    else if (len1 == 0 && val_is_str)
     {
         /* 
          *   we're appending the right value to an empty string, AND the
@@ -742,6 +771,41 @@ void CVmObjString::add_to_str(VMG_ vm_val_t *result,
          */
         *result = *val;
     }
+    else if (len1 + len2 >= VMSTR_ROPE_MIN)
+    {
+        /* 
+         *   The result is long enough that copying it is starting to get
+         *   expensive, so build it as a rope instead.  Check the length
+         *   limit first, since a rope doesn't allocate its buffer yet.  
+         */
+        if (len1 + len2 > 65535)
+            err_throw(VMERR_STR_TOO_LONG);
+
+        /* protect the values from garbage collection */
+        G_stk->push(self);
+        G_stk->push(val);
+        G_stk->push(&new_obj2);
+
+        /* 
+         *   Create the rope.  If the right value is a string, or converted
+         *   to a new string object, refer to it; otherwise its text is in a
+         *   temporary buffer, so copy the text into the rope.  
+         */
+        if (val_is_str)
+            obj = CVmObjStringRope::create(vmg_ self, val, 0, len1 + len2);
+        else if (new_obj2.typ == VM_OBJ)
+            obj = CVmObjStringRope::create(
+                vmg_ self, &new_obj2, 0, len1 + len2);
+        else
+            obj = CVmObjStringRope::create(
+                vmg_ self, 0, strval2, len1 + len2);
+
+        /* done with the garbage collection protection */
+        G_stk->discard(3);
+
+        /* return the new object in the result */
+        result->set_obj(obj);
+    }
     else
     {
         /* 
@@ -751,6 +815,15 @@ void CVmObjString::add_to_str(VMG_ vm_val_t *result,
         G_stk->push(self);
         G_stk->push(&new_obj2);
 
+        /* 
+         *   get the string pointers if we didn't already (neither value can
+         *   be a rope, since ropes are never this short, so this is cheap) 
+         */
+        if (strval1 == 0)
+            strval1 = self->get_as_string(vmg0_);
+        if (strval2 == 0)
+            strval2 = val->get_as_string(vmg0_);
+
         /* create a new string object to hold the result */
         obj = create(vmg_ FALSE, len1 + len2);
         objptr = (CVmObjString *)vm_objp(vmg_ obj);
@@ -987,7 +1060,7 @@ int CVmObjString::equals(VMG_ vm_obj_id_t self,
      *   use the constant string comparison routine, using our underlying
      *   string as the constant string data 
      */
-    return const_equals(vmg_ ext_, val);
+    return const_equals(vmg_ get_as_string(vmg0_), val);
 }
 
 /*
@@ -1026,7 +1099,7 @@ int CVmObjString::const_equals(VMG_ const char *str, const vm_val_t *val)
  */
 uint CVmObjString::calc_hash(VMG_ vm_obj_id_t self, int /*depth*/) const
 {
-    return const_calc_hash(ext_);
+    return const_calc_hash(get_as_string(vmg0_));
 }
 
 /*
@@ -1059,7 +1132,7 @@ int CVmObjString::compare_to(VMG_ vm_obj_id_t /*self*/,
                              const vm_val_t *val) const
 {
     /* use the static string magnitude comparison routine */
-    return const_compare(vmg_ ext_, val);
+    return const_compare(vmg_ get_as_string(vmg0_), val);
 }
 
 /*
@@ -1210,7 +1283,8 @@ int CVmObjString::get_prop(VMG_ vm_prop_id_t prop, vm_val_t *retval,
     
     /* use the constant evaluator */
     self_val.set_obj(self);
-    if (const_get_prop(vmg_ retval, &self_val, ext_, prop, source_obj, argc))
+    if (const_get_prop(vmg_ retval, &self_val, get_as_string(vmg0_),
+                       prop, source_obj, argc))
     {
         *source_obj = metaclass_reg_->get_class_obj(vmg0_);
         return TRUE;
@@ -4312,3 +4386,208 @@ vm_obj_id_t CVmObjStringConst::create(VMG_ const char *const_ptr)
     /* return the new ID */
     return id;
 }
+
+/* ------------------------------------------------------------------------ */
+/*
+ *   Rope string object 
+ */
+
+/*
+ *   create 
+ */
+vm_obj_id_t CVmObjStringRope::create(VMG_ const vm_val_t *left,
+                                     const vm_val_t *right,
+                                     const char *rstr, size_t len)
+{
+    /* create our new ID - we refer to our parts until we're flattened */
+    vm_obj_id_t id = vm_new_id(vmg_ FALSE, TRUE, FALSE);
+
+    /* create the rope */
+    new (vmg_ id) CVmObjStringRope(vmg_ left, right, rstr, len);
+
+    /* return the new ID */
+    return id;
+}
+
+/*
+ *   construct 
+ */
+CVmObjStringRope::CVmObjStringRope(VMG_ const vm_val_t *left,
+                                   const vm_val_t *right,
+                                   const char *rstr, size_t len)
+{
+    size_t rlen = (rstr != 0 ? vmb_get_len(rstr) : 0);
+    vm_strrope_ext *r;
+
+    /* allocate the extension, with room for the right text if needed */
+    ext_ = (char *)G_mem->get_var_heap()->alloc_mem(
+        sizeof(vm_strrope_ext) + rlen, this);
+    r = get_ext();
+
+    /* we haven't been flattened yet */
+    r->len = len;
+    r->flat = 0;
+
+    /* remember the parts */
+    r->left = *left;
+    if (rstr != 0)
+    {
+        /* copy the right text directly */
+        r->right.set_nil();
+        r->right_len = rlen;
+        memcpy(r->right_buf, rstr + VMB_LEN, rlen);
+    }
+    else
+    {
+        /* refer to the right string value */
+        r->right = *right;
+        r->right_len = 0;
+    }
+}
+
+/*
+ *   notify of deletion 
+ */
+void CVmObjStringRope::notify_delete(VMG_ int in_root_set)
+{
+    if (ext_ != 0 && !in_root_set)
+    {
+        /* free the flattened text, if we built it */
+        if (get_ext()->flat != 0)
+            G_mem->get_var_heap()->free_mem(get_ext()->flat);
+
+        /* free the extension */
+        G_mem->get_var_heap()->free_mem(ext_);
+    }
+}
+
+/*
+ *   mark references 
+ */
+void CVmObjStringRope::mark_refs(VMG_ uint state)
+{
+    vm_strrope_ext *r = get_ext();
+
+    /* 
+     *   mark our parts; these are nil once we've been flattened, since we
+     *   don't need them any more at that point 
+     */
+    if (r->left.typ == VM_OBJ)
+        G_obj_table->mark_all_refs(r->left.val.obj, state);
+    if (r->right.typ == VM_OBJ)
+        G_obj_table->mark_all_refs(r->right.val.obj, state);
+}
+
+/*
+ *   A pending part of a rope during flattening: either a rope that we still
+ *   have to expand into its parts, or a piece of text to copy.  
+ */
+struct vm_strrope_part
+{
+    /* set up the part for a string value */
+    void set(VMG_ const vm_val_t *val)
+    {
+        /* if it's a rope that hasn't been flattened, expand it later */
+        if (val->typ == VM_OBJ
+            && (rope = ((CVmObjString *)vm_objp(vmg_ val->val.obj))
+                       ->get_rope()) != 0)
+            return;
+
+        /* otherwise, copy its text */
+        const char *str = val->get_as_string(vmg0_);
+        rope = 0;
+        p = str + VMB_LEN;
+        len = vmb_get_len(str);
+    }
+
+    /* the rope to expand, or null if this is text */
+    const vm_strrope_ext *rope;
+
+    /* the text to copy */
+    const char *p;
+    size_t len;
+};
+
+/*
+ *   Flatten the rope.  Ropes built by repeated appending are deep - one
+ *   level per append - so rather than recursing, we keep an explicit stack
+ *   of pending parts.  We fill in the buffer from right to left, which
+ *   keeps the stack shallow for the usual left-leaning rope: each node's
+ *   right part is copied as soon as the node is expanded, leaving only its
+ *   left part on the stack.  
+ */
+const char *CVmObjStringRope::flatten(VMG0_)
+{
+    vm_strrope_ext *r = get_ext();
+    vm_strrope_part stkbuf[32];
+    vm_strrope_part *stk = stkbuf;
+    size_t stk_max = countof(stkbuf);
+    size_t n;
+    char *flat;
+    char *dst;
+
+    /* allocate the flat buffer and set its length prefix */
+    flat = (char *)G_mem->get_var_heap()->alloc_mem(r->len + VMB_LEN, this);
+    vmb_put_len(flat, r->len);
+
+    /* start with our own parts, and fill in from the end of the buffer */
+    stk[0].rope = r;
+    n = 1;
+    dst = flat + VMB_LEN + r->len;
+    while (n != 0)
+    {
+        /* pop the next part */
+        vm_strrope_part cur = stk[--n];
+
+        /* if it's text, copy it in front of what we've built so far */
+        if (cur.rope == 0)
+        {
+            dst -= cur.len;
+            memcpy(dst, cur.p, cur.len);
+            continue;
+        }
+
+        /* make sure there's room on the stack for the rope's two parts */
+        if (n + 2 > stk_max)
+        {
+            vm_strrope_part *newstk;
+
+            stk_max *= 2;
+            newstk = (vm_strrope_part *)t3malloc(stk_max * sizeof(*stk));
+            memcpy(newstk, stk, n * sizeof(*stk));
+            if (stk != stkbuf)
+                t3free(stk);
+            stk = newstk;
+        }
+
+        /* push the left part, then the right part, which we'll copy first */
+        stk[n++].set(vmg_ &cur.rope->left);
+        if (cur.rope->right.typ == VM_NIL)
+        {
+            stk[n].rope = 0;
+            stk[n].p = cur.rope->right_buf;
+            stk[n].len = cur.rope->right_len;
+            ++n;
+        }
+        else
+            stk[n++].set(vmg_ &cur.rope->right);
+    }
+
+    /* we should have filled the buffer exactly */
+    assert(dst == flat + VMB_LEN);
+
+    /* done with the stack */
+    if (stk != stkbuf)
+        t3free(stk);
+
+    /* 
+     *   remember the text, and drop the parts - we don't need them any
+     *   more, so there's no reason to keep them from being collected 
+     */
+    r->flat = flat;
+    r->left.set_nil();
+    r->right.set_nil();
+
+    /* return the flattened string */
+    return flat;
+}
@@ -24,6 +24,15 @@ Modified
 #include "vmobj.h"
 
 
+/*
+ *   Minimum byte length for a concatenation result to be built as a rope
+ *   (see CVmObjStringRope) rather than copied into a new flat string.
+ *   Copying a short string is cheaper than building and later flattening
+ *   a rope node, so we only use ropes once the copying starts to add up.  
+ */
+const size_t VMSTR_ROPE_MIN = 512;
+
+
 /*
  *   String object
  */
@@ -194,8 +203,8 @@ public:
 
     /*
      *   Get a string representation of the object.  This is trivial for a
-     *   string object - we simply return our extension, which contains
-     *   the string in the required format.  
+     *   string object - we simply return our underlying string, which is
+     *   already in the required format.  
      */
     const char *cast_to_string(VMG_ vm_obj_id_t self,
                                vm_val_t *new_str) const
@@ -203,13 +212,19 @@ public:
         /* we are the string object */
         new_str->set_obj(self);
         
-        /* return our extension directly */
-        return ext_;
+        /* return our underlying string */
+        return get_as_string(vmg0_);
     }
 
     /* get the underlying string */
     const char *get_as_string(VMG0_) const { return ext_; }
 
+    /* 
+     *   Get the rope extension, if this string is a rope that hasn't been
+     *   flattened yet.  Returns null for an ordinary flat string.  
+     */
+    virtual const struct vm_strrope_ext *get_rope() const { return 0; }
+
     /* cast to integer */
     virtual long cast_to_int(VMG0_) const;
 
@@ -563,6 +578,100 @@ protected:
     }
 };
 
+/* ------------------------------------------------------------------------ */
+/*
+ *   A rope is a string built by concatenation that doesn't store its text
+ *   until someone needs it.  Instead, it keeps references to its left and
+ *   right parts, which can themselves be ropes, so building a string with
+ *   a series of '+' operations takes time and memory proportional to the
+ *   added text rather than to the square of the final length.
+ *   
+ *   The first time anyone asks for the underlying text (via
+ *   get_as_string(), which is how indexing, searching, comparison, output,
+ *   and saving all get at a string's bytes), we flatten the rope: we build
+ *   the text in an ordinary length-prefixed buffer, and drop the
+ *   references to the parts.  From then on we behave like an ordinary
+ *   string.
+ *   
+ *   A rope is a String as far as the program can tell; this is only an
+ *   alternative representation.  Since we refer to other objects until
+ *   we're flattened, we can have references, unlike a flat string.  
+ */
+
+/* rope extension */
+struct vm_strrope_ext
+{
+    /* byte length of the full string */
+    size_t len;
+
+    /* the flattened text, in length-prefixed format, once we've built it */
+    char *flat;
+
+    /* 
+     *   The left and right parts.  Each is a string value (a constant
+     *   string or a string object).  If 'right' is nil, the right part's
+     *   text is stored in right_buf instead; we use this for parts that
+     *   were converted to strings from other types.  
+     */
+    vm_val_t left;
+    vm_val_t right;
+
+    /* byte length and text of the right part, if stored directly */
+    size_t right_len;
+    char right_buf[1];
+};
+
+class CVmObjStringRope: public CVmObjString
+{
+public:
+    /* 
+     *   Create a rope for the concatenation of two string values.  If
+     *   'rstr' is non-null, it gives the right part's text, which we copy;
+     *   otherwise 'right' is the right part's string value.  
+     */
+    static vm_obj_id_t create(VMG_ const vm_val_t *left,
+                              const vm_val_t *right,
+                              const char *rstr, size_t len);
+
+    /* get the underlying string - flatten the rope if we haven't already */
+    const char *get_as_string(VMG0_) const
+    {
+        const vm_strrope_ext *r = get_ext();
+        return (r->flat != 0
+                ? r->flat : ((CVmObjStringRope *)this)->flatten(vmg0_));
+    }
+
+    /* get the rope extension, if we haven't been flattened yet */
+    const vm_strrope_ext *get_rope() const
+    {
+        const vm_strrope_ext *r = get_ext();
+        return (r->flat == 0 ? r : 0);
+    }
+
+    /* notify of deletion */
+    void notify_delete(VMG_ int in_root_set);
+
+    /* mark references - our parts are referenced until we're flattened */
+    void mark_refs(VMG_ uint state);
+
+    /* 
+     *   we only set our references when we're created, so old ropes never
+     *   acquire references to younger objects 
+     */
+    int has_gc_write_barrier() const { return TRUE; }
+
+protected:
+    /* construct */
+    CVmObjStringRope(VMG_ const vm_val_t *left, const vm_val_t *right,
+                     const char *rstr, size_t len);
+
+    /* get my extension */
+    vm_strrope_ext *get_ext() const { return (vm_strrope_ext *)ext_; }
+
+    /* build the flattened text, and drop our references to the parts */
+    const char *flatten(VMG0_);
+};
+
 
 /* ------------------------------------------------------------------------ */
 /*
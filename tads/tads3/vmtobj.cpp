@@ -326,6 +326,11 @@ void CVmObjTads::class_init(VMG0_)
     VM_IFELSE_ALLOC_PRE_GLOBAL(
         G_tadsobj_queue = new CVmObjTadsInhQueue(),
         G_tadsobj_queue->init());
+
+    /* allocate the property lookup cache */
+    VM_IFELSE_ALLOC_PRE_GLOBAL(
+        G_tadsobj_cache = new CVmObjTadsPropCache(),
+        G_tadsobj_cache->init());
 }
 
 /*
@@ -338,6 +343,12 @@ void CVmObjTads::class_term(VMG0_)
         delete G_tadsobj_queue;
         G_tadsobj_queue = 0;
     )
+
+    /* delete the property lookup cache */
+    VM_IF_ALLOC_PRE_GLOBAL(
+        delete G_tadsobj_cache;
+        G_tadsobj_cache = 0;
+    )
 }
 
 /* ------------------------------------------------------------------------ */
@@ -656,6 +667,14 @@ void CVmObjTads::notify_delete(VMG_ int in_root_set)
     /* free our extension */
     if (ext_ != 0)
     {
+        /* 
+         *   if the property cache refers to us, invalidate it, since our
+         *   object ID could be reused 
+         */
+        if ((get_hdr()->intern_obj_flags
+             & (VMTO_OBJ_PCACHE | VMTO_OBJ_PCKEY)) != 0)
+            G_tadsobj_cache->inval();
+
         /* tell the header to delete its memory */
         get_hdr()->free_mem();
 
@@ -809,6 +828,14 @@ void CVmObjTads::set_prop(VMG_ CVmUndo *undo, vm_obj_id_t self,
         /* allocate a new entry */
         entry = hdr->alloc_prop_entry(prop, val, 0);
 
+        /* 
+         *   if the property cache refers to us, the new entry could
+         *   override an inherited value that the cache has stored, so
+         *   invalidate it (this also covers the reallocation above) 
+         */
+        if ((hdr->intern_obj_flags & VMTO_OBJ_PCACHE) != 0)
+            G_tadsobj_cache->inval();
+
         /* 
          *   The old value didn't exist, so mark it emtpy, with an intval of
          *   zero.  The zero indicates that this is a newly created property
@@ -857,6 +884,9 @@ void CVmObjTads::set_prop(VMG_ CVmUndo *undo, vm_obj_id_t self,
 
     /* mark the entire object as modified */
     hdr->intern_obj_flags |= VMTO_OBJ_MOD;
+
+    /* note the store for the garbage collector */
+    gc_write_barrier(val);
 }
 
 /* ------------------------------------------------------------------------ */
@@ -1198,6 +1228,105 @@ int CVmObjTads::get_prop(VMG_ vm_prop_id_t prop, vm_val_t *val,
     return CVmObject::get_prop(vmg_ prop, val, self, source_obj, argc);
 }
 
+/*
+ *   Get a property through the property lookup cache 
+ */
+int CVmObjTads::get_prop_cached(VMG_ vm_prop_id_t prop, vm_val_t *val,
+                                vm_obj_id_t self, vm_obj_id_t *source_obj,
+                                uint *argc, const uchar *pc, uchar opc)
+{
+    vm_tadsobj_hdr *hdr = get_hdr();
+    vm_tadsobj_prop *entry;
+    vm_tadsobj_pcache_site *site;
+    vm_tadsobj_pcache_way *way;
+    vm_obj_id_t key;
+    int i;
+
+    /* 
+     *   our own properties override anything inherited, so look in our own
+     *   table first - this isn't cached, since it's a single probe anyway 
+     */
+    if ((entry = hdr->find_prop_entry(prop)) != 0)
+    {
+        VMRUN_IF_COUNT_OPS(G_tadsobj_cache->count_own(opc));
+        *val = entry->val;
+        *source_obj = self;
+        return TRUE;
+    }
+
+    /* 
+     *   Figure the cache key.  With a single superclass, the rest of the
+     *   search depends only on the superclass, so key on it; otherwise the
+     *   search path is our own, so key on ourself.  With no superclasses,
+     *   there's nothing to search, so use the normal lookup.  
+     */
+    switch (hdr->sc_cnt)
+    {
+    case 0:
+        return get_prop(vmg_ prop, val, self, source_obj, argc);
+
+    case 1:
+        key = hdr->sc[0].id;
+        break;
+
+    default:
+        key = self;
+        break;
+    }
+
+    /* look for a cached lookup at this call site */
+    site = G_tadsobj_cache->get_site(pc);
+    for (i = 0, way = site->way ; i < VMTOBJ_PCACHE_WAYS ; ++i, ++way)
+    {
+        if (way->key == key && way->prop == prop)
+        {
+            /* got it - return the current value from the cached entry */
+            VMRUN_IF_COUNT_OPS(G_tadsobj_cache->count_hit(opc));
+            *val = way->entry->val;
+            *source_obj = way->source;
+            return TRUE;
+        }
+    }
+
+    /* 
+     *   Not cached - search our superclasses.  Mark each one we visit, since
+     *   a change to any of them could change the outcome of the search.  
+     */
+    VMRUN_IF_COUNT_OPS(G_tadsobj_cache->count_miss(opc));
+    tadsobj_sc_search_ctx curpos(vmg_ self, this);
+    while (curpos.to_next(vmg0_))
+    {
+        curpos.curhdr->intern_obj_flags |= VMTO_OBJ_PCACHE;
+        if ((entry = curpos.curhdr->find_prop_entry(prop)) != 0)
+        {
+            /* if we're the key, note that deleting us affects the cache */
+            if (key == self)
+                hdr->intern_obj_flags |= VMTO_OBJ_PCKEY;
+
+            /* cache the result, replacing the ways in rotation */
+            way = &site->way[site->nxt];
+            site->nxt = (site->nxt + 1) % VMTOBJ_PCACHE_WAYS;
+            way->key = key;
+            way->prop = prop;
+            way->source = curpos.cur;
+            way->entry = entry;
+
+            /* return the value */
+            *val = entry->val;
+            *source_obj = curpos.cur;
+            return TRUE;
+        }
+    }
+
+    /* 
+     *   we didn't find it in a property list, so try the intrinsic class
+     *   methods and then the base metaclass, as get_prop() does 
+     */
+    if (get_prop_intrinsic(vmg_ prop, val, self, source_obj, argc))
+        return TRUE;
+    return CVmObject::get_prop(vmg_ prop, val, self, source_obj, argc);
+}
+
 /*
  *   Inherit a property.  
  */
@@ -1504,6 +1633,7 @@ void CVmObjTads::apply_undo(VMG_ CVmUndoRecord *rec)
 
     /* restore the value from the record */
     entry->val = rec->oldval;
+    gc_write_barrier(&rec->oldval);
 
     /* if the old value is 'empty', it requires special handling */
     if (rec->oldval.typ == VM_EMPTY)
@@ -1538,6 +1668,10 @@ void CVmObjTads::apply_undo(VMG_ CVmUndoRecord *rec)
                 /* return it to the free list */
                 hdr->prop_entry_free -= 1;
                 assert(entry == &hdr->prop_entry_arr[hdr->prop_entry_free]);
+
+                /* the property cache might point to the deleted entry */
+                if ((hdr->intern_obj_flags & VMTO_OBJ_PCACHE) != 0)
+                    G_tadsobj_cache->inval();
             }
             else
             {
@@ -1787,6 +1921,9 @@ void CVmObjTads::restore_from_file(VMG_ vm_obj_id_t self,
      */
     hdr->inval_inh_path();
 
+    /* likewise, forget any cached property lookups */
+    G_tadsobj_cache->inval();
+
     /* read the modified properties */
     for (i = 0 ; i < mod_count ; ++i)
     {
@@ -1849,6 +1986,9 @@ void CVmObjTads::load_from_image(VMG_ vm_obj_id_t self,
     {
         G_mem->get_var_heap()->free_mem(ext_);
         ext_ = 0;
+
+        /* any cached property lookups could refer to the old memory */
+        G_tadsobj_cache->inval();
     }
 
     /* get the number of superclasses */
@@ -1897,6 +2037,9 @@ void CVmObjTads::reload_from_image(VMG_ vm_obj_id_t self,
     hdr->prop_entry_free = 0;
     memset(hdr->hash_arr, 0, hdr->hash_siz * sizeof(hdr->hash_arr[0]));
 
+    /* any cached property lookups could refer to the discarded entries */
+    G_tadsobj_cache->inval();
+
     /* if we need space for more superclasses, reallocate the header */
     if (sc_cnt > hdr->sc_cnt)
     {
@@ -2311,8 +2454,17 @@ void CVmObjTads::change_superclass_list(VMG_ const vm_val_t *lst, int cnt)
         hdr->sc[i].objp = (CVmObjTads *)vm_objp(vmg_ ele.val.obj);
     }
 
+    /* note the new references for the garbage collector */
+    gc_write_barrier();
+
     /* invalidate the cached inheritance path */
     hdr->inval_inh_path();
+
+    /* 
+     *   invalidate the property cache - the new superclasses change the
+     *   inheritance of our instances and subclasses, too 
+     */
+    G_tadsobj_cache->inval();
 }
 
 /* ------------------------------------------------------------------------ */
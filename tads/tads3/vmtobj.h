@@ -227,6 +227,19 @@ struct vm_tadsobj_prop
 /* modified - object has been modified since being loaded from image */
 #define VMTO_OBJ_MOD     0x0002
 
+/* 
+ *   property cache dependency - an entry in the property lookup cache was
+ *   found by searching this object, so changes to the object's property
+ *   table or superclass list must invalidate the cache 
+ */
+#define VMTO_OBJ_PCACHE  0x0004
+
+/* 
+ *   property cache key - the property lookup cache has entries keyed on
+ *   this object's ID, so deleting the object must invalidate the cache 
+ */
+#define VMTO_OBJ_PCKEY   0x0008
+
 
 /*
  *   Property entry flags 
@@ -256,6 +269,156 @@ struct vm_tadsobj_prop
 const ushort VMTOBJ_PROP_INIT = 16;
 
 
+/* ------------------------------------------------------------------------ */
+/*
+ *   Property lookup cache.  Most property evaluations in a typical program
+ *   find the property not in the target object itself but in one of its
+ *   classes, and with a deep class tree the superclass search costs a hash
+ *   probe per class.  Most call sites, though, only ever see objects of one
+ *   class (or a handful), so we remember, per call site, where the last few
+ *   lookups at that site ended up.
+ *   
+ *   A cache entry is keyed on the object the superclass search started
+ *   from and the property ID.  For an object with a single superclass,
+ *   the search after the object itself depends only on the superclass, so
+ *   we key on the superclass, which lets all instances of a class share an
+ *   entry; the object's own property table is always searched directly
+ *   first.  For an object with multiple superclasses, the search path is
+ *   particular to the object, so we key on the object itself.
+ *   
+ *   The entry points directly to the property entry of the defining
+ *   object, so we always read the current value.  Every superclass visited
+ *   while filling a cache entry is marked with VMTO_OBJ_PCACHE, and an
+ *   object used as a key is marked with VMTO_OBJ_PCKEY; anything that
+ *   could change the outcome of a search through a marked object (adding
+ *   or removing a property, changing a superclass list, deleting or
+ *   reloading the object) invalidates the whole cache, which simply bumps
+ *   an epoch number that each site checks.  These events are rare
+ *   once a program is running, since properties are normally added to
+ *   instances rather than to the classes they inherit from.  
+ */
+
+/* number of call sites in the cache (must be a power of two) */
+const size_t VMTOBJ_PCACHE_SITES = 2048;
+
+/* number of entries (ways) per call site */
+const int VMTOBJ_PCACHE_WAYS = 4;
+
+/* a cached lookup result */
+struct vm_tadsobj_pcache_way
+{
+    /* the search starting point (a class or object) and property */
+    vm_obj_id_t key;
+    vm_prop_id_t prop;
+
+    /* the object that defines the property, and its property entry */
+    vm_obj_id_t source;
+    vm_tadsobj_prop *entry;
+};
+
+/* a call site's cache entries */
+struct vm_tadsobj_pcache_site
+{
+    /* the call site's code pointer */
+    const uchar *pc;
+
+    /* the cache epoch when the entries were stored */
+    unsigned long epoch;
+
+    /* the next way to replace */
+    unsigned int nxt;
+
+    /* the cached lookups */
+    vm_tadsobj_pcache_way way[VMTOBJ_PCACHE_WAYS];
+};
+
+class CVmObjTadsPropCache
+{
+public:
+    CVmObjTadsPropCache()
+    {
+        init();
+    }
+
+    void init()
+    {
+        /* start with every site empty */
+        memset(sites_, 0, sizeof(sites_));
+        epoch_ = 1;
+
+#ifdef VMRUN_COUNT_OPS
+        /* clear the statistics */
+        memset(own_, 0, sizeof(own_));
+        memset(hit_, 0, sizeof(hit_));
+        memset(miss_, 0, sizeof(miss_));
+#endif
+    }
+
+    /* invalidate all cached lookups */
+    void inval()
+    {
+        /* 
+         *   start a new epoch; if the counter wraps, we have to actually
+         *   clear the sites, since an old site could match the new epoch 
+         */
+        if (++epoch_ == 0)
+        {
+            memset(sites_, 0, sizeof(sites_));
+            epoch_ = 1;
+        }
+    }
+
+    /* 
+     *   get the cache site for a call site, clearing it if it was last
+     *   used by another call site or in an earlier epoch 
+     */
+    vm_tadsobj_pcache_site *get_site(const uchar *pc)
+    {
+        size_t h = (size_t)pc;
+        vm_tadsobj_pcache_site *site =
+            &sites_[(h ^ (h >> 11)) & (VMTOBJ_PCACHE_SITES - 1)];
+        
+        if (site->pc != pc || site->epoch != epoch_)
+        {
+            int i;
+            
+            site->pc = pc;
+            site->epoch = epoch_;
+            site->nxt = 0;
+            for (i = 0 ; i < VMTOBJ_PCACHE_WAYS ; ++i)
+                site->way[i].key = VM_INVALID_OBJ;
+        }
+        return site;
+    }
+
+#ifdef VMRUN_COUNT_OPS
+    /* 
+     *   Lookup statistics, by opcode: properties found in the target
+     *   object itself, cache hits, and cache misses.  These are only kept
+     *   in benchmarking builds (see vmrun.h).  
+     */
+    void count_own(uchar opc) { ++own_[opc]; }
+    void count_hit(uchar opc) { ++hit_[opc]; }
+    void count_miss(uchar opc) { ++miss_[opc]; }
+    unsigned long get_own_count(uchar opc) const { return own_[opc]; }
+    unsigned long get_hit_count(uchar opc) const { return hit_[opc]; }
+    unsigned long get_miss_count(uchar opc) const { return miss_[opc]; }
+#endif
+
+protected:
+    /* the call sites */
+    vm_tadsobj_pcache_site sites_[VMTOBJ_PCACHE_SITES];
+
+    /* the current epoch */
+    unsigned long epoch_;
+
+#ifdef VMRUN_COUNT_OPS
+    unsigned long own_[256];
+    unsigned long hit_[256];
+    unsigned long miss_[256];
+#endif
+};
+
 /* ------------------------------------------------------------------------ */
 /*
  *   TADS object interface.
@@ -394,6 +557,17 @@ public:
     int get_prop(VMG_ vm_prop_id_t prop, vm_val_t *val,
                  vm_obj_id_t self, vm_obj_id_t *source_obj, uint *argc);
 
+    /* 
+     *   Get a property through the property lookup cache.  This works like
+     *   get_prop(), but remembers the result of the superclass search for
+     *   the call site 'pc' (the code pointer of the instruction, 'opc').
+     *   The interpreter uses this for the property-evaluation instructions
+     *   with a constant property ID.  
+     */
+    int get_prop_cached(VMG_ vm_prop_id_t prop, vm_val_t *val,
+                        vm_obj_id_t self, vm_obj_id_t *source_obj,
+                        uint *argc, const uchar *pc, uchar opc);
+
     /* inherit a property */
     int inh_prop(VMG_ vm_prop_id_t prop, vm_val_t *val,
                  vm_obj_id_t self,
@@ -432,6 +606,9 @@ public:
     /* mark references */
     void mark_refs(VMG_ uint state);
 
+    /* we maintain the write barrier in set_prop() and set_sc() */
+    int has_gc_write_barrier() const { return TRUE; }
+
     /* 
      *   remove weak references - we keep only normal (strong) references,
      *   so this routine doesn't need to do anything 
@@ -478,6 +655,7 @@ public:
     {
         get_hdr()->sc[n].id = obj;
         get_hdr()->sc[n].objp = (CVmObjTads *)vm_objp(vmg_ obj);
+        gc_write_barrier();
     }
 
     /* static class initialization/termination */
@@ -146,6 +146,9 @@ public:
     /* mark references */
     void mark_refs(VMG_ uint state);
 
+    /* we maintain the write barrier in set_element() */
+    int has_gc_write_barrier() const { return TRUE; }
+
     /* 
      *   remove weak references - we keep only normal (strong) references,
      *   so this routine doesn't need to do anything 
@@ -326,6 +329,9 @@ protected:
     {
         /* set the element's data holder from the value */
         vmb_put_dh(get_element_ptr(idx), val);
+
+        /* note the store for the garbage collector */
+        gc_write_barrier(val);
     }
 
     /* set the allocated size */